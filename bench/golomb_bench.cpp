@@ -0,0 +1,478 @@
+// golomb_bench.cpp
+// Micro- and macro-benchmarks for every codec stage, run on the bundled corpora.
+// Usage:
+//   ./build/golomb_bench [--json out.json] [--filter substr] [--min-time sec] [--root dir]
+// Results go to the JSON file (or stdout) so throughput can be tracked across
+// releases; a human-readable table is printed to stderr.
+
+#include "entropy_coder.hpp"
+#include "libgolomb.hpp"
+#include "netpbm.hpp"
+#include "pixel_ops.hpp"
+#include "wav_io.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Result {
+    string name;       // stage, e.g. "golomb.encode"
+    string input;      // corpus file or synthetic description
+    string params;     // JSON object body, e.g. "\"m\":4"
+    double seconds;    // best time of one iteration
+    double items;      // symbols / samples / pixels processed per iteration
+    string unit;       // what `items` counts
+    double bytes;      // uncompressed bytes processed per iteration
+    double ratio;      // compressed bits per item (0 if not applicable)
+};
+
+struct Options {
+    string json;
+    string filter;
+    string root = ".";
+    double minTime = 0.2;
+};
+
+static Options opts;
+static vector<Result> results;
+
+static bool selected(const string &name, const string &input) {
+    return opts.filter.empty() || (name + " " + input).find(opts.filter) != string::npos;
+}
+
+// Run fn until minTime has elapsed (at least 3 times); return the fastest iteration.
+static double timeIt(const function<void()> &fn) {
+    using clk = chrono::steady_clock;
+    fn(); // warm-up
+    double best = 1e300, total = 0;
+    int iters = 0;
+    while (total < opts.minTime || iters < 3) {
+        auto t0 = clk::now();
+        fn();
+        double dt = chrono::duration<double>(clk::now() - t0).count();
+        best = min(best, dt);
+        total += dt;
+        ++iters;
+    }
+    return best;
+}
+
+static void record(const string &name, const string &input, const string &params, double items,
+                   const string &unit, double bytes, double ratio, const function<void()> &fn) {
+    if (!selected(name, input)) return;
+    double s = timeIt(fn);
+    results.push_back({name, input, params, s, items, unit, bytes, ratio});
+    fprintf(stderr, "%-22s %-20s %-48s %10.2f M%s/s %9.1f MB/s", name.c_str(), input.c_str(), params.c_str(),
+            items / s / 1e6, unit.c_str(), bytes / s / 1e6);
+    if (ratio > 0) fprintf(stderr, "  %6.3f bits/%s", ratio, unit.c_str());
+    fprintf(stderr, "\n");
+}
+
+static string baseName(const string &p) {
+    size_t s = p.find_last_of('/');
+    return s == string::npos ? p : p.substr(s + 1);
+}
+
+// ---------------- micro: Golomb coder and bit I/O ----------------
+
+// Two-sided geometric residuals whose mean magnitude suits Golomb parameter m
+static vector<int32_t> syntheticResiduals(size_t n, uint64_t m) {
+    mt19937 rng(12345);
+    geometric_distribution<int> geo(1.0 / (1.0 + (double)m / 1.4));
+    vector<int32_t> v(n);
+    for (auto &x : v) { int mag = geo(rng); x = (rng() & 1) ? mag : -mag; }
+    return v;
+}
+
+static void benchGolomb() {
+    const size_t n = 1 << 20;
+    for (uint64_t m : {1, 2, 3, 4, 5, 8, 16, 64}) {
+        vector<int32_t> v = syntheticResiduals(n, m);
+        Golomb g(m, NegativeMode::INTERLEAVED);
+        uint64_t nbits = g.arrayLength(v.data(), n);
+        vector<uint8_t> buf(nbits / 8 + 16);
+        // decode reads this stream, so it must not depend on the encode stages being selected
+        encodeInts(v.data(), n, m, NegativeMode::INTERLEAVED, buf.data(), buf.size(), nbits);
+        string params = "\"m\":" + to_string(m);
+        string input = "synthetic-geometric";
+        double bytes = (double)n * sizeof(int32_t), bps = (double)nbits / n;
+
+        record("golomb.encode", input, params, n, "sym", bytes, bps, [&] {
+            BitSink w(buf.data(), buf.size());
+            for (size_t i = 0; i < n; ++i) g.encode(v[i], w);
+            w.finish();
+        });
+        record("golomb.encodeArray", input, params, n, "sym", bytes, bps, [&] {
+            BitSink w(buf.data(), buf.size());
+            g.encodeArray(v.data(), n, w);
+            w.finish();
+        });
+        vector<int32_t> out(n);
+        record("golomb.decode", input, params, n, "sym", bytes, bps, [&] {
+            decodeInts(buf.data(), nbits, m, NegativeMode::INTERLEAVED, out.data(), n);
+        });
+    }
+}
+
+static void benchBitIO() {
+    const size_t n = 1 << 22;
+    vector<uint8_t> buf(n * 4 + 16);
+    for (int width : {1, 5, 13, 32}) {
+        string params = "\"width\":" + to_string(width);
+        double bytes = (double)n * width / 8;
+        record("bitsink.writeBits", "synthetic", params, n, "field", bytes, 0, [&] {
+            BitSink w(buf.data(), buf.size());
+            for (size_t i = 0; i < n; ++i) w.writeBits(i, width);
+            w.finish();
+        });
+        uint64_t nbits = (uint64_t)n * width;
+        if (nbits / 8 > buf.size()) continue;
+        volatile uint64_t sink = 0;
+        record("bitsource.readBits", "synthetic", params, n, "field", bytes, 0, [&] {
+            BitSource r(buf.data(), nbits);
+            uint64_t acc = 0;
+            for (size_t i = 0; i < n; ++i) acc += r.readBits(width);
+            sink = acc;
+        });
+    }
+}
+
+static void benchBitPack() {
+    const size_t n = 1 << 24;
+    mt19937 rng(7);
+    string text(n, '0');
+    for (char &c : text) c = char('0' + (rng() & 1));
+    vector<uint8_t> packed(packedBytes(n));
+    packBits(text.data(), n, packed.data());
+    string out(n, '0');
+    record("bitpack.pack", "synthetic", "", n, "bit", (double)n, 0, [&] {
+        packBits(text.data(), n, packed.data());
+    });
+    record("bitpack.unpack", "synthetic", "", n, "bit", (double)n, 0, [&] {
+        unpackBits(packed.data(), n, &out[0]);
+    });
+}
+
+static void benchChecksum() {
+    const size_t n = (size_t)1 << 26;
+    mt19937 rng(11);
+    vector<uint8_t> buf(n + checksumTrailerSize(n));
+    for (size_t i = 0; i < n; ++i) buf[i] = (uint8_t)rng();
+    volatile uint32_t sink = 0;
+    record("crc32c", "synthetic", "", n, "byte", (double)n, 0, [&] {
+        sink = crc32c(buf.data(), n);
+    });
+    writeChecksums(buf.data(), 0, n);
+    record("checksum.verify", "synthetic", "\"segment\":" + to_string(kCrcSegment), n, "byte", (double)n, 0, [&] {
+        verifyChecksums(buf.data(), 0, n);
+    });
+}
+
+// ---------------- macro: audio codec ----------------
+
+static void benchAudio(const string &path) {
+    WAVHeader wh;
+    vector<int16_t> samples;
+    if (!readWav(path, wh, samples)) { cerr << "skipping " << path << "\n"; return; }
+    AudioInfo info;
+    info.channels = wh.channels;
+    info.sample_rate = wh.sample_rate;
+    info.bits_per_sample = wh.bits_per_sample;
+    info.frames = samples.size() / max<uint16_t>(wh.channels, 1);
+    string input = baseName(path);
+    double bytes = (double)samples.size() * sizeof(int16_t);
+    vector<int16_t> out(samples.size());
+    // mode 0: EMA, 1: EMA with run mode, 2: partitioned Rice blocks (Golomb only)
+    for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) for (int mode : {0, 1, 2}) {
+        if (mode == 2 && backend != BACKEND_GOLOMB) continue;
+        const bool run = mode == 1;
+        info.backend = backend;
+        info.runMode = run;
+        info.blocks = mode == 2;
+        vector<uint8_t> enc(audioEncodedSizeHint(info));
+        size_t written = 0;
+        if (encodeAudio(samples.data(), info, enc.data(), enc.size(), written) == CodecStatus::BufferTooSmall) {
+            enc.resize(written);
+            encodeAudio(samples.data(), info, enc.data(), enc.size(), written);
+        }
+        string params = string("\"backend\":\"") + backendName(backend) + "\",\"run\":" + (run ? "true" : "false") +
+                        ",\"blocks\":" + (info.blocks ? "true" : "false");
+        double bps = written * 8.0 / samples.size();
+        record("audio.encode", input, params, (double)samples.size(), "sample", bytes, bps, [&] {
+            size_t w = 0;
+            encodeAudio(samples.data(), info, enc.data(), enc.size(), w);
+        });
+        record("audio.decode", input, params, (double)samples.size(), "sample", bytes, bps, [&] {
+            decodeAudio(enc.data(), written, out.data(), out.size());
+        });
+        // AudioDecoder as a player drives it: one 256-frame period per read
+        record("audio.stream", input, params + ",\"period\":256", (double)samples.size(), "sample", bytes, bps, [&] {
+            AudioDecoder dec;
+            dec.open(enc.data(), written);
+            size_t got;
+            for (int16_t *p = out.data(); dec.read(p, 256, got) == CodecStatus::Ok && got; p += got * info.channels) {}
+        });
+    }
+
+    // encoder presets (golomb_audio_codec -N)
+    for (int level = 0; level <= 8; ++level) {
+        AudioInfo p = info;
+        audioPreset(level, p);
+        vector<uint8_t> enc(audioEncodedSizeHint(p));
+        size_t written = 0;
+        if (encodeAudio(samples.data(), p, enc.data(), enc.size(), written) == CodecStatus::BufferTooSmall) {
+            enc.resize(written);
+            encodeAudio(samples.data(), p, enc.data(), enc.size(), written);
+        }
+        string params = "\"preset\":" + to_string(level);
+        double bps = written * 8.0 / samples.size();
+        record("audio.preset.encode", input, params, (double)samples.size(), "sample", bytes, bps, [&] {
+            size_t w = 0;
+            encodeAudio(samples.data(), p, enc.data(), enc.size(), w);
+        });
+        record("audio.preset.decode", input, params, (double)samples.size(), "sample", bytes, bps, [&] {
+            decodeAudio(enc.data(), written, out.data(), out.size());
+        });
+    }
+
+    // one file, its blocks coded on several threads (golomb_audio_codec --jobs N)
+    for (int threads : {1, 2, 4, 8}) {
+        AudioInfo p = info;
+        audioPreset(8, p);
+        p.threads = threads;
+        vector<uint8_t> enc(audioEncodedSizeHint(p));
+        size_t written = 0;
+        if (encodeAudio(samples.data(), p, enc.data(), enc.size(), written) == CodecStatus::BufferTooSmall) {
+            enc.resize(written);
+            encodeAudio(samples.data(), p, enc.data(), enc.size(), written);
+        }
+        string params = "\"preset\":8,\"threads\":" + to_string(threads);
+        double bps = written * 8.0 / samples.size();
+        record("audio.blocks.threads", input, params, (double)samples.size(), "sample", bytes, bps, [&] {
+            size_t w = 0;
+            encodeAudio(samples.data(), p, enc.data(), enc.size(), w);
+        });
+    }
+}
+
+// ---------------- macro: image codec and transforms ----------------
+
+static void benchImage(const string &path) {
+    NetpbmImage img;
+    string err;
+    if (!readNetpbm(path, img, err)) { cerr << "skipping " << path << ": " << err << "\n"; return; }
+    string input = baseName(path);
+    const size_t npx = (size_t)img.width * img.height;
+    const size_t rowBytes = (size_t)img.width * img.channels;
+
+    // one plane to feed the grayscale codec: green for colour input
+    vector<uint8_t> plane(npx);
+    if (img.channels == 3) deinterleave3(img.pixels.data(), npx, nullptr, plane.data(), nullptr);
+    else plane = img.pixels;
+
+    if (img.channels == 3) {
+        vector<uint8_t> b(npx), g(npx), r(npx);
+        record("transform.deinterleave", input, "\"planes\":3", npx, "px", (double)npx * 3, 0, [&] {
+            deinterleave3(img.pixels.data(), npx, b.data(), g.data(), r.data());
+        });
+    }
+
+    vector<uint8_t> dst(img.pixels.size());
+    double bytes = (double)img.pixels.size();
+    record("transform.neg", input, "", npx, "px", bytes, 0, [&] {
+        negateRow(img.pixels.data(), dst.data(), img.pixels.size());
+    });
+    record("transform.bright", input, "\"delta\":40", npx, "px", bytes, 0, [&] {
+        brightenRow(img.pixels.data(), dst.data(), img.pixels.size(), 40);
+    });
+    record("transform.mirror_h", input, "", npx, "px", bytes, 0, [&] {
+        for (int r = 0; r < img.height; ++r)
+            mirrorRow(img.pixels.data() + r*rowBytes, dst.data() + r*rowBytes, img.width, img.channels);
+    });
+    record("transform.rotate", input, "\"k\":1", npx, "px", bytes, 0, [&] {
+        rotateImage(img.pixels.data(), rowBytes, img.width, img.height, img.channels, 1,
+                    dst.data(), (size_t)img.height * img.channels);
+    });
+
+    // both predictors with Golomb, then the adaptive backends with the median
+    // predictor; run mode with the median predictor on Golomb and range;
+    // progressive files on Golomb and range
+    const int configs[][3] = {{PRED_LEFT, BACKEND_GOLOMB, 0}, {PRED_MEDIAN, BACKEND_GOLOMB, 0},
+                              {PRED_MEDIAN, BACKEND_RANGE, 0}, {PRED_MEDIAN, BACKEND_RANS, 0},
+                              {PRED_MEDIAN, BACKEND_GOLOMB, 1}, {PRED_MEDIAN, BACKEND_RANGE, 1},
+                              {PRED_INTERPOLATE, BACKEND_GOLOMB, 0}, {PRED_INTERPOLATE, BACKEND_RANGE, 0}};
+    for (const auto &cfg : configs) {
+        int pred = cfg[0], backend = cfg[1];
+        bool run = cfg[2] != 0;
+        vector<uint8_t> enc(imageEncodedBound(img.width, img.height, backend));
+        size_t written = 0;
+        ImageInfo info;
+        encodeImagePlane(plane.data(), img.width, img.height, img.width, pred, enc.data(), enc.size(), written, &info,
+                         nullptr, backend, run);
+        string params = "\"predictor\":" + to_string(pred) + ",\"backend\":\"" + backendName(backend) + "\"" +
+                        ",\"run\":" + (run ? "true" : "false");
+        double bpp = (double)info.nbits / npx;
+        record("image.encode", input, params, npx, "px", (double)npx, bpp, [&] {
+            size_t w = 0;
+            encodeImagePlane(plane.data(), img.width, img.height, img.width, pred, enc.data(), enc.size(), w,
+                             nullptr, nullptr, backend, run);
+        });
+        vector<uint8_t> out(npx);
+        record("image.decode", input, params, npx, "px", (double)npx, bpp, [&] {
+            decodeImagePlane(enc.data(), written, out.data(), img.width);
+        });
+    }
+
+    // image_codec transform: decode, rotate and re-encode with the m of the
+    // input, against a full encode of the rotated plane
+    {
+        vector<uint8_t> enc(imageEncodedBound(img.width, img.height));
+        size_t written = 0;
+        ImageInfo info;
+        encodeImagePlane(plane.data(), img.width, img.height, img.width, PRED_MEDIAN, enc.data(), enc.size(), written,
+                         &info);
+        vector<uint8_t> dec(npx), rot(npx), out(imageEncodedBound(img.height, img.width, info.backend, info.m));
+        for (int reuse = 1; reuse >= 0; --reuse) {
+            string params = string("\"op\":\"rotate\",\"k\":1,\"reuse_m\":") + (reuse ? "true" : "false");
+            record("image.transform", input, params, npx, "px", (double)npx, 0, [&] {
+                size_t w = 0;
+                decodeImagePlane(enc.data(), written, dec.data(), img.width);
+                rotateImage(dec.data(), img.width, img.width, img.height, 1, 1, rot.data(), img.height);
+                if (reuse) reencodeImagePlane(rot.data(), img.height, img.width, img.height, info, out.data(),
+                                              out.size(), w);
+                else encodeImagePlane(rot.data(), img.height, img.width, img.height, PRED_MEDIAN, out.data(),
+                                      out.size(), w);
+            });
+        }
+    }
+
+    // thumbnails of a progressive file, each decoded from just its prefix
+    // (the share of the file read is in the params)
+    {
+        vector<uint8_t> enc(imageEncodedBound(img.width, img.height));
+        size_t written = 0;
+        encodeImagePlane(plane.data(), img.width, img.height, img.width, PRED_INTERPOLATE, enc.data(), enc.size(),
+                         written);
+        vector<uint8_t> out(npx);
+        for (int scale = 1; scale <= 3; ++scale) {
+            ImageThumbnail thumb;
+            imageThumbnailInfo(enc.data(), written, scale, thumb);
+            const double tpx = (double)thumb.width * thumb.height;
+            char params[64];
+            snprintf(params, sizeof params, "\"scale\":%d,\"prefix\":%.3f", scale, (double)thumb.bytes / written);
+            record("image.thumbnail", input, params, tpx, "px", tpx, thumb.bytes * 8.0 / tpx, [&] {
+                decodeImageThumbnail(enc.data(), thumb.bytes, scale, out.data(), thumb.width);
+            });
+        }
+    }
+
+    // encoder presets (image_codec -N)
+    for (int level = 0; level <= 8; ++level) {
+        ImagePreset p = imagePreset(level);
+        vector<uint8_t> enc(imageEncodedBound(img.width, img.height, p.backend));
+        size_t written = 0;
+        encodeImagePlane(plane.data(), img.width, img.height, img.width, p.predictor, enc.data(), enc.size(), written,
+                         nullptr, nullptr, p.backend, p.runMode, p.mSearch);
+        string params = "\"preset\":" + to_string(level);
+        double bpp = written * 8.0 / npx;
+        record("image.preset.encode", input, params, npx, "px", (double)npx, bpp, [&] {
+            size_t w = 0;
+            encodeImagePlane(plane.data(), img.width, img.height, img.width, p.predictor, enc.data(), enc.size(), w,
+                             nullptr, nullptr, p.backend, p.runMode, p.mSearch);
+        });
+        vector<uint8_t> out(npx);
+        record("image.preset.decode", input, params, npx, "px", (double)npx, bpp, [&] {
+            decodeImagePlane(enc.data(), written, out.data(), img.width);
+        });
+    }
+}
+
+// ---------------- macro: netpbm input ----------------
+
+// gzip files are inflated on the reader's worker thread while rows are copied out
+static void benchNetpbm(const string &path) {
+    NetpbmImage img;
+    string err;
+    if (!readNetpbm(path, img, err)) { cerr << "skipping " << path << ": " << err << "\n"; return; }
+    const double npx = (double)img.width * img.height;
+    string params = string("\"gzip\":") + (isGzipFile(path) ? "true" : "false");
+    record("netpbm.read", baseName(path), params, npx, "px", (double)img.pixels.size(), 0, [&] {
+        readNetpbm(path, img, err);
+    });
+}
+
+// ---------------- JSON report ----------------
+
+static string jsonEscape(const string &s) {
+    string o;
+    for (char c : s) {
+        if (c == '"' || c == '\\') o.push_back('\\');
+        o.push_back(c);
+    }
+    return o;
+}
+
+static void writeJson(ostream &os) {
+    os << "{\n  \"benchmark\": \"golomb_bench\",\n  \"min_time_s\": " << opts.minTime << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        char num[512];
+        snprintf(num, sizeof num,
+                 "\"seconds\": %.9g, \"items\": %.0f, \"unit\": \"%s\", \"items_per_sec\": %.6g, "
+                 "\"mb_per_sec\": %.6g, \"bits_per_item\": %.6g",
+                 r.seconds, r.items, r.unit.c_str(), r.items / r.seconds, r.bytes / r.seconds / 1e6, r.ratio);
+        os << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"input\": \"" << jsonEscape(r.input)
+           << "\", \"params\": {" << r.params << "}, " << num << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--json" && i + 1 < argc) opts.json = argv[++i];
+        else if (a == "--filter" && i + 1 < argc) opts.filter = argv[++i];
+        else if (a == "--min-time" && i + 1 < argc) opts.minTime = atof(argv[++i]);
+        else if (a == "--root" && i + 1 < argc) opts.root = argv[++i];
+        else {
+            cerr << "Usage: " << argv[0] << " [--json out.json] [--filter substr] [--min-time sec] [--root dir]\n";
+            return 1;
+        }
+    }
+
+    benchGolomb();
+    benchBitIO();
+    benchBitPack();
+    benchChecksum();
+    for (const char *w : {"src/sample.wav", "src/sample_mono.wav", "src/speech.wav"}) benchAudio(opts.root + "/" + w);
+    for (const char *im : {"airplane", "anemone", "arial", "baboon", "bike3", "boat", "girl", "house", "lena",
+                           "monarch", "peppers", "tulips"})
+        benchImage(opts.root + "/images-ppm/" + im + ".ppm");
+    benchNetpbm(opts.root + "/images-ppm/lena.ppm");
+    for (int i = 1; i <= 23; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "/images-ppm/kodak/%02d.256.ppm.gz", i);
+        benchNetpbm(opts.root + name);
+    }
+
+    if (opts.json.empty()) {
+        writeJson(cout);
+    } else {
+        ofstream f(opts.json);
+        if (!f) { cerr << "Cannot write " << opts.json << "\n"; return 1; }
+        writeJson(f);
+        cerr << "Wrote " << opts.json << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,841 @@
+#include "audio_coder.hpp"
+#include "container.hpp"
+#include "entropy_coder.hpp"
+#include "rice_partition.hpp"
+#include "run_mode.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+static const char kMagic[] = "GBL2";
+static const char kLegacyMagic[] = "GBL1";
+static const size_t kLegacyPayloadOffset = sizeof(GBLHeader) + sizeof(uint32_t);
+
+struct Payload {
+    const uint8_t *data = nullptr;
+    size_t bytes = 0;
+};
+
+// compute m from EMA of absolute residuals.
+static uint64_t choose_m_from_ema(double ema) {
+    double r = std::floor(ema + 0.5);
+    return (uint64_t)std::max<double>(1.0, r);
+}
+
+static void recordTotals(CodecStats *stats, const AudioInfo &info, uint64_t nbits, uint64_t fileBytes) {
+    stats->unit = "sample";
+    stats->items += info.frames * info.channels;
+    stats->rawBytes += info.frames * info.channels * sizeof(int16_t);
+    stats->codedBits += nbits;
+    stats->codedBytes += fileBytes;
+}
+
+static inline uint32_t zigzag(int64_t v) { return v >= 0 ? (uint32_t)v << 1 : ((uint32_t)(-v) << 1) - 1; }
+static inline int64_t unzigzag(uint32_t z) { return (z & 1) ? -(int64_t)((z + 1) >> 1) : (int64_t)(z >> 1); }
+
+// Adaptive backends: one context per (channel, bit length of the EMA m), so the
+// model sees the same local loudness estimate that picks the Golomb parameter.
+static const int kAudioClasses = 18; // zig-zag residuals of 16-bit audio have at most 17 bits
+static inline int audioContext(int channel, uint64_t m) {
+    return channel * kAudioClasses + std::min(CodecStats::bucket(m), kAudioClasses - 1);
+}
+// zig-zag values run about twice the mean magnitude m, i.e. one bit longer
+static inline int audioPivot(uint64_t m) { return std::min(CodecStats::bucket(m) + 1, kAudioClasses - 1); }
+
+static const int kModeRun = 0x08; // neg_mode bit: run mode enabled
+static const int kModeCrc = 0x80; // neg_mode bit of version 1 files: CRC32C trailer (checksum.hpp)
+static const int kModeBlocks = 0x100; // flags bit of version 2 files: partitioned Rice blocks
+static const int kModeBlockHeads = 0x200; // flags bit: blocks carry stereo mode and predictor orders,
+                                          // INFO carries block_frames (set with kModeBlocks)
+static const int kModeProfile = 0x400; // flags bit: coded from a trained profile, INFO carries its ID
+// runs are only tried where the left EMA already picks m = 1 (digital silence
+// or near silence); isolated zeros in louder passages are cheaper as residuals
+static const double kQuietEma = 1.5;
+
+// Prediction and EMA loop shared by every backend; put(channel, residual, m)
+// codes one residual. Left is predicted from the previous left sample, right
+// from the current left sample.
+//
+// Run mode: after a frame whose residuals are all zero, the number of
+// following all-zero frames is coded as one run (run_mode.hpp) through
+// runOut; the frame that ends the run is coded normally. The EMAs decay
+// across the run exactly as if the zeros had been coded one by one. They
+// start at 1, or where a trained profile puts them.
+template <class RunOut, typename Put>
+static void forEachResidual(const int16_t *samples, size_t frames, int channels, bool runMode, RunOut &runOut,
+                            const CodecProfile *profile, CodecStats *stats, Put put) {
+    double emaL = profile ? profile->ema[0] : 1.0, emaR = profile ? profile->ema[1] : 1.0;
+    const double alpha = 0.01;
+    int64_t prevL = 0;
+    bool silent = false; // previous frame had only zero residuals
+    RunState rs;
+    for (size_t i = 0; i < frames; ++i) {
+        if (runMode && silent) {
+            size_t end = i;
+            while (end < frames && samples[end*channels] == prevL &&
+                   (channels == 1 || samples[end*channels + 1] == prevL)) ++end;
+            encodeRun(runOut, rs, end - i, end == frames);
+            for (size_t j = i; j < end; ++j) {
+                emaL = (1.0 - alpha) * emaL + alpha * 0.0;
+                emaR = (1.0 - alpha) * emaR + alpha * 0.0;
+            }
+            if (stats) { ++stats->runs; stats->runItems += (end - i) * channels; }
+            if (end == frames) break;
+            i = end;
+        }
+        int64_t L = samples[i*channels + 0];
+        int64_t resL = L - prevL;
+        put(0, resL, choose_m_from_ema(emaL));
+        emaL = (1.0 - alpha) * emaL + alpha * std::abs((double)resL);
+        if (stats) stats->addResidual(resL);
+        silent = resL == 0;
+
+        if (channels == 2) {
+            int64_t resR = int64_t(samples[i*channels + 1]) - L;
+            put(1, resR, choose_m_from_ema(emaR));
+            emaR = (1.0 - alpha) * emaR + alpha * std::abs((double)resR);
+            if (stats) stats->addResidual(resR);
+            silent = silent && resR == 0;
+        }
+        silent = silent && emaL < kQuietEma;
+        prevL = L;
+    }
+}
+
+// Where reconstruct stopped, so a file can be decoded in pieces (AudioDecoder).
+struct ReconstructState {
+    double emaL = 1.0, emaR = 1.0;
+    int64_t prevL = 0;
+    bool silent = false;
+    RunState rs;
+    uint64_t frame = 0;     // frames decoded so far
+    uint64_t runLeft = 0;   // frames of the current run not output yet
+
+    ReconstructState() = default;
+    explicit ReconstructState(const CodecProfile *profile) {
+        if (profile) { emaL = profile->ema[0]; emaR = profile->ema[1]; }
+    }
+};
+
+// adaptive backend model: cold, or the probabilities of a trained profile
+static ResidualModel initialModel(const CodecProfile *profile) {
+    return profile ? profile->model : ResidualModel(kAudioClasses);
+}
+
+// Inverse of forEachResidual: get(channel, m) returns the next residual.
+// Decodes the next `count` of the file's `frames` frames into dst, resuming
+// from st (a run may straddle two calls). Stops early (returning false) once
+// ok() reports a damaged stream.
+template <class RunIn, typename Get, typename Ok>
+static bool reconstruct(ReconstructState &st, int16_t *dst, size_t count, uint64_t frames, int channels,
+                        bool runMode, RunIn &runIn, CodecStats *stats, Get get, Ok ok) {
+    double emaL = st.emaL, emaR = st.emaR;
+    const double alpha = 0.01;
+    int64_t prevL = st.prevL;
+    bool silent = st.silent;
+    bool good = true;
+    size_t i = 0;
+    while (i < count) {
+        if (st.runLeft) {
+            const size_t len = (size_t)std::min<uint64_t>(st.runLeft, count - i);
+            std::fill(dst + i*channels, dst + (i + len)*channels, int16_t(prevL));
+            for (size_t j = 0; j < len; ++j) {
+                emaL = (1.0 - alpha) * emaL + alpha * 0.0;
+                emaR = (1.0 - alpha) * emaR + alpha * 0.0;
+            }
+            st.runLeft -= len;
+            i += len;
+            continue;
+        }
+        if (runMode && silent) {
+            // a run that is not interrupted covers the rest of the file
+            bool interrupted;
+            st.runLeft = decodeRun(runIn, st.rs, frames - (st.frame + i), interrupted);
+            if (stats) { ++stats->runs; stats->runItems += st.runLeft * channels; }
+            if (st.rs.bad || !ok()) { good = false; break; }
+            silent = false; // the frame that ends the run is coded normally
+            continue;
+        }
+        int64_t resL = get(0, choose_m_from_ema(emaL));
+        int64_t L = std::clamp(prevL + resL, int64_t(-32768), int64_t(32767));
+        dst[i*channels + 0] = int16_t(L);
+        emaL = (1.0 - alpha) * emaL + alpha * std::abs((double)resL);
+        if (stats) stats->addResidual(resL);
+        silent = resL == 0;
+
+        if (channels == 2) {
+            int64_t resR = get(1, choose_m_from_ema(emaR));
+            int64_t R = std::clamp(L + resR, int64_t(-32768), int64_t(32767));
+            dst[i*channels + 1] = int16_t(R);
+            emaR = (1.0 - alpha) * emaR + alpha * std::abs((double)resR);
+            if (stats) stats->addResidual(resR);
+            silent = silent && resR == 0;
+        }
+        silent = silent && emaL < kQuietEma;
+        if (!ok()) { good = false; break; }
+        prevL = L;
+        ++i;
+    }
+    st.emaL = emaL;
+    st.emaR = emaR;
+    st.prevL = prevL;
+    st.silent = silent;
+    st.frame += i;
+    return good;
+}
+
+template <class Enc>
+static size_t encodeAdaptive(const int16_t *samples, const AudioInfo &info, const CodecProfile *profile,
+                             uint8_t *payload, size_t cap, bool &overflow, CodecStats *stats) {
+    Enc e(payload, cap);
+    ResidualModel model = initialModel(profile);
+    RunModel runModel;
+    CodedRunOut<Enc> runOut{e, runModel};
+    forEachResidual(samples, info.frames, info.channels, info.runMode, runOut, profile, stats,
+                    [&](int ch, int64_t res, uint64_t m) {
+        encodeResidual(e, model, audioContext(ch, m), audioPivot(m), zigzag(res));
+    });
+    size_t n = e.finish();
+    overflow = e.overflowed();
+    return n;
+}
+
+// Decoding state of the sequential backends; read() decodes the next count frames.
+struct GolombSource {
+    BitSource r{nullptr, 0};
+    ReconstructState st;
+
+    GolombSource() = default;
+    GolombSource(const uint8_t *payload, uint64_t nbits, const CodecProfile *profile)
+        : r(payload, nbits), st(profile) {}
+    bool read(int16_t *dst, size_t count, const AudioInfo &info, CodecStats *stats) {
+        BitRunIn runIn{r};
+        return reconstruct(st, dst, count, info.frames, info.channels, info.runMode, runIn, stats,
+                           [&](int, uint64_t m) {
+            if (stats) stats->addM(m);
+            return Golomb(m, NegativeMode::INTERLEAVED).decode(r);
+        }, [&] { return r.ok(); });
+    }
+};
+
+template <class Dec>
+struct AdaptiveSource {
+    Dec d{nullptr, 0};
+    ResidualModel model{kAudioClasses};
+    RunModel runModel;
+    ReconstructState st;
+
+    AdaptiveSource() = default;
+    AdaptiveSource(const uint8_t *payload, size_t len, const CodecProfile *profile)
+        : d(payload, len), model(initialModel(profile)), st(profile) {}
+    bool read(int16_t *dst, size_t count, const AudioInfo &info, CodecStats *stats) {
+        CodedRunIn<Dec> runIn{d, runModel};
+        return reconstruct(st, dst, count, info.frames, info.channels, info.runMode, runIn, stats,
+                           [&](int ch, uint64_t m) {
+            return unzigzag(decodeResidual(d, model, audioContext(ch, m), audioPivot(m)));
+        }, [&] { return d.ok(); });
+    }
+};
+
+// Block mode (Golomb backend): frames are coded blockFrames at a time. Each
+// block of a stereo file picks how to decorrelate the channels, then each of
+// its two coded signals picks a fixed polynomial predictor (FLAC's orders
+// 0-4) and the optimal Rice partitioning of the residuals (rice_partition.hpp),
+// so parameters follow the signal exactly instead of lagging behind an EMA:
+//   [stereo mode: 2 bits] | per coded signal: order (3 bits) | partitioned residuals
+static const uint32_t kMinBlockFrames = 16;
+static const uint32_t kMaxBlockFrames = 4096;
+static const int kMaxFixedOrder = 4;
+static const int kOrderBits = 3;
+
+// coded signals: left, right, side = right - left, mid = (left + right) >> 1
+enum BlockSignal { SIG_LEFT, SIG_RIGHT, SIG_SIDE, SIG_MID, kBlockSignals };
+enum StereoMode { STEREO_LEFT_SIDE, STEREO_INDEPENDENT, STEREO_SIDE_RIGHT, STEREO_MID_SIDE, kStereoModes };
+static const int kStereoSignals[kStereoModes][2] = {
+    {SIG_LEFT, SIG_SIDE}, {SIG_LEFT, SIG_RIGHT}, {SIG_SIDE, SIG_RIGHT}, {SIG_MID, SIG_SIDE}};
+
+static inline int32_t blockSignal(int sig, int32_t L, int32_t R) {
+    switch (sig) {
+    case SIG_LEFT: return L;
+    case SIG_RIGHT: return R;
+    case SIG_SIDE: return R - L;
+    default: return (L + R) >> 1;
+    }
+}
+
+// Fill x[-kMaxFixedOrder .. -1] with the frames before the block starting at
+// `block`, of which `history` exist (zero before the first frame).
+static void blockHistory(int32_t *x, int sig, const int16_t *block, size_t history, int channels) {
+    for (int i = 1; i <= kMaxFixedOrder; ++i) {
+        if (history < (size_t)i) { x[-i] = 0; continue; }
+        const int16_t *f = block - (size_t)i * channels;
+        x[-i] = blockSignal(sig, f[0], channels == 2 ? f[1] : 0);
+    }
+}
+
+// x[0..n) preceded by kMaxFixedOrder samples of history
+static void fixedResiduals(const int32_t *x, size_t n, int order, int32_t *res) {
+    switch (order) {
+    case 0: std::copy(x, x + n, res); break;
+    case 1: for (size_t i = 0; i < n; ++i) res[i] = x[i] - x[i-1]; break;
+    case 2: for (size_t i = 0; i < n; ++i) res[i] = x[i] - 2*x[i-1] + x[i-2]; break;
+    case 3: for (size_t i = 0; i < n; ++i) res[i] = x[i] - 3*x[i-1] + 3*x[i-2] - x[i-3]; break;
+    default: for (size_t i = 0; i < n; ++i) res[i] = x[i] - 4*x[i-1] + 6*x[i-2] - 4*x[i-3] + x[i-4]; break;
+    }
+}
+
+// Inverse of fixedResiduals; values are clamped to [lo, hi] so a damaged
+// stream cannot overflow.
+template <int kOrder>
+static void fixedRestore(int32_t *x, size_t n, const int32_t *res, int64_t lo, int64_t hi) {
+    for (size_t i = 0; i < n; ++i) {
+        int64_t p = kOrder == 0 ? 0
+                  : kOrder == 1 ? x[i-1]
+                  : kOrder == 2 ? 2*(int64_t)x[i-1] - x[i-2]
+                  : kOrder == 3 ? 3*((int64_t)x[i-1] - x[i-2]) + x[i-3]
+                  : 4*((int64_t)x[i-1] + x[i-3]) - 6*(int64_t)x[i-2] - x[i-4];
+        x[i] = (int32_t)std::clamp(p + res[i], lo, hi);
+    }
+}
+
+static void fixedRestore(int32_t *x, size_t n, int order, const int32_t *res, int sig) {
+    const int64_t hi = sig == SIG_SIDE ? 65535 : 32767, lo = sig == SIG_SIDE ? -65535 : -32768;
+    switch (order) {
+    case 0: fixedRestore<0>(x, n, res, lo, hi); break;
+    case 1: fixedRestore<1>(x, n, res, lo, hi); break;
+    case 2: fixedRestore<2>(x, n, res, lo, hi); break;
+    case 3: fixedRestore<3>(x, n, res, lo, hi); break;
+    default: fixedRestore<4>(x, n, res, lo, hi); break;
+    }
+}
+
+static void addPartitionStats(CodecStats *stats, const int32_t *res, size_t n, const RicePartition &part) {
+    if (!stats) return;
+    for (size_t i = 0; i < n; ++i) stats->addResidual(res[i]);
+    for (size_t j = 0; j < ((size_t)1 << part.order); ++j) {
+        if (part.k[j] == kRiceZero) continue; // no codewords
+        stats->addM(1ULL << part.k[j], partitionStart(n, part.order, j + 1) - partitionStart(n, part.order, j));
+    }
+}
+
+struct SignalChoice {
+    int order;
+    RicePartition part;
+};
+
+// Scratch space of encodeBlocks (about 150 KB)
+struct BlockEncodeScratch {
+    int32_t sig[kBlockSignals][kMaxFixedOrder + kMaxBlockFrames];
+    int32_t res[kMaxBlockFrames];
+    SignalChoice best[kBlockSignals];
+    RicePartition part;
+    RiceScratch rice;
+};
+
+// Code the blocks starting at frames [first, end) (multiples of blockFrames).
+static void encodeBlocks(const int16_t *samples, const AudioInfo &info, uint64_t first, uint64_t end, BitSink &w,
+                         BlockEncodeScratch &b, CodecStats *stats) {
+    const int channels = info.channels;
+    const bool stereoSearch = channels == 2 && info.stereoSearch;
+    auto &sig = b.sig;
+    int32_t *res = b.res;
+    SignalChoice *best = b.best;
+    RicePartition &part = b.part;
+    for (size_t start = (size_t)first; start < end; start += info.blockFrames) {
+        const size_t n = std::min<size_t>(info.blockFrames, info.frames - start);
+        // the signals this block may code, each with its best order
+        bool used[kBlockSignals] = {true, stereoSearch, channels == 2, stereoSearch};
+        for (int s = 0; s < kBlockSignals; ++s) {
+            if (!used[s]) continue;
+            int32_t *x = sig[s] + kMaxFixedOrder;
+            blockHistory(x, s, samples + start * channels, start, channels);
+            const int16_t *f = samples + start * channels;
+            for (size_t i = 0; i < n; ++i, f += channels) x[i] = blockSignal(s, f[0], channels == 2 ? f[1] : 0);
+            best[s].part.bits = UINT64_MAX;
+            for (int order = 0; order <= info.maxOrder; ++order) {
+                fixedResiduals(x, n, order, res);
+                chooseRicePartition(res, n, part, b.rice, info.maxPartitionOrder);
+                if (part.bits < best[s].part.bits) { best[s].order = order; best[s].part = part; }
+            }
+        }
+        int mode = STEREO_LEFT_SIDE;
+        if (stereoSearch) {
+            uint64_t bestBits = UINT64_MAX;
+            for (int m = 0; m < kStereoModes; ++m) {
+                uint64_t bits = best[kStereoSignals[m][0]].part.bits + best[kStereoSignals[m][1]].part.bits;
+                if (bits < bestBits) { bestBits = bits; mode = m; }
+            }
+        }
+        if (channels == 2) w.writeBits((uint64_t)mode, 2);
+        for (int c = 0; c < channels; ++c) {
+            const SignalChoice &ch = best[channels == 1 ? SIG_LEFT : kStereoSignals[mode][c]];
+            fixedResiduals(sig[channels == 1 ? SIG_LEFT : kStereoSignals[mode][c]] + kMaxFixedOrder, n, ch.order, res);
+            w.writeBits((uint64_t)ch.order, kOrderBits);
+            writeRicePartitioned(res, n, ch.part, w);
+            addPartitionStats(stats, res, n, ch.part);
+        }
+    }
+}
+
+// Upper bound on the coded bits of `frames` frames in `blocks` blocks: the
+// residuals of order-4 prediction of the side signal have at most 21 bits
+// zig-zag coded, so k = 21 codes each in 22 bits, and the chosen
+// partitioning is never longer than that.
+static uint64_t blockBitsBound(uint64_t frames, uint64_t blocks, int channels) {
+    const uint64_t head = kPartitionOrderBits + ((uint64_t)kRiceParamBits << kMaxPartitionOrder);
+    return frames * channels * 22 + blocks * (2 + channels * (kOrderBits + head));
+}
+
+// Append nbits bits packed MSB first at src.
+static void appendBits(BitSink &w, const uint8_t *src, uint64_t nbits) {
+    for (; nbits >= 32; nbits -= 32, src += 4)
+        w.writeBits((uint64_t)src[0] << 24 | (uint64_t)src[1] << 16 | (uint64_t)src[2] << 8 | src[3], 32);
+    for (int i = 0; nbits > 0; ++i) {
+        const int n = (int)std::min<uint64_t>(nbits, 8);
+        w.writeBits(src[i] >> (8 - n), n);
+        nbits -= (uint64_t)n;
+    }
+}
+
+// Block mode on up to info.threads threads. Blocks only depend on the
+// input, so each thread codes a contiguous run of them into a buffer of its
+// own and the runs are appended to w in order: the stream is the same as
+// from one thread. The calling thread codes the first run.
+static const uint64_t kMinThreadFrames = 1 << 15; // below this, starting a thread costs more than it saves
+
+static void encodeBlocksParallel(const int16_t *samples, const AudioInfo &info, BitSink &w, CodecStats *stats) {
+    const uint64_t blocks = (info.frames + info.blockFrames - 1) / info.blockFrames;
+    const size_t nthreads = (size_t)std::max<uint64_t>(1, std::min<uint64_t>(
+        {(uint64_t)std::max(info.threads, 1), blocks, info.frames / kMinThreadFrames}));
+    struct Run {
+        uint64_t first = 0, end = 0;  // frames
+        std::vector<uint8_t> bytes;
+        uint64_t nbits = 0;
+        CodecStats stats;
+    };
+    std::vector<Run> runs(nthreads);
+    for (size_t t = 0; t < nthreads; ++t) {
+        runs[t].first = blocks * t / nthreads * info.blockFrames;
+        runs[t].end = std::min<uint64_t>(blocks * (t + 1) / nthreads * info.blockFrames, info.frames);
+    }
+    auto code = [&](Run &r) {
+        const uint64_t nblocks = (r.end - r.first + info.blockFrames - 1) / info.blockFrames;
+        r.bytes.resize((size_t)((blockBitsBound(r.end - r.first, nblocks, info.channels) + 7) / 8 + 8));
+        std::unique_ptr<BlockEncodeScratch> scratch(new BlockEncodeScratch);
+        BitSink sink(r.bytes.data(), r.bytes.size());
+        encodeBlocks(samples, info, r.first, r.end, sink, *scratch, stats ? &r.stats : nullptr);
+        r.nbits = sink.bitCount();
+        sink.finish();
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(nthreads - 1);
+    for (size_t t = 1; t < nthreads; ++t) workers.emplace_back(code, std::ref(runs[t]));
+    code(runs[0]);
+    for (auto &th : workers) th.join();
+    for (const Run &r : runs) {
+        appendBits(w, r.bytes.data(), r.nbits);
+        if (stats) stats->merge(r.stats);
+    }
+}
+
+// Scratch space of decodeBlock (about 50 KB)
+struct BlockScratch {
+    int32_t sig[2][kMaxFixedOrder + kMaxBlockFrames];
+    int32_t res[kMaxBlockFrames];
+    RicePartition part;
+};
+
+// Decode the next block, n frames, into f; the `history` frames before f
+// (the end of the previous block) seed the predictors.
+static bool decodeBlock(BitSource &r, int channels, int16_t *f, size_t n, size_t history,
+                        BlockScratch &b, CodecStats *stats) {
+    const int mode = channels == 2 ? (int)r.readBits(2) : STEREO_LEFT_SIDE;
+    for (int c = 0; c < channels; ++c) {
+        const int s = channels == 1 ? SIG_LEFT : kStereoSignals[mode][c];
+        const int order = (int)r.readBits(kOrderBits);
+        if (order > kMaxFixedOrder || !readRicePartitioned(r, b.res, n, b.part)) return false;
+        addPartitionStats(stats, b.res, n, b.part);
+        int32_t *x = b.sig[c] + kMaxFixedOrder;
+        blockHistory(x, s, f, history, channels);
+        fixedRestore(x, n, order, b.res, s);
+    }
+    const int32_t *a = b.sig[0] + kMaxFixedOrder, *d = b.sig[1] + kMaxFixedOrder;
+    if (channels == 1) {
+        std::copy(a, a + n, f);
+        return true;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        int32_t L, R;
+        switch (mode) {
+        case STEREO_LEFT_SIDE: L = a[i]; R = a[i] + d[i]; break;
+        case STEREO_INDEPENDENT: L = a[i]; R = d[i]; break;
+        case STEREO_SIDE_RIGHT: L = d[i] - a[i]; R = d[i]; break;
+        default: { // mid and side have the same parity as left + right
+            int32_t sum = 2 * a[i] + (d[i] & 1);
+            L = (sum - d[i]) >> 1;
+            R = (sum + d[i]) >> 1;
+        }
+        }
+        f[2*i] = int16_t(std::clamp(L, -32768, 32767));
+        f[2*i + 1] = int16_t(std::clamp(R, -32768, 32767));
+    }
+    return true;
+}
+
+static bool decodeBlocks(BitSource &r, const AudioInfo &info, int16_t *dst, CodecStats *stats) {
+    BlockScratch b;
+    for (size_t start = 0; start < info.frames; start += info.blockFrames) {
+        const size_t n = std::min<size_t>(info.blockFrames, info.frames - start);
+        if (!decodeBlock(r, info.channels, dst + start * info.channels, n, start, b, stats)) return false;
+    }
+    return true;
+}
+
+bool audioPreset(int level, AudioInfo &info) {
+    // maxOrder, stereoSearch, maxPartitionOrder, blockFrames
+    static const int kPresets[9][4] = {{1, 0, 0, 4096}, {1, 0, 4, 4096}, {2, 0, 4, 4096},
+                                       {2, 1, 4, 4096}, {3, 1, 6, 4096}, {4, 1, 6, 4096},
+                                       {4, 1, 6, 2048}, {4, 1, 6, 1024}, {4, 1, 5, 512}};
+    if (level < 0 || level > 8) return false;
+    const int *p = kPresets[level];
+    info.backend = BACKEND_GOLOMB;
+    info.runMode = false;
+    info.blocks = true;
+    info.maxOrder = p[0];
+    info.stereoSearch = p[1] != 0;
+    info.maxPartitionOrder = p[2];
+    info.blockFrames = (uint32_t)p[3];
+    return true;
+}
+
+// Training runs the coding loop of the adaptive backends, without run mode,
+// and hands every residual to the trainer; the EMAs are learnt from the
+// mean |residual| of the first kTrainEmaFrames frames.
+static const size_t kTrainEmaFrames = 256;
+
+CodecStatus trainAudioProfile(const int16_t *samples, const AudioInfo &info, ProfileTrainer &trainer) {
+    if (info.channels != 1 && info.channels != 2) return CodecStatus::Unsupported;
+    if (info.frames == 0) return CodecStatus::Ok;
+    if (!trainer.start(PROFILE_AUDIO, kAudioClasses, 2 * kAudioClasses)) return CodecStatus::Unsupported;
+    RunBitCounter runOut;
+    double sum[2] = {};
+    uint64_t seen[2] = {};
+    forEachResidual(samples, info.frames, info.channels, false, runOut, nullptr, nullptr,
+                    [&](int ch, int64_t res, uint64_t m) {
+        trainer.addResidual(audioContext(ch, m), audioPivot(m), zigzag(res));
+        if (seen[ch] < kTrainEmaFrames) { sum[ch] += std::abs((double)res); ++seen[ch]; }
+    });
+    for (int ch = 0; ch < info.channels; ++ch) trainer.addEma(ch, sum[ch] / (double)seen[ch]);
+    return CodecStatus::Ok;
+}
+
+size_t audioEncodedSizeHint(const AudioInfo &info) {
+    uint64_t raw = info.frames * info.channels * sizeof(int16_t);
+    return (size_t)(kPayloadReserve + raw + containerTail(raw));
+}
+
+CodecStatus encodeAudio(const int16_t *samples, const AudioInfo &info,
+                        uint8_t *dst, size_t capacity, size_t &written, CodecStats *stats,
+                        const CodecProfile *profile) {
+    written = 0;
+    if (info.channels != 1 && info.channels != 2) return CodecStatus::Unsupported;
+    if (info.blocks) profile = nullptr; // nothing adapts in block mode
+    if (profile && (profile->kind != PROFILE_AUDIO || profile->model.classes != kAudioClasses ||
+                    profile->contexts != 2 * kAudioClasses))
+        return CodecStatus::Unsupported;
+
+    if (info.backend < BACKEND_GOLOMB || info.backend > BACKEND_RANS) return CodecStatus::Unsupported;
+    if (info.blocks && (info.backend != BACKEND_GOLOMB || info.runMode || info.blockFrames < kMinBlockFrames ||
+                        info.blockFrames > kMaxBlockFrames || info.maxOrder < 0 || info.maxOrder > kMaxFixedOrder))
+        return CodecStatus::Unsupported;
+    const int channels = info.channels;
+
+    uint8_t *payload = capacity >= kPayloadReserve ? dst + kPayloadReserve : nullptr;
+    size_t payloadCap = payload ? capacity - kPayloadReserve : 0;
+    size_t payloadBytes;
+    uint64_t payloadBits;
+    bool overflow;
+    {
+        // prediction, m selection and packing run fused in one pass (one stage)
+        StageTimer timer(stats, "encode", info.frames * channels, info.frames * channels * sizeof(int16_t));
+        if (info.blocks) {
+            BitSink w(payload, payloadCap);
+            if (info.threads > 1 && info.frames >= 2 * kMinThreadFrames) {
+                encodeBlocksParallel(samples, info, w, stats);
+            } else {
+                std::unique_ptr<BlockEncodeScratch> scratch(new BlockEncodeScratch);
+                encodeBlocks(samples, info, 0, info.frames, w, *scratch, stats);
+            }
+            payloadBytes = w.finish();
+            payloadBits = w.bitCount();
+            overflow = w.overflowed();
+        } else if (info.backend == BACKEND_GOLOMB) {
+            BitSink w(payload, payloadCap);
+            BitRunOut runOut{w};
+            forEachResidual(samples, info.frames, channels, info.runMode, runOut, profile, stats,
+                            [&](int, int64_t res, uint64_t m) {
+                Golomb(m, NegativeMode::INTERLEAVED).encode(res, w);
+                if (stats) stats->addM(m);
+            });
+            payloadBytes = w.finish();
+            payloadBits = w.bitCount();
+            overflow = w.overflowed();
+        } else {
+            payloadBytes = info.backend == BACKEND_RANGE
+                ? encodeAdaptive<RangeEncoder>(samples, info, profile, payload, payloadCap, overflow, stats)
+                : encodeAdaptive<RansEncoder>(samples, info, profile, payload, payloadCap, overflow, stats);
+            payloadBits = (uint64_t)payloadBytes * 8;
+        }
+    }
+    written = (size_t)(kPayloadReserve + payloadBytes + containerTail(payloadBytes));
+    if (overflow || payload == nullptr || capacity < written) return CodecStatus::BufferTooSmall;
+
+    FieldWriter fields;
+    fields.put(info.channels);
+    fields.put(info.sample_rate);
+    fields.put(info.bits_per_sample);
+    fields.put(info.frames);
+    fields.put(static_cast<int>(NegativeMode::INTERLEAVED) | (info.runMode ? kModeRun : 0) | info.backend << 4 |
+               (info.blocks ? kModeBlocks | kModeBlockHeads : 0) | (profile ? kModeProfile : 0));
+    fields.put(payloadBits);
+    if (info.blocks) fields.put(info.blockFrames);
+    if (profile) fields.put(profile->id);
+    {
+        StageTimer timer(stats, "container", 0, payloadBytes);
+        written = (size_t)finishContainer(dst, kMagic, fields, payloadBytes);
+    }
+    if (stats) recordTotals(stats, info, payloadBits, written);
+    return CodecStatus::Ok;
+}
+
+// Version 1 files: packed GBLHeader and u32 nbits in host byte order, then
+// the payload and, if flagged, a checksum trailer (the header as its head).
+static CodecStatus parseLegacy(const uint8_t *src, size_t len, AudioInfo &info, Payload &payload) {
+    if (len < kLegacyPayloadOffset) return CodecStatus::Corrupt;
+    GBLHeader gh;
+    std::memcpy(&gh, src, sizeof(GBLHeader));
+    if (gh.channels != 1 && gh.channels != 2) return CodecStatus::Unsupported;
+    info.channels = gh.channels;
+    info.sample_rate = gh.sample_rate;
+    info.bits_per_sample = gh.bits_per_sample;
+    info.frames = gh.num_frames;
+    info.backend = (gh.neg_mode >> 4) & 0x07;
+    info.runMode = (gh.neg_mode & kModeRun) != 0;
+    info.checksum = (gh.neg_mode & kModeCrc) != 0;
+    if (info.backend > BACKEND_RANS) return CodecStatus::Unsupported;
+    uint32_t nbits;
+    std::memcpy(&nbits, src + sizeof(GBLHeader), sizeof(uint32_t));
+    info.nbits = nbits;
+    payload.data = src + kLegacyPayloadOffset;
+    payload.bytes = (size_t)((nbits + 7ULL) / 8);
+    if (payload.bytes > len - kLegacyPayloadOffset) return CodecStatus::Corrupt;
+    // checksummed files end right after the trailer
+    if (info.checksum && len - kLegacyPayloadOffset - payload.bytes != checksumTrailerSize(payload.bytes))
+        return CodecStatus::Corrupt;
+    return CodecStatus::Ok;
+}
+
+// Header fields and payload of either version, checked against len;
+// checksums of the header (not of the payload) are checked.
+static CodecStatus parseFile(const uint8_t *src, size_t len, AudioInfo &info, Payload &payload) {
+    if (hasMagic(src, len, kLegacyMagic)) {
+        CodecStatus st = parseLegacy(src, len, info, payload);
+        if (st == CodecStatus::Ok && info.checksum && !checkHeaderChecksum(src, kLegacyPayloadOffset, payload.bytes))
+            return CodecStatus::Corrupt;
+        return st;
+    }
+    ContainerView view;
+    CodecStatus st = readContainer(src, len, kMagic, view);
+    if (st != CodecStatus::Ok) return st;
+    FieldReader f(view.info.body, view.info.size);
+    uint64_t channels = f.get(), rate = f.get(), bps = f.get();
+    info.frames = f.get();
+    uint64_t flags = f.get();
+    info.nbits = f.get();
+    if (f.error || rate > UINT32_MAX || bps > UINT16_MAX) return CodecStatus::Corrupt;
+    if (channels != 1 && channels != 2) return CodecStatus::Unsupported;
+    info.channels = (uint16_t)channels;
+    info.sample_rate = (uint32_t)rate;
+    info.bits_per_sample = (uint16_t)bps;
+    info.backend = (int)((flags >> 4) & 0x07);
+    info.runMode = (flags & kModeRun) != 0;
+    info.blocks = (flags & kModeBlocks) != 0;
+    // block files carry their heads and block length (kModeBlockHeads)
+    if (info.blocks != ((flags & kModeBlockHeads) != 0)) return CodecStatus::Corrupt;
+    info.blockFrames = info.blocks ? (uint32_t)std::min<uint64_t>(f.get(), UINT32_MAX) : kMaxBlockFrames;
+    const uint64_t profile = (flags & kModeProfile) ? f.get() : 0;
+    if (f.error || info.blockFrames < kMinBlockFrames || profile > UINT32_MAX || ((flags & kModeProfile) && !profile))
+        return CodecStatus::Corrupt;
+    info.profile = (uint32_t)profile;
+    if (info.blockFrames > kMaxBlockFrames) return CodecStatus::Unsupported;
+    info.checksum = true;
+    if (info.backend > BACKEND_RANS) return CodecStatus::Unsupported;
+    if (info.blocks && (info.backend != BACKEND_GOLOMB || info.runMode || info.profile))
+        return CodecStatus::Unsupported;
+    if (info.nbits / 8 + (info.nbits % 8 != 0) != view.data.size) return CodecStatus::Corrupt;
+    payload.data = view.data.body;
+    payload.bytes = (size_t)view.data.size;
+    return CodecStatus::Ok;
+}
+
+// The profile to decode a file with: the caller's if the file names it,
+// none if the file was coded cold; Unsupported if the caller lacks it.
+static CodecStatus fileProfile(const AudioInfo &info, const CodecProfile *&profile) {
+    if (!info.profile) profile = nullptr;
+    else if (!profile || profile->id != info.profile || profile->kind != PROFILE_AUDIO ||
+             profile->model.classes != kAudioClasses || profile->contexts != 2 * kAudioClasses)
+        return CodecStatus::Unsupported;
+    return CodecStatus::Ok;
+}
+
+CodecStatus readAudioInfo(const uint8_t *src, size_t len, AudioInfo &info) {
+    Payload payload;
+    return parseFile(src, len, info, payload);
+}
+
+CodecStatus verifyAudio(const uint8_t *src, size_t len, ChecksumReport *report) {
+    if (report) *report = ChecksumReport();
+    if (!hasMagic(src, len, kLegacyMagic)) return verifyContainer(src, len, kMagic, report);
+    AudioInfo info;
+    Payload payload;
+    CodecStatus st = parseLegacy(src, len, info, payload);
+    if (st != CodecStatus::Ok || !info.checksum) return st;
+    return verifyChecksums(src, kLegacyPayloadOffset, payload.bytes, report);
+}
+
+CodecStatus decodeAudio(const uint8_t *src, size_t len, int16_t *dst, size_t dstSamples, CodecStats *stats,
+                        const CodecProfile *profile) {
+    AudioInfo info;
+    Payload pl;
+    CodecStatus st = parseFile(src, len, info, pl);
+    if (st == CodecStatus::Ok) st = fileProfile(info, profile);
+    if (st != CodecStatus::Ok) return st;
+    const int channels = info.channels;
+    if (dstSamples < info.frames * channels) return CodecStatus::BufferTooSmall;
+    const uint64_t nbits = info.nbits;
+    const uint8_t *payload = pl.data;
+    const size_t payloadLen = pl.bytes;
+    if (info.checksum) {
+        StageTimer timer(stats, "checksum", 0, len);
+        if (verifyAudio(src, len) != CodecStatus::Ok) return CodecStatus::Corrupt;
+    }
+
+    StageTimer timer(stats, "decode", info.frames * channels, info.frames * channels * sizeof(int16_t));
+    bool ok;
+    if (info.blocks) {
+        BitSource r(payload, nbits);
+        ok = decodeBlocks(r, info, dst, stats);
+    } else if (info.backend == BACKEND_GOLOMB) {
+        ok = GolombSource(payload, nbits, profile).read(dst, (size_t)info.frames, info, stats);
+    } else if (info.backend == BACKEND_RANGE) {
+        ok = AdaptiveSource<RangeDecoder>(payload, payloadLen, profile).read(dst, (size_t)info.frames, info, stats);
+    } else {
+        ok = AdaptiveSource<RansDecoder>(payload, payloadLen, profile).read(dst, (size_t)info.frames, info, stats);
+    }
+    if (!ok) return CodecStatus::Corrupt;
+    if (stats) recordTotals(stats, info, nbits, info.checksum ? len : kLegacyPayloadOffset + payloadLen);
+    return CodecStatus::Ok;
+}
+
+// AudioDecoder: the sources above resume where the previous read() stopped;
+// block mode decodes a whole block into pcm and hands it out piecewise.
+struct AudioDecoder::State {
+    AudioInfo info;
+    Payload pl;
+    bool open = false;
+    bool failed = false;
+    uint64_t pos = 0;            // frames delivered
+
+    GolombSource golomb;
+    AdaptiveSource<RangeDecoder> range;
+    AdaptiveSource<RansDecoder> rans;
+
+    BitSource bits{nullptr, 0};
+    BlockScratch scratch;
+    // the last kMaxFixedOrder frames of the previous block, then the current one
+    int16_t pcm[(kMaxFixedOrder + kMaxBlockFrames) * 2];
+    size_t blockLen = 0;         // frames of the current block
+    size_t blockPos = 0;         // of which delivered
+
+    bool readBlocks(int16_t *dst, size_t frames) {
+        const int channels = info.channels;
+        int16_t *block = pcm + kMaxFixedOrder * channels;
+        for (size_t done = 0; done < frames;) {
+            if (blockPos == blockLen) {
+                // keep the history, which ends where the previous block ended
+                if (blockLen) std::copy(pcm + blockLen * channels, pcm + (blockLen + kMaxFixedOrder) * channels, pcm);
+                const uint64_t start = pos + done;
+                blockLen = (size_t)std::min<uint64_t>(info.blockFrames, info.frames - start);
+                blockPos = 0;
+                if (!decodeBlock(bits, channels, block, blockLen, (size_t)std::min<uint64_t>(start, kMaxFixedOrder),
+                                 scratch, nullptr))
+                    return false;
+            }
+            const size_t n = std::min(frames - done, blockLen - blockPos);
+            std::copy(block + blockPos * channels, block + (blockPos + n) * channels, dst + done * channels);
+            blockPos += n;
+            done += n;
+        }
+        return true;
+    }
+};
+
+AudioDecoder::AudioDecoder() = default;
+AudioDecoder::~AudioDecoder() = default;
+
+CodecStatus AudioDecoder::open(const uint8_t *src, size_t len, const CodecProfile *profile) {
+    if (!st) st.reset(new State);
+    State &s = *st;
+    s.open = false;
+    s.failed = false;
+    s.pos = 0;
+    s.info = AudioInfo();
+    s.pl = Payload();
+    CodecStatus status = parseFile(src, len, s.info, s.pl);
+    if (status == CodecStatus::Ok) status = fileProfile(s.info, profile);
+    if (status != CodecStatus::Ok) return status;
+    if (s.info.checksum && verifyAudio(src, len) != CodecStatus::Ok) return CodecStatus::Corrupt;
+    if (s.info.blocks) {
+        s.bits = BitSource(s.pl.data, s.info.nbits);
+        s.blockLen = s.blockPos = 0;
+    } else if (s.info.backend == BACKEND_GOLOMB) {
+        s.golomb = GolombSource(s.pl.data, s.info.nbits, profile);
+    } else if (s.info.backend == BACKEND_RANGE) {
+        s.range = AdaptiveSource<RangeDecoder>(s.pl.data, s.pl.bytes, profile);
+    } else {
+        s.rans = AdaptiveSource<RansDecoder>(s.pl.data, s.pl.bytes, profile);
+    }
+    s.open = true;
+    return CodecStatus::Ok;
+}
+
+CodecStatus AudioDecoder::read(int16_t *dst, size_t frames, size_t &got) {
+    got = 0;
+    if (!st || !st->open || st->failed) return CodecStatus::Corrupt;
+    State &s = *st;
+    const size_t n = (size_t)std::min<uint64_t>(frames, s.info.frames - s.pos);
+    if (n == 0) return CodecStatus::Ok;
+    bool ok;
+    if (s.info.blocks) ok = s.readBlocks(dst, n);
+    else if (s.info.backend == BACKEND_GOLOMB) ok = s.golomb.read(dst, n, s.info, nullptr);
+    else if (s.info.backend == BACKEND_RANGE) ok = s.range.read(dst, n, s.info, nullptr);
+    else ok = s.rans.read(dst, n, s.info, nullptr);
+    if (!ok) {
+        s.failed = true;
+        return CodecStatus::Corrupt;
+    }
+    s.pos += n;
+    got = n;
+    return CodecStatus::Ok;
+}
+
+const AudioInfo &AudioDecoder::info() const {
+    static const AudioInfo none;
+    return st ? st->info : none;
+}
+
+uint64_t AudioDecoder::position() const { return st ? st->pos : 0; }
@@ -0,0 +1,138 @@
+#ifndef AUDIO_CODER_HPP
+#define AUDIO_CODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "checksum.hpp"
+#include "codec_profile.hpp"
+#include "codec_stats.hpp"
+#include "golomb.hpp"
+
+// Lossless PCM16 audio codec (GBL container). Left is predicted from the
+// previous left sample, right from the current left sample; residuals are
+// Golomb coded with m tracking an EMA of recent residual magnitudes, or coded
+// with an adaptive binary backend (entropy_coder.hpp) using that m as context.
+// In block mode (Golomb only) each block of frames instead picks a stereo
+// decorrelation and fixed predictor orders, and m is chosen exactly by
+// block-optimal Rice partitioning (rice_partition.hpp).
+//
+// Files are written in the chunked container (container.hpp) with magic
+// "GBL2"; INFO holds the varints channels, sample_rate, bits_per_sample,
+// frames, flags (bits 0-2: NegativeMode, bit 3: run mode, bits 4-6:
+// EntropyBackend, bit 8: block mode, bit 9: block headers), nbits and, with
+// block headers, block_frames. Flags bit 10 marks a file coded from a trained
+// profile (codec_profile.hpp), whose ID then follows as the last field.
+// Version 1 files ("GBL1", GBLHeader below) are still read.
+//
+// All entry points work on caller-provided memory and keep no global state,
+// so they may be called concurrently from several threads. Decoding does not
+// allocate; encoding allocates its scratch space (up to about 150 KB in
+// block mode, 96 KB for rANS) once per call rather than keeping it on the
+// stack. AudioDecoder (below) allocates its state once, when it opens its
+// first file.
+
+// Version 1 header (read only): host byte order, followed by u32 nbits.
+// keeping memory offsets continuous
+#pragma pack(push,1)
+struct GBLHeader {
+    char magic[4]; // "GBL1"
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t num_frames;
+    uint16_t bits_per_sample;
+    uint8_t neg_mode;  // bits 0-2: NegativeMode, bit 3: run mode, bits 4-6: EntropyBackend (0 in older files),
+                       // bit 7: CRC32C trailer after the payload (checksum.hpp)
+};
+#pragma pack(pop)
+
+struct AudioInfo {
+    uint16_t channels = 0;        // 1 or 2
+    uint32_t sample_rate = 0;
+    uint16_t bits_per_sample = 16;
+    uint64_t frames = 0;
+    int backend = 0;              // EntropyBackend
+    bool runMode = false;         // runs of silent frames coded as run lengths
+    bool blocks = false;          // block-optimal Rice partitioning (Golomb backend, without runMode)
+    // block mode search (encoder side, see audioPreset); blockFrames is stored in the file
+    uint32_t blockFrames = 4096;  // frames per block, 16..4096
+    int maxOrder = 1;             // fixed predictor orders 0..maxOrder (up to 4) tried per block and channel
+    bool stereoSearch = false;    // try left/side, left/right, side/right and mid/side per block
+    int maxPartitionOrder = 8;    // Rice partition orders 0..maxPartitionOrder (up to 8) tried
+    int threads = 1;              // blocks coded on this many threads (encoder side; same output)
+    bool checksum = false;        // set by readAudioInfo: the file carries checksums (older files may not)
+    uint64_t nbits = 0;           // set by readAudioInfo: payload length in bits
+    uint32_t profile = 0;         // set by readAudioInfo: ID of the profile needed to decode (0 = none)
+};
+
+// Encode frames * channels interleaved samples into a complete GBL file image.
+// `written` receives the encoded size; on BufferTooSmall it is the size needed
+// to encode (a few bytes above the final size, which depends on the header).
+// stats (optional) receives stage timings, totals and residual/m histograms.
+// profile (optional, an audio profile) sets the starting EMAs and model; it
+// is not used, nor referenced by the file, in block mode.
+CodecStatus encodeAudio(const int16_t *samples, const AudioInfo &info,
+                        uint8_t *dst, size_t capacity, size_t &written, CodecStats *stats = nullptr,
+                        const CodecProfile *profile = nullptr);
+
+// Add a recording (as for encodeAudio; the coding fields of info are
+// ignored) to an audio profile being trained.
+CodecStatus trainAudioProfile(const int16_t *samples, const AudioInfo &info, ProfileTrainer &trainer);
+
+// Encoder presets 0 (fastest) to 8 (smallest), as `golomb_audio_codec -N`:
+// they set backend, blocks and the block mode search fields of info. Level 0
+// codes blocks with the plain left/side prediction; higher levels try more
+// predictor orders and partition orders, then stereo modes and shorter
+// blocks. Returns false for a level outside 0..8.
+bool audioPreset(int level, AudioInfo &info);
+
+// Usual destination size for encodeAudio (raw PCM size plus header). Golomb
+// output is normally well below this; encodeAudio reports the exact size if not.
+size_t audioEncodedSizeHint(const AudioInfo &info);
+
+// Parse the GBL header. For checksummed files the length and the header
+// checksum are checked too, so a damaged header is reported as Corrupt.
+CodecStatus readAudioInfo(const uint8_t *src, size_t len, AudioInfo &info);
+
+// Check a GBL file image against its checksums without decoding it (runs at
+// memory bandwidth). Files without checksums only get the structural checks
+// and leave report->present false.
+CodecStatus verifyAudio(const uint8_t *src, size_t len, ChecksumReport *report = nullptr);
+
+// Decode a GBL file image into dst (frames * channels interleaved samples).
+// Checksums, when present, are verified before decoding. A file coded from
+// a profile needs that profile (Unsupported otherwise); other files ignore it.
+CodecStatus decodeAudio(const uint8_t *src, size_t len, int16_t *dst, size_t dstSamples,
+                        CodecStats *stats = nullptr, const CodecProfile *profile = nullptr);
+
+// Incremental decoder for playback: open() parses a GBL file image (which
+// must stay valid while it is read) and verifies its checksums, then read()
+// delivers the frames in pieces of any size, e.g. one audio period per call.
+// Only the current block is held (up to 4096 frames), never the decoded file.
+// read() does not allocate, and its work is bounded by the frames requested
+// plus one block in block mode, so it may run on an audio callback thread.
+class AudioDecoder {
+public:
+    AudioDecoder();
+    ~AudioDecoder();
+
+    // Start decoding the file, with its profile as for decodeAudio (needed
+    // during open() only); the state (about 90 KB) is allocated by the
+    // first call and reused by later ones.
+    CodecStatus open(const uint8_t *src, size_t len, const CodecProfile *profile = nullptr);
+
+    // Decode the next frames (at most `frames`) into dst, interleaved.
+    // `got` receives the number decoded, fewer than asked only at the end of
+    // the file. Corrupt on a damaged stream, then on every later call too,
+    // and if no file is open.
+    CodecStatus read(int16_t *dst, size_t frames, size_t &got);
+
+    const AudioInfo &info() const;   // of the open file
+    uint64_t position() const;       // frames delivered so far
+
+private:
+    struct State;
+    std::unique_ptr<State> st;
+};
+
+#endif
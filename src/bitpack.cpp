@@ -0,0 +1,169 @@
+#include "bitpack.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITPACK_X86 1
+#endif
+
+// 64-bit words with byte k at memory offset k
+static inline uint64_t loadLE64(const void *p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline void storeLE64(void *p, uint64_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    std::memcpy(p, &v, 8);
+}
+
+static const uint64_t kOnes = 0x0101010101010101ULL;
+static const uint64_t kAsciiZero = 0x3030303030303030ULL;
+
+// ---------------- scalar paths (8 bits per step) ----------------
+static bool packScalar(const char *text, size_t nbits, uint8_t *dst) {
+    size_t i = 0;
+    for (; i + 8 <= nbits; i += 8) {
+        uint64_t v = loadLE64(text + i) ^ kAsciiZero;  // '0' -> 0, '1' -> 1
+        if (v & ~kOnes) return false;
+        // gathers byte k's low bit into bit 63 - k; byte 0 (first bit) ends up as the MSB
+        *dst++ = uint8_t((v * 0x8040201008040201ULL) >> 56);
+    }
+    if (i < nbits) {
+        uint8_t b = 0;
+        for (int k = 0; i < nbits; ++i, ++k) {
+            char c = text[i];
+            if (c != '0' && c != '1') return false;
+            b |= uint8_t((c - '0') << (7 - k));
+        }
+        *dst = b;
+    }
+    return true;
+}
+
+static void unpackScalar(const uint8_t *src, size_t nbits, char *text) {
+    size_t i = 0;
+    for (; i + 8 <= nbits; i += 8) {
+        // byte k keeps bit 7 - k of the source byte, then becomes 0 or 1
+        uint64_t v = (*src++ * kOnes) & 0x0102040810204080ULL;
+        v = ((v + 0x7F7F7F7F7F7F7F7FULL) >> 7) & kOnes;
+        storeLE64(text + i, v | kAsciiZero);
+    }
+    for (int k = 0; i < nbits; ++i, ++k) text[i] = char('0' + ((*src >> (7 - k)) & 1));
+}
+
+#ifdef BITPACK_X86
+// ---------------- SSSE3 (16 bits per step, runtime dispatched) ----------------
+// Packing reverses each group of 8 characters with pshufb so that movemask
+// (which puts the first lane in the LSB) yields MSB-first bytes. Unpacking
+// broadcasts the source bytes to 8 lanes each with pshufb and tests one bit
+// per lane.
+__attribute__((target("ssse3")))
+static size_t packSSSE3(const char *text, size_t nbits, uint8_t *dst) {
+    const __m128i rev = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    const __m128i zero = _mm_set1_epi8('0'), one = _mm_set1_epi8('1');
+    size_t i = 0;
+    for (; i + 16 <= nbits; i += 16) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)), rev);
+        __m128i ones = _mm_cmpeq_epi8(v, one);
+        if (_mm_movemask_epi8(_mm_or_si128(ones, _mm_cmpeq_epi8(v, zero))) != 0xFFFF) break;
+        uint16_t m = (uint16_t)_mm_movemask_epi8(ones);
+        std::memcpy(dst + i / 8, &m, 2);
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t unpackSSSE3(const uint8_t *src, size_t nbits, char *text) {
+    const __m128i sel = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bit = _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+    const __m128i zero = _mm_set1_epi8('0');
+    size_t i = 0;
+    for (; i + 16 <= nbits; i += 16) {
+        uint16_t w;
+        std::memcpy(&w, src + i / 8, 2);
+        __m128i v = _mm_and_si128(_mm_shuffle_epi8(_mm_set1_epi16((short)w), sel), bit);
+        // set lanes compare to -1; '0' - (-1) = '1'
+        v = _mm_sub_epi8(zero, _mm_cmpeq_epi8(v, bit));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(text + i), v);
+    }
+    return i;
+}
+
+// ---------------- AVX2 (32 bits per step, runtime dispatched) ----------------
+// Same as SSSE3; pshufb works within 128-bit halves, which is all either
+// direction needs.
+__attribute__((target("avx2")))
+static size_t packAVX2(const char *text, size_t nbits, uint8_t *dst) {
+    const __m256i rev = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    const __m256i zero = _mm256_set1_epi8('0'), one = _mm256_set1_epi8('1');
+    size_t i = 0;
+    for (; i + 32 <= nbits; i += 32) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)), rev);
+        __m256i ones = _mm256_cmpeq_epi8(v, one);
+        if (_mm256_movemask_epi8(_mm256_or_si256(ones, _mm256_cmpeq_epi8(v, zero))) != -1) break;
+        uint32_t m = (uint32_t)_mm256_movemask_epi8(ones);
+        std::memcpy(dst + i / 8, &m, 4);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t unpackAVX2(const uint8_t *src, size_t nbits, char *text) {
+    const __m256i sel = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                         2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bit = _mm256_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1,
+                                         -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+    const __m256i zero = _mm256_set1_epi8('0');
+    size_t i = 0;
+    for (; i + 32 <= nbits; i += 32) {
+        uint32_t w;
+        std::memcpy(&w, src + i / 8, 4);
+        __m256i v = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_set1_epi32((int)w), sel), bit);
+        v = _mm256_sub_epi8(zero, _mm256_cmpeq_epi8(v, bit));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(text + i), v);
+    }
+    return i;
+}
+
+static bool haveAVX2() { static const bool v = __builtin_cpu_supports("avx2"); return v; }
+static bool haveSSSE3() { static const bool v = __builtin_cpu_supports("ssse3"); return v; }
+#endif
+
+// ---------------- public entry points ----------------
+// The SIMD loops stop at the last full step (or at the first invalid
+// character); the scalar path finishes the tail and reports invalid input.
+bool packBits(const char *text, size_t nbits, uint8_t *dst) {
+    size_t done = 0;
+#ifdef BITPACK_X86
+    if (haveAVX2()) done = packAVX2(text, nbits, dst);
+    else if (haveSSSE3()) done = packSSSE3(text, nbits, dst);
+#endif
+    return packScalar(text + done, nbits - done, dst + done / 8);
+}
+
+void unpackBits(const uint8_t *src, size_t nbits, char *text) {
+    size_t done = 0;
+#ifdef BITPACK_X86
+    if (haveAVX2()) done = unpackAVX2(src, nbits, text);
+    else if (haveSSSE3()) done = unpackSSSE3(src, nbits, text);
+#endif
+    unpackScalar(src + done / 8, nbits - done, text + done);
+}
+
+size_t filterBits(const char *text, size_t len, char *dst) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i) {
+        char c = text[i];
+        dst[n] = c;
+        n += (c == '0') | (c == '1');
+    }
+    return n;
+}
@@ -0,0 +1,30 @@
+#ifndef BITPACK_HPP
+#define BITPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Conversion between the textual '0'/'1' form of a bitstream (BitWriter, the
+// golomb CLI) and packed bytes as written by BitSink: MSB first, unused low
+// bits of the last byte zero. On x86 the widest available SIMD path is picked
+// at runtime (AVX2: 32 bits per step, SSSE3: 16); elsewhere 8 bits per step
+// with 64-bit multiply tricks.
+
+// Bytes needed for nbits packed bits
+inline size_t packedBytes(size_t nbits) { return (nbits + 7) / 8; }
+
+// Pack nbits characters of text into packedBytes(nbits) bytes at dst.
+// Returns false if text contains anything but '0' and '1' (dst is then
+// partially written).
+bool packBits(const char *text, size_t nbits, uint8_t *dst);
+
+// Unpack the first nbits bits of src into nbits '0'/'1' characters at text
+// (no terminator is written).
+void unpackBits(const uint8_t *src, size_t nbits, char *text);
+
+// Copy the '0'/'1' characters of text (len bytes) to dst, dropping anything
+// else (whitespace, separators); returns the number kept. dst needs room for
+// len bytes and may equal text.
+size_t filterBits(const char *text, size_t len, char *dst);
+
+#endif
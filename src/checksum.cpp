@@ -0,0 +1,154 @@
+#include "checksum.hpp"
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#endif
+
+static inline uint32_t loadLE32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void storeLE32(uint8_t *p, uint32_t v) {
+    p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); p[2] = uint8_t(v >> 16); p[3] = uint8_t(v >> 24);
+}
+
+// ---------------- table path (slicing-by-8) ----------------
+struct Crc32cTables {
+    uint32_t t[8][256];
+    Crc32cTables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ ((c & 1) ? 0x82F63B78u : 0);
+            t[0][i] = c;
+        }
+        // t[k][i]: byte i followed by k zero bytes
+        for (int k = 1; k < 8; ++k)
+            for (int i = 0; i < 256; ++i) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+    }
+};
+
+static const Crc32cTables &tables() {
+    static const Crc32cTables tab;
+    return tab;
+}
+
+// crc is the running (inverted) register
+static uint32_t crcTable(const uint8_t *p, size_t len, uint32_t crc) {
+    const Crc32cTables &tab = tables();
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t lo = loadLE32(p) ^ crc, hi = loadLE32(p + 4);
+        crc = tab.t[7][lo & 0xFF] ^ tab.t[6][(lo >> 8) & 0xFF] ^ tab.t[5][(lo >> 16) & 0xFF] ^ tab.t[4][lo >> 24] ^
+              tab.t[3][hi & 0xFF] ^ tab.t[2][(hi >> 8) & 0xFF] ^ tab.t[1][(hi >> 16) & 0xFF] ^ tab.t[0][hi >> 24];
+    }
+    for (; len; --len) crc = (crc >> 8) ^ tab.t[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#ifdef CHECKSUM_X86
+// ---------------- SSE4.2 (runtime dispatched) ----------------
+// crc32 has a latency of three cycles but a throughput of one per cycle, so
+// one stream runs at a third of the possible speed. Segments are independent,
+// which lets the container code run three of them interleaved.
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crcSSE42(const uint8_t *p, size_t len, uint32_t crc) {
+    uint64_t c = crc;
+    for (; len >= 8; p += 8, len -= 8) c = _mm_crc32_u64(c, load64(p));
+    uint32_t c32 = (uint32_t)c;
+    for (; len; --len) c32 = _mm_crc32_u8(c32, *p++);
+    return c32;
+}
+
+// three consecutive full segments starting at p
+__attribute__((target("sse4.2")))
+static void crc3SSE42(const uint8_t *p, uint32_t out[3]) {
+    const uint8_t *a = p, *b = p + kCrcSegment, *c = p + 2 * kCrcSegment;
+    uint64_t ca = 0xFFFFFFFFu, cb = 0xFFFFFFFFu, cc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < kCrcSegment; i += 8) {
+        ca = _mm_crc32_u64(ca, load64(a + i));
+        cb = _mm_crc32_u64(cb, load64(b + i));
+        cc = _mm_crc32_u64(cc, load64(c + i));
+    }
+    out[0] = ~(uint32_t)ca;
+    out[1] = ~(uint32_t)cb;
+    out[2] = ~(uint32_t)cc;
+}
+
+static bool haveSSE42() { static const bool v = __builtin_cpu_supports("sse4.2"); return v; }
+#endif
+
+uint32_t crc32c(const void *data, size_t len, uint32_t crc) {
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+#ifdef CHECKSUM_X86
+    if (haveSSE42()) return ~crcSSE42(p, len, ~crc);
+#endif
+    return ~crcTable(p, len, ~crc);
+}
+
+uint32_t crc32cTable(const void *data, size_t len, uint32_t crc) {
+    return ~crcTable(static_cast<const uint8_t*>(data), len, ~crc);
+}
+
+// ---------------- checksummed blocks ----------------
+
+// CRCs of up to three segments starting at body (len bytes remain);
+// returns how many were computed
+static size_t crcGroup(const uint8_t *body, uint64_t len, uint32_t out[3]) {
+#ifdef CHECKSUM_X86
+    if (len >= 3 * kCrcSegment && haveSSE42()) { crc3SSE42(body, out); return 3; }
+#endif
+    out[0] = crc32c(body, (size_t)(len < kCrcSegment ? len : kCrcSegment));
+    return 1;
+}
+
+static uint32_t headCrc(const uint8_t *block, size_t headBytes, size_t bodyBytes) {
+    uint32_t crc = crc32c(block, headBytes);
+    return crc32c(block + headBytes + bodyBytes, (size_t)(4 * crcSegments(bodyBytes)), crc);
+}
+
+void writeChecksums(uint8_t *block, size_t headBytes, size_t bodyBytes) {
+    const uint8_t *body = block + headBytes;
+    uint8_t *table = block + headBytes + bodyBytes;
+    const uint64_t n = crcSegments(bodyBytes);
+    for (uint64_t i = 0; i < n;) {
+        uint32_t crc[3];
+        size_t k = crcGroup(body + i * kCrcSegment, bodyBytes - i * kCrcSegment, crc);
+        for (size_t j = 0; j < k; ++j, ++i) storeLE32(table + 4 * i, crc[j]);
+    }
+    storeLE32(table + 4 * n, headCrc(block, headBytes, bodyBytes));
+}
+
+bool checkHeaderChecksum(const uint8_t *block, size_t headBytes, size_t bodyBytes) {
+    return loadLE32(block + headBytes + bodyBytes + 4 * crcSegments(bodyBytes)) == headCrc(block, headBytes, bodyBytes);
+}
+
+CodecStatus verifyChecksums(const uint8_t *block, size_t headBytes, size_t bodyBytes, ChecksumReport *report,
+                            uint64_t blockOffset) {
+    ChecksumReport local;
+    ChecksumReport &rep = report ? *report : local;
+    const uint64_t n = crcSegments(bodyBytes);
+    const uint64_t bad = rep.badSegments;
+    bool headOk = checkHeaderChecksum(block, headBytes, bodyBytes);
+    rep.present = true;
+    rep.headerOk = rep.headerOk && headOk;
+    rep.segments += n;
+    rep.bytes += headBytes + bodyBytes + checksumTrailerSize(bodyBytes);
+    const uint8_t *body = block + headBytes;
+    const uint8_t *table = block + headBytes + bodyBytes;
+    for (uint64_t i = 0; i < n;) {
+        uint32_t crc[3];
+        size_t k = crcGroup(body + i * kCrcSegment, bodyBytes - i * kCrcSegment, crc);
+        for (size_t j = 0; j < k; ++j, ++i) {
+            if (loadLE32(table + 4 * i) == crc[j]) continue;
+            if (rep.badSegments++ == 0) rep.firstBadOffset = blockOffset + headBytes + i * kCrcSegment;
+        }
+    }
+    return headOk && rep.badSegments == bad ? CodecStatus::Ok : CodecStatus::Corrupt;
+}
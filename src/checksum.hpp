@@ -0,0 +1,56 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "golomb.hpp"
+
+// CRC32C (Castagnoli) and the checksummed blocks of the GBL and GIMG
+// containers. On x86 the SSE4.2 crc32 instruction is picked at runtime,
+// running three independent segments interleaved to hide its latency;
+// elsewhere a slicing-by-8 table is used.
+
+// CRC32C of len bytes; pass a previous result as crc to continue it.
+uint32_t crc32c(const void *data, size_t len, uint32_t crc = 0);
+// The same through the slicing-by-8 table on every CPU (the reference the
+// SSE4.2 path is tested against).
+uint32_t crc32cTable(const void *data, size_t len, uint32_t crc = 0);
+
+// ---------------- checksummed blocks ----------------
+// A checksummed block is
+//   head | body | u32 crc[segments] | u32 headCrc      (little-endian)
+// where crc[i] covers body bytes [i * kCrcSegment, (i + 1) * kCrcSegment)
+// and headCrc covers the head followed by the crc table, so the head can be
+// trusted after a cheap check and damage in the body is located to one
+// segment. Every chunk of the GBL/GIMG container is such a block (the head
+// is the chunk tag and length); files from before the chunked container
+// carry one block trailer after the payload, with the whole header as head.
+
+static const size_t kCrcSegment = (size_t)1 << 16;
+
+constexpr uint64_t crcSegments(uint64_t bodyBytes) { return (bodyBytes + kCrcSegment - 1) / kCrcSegment; }
+constexpr uint64_t checksumTrailerSize(uint64_t bodyBytes) { return 4 * (crcSegments(bodyBytes) + 1); }
+
+struct ChecksumReport {
+    bool present = false;        // the file carries checksums (older files may not)
+    bool headerOk = true;        // every head checksum matched
+    uint64_t segments = 0;
+    uint64_t badSegments = 0;
+    uint64_t firstBadOffset = 0; // file offset of the first damaged segment
+    uint64_t bytes = 0;          // bytes checked
+};
+
+// Fill the trailer of block (headBytes of head, then bodyBytes of body,
+// then checksumTrailerSize(bodyBytes) bytes of room).
+void writeChecksums(uint8_t *block, size_t headBytes, size_t bodyBytes);
+
+// Check the head checksum only (cheap: head and crc table).
+bool checkHeaderChecksum(const uint8_t *block, size_t headBytes, size_t bodyBytes);
+
+// Check the head and every body segment; Corrupt on any mismatch. The
+// result is added to report (optional), whose offsets count from
+// blockOffset, so the blocks of one file can share a report.
+CodecStatus verifyChecksums(const uint8_t *block, size_t headBytes, size_t bodyBytes,
+                            ChecksumReport *report = nullptr, uint64_t blockOffset = 0);
+
+#endif
@@ -0,0 +1,151 @@
+#include "codec_profile.hpp"
+#include "container.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static const char kMagic[] = "GPRF";
+static const uint64_t kEmaOne = 256;          // EMAs are stored in 1/256 units
+static const uint64_t kMaxEma = 1u << 24;     // 65536, above any 16-bit residual
+
+static inline uint32_t zigzag(int v) { return v >= 0 ? (uint32_t)v << 1 : ((uint32_t)(-v) << 1) - 1; }
+static inline int unzigzag(uint64_t z) { return (z & 1) ? -(int)((z + 1) >> 1) : (int)(z >> 1); }
+
+// the probabilities of a context in file order (or the training counts
+// kept for them)
+template <class Model, typename Visit>
+static void forEachProb(Model &m, int contexts, Visit visit) {
+    for (int c = 0; c < contexts; ++c) {
+        visit(m.side[c]);
+        for (int j = 0; j < m.classes; ++j) visit(m.up[c][j]);
+        for (int j = 0; j < m.classes; ++j) visit(m.down[c][j]);
+        for (int j = 0; j < m.classes; ++j) visit(m.mant[c][j]);
+    }
+}
+
+// INFO fields and DATA body of a profile; returns the DATA size
+static size_t serialize(const CodecProfile &profile, FieldWriter &fields, uint8_t *data) {
+    fields.put((uint64_t)profile.kind);
+    fields.put((uint64_t)profile.model.classes);
+    fields.put((uint64_t)profile.contexts);
+    fields.put((uint64_t)std::llround(profile.ema[0] * kEmaOne));
+    fields.put((uint64_t)std::llround(profile.ema[1] * kEmaOne));
+    size_t n = 0;
+    forEachProb(profile.model, profile.contexts, [&](const uint16_t &p) {
+        n += putVarint(data + n, zigzag((int)p - (int)(kProbOne / 2)));
+    });
+    return n;
+}
+
+static uint32_t profileId(const uint8_t *info, size_t infoLen, const uint8_t *data, size_t dataLen) {
+    uint32_t id = crc32c(data, dataLen, crc32c(info, infoLen));
+    return id ? id : 1;
+}
+
+CodecStatus writeProfile(const CodecProfile &profile, uint8_t *dst, size_t capacity, size_t &written) {
+    written = 0;
+    FieldWriter fields;
+    uint8_t data[kMaxProfileBytes];
+    const size_t n = serialize(profile, fields, data);
+    written = (size_t)(kPayloadReserve + n + containerTail(n));
+    if (capacity < written) return CodecStatus::BufferTooSmall;
+    std::copy(data, data + n, dst + kPayloadReserve);
+    written = (size_t)finishContainer(dst, kMagic, fields, n);
+    return CodecStatus::Ok;
+}
+
+CodecStatus readProfile(const uint8_t *src, size_t len, CodecProfile &profile) {
+    ContainerView view;
+    CodecStatus st = readContainer(src, len, kMagic, view);
+    if (st != CodecStatus::Ok) return st;
+    if (verifyContainer(src, len, kMagic) != CodecStatus::Ok) return CodecStatus::Corrupt;
+    FieldReader f(view.info.body, view.info.size);
+    const uint64_t kind = f.get(), classes = f.get(), contexts = f.get(), emaL = f.get(), emaR = f.get();
+    if (f.error || emaL > kMaxEma || emaR > kMaxEma) return CodecStatus::Corrupt;
+    if (kind > PROFILE_IMAGE || classes == 0 || classes > (uint64_t)ResidualModel::kMaxClasses ||
+        contexts == 0 || contexts > (uint64_t)ResidualModel::kMaxContexts)
+        return CodecStatus::Unsupported;
+    profile = CodecProfile();
+    profile.kind = (int)kind;
+    profile.contexts = (int)contexts;
+    profile.ema[0] = (double)emaL / kEmaOne;
+    profile.ema[1] = (double)emaR / kEmaOne;
+    profile.model = ResidualModel((int)classes);
+    const uint8_t *p = view.data.body, *end = p + view.data.size;
+    bool ok = true;
+    forEachProb(profile.model, profile.contexts, [&](uint16_t &prob) {
+        uint64_t z;
+        if (!ok || !getVarint(p, end, z) || z > 2 * kProbOne) { ok = false; return; }
+        const int v = (int)(kProbOne / 2) + unzigzag(z);
+        if (v <= 0 || v >= (int)kProbOne) { ok = false; return; }
+        prob = (uint16_t)v;
+    });
+    if (!ok || p != end) return CodecStatus::Corrupt;
+    profile.id = profileId(view.info.body, (size_t)view.info.size, view.data.body, (size_t)view.data.size);
+    return CodecStatus::Ok;
+}
+
+// ---------------- training ----------------
+
+bool ProfileTrainer::start(int kind_, int classes, int contexts_) {
+    if (nfiles == 0) {
+        kind = kind_;
+        contexts = contexts_;
+        counts.classes = classes;
+    } else if (kind != kind_ || contexts != contexts_ || counts.classes != classes) {
+        return false;
+    }
+    ++nfiles;
+    return true;
+}
+
+void ProfileTrainer::addEma(int channel, double meanAbs) {
+    emaSum[channel] += meanAbs;
+    ++emaFiles[channel];
+}
+
+// the walk of encodeResidual, with the raw bits below the mantissa skipped
+void ProfileTrainer::addResidual(int ctx, int pivot, uint32_t z) {
+    const int k = z ? 32 - __builtin_clz(z) : 0;
+    if (pivot > 0) ++counts.side[ctx].n[k >= pivot];
+    if (k >= pivot) {
+        for (int j = pivot; j < counts.classes - 1; ++j) {
+            ++counts.up[ctx][j].n[k > j];
+            if (k == j) break;
+        }
+    } else {
+        for (int j = pivot - 1; j > 0; --j) {
+            ++counts.down[ctx][j].n[k < j];
+            if (k == j) break;
+        }
+    }
+    if (k >= 2) ++counts.mant[ctx][k].n[(z >> (k - 2)) & 1];
+}
+
+CodecStatus ProfileTrainer::finish(CodecProfile &profile) const {
+    if (nfiles == 0) return CodecStatus::Unsupported;
+    profile = CodecProfile();
+    profile.kind = kind;
+    profile.contexts = contexts;
+    // on the 1/256 grid of the file, so a profile used straight away codes
+    // like the same profile read back
+    for (int ch = 0; ch < 2; ++ch)
+        if (emaFiles[ch]) profile.ema[ch] = std::round(emaSum[ch] / emaFiles[ch] * kEmaOne) / kEmaOne;
+    profile.model = ResidualModel(counts.classes);
+    // both layouts are visited in the same order
+    std::vector<const Counts*> seen;
+    forEachProb(counts, contexts, [&](const Counts &c) { seen.push_back(&c); });
+    // P(0) estimated with half a count of each outcome added, within the
+    // range adaptProb keeps probabilities in
+    size_t i = 0;
+    forEachProb(profile.model, contexts, [&](uint16_t &p) {
+        const uint64_t *n = seen[i++]->n;
+        const double p0 = (n[0] + 0.5) / (n[0] + n[1] + 1.0);
+        p = (uint16_t)std::min(std::max(std::lround(p0 * kProbOne), 31L), (long)kProbOne - 31);
+    });
+    FieldWriter fields;
+    uint8_t data[kMaxProfileBytes];
+    const size_t n = serialize(profile, fields, data);
+    profile.id = profileId(fields.buf, fields.size, data, n);
+    return CodecStatus::Ok;
+}
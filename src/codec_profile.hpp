@@ -0,0 +1,94 @@
+#ifndef CODEC_PROFILE_HPP
+#define CODEC_PROFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "entropy_coder.hpp"
+#include "golomb.hpp"
+
+// Trained starting state for the adaptive parts of the codecs. Without a
+// profile every file starts cold: the audio EMAs at 1 and every probability
+// of the adaptive backends at 1/2, so much of a short file is coded before
+// the state has converged. A profile learnt from a corpus
+// (`golomb_audio_codec train`, `image_codec train`) starts encoder and
+// decoder from the state typical of that corpus instead:
+//   audio : the EMA of |residual| per channel (the Golomb m and the contexts
+//           of the adaptive backends) and the adaptive backend probabilities
+//   image : the adaptive backend probabilities (Golomb files already carry
+//           the m chosen for the whole plane)
+// Files coded with a profile store its ID in INFO and decode only with the
+// same profile; the profile itself is never stored in them.
+//
+// Profile files use the container of the codecs (container.hpp) with magic
+// "GPRF". INFO holds the varints kind, classes, contexts and the two EMAs in
+// 1/256 units; DATA holds, context by context, the probabilities side, up,
+// down and mant (classes each) as varints of their zig-zagged distance from
+// 1/2, so a context that was never trained takes a byte per probability.
+// The ID is the CRC32C of the INFO and DATA bodies (never 0).
+
+enum ProfileKind : int {
+    PROFILE_AUDIO = 0,
+    PROFILE_IMAGE = 1
+};
+
+struct CodecProfile {
+    int kind = PROFILE_AUDIO;
+    int contexts = 0;                 // model contexts in use
+    uint32_t id = 0;
+    double ema[2] = {1.0, 1.0};       // audio: initial EMA of left and right
+    ResidualModel model{ResidualModel::kMaxClasses};
+};
+
+// Upper bound on the size of a profile file.
+static const size_t kMaxProfileBytes = 16384;
+
+// Write profile as a file image; BufferTooSmall if capacity is short.
+CodecStatus writeProfile(const CodecProfile &profile, uint8_t *dst, size_t capacity, size_t &written);
+
+// Read a profile file image (checksums included) and compute its ID.
+CodecStatus readProfile(const uint8_t *src, size_t len, CodecProfile &profile);
+
+// Collects the statistics of a training corpus. The codecs feed it one file
+// at a time (trainAudioProfile, trainImageProfile) by running their coding
+// loop and handing it each residual with its context and pivot: the
+// decisions encodeResidual would take are counted per probability of the
+// model, and finish() sets each initial probability to the share of zeros
+// seen (the corpus average) and the EMAs to the mean over the files of
+// their first frames' mean |residual|. Run decisions are not trained.
+class ProfileTrainer {
+public:
+    // Called by the codec with every file: false if the trainer already
+    // holds files of another kind.
+    bool start(int kind, int classes, int contexts);
+    void addEma(int channel, double meanAbs);
+
+    // count the decisions coding zig-zag value z in context ctx (see encodeResidual)
+    void addResidual(int ctx, int pivot, uint32_t z);
+
+    uint64_t files() const { return nfiles; }
+
+    // Unsupported if no file was added.
+    CodecStatus finish(CodecProfile &profile) const;
+
+private:
+    // zeros and ones seen, laid out like the probabilities of ResidualModel
+    struct Counts {
+        uint64_t n[2] = {};
+    };
+    struct DecisionCounts {
+        int classes = 0;
+        Counts side[ResidualModel::kMaxContexts];
+        Counts up[ResidualModel::kMaxContexts][ResidualModel::kMaxClasses];
+        Counts down[ResidualModel::kMaxContexts][ResidualModel::kMaxClasses];
+        Counts mant[ResidualModel::kMaxContexts][ResidualModel::kMaxClasses];
+    };
+
+    int kind = -1;
+    int contexts = 0;
+    uint64_t nfiles = 0;
+    DecisionCounts counts;
+    double emaSum[2] = {};
+    uint64_t emaFiles[2] = {};
+};
+
+#endif
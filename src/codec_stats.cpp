@@ -0,0 +1,149 @@
+#include "codec_stats.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <sys/resource.h>
+
+double wallSeconds() {
+    using clk = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clk::now().time_since_epoch()).count();
+}
+
+double cpuSeconds() {
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+uint64_t peakRssKiB() {
+    rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    return (uint64_t)ru.ru_maxrss; // KiB on Linux
+}
+
+void CodecStats::addStage(const char *name, double wall, double cpu, uint64_t items, uint64_t bytes) {
+    for (StageStats &s : stages) {
+        if (s.name == name) {
+            s.wallSeconds += wall; s.cpuSeconds += cpu; s.items += items; s.bytes += bytes;
+            return;
+        }
+    }
+    StageStats s;
+    s.name = name; s.wallSeconds = wall; s.cpuSeconds = cpu; s.items = items; s.bytes = bytes;
+    stages.push_back(s);
+}
+
+void CodecStats::merge(const CodecStats &other) {
+    unit = other.unit;
+    items += other.items; rawBytes += other.rawBytes; codedBits += other.codedBits; codedBytes += other.codedBytes;
+    runs += other.runs; runItems += other.runItems;
+    for (const StageStats &s : other.stages) addStage(s.name.c_str(), s.wallSeconds, s.cpuSeconds, s.items, s.bytes);
+    for (int i = 0; i < kBuckets; ++i) {
+        residualHist[i] += other.residualHist[i];
+        mHist[i] += other.mHist[i];
+        kHist[i] += other.kHist[i];
+    }
+}
+
+StageTimer::StageTimer(CodecStats *stats, const char *name, uint64_t items, uint64_t bytes)
+    : stats(stats), name(name), items(items), bytes(bytes), wall0(0), cpu0(0) {
+    if (stats) { wall0 = wallSeconds(); cpu0 = cpuSeconds(); }
+}
+
+StageTimer::~StageTimer() {
+    if (stats) stats->addStage(name, wallSeconds() - wall0, cpuSeconds() - cpu0, items, bytes);
+}
+
+// ---------------- reports ----------------
+
+// last non-empty bucket + 1, so reports stop at the largest value seen
+static int usedBuckets(const uint64_t *hist) {
+    int n = CodecStats::kBuckets;
+    while (n > 0 && hist[n-1] == 0) --n;
+    return n;
+}
+
+static std::string bucketLabel(int i) {
+    if (i == 0) return "0";
+    if (i == 1) return "1";
+    uint64_t lo = 1ULL << (i - 1);
+    return std::to_string(lo) + "-" + std::to_string(i == 64 ? ~0ULL : (lo << 1) - 1);
+}
+
+// exact: the index is the value itself rather than a power-of-two bucket
+static void printHist(std::ostream &os, const char *title, const uint64_t *hist, bool exact = false) {
+    uint64_t total = 0;
+    for (int i = 0; i < CodecStats::kBuckets; ++i) total += hist[i];
+    if (total == 0) return;
+    os << title << "\n";
+    char line[96];
+    for (int i = 0, n = usedBuckets(hist); i < n; ++i) {
+        if (!hist[i]) continue;
+        std::snprintf(line, sizeof line, "  %-22s %12llu  %6.2f%%\n", (exact ? std::to_string(i) : bucketLabel(i)).c_str(),
+                      (unsigned long long)hist[i], 100.0 * hist[i] / total);
+        os << line;
+    }
+}
+
+void CodecStats::printTable(std::ostream &os) const {
+    char line[160];
+    double wall = 0, cpu = 0;
+    os << "stage            wall ms     cpu ms      M" << unit << "/s      MB/s\n";
+    for (const StageStats &s : stages) {
+        std::snprintf(line, sizeof line, "%-14s %9.3f %10.3f %12.2f %9.1f\n", s.name.c_str(),
+                      s.wallSeconds * 1e3, s.cpuSeconds * 1e3,
+                      s.wallSeconds > 0 ? s.items / s.wallSeconds / 1e6 : 0.0,
+                      s.wallSeconds > 0 ? s.bytes / s.wallSeconds / 1e6 : 0.0);
+        os << line;
+        wall += s.wallSeconds; cpu += s.cpuSeconds;
+    }
+    std::snprintf(line, sizeof line, "%-14s %9.3f %10.3f\n", "total", wall * 1e3, cpu * 1e3);
+    os << line;
+    std::snprintf(line, sizeof line, "%llu %ss, %llu -> %llu bytes (ratio %.3f), %.4f bits/%s, peak RSS %llu KiB\n",
+                  (unsigned long long)items, unit.c_str(), (unsigned long long)rawBytes,
+                  (unsigned long long)codedBytes, codedBytes ? (double)rawBytes / codedBytes : 0.0,
+                  items ? (double)codedBits / items : 0.0, unit.c_str(), (unsigned long long)peakRssKiB());
+    os << line;
+    if (runs) {
+        std::snprintf(line, sizeof line, "%llu runs covering %llu %ss (%.2f%%), mean length %.1f\n",
+                      (unsigned long long)runs, (unsigned long long)runItems, unit.c_str(),
+                      items ? 100.0 * runItems / items : 0.0, (double)runItems / runs);
+        os << line;
+    }
+    printHist(os, "|residual| histogram:", residualHist);
+    printHist(os, "m histogram:", mHist);
+    printHist(os, "k = ceil(log2 m) histogram:", kHist, true);
+}
+
+static void jsonHist(std::ostream &os, const char *key, const uint64_t *hist) {
+    os << "  \"" << key << "\": [";
+    for (int i = 0, n = usedBuckets(hist); i < n; ++i) os << (i ? ", " : "") << hist[i];
+    os << "]";
+}
+
+void CodecStats::writeJson(std::ostream &os) const {
+    char num[64];
+    auto fmt = [&](double v) { std::snprintf(num, sizeof num, "%.9g", v); return num; };
+    double wall = 0, cpu = 0;
+    os << "{\n  \"unit\": \"" << unit << "\",\n  \"items\": " << items
+       << ",\n  \"raw_bytes\": " << rawBytes << ",\n  \"coded_bytes\": " << codedBytes
+       << ",\n  \"coded_bits\": " << codedBits
+       << ",\n  \"runs\": " << runs << ",\n  \"run_items\": " << runItems
+       << ",\n  \"bits_per_item\": " << fmt(items ? (double)codedBits / items : 0.0)
+       << ",\n  \"stages\": [";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const StageStats &s = stages[i];
+        os << (i ? ",\n" : "\n") << "    {\"name\": \"" << s.name << "\", \"wall_s\": " << fmt(s.wallSeconds);
+        os << ", \"cpu_s\": " << fmt(s.cpuSeconds) << ", \"items\": " << s.items << ", \"bytes\": " << s.bytes;
+        os << ", \"items_per_s\": " << fmt(s.wallSeconds > 0 ? s.items / s.wallSeconds : 0.0);
+        os << ", \"mb_per_s\": " << fmt(s.wallSeconds > 0 ? s.bytes / s.wallSeconds / 1e6 : 0.0) << "}";
+        wall += s.wallSeconds; cpu += s.cpuSeconds;
+    }
+    os << "\n  ],\n  \"wall_s\": " << fmt(wall);
+    os << ",\n  \"cpu_s\": " << fmt(cpu);
+    os << ",\n  \"peak_rss_kib\": " << peakRssKiB() << ",\n";
+    os << "  \"histogram_buckets\": \"bucket 0 counts 0, bucket i counts [2^(i-1), 2^i); k_hist is indexed by k\",\n";
+    jsonHist(os, "residual_hist", residualHist); os << ",\n";
+    jsonHist(os, "m_hist", mHist); os << ",\n";
+    jsonHist(os, "k_hist", kHist); os << "\n}\n";
+}
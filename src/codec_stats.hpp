@@ -0,0 +1,89 @@
+#ifndef CODEC_STATS_HPP
+#define CODEC_STATS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Optional instrumentation for the codecs. Callers that want statistics pass
+// a CodecStats*; a null pointer (the default everywhere) disables collection,
+// so the hot loops only pay for a predictable "if (stats)" test and no clock
+// is ever read. Collection allocates (stage names), unlike the codecs proper.
+//
+// Histograms use power-of-two buckets: bucket 0 counts the value 0 and bucket
+// i > 0 counts values in [2^(i-1), 2^i), i.e. the bucket is the bit length.
+// The k histogram is the exception: it is indexed by k itself.
+
+struct StageStats {
+    std::string name;
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    uint64_t items = 0;   // samples / pixels / symbols handled by the stage
+    uint64_t bytes = 0;   // bytes read or written by the stage
+};
+
+class CodecStats {
+public:
+    static const int kBuckets = 65;
+
+    std::string unit = "sample";   // what an item is ("sample" or "pixel")
+    uint64_t items = 0;            // samples or pixels coded
+    uint64_t rawBytes = 0;         // uncompressed size
+    uint64_t codedBits = 0;        // payload size in bits
+    uint64_t codedBytes = 0;       // file size including headers
+    uint64_t runs = 0;             // runs coded in run mode
+    uint64_t runItems = 0;         // samples / pixels covered by those runs
+    std::vector<StageStats> stages;
+    uint64_t residualHist[kBuckets] = {};   // |residual|
+    uint64_t mHist[kBuckets] = {};          // Golomb m per coded symbol
+    uint64_t kHist[kBuckets] = {};          // indexed by k = ceil(log2 m) (not bucketed) per coded symbol
+
+    static int bucket(uint64_t v) { return v ? 64 - __builtin_clzll(v) : 0; }
+
+    // per-symbol hooks used by the coders
+    void addResidual(int64_t r) { ++residualHist[bucket(r < 0 ? 0 - (uint64_t)r : (uint64_t)r)]; }
+    void addM(uint64_t m, uint64_t count = 1) {
+        mHist[bucket(m)] += count;
+        kHist[m > 1 ? bucket(m - 1) : 0] += count;
+    }
+
+    // add wall/CPU time to the stage `name` (created on first use, kept in order)
+    void addStage(const char *name, double wall, double cpu, uint64_t items, uint64_t bytes);
+
+    // add the totals, stages and histograms of another run (e.g. one file of a batch)
+    void merge(const CodecStats &other);
+
+    // Human-readable report (for stderr) and a single JSON object. Peak RSS
+    // is sampled when the report is produced.
+    void printTable(std::ostream &os) const;
+    void writeJson(std::ostream &os) const;
+};
+
+// Times the enclosing scope as one stage of `stats`; does nothing when stats is null.
+class StageTimer {
+public:
+    StageTimer(CodecStats *stats, const char *name, uint64_t items = 0, uint64_t bytes = 0);
+    ~StageTimer();
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    // set the work done when it is only known at the end of the stage
+    void setWork(uint64_t items, uint64_t bytes) { this->items = items; this->bytes = bytes; }
+
+private:
+    CodecStats *stats;
+    const char *name;
+    uint64_t items, bytes;
+    double wall0, cpu0;
+};
+
+// Wall clock and process CPU time in seconds
+double wallSeconds();
+double cpuSeconds();
+
+// Peak resident set size of this process in KiB (0 if unavailable)
+uint64_t peakRssKiB();
+
+#endif
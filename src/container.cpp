@@ -0,0 +1,122 @@
+#include "container.hpp"
+#include <algorithm>
+
+static size_t writeChunkHead(uint8_t *p, const char *tag, uint64_t bodyLen) {
+    std::memcpy(p, tag, 4);
+    return 4 + putVarint(p + 4, bodyLen);
+}
+
+uint64_t writeChunk(uint8_t *p, const char *tag, const uint8_t *body, size_t bodyLen) {
+    size_t head = writeChunkHead(p, tag, bodyLen);
+    if (bodyLen) std::memcpy(p + head, body, bodyLen);
+    writeChecksums(p, head, bodyLen);
+    return chunkSize(bodyLen);
+}
+
+bool ChunkReader::next(Chunk &c) {
+    if (done || error) return false;
+    if (len - pos < 4) { error = true; return false; } // no END
+    const uint8_t *p = src + pos + 4;
+    uint64_t size;
+    if (!getVarint(p, src + len, size)) { error = true; return false; }
+    const size_t head = (size_t)(p - (src + pos));
+    const uint64_t avail = len - pos - head;
+    if (size > avail || checksumTrailerSize(size) > avail - size) { error = true; return false; }
+    if (!checkHeaderChecksum(src + pos, head, (size_t)size)) { error = true; return false; }
+    std::memcpy(c.tag, src + pos, 4);
+    c.offset = pos;
+    c.headSize = head;
+    c.body = src + pos + head;
+    c.size = size;
+    pos += head + size + checksumTrailerSize(size);
+    if (c.is("END ")) {
+        done = true;
+        if (pos != len) { error = true; return false; } // trailing bytes
+    }
+    return true;
+}
+
+CodecStatus readContainer(const uint8_t *src, size_t len, const char *magic, ContainerView &view) {
+    if (!hasMagic(src, len, magic)) return CodecStatus::Corrupt;
+    ChunkReader r(src, len);
+    Chunk c;
+    bool haveInfo = false, haveData = false;
+    while (r.next(c)) {
+        if (c.is("INFO")) {
+            if (haveInfo) return CodecStatus::Corrupt;
+            view.info = c;
+            haveInfo = true;
+        } else if (c.is("DATA")) {
+            if (!haveInfo || haveData) return CodecStatus::Corrupt;
+            view.data = c;
+            haveData = true;
+        }
+    }
+    return r.ok() && haveData ? CodecStatus::Ok : CodecStatus::Corrupt;
+}
+
+CodecStatus readContainerPrefix(const uint8_t *src, size_t len, const char *magic, ContainerView &view,
+                                uint64_t &available) {
+    if (!hasMagic(src, len, magic)) return CodecStatus::Corrupt;
+    bool haveInfo = false;
+    for (uint64_t pos = 4;;) {
+        if (len - pos < 4) return CodecStatus::Corrupt;
+        const uint8_t *p = src + pos + 4;
+        uint64_t size;
+        if (!getVarint(p, src + len, size)) return CodecStatus::Corrupt;
+        Chunk c;
+        std::memcpy(c.tag, src + pos, 4);
+        c.offset = pos;
+        c.headSize = (size_t)(p - (src + pos));
+        c.body = p;
+        c.size = size;
+        const uint64_t avail = len - pos - c.headSize;
+        if (c.is("DATA")) {
+            if (!haveInfo) return CodecStatus::Corrupt;
+            view.data = c;
+            available = std::min(size, avail);
+            return CodecStatus::Ok;
+        }
+        if (size > avail || checksumTrailerSize(size) > avail - size ||
+            !checkHeaderChecksum(src + pos, c.headSize, (size_t)size) || c.is("END "))
+            return CodecStatus::Corrupt;
+        if (c.is("INFO")) {
+            if (haveInfo) return CodecStatus::Corrupt;
+            view.info = c;
+            haveInfo = true;
+        }
+        pos += c.headSize + size + checksumTrailerSize(size);
+    }
+}
+
+CodecStatus verifyContainer(const uint8_t *src, size_t len, const char *magic, ChecksumReport *report) {
+    ChecksumReport local;
+    ChecksumReport &rep = report ? *report : local;
+    rep = ChecksumReport();
+    if (!hasMagic(src, len, magic)) return CodecStatus::Corrupt;
+    rep.present = true;
+    rep.bytes = 4;
+    ChunkReader r(src, len);
+    Chunk c;
+    bool ok = true;
+    while (r.next(c)) {
+        if (verifyChecksums(c.body - c.headSize, c.headSize, (size_t)c.size, &rep, c.offset) != CodecStatus::Ok)
+            ok = false;
+    }
+    // damaged framing or head: nothing behind it can be located
+    if (!r.ok()) { rep.headerOk = false; ok = false; }
+    return ok ? CodecStatus::Ok : CodecStatus::Corrupt;
+}
+
+uint64_t finishContainer(uint8_t *dst, const char *magic, const FieldWriter &info, size_t payloadBytes) {
+    uint8_t *p = dst;
+    std::memcpy(p, magic, 4);
+    p += 4;
+    p += writeChunk(p, "INFO", info.buf, info.size);
+    size_t head = writeChunkHead(p, "DATA", payloadBytes);
+    std::memmove(p + head, dst + kPayloadReserve, payloadBytes);
+    writeChecksums(p, head, payloadBytes);
+    p += chunkSize(payloadBytes);
+    p += writeChunk(p, "END ", nullptr, 0);
+    return (uint64_t)(p - dst);
+}
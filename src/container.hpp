@@ -0,0 +1,144 @@
+#ifndef CONTAINER_HPP
+#define CONTAINER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "checksum.hpp"
+#include "golomb.hpp"
+
+// Chunked container shared by GBL and GIMG (version 2 of both formats):
+//   magic[4] | chunk* ,  chunk := tag[4] | varint length | body | checksums
+// Every chunk is a checksummed block (checksum.hpp) whose head is its tag
+// and length. Header fields are LEB128 varints (7 bits per byte, low group
+// first) and fixed-width values are little-endian, so files are 64-bit clean
+// and independent of the host byte order.
+//
+// A file holds "INFO" (the codec's header fields), "DATA" (the payload) and
+// ends with an empty "END " chunk. Readers skip chunks with other tags and
+// INFO fields past the ones they know, so seek tables, statistics and the
+// like can be added later without breaking older readers.
+
+static const size_t kMaxVarint = 10;
+
+constexpr size_t varintSize(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) { v >>= 7; ++n; }
+    return n;
+}
+
+inline size_t putVarint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) { p[n++] = uint8_t(v | 0x80); v >>= 7; }
+    p[n++] = uint8_t(v);
+    return n;
+}
+
+// false if the varint runs past end or does not fit 64 bits
+inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        if (shift == 63 && b > 1) return false;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Header fields in an INFO body, in order
+static const int kMaxInfoFields = 16;
+static const size_t kMaxInfoBytes = kMaxInfoFields * kMaxVarint;
+
+struct FieldWriter {
+    uint8_t buf[kMaxInfoBytes];
+    size_t size = 0;
+    void put(uint64_t v) { size += putVarint(buf + size, v); }
+};
+
+struct FieldReader {
+    const uint8_t *p, *end;
+    bool error = false;
+    FieldReader(const uint8_t *body, uint64_t len) : p(body), end(body + len) {}
+    // a missing or malformed field reads as 0 and sets error
+    uint64_t get() {
+        uint64_t v;
+        if (getVarint(p, end, v)) return v;
+        error = true;
+        return 0;
+    }
+};
+
+// ---------------- chunks ----------------
+
+constexpr size_t chunkHeadSize(uint64_t bodyLen) { return 4 + varintSize(bodyLen); }
+constexpr uint64_t chunkSize(uint64_t bodyLen) { return chunkHeadSize(bodyLen) + bodyLen + checksumTrailerSize(bodyLen); }
+
+// Write a complete chunk at p; returns its size.
+uint64_t writeChunk(uint8_t *p, const char *tag, const uint8_t *body, size_t bodyLen);
+
+struct Chunk {
+    char tag[4];
+    uint64_t offset = 0;        // file offset of the chunk
+    size_t headSize = 0;        // tag and length
+    const uint8_t *body = nullptr;
+    uint64_t size = 0;          // body length
+    bool is(const char *t) const { return std::memcmp(tag, t, 4) == 0; }
+};
+
+// Walks the chunks after the magic, checking their framing and head
+// checksums (not the bodies). next() returns false after "END " or on
+// error; ok() then tells whether the file was well formed up to and
+// including an "END " that is its last byte.
+class ChunkReader {
+public:
+    ChunkReader(const uint8_t *src, size_t len) : src(src), len(len), pos(4), done(false), error(false) {}
+    bool next(Chunk &c);
+    bool ok() const { return done && !error; }
+
+private:
+    const uint8_t *src;
+    size_t len;
+    uint64_t pos;
+    bool done, error;
+};
+
+// ---------------- files ----------------
+
+inline bool hasMagic(const uint8_t *src, size_t len, const char *magic) {
+    return len >= 4 && std::memcmp(src, magic, 4) == 0;
+}
+
+// INFO and DATA of a well-formed file
+struct ContainerView {
+    Chunk info, data;
+};
+
+// Check magic, framing and head checksums; INFO must come before DATA.
+CodecStatus readContainer(const uint8_t *src, size_t len, const char *magic, ContainerView &view);
+
+// Magic, INFO and the head of DATA from the first len bytes of a file, for
+// decoders that can make use of part of the payload. INFO is checked as by
+// readContainer; of DATA only tag and length are known, since its checksums
+// follow the body. `available` receives how much of the body lies in src.
+CodecStatus readContainerPrefix(const uint8_t *src, size_t len, const char *magic, ContainerView &view,
+                                uint64_t &available);
+
+// Check every chunk against its checksums (bodies included) without
+// decoding; report (optional) receives the details.
+CodecStatus verifyContainer(const uint8_t *src, size_t len, const char *magic, ChecksumReport *report = nullptr);
+
+// Encoders write the payload at dst + kPayloadReserve, where it fits in
+// front of any header, and finishContainer then lays the file out around
+// it: magic, INFO, the payload moved down behind its DATA head, checksums
+// and END. Returns the file size; capacity must be at least
+// kPayloadReserve + payloadBytes + containerTail(payloadBytes). The reserve
+// holds the largest INFO chunk (its length varint included) and a DATA head
+// with a full-width length.
+static const size_t kPayloadReserve = 4 + chunkSize(kMaxInfoBytes) + (4 + kMaxVarint);
+
+inline uint64_t containerTail(uint64_t payloadBytes) { return checksumTrailerSize(payloadBytes) + chunkSize(0); }
+
+uint64_t finishContainer(uint8_t *dst, const char *magic, const FieldWriter &info, size_t payloadBytes);
+
+#endif
@@ -0,0 +1,101 @@
+#include "entropy_coder.hpp"
+#include <cstdlib>
+#include <initializer_list>
+
+const char *backendName(int backend) {
+    switch (backend) {
+    case BACKEND_GOLOMB: return "golomb";
+    case BACKEND_RANGE: return "range";
+    case BACKEND_RANS: return "rans";
+    }
+    return "unknown";
+}
+
+int parseBackend(const char *name) {
+    for (int b = BACKEND_GOLOMB; b <= BACKEND_RANS; ++b) {
+        if (std::strcmp(name, backendName(b)) == 0) return b;
+    }
+    char *end;
+    long v = std::strtol(name, &end, 10);
+    if (*name && !*end && v >= BACKEND_GOLOMB && v <= BACKEND_RANS) return (int)v;
+    return -1;
+}
+
+// ---------------- RangeEncoder / RangeDecoder ----------------
+RangeEncoder::RangeEncoder(uint8_t *dst_, size_t capacityBytes)
+    : dst(dst_), cap(capacityBytes), nbytes(0), low(0), range(0xFFFFFFFFu), cache(0), cacheSize(1),
+      overflow(false) {}
+
+// emit the top byte of low, holding back 0xFF bytes until a carry is resolved
+void RangeEncoder::shiftLow() {
+    if ((uint32_t)low < 0xFF000000u || (low >> 32) != 0) {
+        uint8_t carry = uint8_t(low >> 32);
+        uint8_t temp = cache;
+        do {
+            put(uint8_t(temp + carry));
+            temp = 0xFF;
+        } while (--cacheSize != 0);
+        cache = uint8_t(low >> 24);
+    }
+    ++cacheSize;
+    low = (low & 0x00FFFFFFu) << 8;
+}
+
+size_t RangeEncoder::finish() {
+    for (int i = 0; i < 5; ++i) shiftLow();
+    return nbytes;
+}
+
+RangeDecoder::RangeDecoder(const uint8_t *src_, size_t len_)
+    : src(src_), len(len_), pos(0), code(0), range(0xFFFFFFFFu), error(false) {
+    // the first byte is always the encoder's initial (zero) cache byte
+    for (int i = 0; i < 5; ++i) code = (code << 8) | next();
+}
+
+// ---------------- RansEncoder / RansDecoder ----------------
+RansEncoder::RansEncoder(uint8_t *dst_, size_t capacityBytes)
+    : dst(dst_), cap(capacityBytes), nbytes(0), nrec(0), overflow(false), rec(kChunk), stage(kChunk * 2 + 8) {}
+
+// Code the buffered decisions last to first; decision i uses state i & 1.
+// Layout of a chunk: u32 x0 | u32 x1 (little endian) | renormalisation bytes.
+void RansEncoder::flushChunk() {
+    uint32_t x[2] = {kRansL, kRansL};
+    uint8_t *const end = stage.data() + stage.size();
+    uint8_t *p = end;
+    for (int i = nrec - 1; i >= 0; --i) {
+        uint32_t start = rec[i] & 0xFFFF, freq = rec[i] >> 16;
+        uint32_t &s = x[i & 1];
+        uint32_t xmax = ((kRansL >> kProbBits) << 8) * freq;
+        while (s >= xmax) { *--p = uint8_t(s); s >>= 8; }
+        s = ((s / freq) << kProbBits) + (s % freq) + start;
+    }
+    for (int j = 1; j >= 0; --j) {
+        p -= 4;
+        p[0] = uint8_t(x[j]); p[1] = uint8_t(x[j] >> 8); p[2] = uint8_t(x[j] >> 16); p[3] = uint8_t(x[j] >> 24);
+    }
+    size_t n = end - p;
+    if (nbytes + n <= cap) std::memcpy(dst + nbytes, p, n);
+    else overflow = true;
+    nbytes += n;
+    nrec = 0;
+}
+
+size_t RansEncoder::finish() {
+    if (nrec) flushChunk();
+    return nbytes;
+}
+
+RansDecoder::RansDecoder(const uint8_t *src_, size_t len_)
+    : src(src_), len(len_), pos(0), nrec(RansEncoder::kChunk), x0(0), x1(0), error(false) {}
+
+void RansDecoder::startChunk() {
+    // a fully decoded chunk returns both states to their initial value
+    if (pos != 0 && (x0 != kRansL || x1 != kRansL)) error = true;
+    for (uint32_t *s : {&x0, &x1}) {
+        *s = next();
+        *s |= (uint32_t)next() << 8;
+        *s |= (uint32_t)next() << 16;
+        *s |= (uint32_t)next() << 24;
+    }
+    nrec = 0;
+}
@@ -0,0 +1,275 @@
+#ifndef ENTROPY_CODER_HPP
+#define ENTROPY_CODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Adaptive binary entropy coders used as an alternative to Golomb codes.
+// Residuals are mapped to zig-zag values z and binarised as
+//   k = bit length of z           -> adaptive bits walking from a pivot, per context
+//   first bit below the MSB of z  -> adaptive bit, per (context, k)
+//   remaining low bits            -> equiprobable bits, up to 12 per call
+// so a very likely value (e.g. 0 in silence or a flat area) costs a small
+// fraction of a bit instead of Golomb's minimum of one bit.
+//
+// Two backends share that binarisation:
+//   BACKEND_RANGE : LZMA-style binary range coder (carry-less byte output)
+//   BACKEND_RANS  : rANS with two interleaved states; the encoder buffers a
+//                   chunk of decisions and codes it backwards so the decoder
+//                   runs forwards without any division
+// Like BitSink, encoders write into caller memory and keep counting bytes
+// after the capacity is exceeded so the needed size is known. The rANS
+// encoder holds its chunk of decisions on the heap (96 KB), the decoders and
+// the range encoder never allocate.
+
+enum EntropyBackend : int {
+    BACKEND_GOLOMB = 0,
+    BACKEND_RANGE = 1,
+    BACKEND_RANS = 2
+};
+
+const char *backendName(int backend);
+// "golomb" / "range" / "rans" (or the number); returns -1 if unknown
+int parseBackend(const char *name);
+
+static const int kProbBits = 12;
+static const uint32_t kProbOne = 1u << kProbBits;
+
+// Probabilities are P(bit == 0) in 1/4096 units. Each update moves p 1/32 of
+// the way towards 31 or 4065, so p stays within [30, 4065], no decision costs
+// more than about 7.1 bits, and the update compiles without a branch.
+inline void adaptProb(uint16_t &p, int bit) {
+    int target = bit ? 31 : (int)kProbOne - 31;
+    p = uint16_t(p + ((target - (int)p) >> 5));
+}
+
+// ---------------- range coder ----------------
+
+class RangeEncoder {
+public:
+    RangeEncoder(uint8_t *dst, size_t capacityBytes);
+    void encodeBit(uint16_t &p, int bit) {
+        uint32_t bound = (range >> kProbBits) * p;
+        if (bit) { low += bound; range -= bound; }
+        else range = bound;
+        adaptProb(p, bit);
+        while (range < (1u << 24)) { range <<= 8; shiftLow(); }
+    }
+    // n (1..12) equiprobable bits
+    void encodeBits(uint32_t value, int n) {
+        range >>= n;
+        low += (uint64_t)value * range;
+        while (range < (1u << 24)) { range <<= 8; shiftLow(); }
+    }
+    // flush the coder state; returns bytes used (including dropped ones)
+    size_t finish();
+    bool overflowed() const { return overflow; }
+
+private:
+    uint8_t *dst;
+    size_t cap;
+    size_t nbytes;
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint64_t cacheSize;
+    bool overflow;
+
+    void shiftLow();
+    void put(uint8_t b) {
+        if (nbytes < cap) dst[nbytes] = b; else overflow = true;
+        ++nbytes;
+    }
+};
+
+class RangeDecoder {
+public:
+    RangeDecoder(const uint8_t *src, size_t len);
+    int decodeBit(uint16_t &p) {
+        uint32_t bound = (range >> kProbBits) * p;
+        int bit = code >= bound;
+        code -= bit ? bound : 0;
+        range = bit ? range - bound : bound;
+        adaptProb(p, bit);
+        // one decision shrinks range by less than 2^8, so one byte renormalises
+        if (range < (1u << 24)) { range <<= 8; code = (code << 8) | next(); }
+        return bit;
+    }
+    uint32_t decodeBits(int n) {
+        range >>= n;
+        uint32_t v = code / range;
+        if (v >> n) { v = (1u << n) - 1; error = true; }
+        code -= v * range;
+        while (range < (1u << 24)) { range <<= 8; code = (code << 8) | next(); }
+        return v;
+    }
+    bool ok() const { return !error; }
+
+private:
+    const uint8_t *src;
+    size_t len;
+    size_t pos;
+    uint32_t code;
+    uint32_t range;
+    bool error;
+
+    uint8_t next() {
+        if (pos < len) return src[pos++];
+        error = true;
+        return 0;
+    }
+};
+
+// ---------------- interleaved rANS ----------------
+
+static const uint32_t kRansL = 1u << 23; // lower bound of the normalised state
+
+class RansEncoder {
+public:
+    // decisions coded per chunk; each chunk starts with both 32-bit states
+    static const int kChunk = 16384;
+
+    RansEncoder(uint8_t *dst, size_t capacityBytes);
+    void encodeBit(uint16_t &p, int bit) {
+        put(bit ? p : 0, bit ? kProbOne - p : p);
+        adaptProb(p, bit);
+    }
+    void encodeBits(uint32_t value, int n) { put(value << (kProbBits - n), 1u << (kProbBits - n)); }
+    size_t finish();
+    bool overflowed() const { return overflow; }
+
+private:
+    uint8_t *dst;
+    size_t cap;
+    size_t nbytes;
+    int nrec;
+    bool overflow;
+    std::vector<uint32_t> rec;              // kChunk of start | freq << 16, in coding order
+    std::vector<uint8_t> stage;             // chunk output, filled backwards (96 KB together)
+
+    void put(uint32_t start, uint32_t freq) {
+        rec[nrec++] = start | freq << 16;
+        if (nrec == kChunk) flushChunk();
+    }
+    void flushChunk();
+};
+
+class RansDecoder {
+public:
+    RansDecoder(const uint8_t *src, size_t len);
+    int decodeBit(uint16_t &p) {
+        nextState();
+        uint32_t slot = x0 & (kProbOne - 1);
+        int bit = slot >= p;
+        uint32_t freq = bit ? kProbOne - p : p;
+        uint32_t start = bit ? p : 0;
+        x0 = freq * (x0 >> kProbBits) + slot - start;
+        // one decision costs under 8 bits, so at most one byte renormalises
+        if (x0 < kRansL) x0 = (x0 << 8) | next();
+        adaptProb(p, bit);
+        return bit;
+    }
+    uint32_t decodeBits(int n) {
+        nextState();
+        int shift = kProbBits - n;
+        uint32_t slot = x0 & (kProbOne - 1);
+        x0 = (1u << shift) * (x0 >> kProbBits) + (slot & ((1u << shift) - 1));
+        while (x0 < kRansL) x0 = (x0 << 8) | next();
+        return slot >> shift;
+    }
+    bool ok() const { return !error && pos <= len; }
+
+private:
+    const uint8_t *src;
+    size_t len;
+    size_t pos;
+    int nrec;        // decisions decoded in the current chunk
+    uint32_t x0, x1; // x0 serves the next decision; the two states alternate
+    bool error;
+
+    // past the end the stream reads as zeros and pos keeps counting (ok() fails)
+    uint8_t next() {
+        uint8_t b = pos < len ? src[pos] : 0;
+        ++pos;
+        return b;
+    }
+    // rotate to the state of the next decision; chunk boundaries reload both
+    void nextState() {
+        if (nrec == RansEncoder::kChunk) startChunk();
+        else if (nrec) std::swap(x0, x1);
+        ++nrec;
+    }
+    void startChunk();
+};
+
+// ---------------- residual binarisation ----------------
+
+struct ResidualModel {
+    static const int kMaxContexts = 40;
+    static const int kMaxClasses = 32;
+
+    int classes;                                  // possible k values (0 .. classes-1)
+    uint16_t side[kMaxContexts];                  // k >= pivot ?
+    uint16_t up[kMaxContexts][kMaxClasses];       // walking up from the pivot: k > j ?
+    uint16_t down[kMaxContexts][kMaxClasses];     // walking down below the pivot: k < j ?
+    uint16_t mant[kMaxContexts][kMaxClasses];     // first bit below the MSB, per k
+
+    explicit ResidualModel(int classes_) : classes(classes_) {
+        for (int c = 0; c < kMaxContexts; ++c) {
+            side[c] = kProbOne / 2;
+            for (int j = 0; j < kMaxClasses; ++j) up[c][j] = down[c][j] = mant[c][j] = kProbOne / 2;
+        }
+    }
+};
+
+// k is coded as a walk away from the caller's pivot (the expected bit length
+// in this context), so typical values take two or three decisions.
+template <class Enc>
+inline void encodeResidual(Enc &e, ResidualModel &m, int ctx, int pivot, uint32_t z) {
+    int k = z ? 32 - __builtin_clz(z) : 0;
+    if (pivot > 0) e.encodeBit(m.side[ctx], k >= pivot);
+    if (k >= pivot) {
+        for (int j = pivot; j < m.classes - 1; ++j) {
+            e.encodeBit(m.up[ctx][j], k > j);
+            if (k == j) break;
+        }
+    } else {
+        for (int j = pivot - 1; j > 0; --j) {
+            e.encodeBit(m.down[ctx][j], k < j);
+            if (k == j) break;
+        }
+    }
+    if (k < 2) return;
+    int nb = k - 2; // bits below the first mantissa bit
+    e.encodeBit(m.mant[ctx][k], (z >> nb) & 1);
+    while (nb > 0) {
+        int n = nb < 12 ? nb : 12;
+        nb -= n;
+        e.encodeBits((z >> nb) & ((1u << n) - 1), n);
+    }
+}
+
+template <class Dec>
+inline uint32_t decodeResidual(Dec &d, ResidualModel &m, int ctx, int pivot) {
+    int k = pivot;
+    if (pivot == 0 || d.decodeBit(m.side[ctx])) {
+        while (k < m.classes - 1 && d.decodeBit(m.up[ctx][k])) ++k;
+    } else {
+        k = pivot - 1;
+        while (k > 0 && d.decodeBit(m.down[ctx][k])) --k;
+    }
+    if (k < 2) return (uint32_t)k;
+    int nb = k - 2;
+    uint32_t z = 2 | d.decodeBit(m.mant[ctx][k]);
+    while (nb > 0) {
+        int n = nb < 12 ? nb : 12;
+        nb -= n;
+        z = z << n | d.decodeBits(n);
+    }
+    return z;
+}
+
+#endif
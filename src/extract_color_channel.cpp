@@ -1,61 +1,196 @@
 #include <opencv2/opencv.hpp>
+#include "pixel_ops.hpp"
+#include "image_coder.hpp"
+#include "netpbm.hpp"
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
+
+static const char* kChannelNames[3] = {"Blue", "Green", "Red"};
+static const char* kChannelSuffix[3] = {"_b", "_g", "_r"};
+
+static void print_usage(const char* prog) {
+	std::cerr << "Usage: " << prog << " <input_image> <output_image> <channel_index>\n"
+			  << "       " << prog << " <input_image> <output> <channels> [--planar] [--gimg [predictor]]\n"
+			  << "channel_index: 0=Blue 1=Green 2=Red (OpenCV BGR)\n"
+			  << "channels: 'all' or any combination of indices (e.g. '02'); all selected planes\n"
+			  << "          are split from a single read of the input.\n"
+			  << "  (default)  one file per plane: <output> with _b/_g/_r inserted before the extension\n"
+			  << "  --planar   one PGM with the selected planes stacked vertically (B, G, R order)\n"
+			  << "  --gimg     encode each plane in-process with the Golomb image codec (.gimg)\n"
+			  << "input_image may also be a gzip-compressed PPM (.ppm.gz)\n";
+}
+
+// "out.pgm" + "_r" -> "out_r.pgm"; the extension is replaced by `ext` when given
+static std::string plane_path(const std::string& base, const char* suffix, const std::string& ext = "") {
+	size_t slash = base.find_last_of("/\\");
+	size_t dot = base.find_last_of('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = base.size();
+	std::string e = ext.empty() ? base.substr(dot) : ext;
+	if (e.empty()) e = ".pgm";
+	return base.substr(0, dot) + suffix + e;
+}
 
 int main(int argc, char* argv[]) {
-	if (argc != 4) {
-		std::cerr << "Usage: " << argv[0] << " <input_image> <output_image> <channel_index>\n"
-				  << "channel_index: 0=Blue 1=Green 2=Red (OpenCV BGR)\n";
+	if (argc < 4) {
+		print_usage(argv[0]);
 		return 1;
 	}
 
 	std::string inputPath = argv[1];
 	std::string outputPath = argv[2];
-	int channelIndex;
-	try {
-		channelIndex = std::stoi(argv[3]);
-	} catch (const std::exception&) {
-		std::cerr << "Invalid channel index (must be an integer 0-2).\n";
+	std::string channelArg = argv[3];
+
+	bool selected[3] = {false, false, false};
+	if (channelArg == "all") {
+		selected[0] = selected[1] = selected[2] = true;
+	} else {
+		for (char ch : channelArg) {
+			if (ch < '0' || ch > '9') {
+				std::cerr << "Invalid channel index (must be an integer 0-2).\n";
+				return 1;
+			}
+			if (ch > '2') {
+				std::cerr << "Channel index out of range (expected 0,1,2).\n";
+				return 1;
+			}
+			selected[ch - '0'] = true;
+		}
+	}
+	int nselected = selected[0] + selected[1] + selected[2];
+	if (nselected == 0) {
+		std::cerr << "No channel selected.\n";
 		return 1;
 	}
 
-	if (channelIndex < 0 || channelIndex > 2) {
-		std::cerr << "Channel index out of range (expected 0,1,2).\n";
+	bool planar = false, gimg = false;
+	int predictor = PRED_MEDIAN;
+	for (int i = 4; i < argc; ++i) {
+		std::string opt = argv[i];
+		if (opt == "--planar") {
+			planar = true;
+		} else if (opt == "--gimg") {
+			gimg = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-') predictor = std::atoi(argv[++i]);
+		} else {
+			std::cerr << "Unknown option: " << opt << "\n";
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (planar && gimg) {
+		std::cerr << "--planar and --gimg are mutually exclusive.\n";
 		return 1;
 	}
 
-	// Read the input image as color (this ensures we have 3 channels in BGR order)
-	cv::Mat color = cv::imread(inputPath, cv::IMREAD_COLOR);
-	if (color.empty()) {
-		std::cerr << "Failed to read image: " << inputPath << "\n";
-		return 1;
+	// Read the input image as color (this ensures we have 3 channels in BGR order).
+	// Gzip netpbm input, which OpenCV cannot read, is inflated on a worker thread
+	// and split band by band as its rows arrive.
+	const bool gz = isGzipFile(inputPath);
+	NetpbmReader gzIn;
+	cv::Mat color;
+	std::string err;
+	if (gz) {
+		if (!gzIn.open(inputPath, err)) {
+			std::cerr << "Failed to read image: " << inputPath << " (" << err << ")\n";
+			return 1;
+		}
+	} else {
+		color = cv::imread(inputPath, cv::IMREAD_COLOR);
+		if (color.empty()) {
+			std::cerr << "Failed to read image: " << inputPath << "\n";
+			return 1;
+		}
 	}
+	const int channels = gz ? gzIn.channels : color.channels();
+	const int rows = gz ? gzIn.height : color.rows, cols = gz ? gzIn.width : color.cols;
 
-	if (color.channels() != 3) {
-		std::cerr << "Input image must have 3 channels (BGR). Got " << color.channels() << " channels.\n";
+	if (channels != 3) {
+		std::cerr << "Input image must have 3 channels (BGR). Got " << channels << " channels.\n";
 		return 1;
 	}
 
-	// Create single-channel output image with same width/height, 8-bit
-	cv::Mat singleChannel(color.rows, color.cols, CV_8UC1);
+	// Planes are slices of one CV_8UC1 image, stacked vertically in B, G, R order
+	// (this is also the --planar output layout)
+	cv::Mat planes(rows * nselected, cols, CV_8UC1);
+	int planeRow[3] = {-1, -1, -1};
+	for (int k = 0, slot = 0; k < 3; ++k) {
+		if (selected[k]) planeRow[k] = (slot++) * rows;
+	}
+	auto split = [&](const unsigned char* src, int r) {
+		unsigned char* dst[3];
+		for (int k = 0; k < 3; ++k) dst[k] = selected[k] ? planes.ptr<unsigned char>(planeRow[k] + r) : nullptr;
+		deinterleave3(src, cols, dst[0], dst[1], dst[2]);
+	};
 
-	// Pixel-by-pixel extraction
-	for (int r = 0; r < color.rows; ++r) {
-		const cv::Vec3b* srcRow = color.ptr<cv::Vec3b>(r);
-		unsigned char* dstRow = singleChannel.ptr<unsigned char>(r);
-		for (int c = 0; c < color.cols; ++c) {
-			dstRow[c] = srcRow[c][channelIndex];
+	if (gz) {
+		const int bandRows = 64;
+		std::vector<unsigned char> band(static_cast<size_t>(bandRows) * cols * 3);
+		for (int r0 = 0; r0 < rows; r0 += bandRows) {
+			int n = std::min(bandRows, rows - r0);
+			if (!gzIn.readRows(band.data(), static_cast<size_t>(cols) * 3, n, err, true)) {
+				std::cerr << "Failed to read image: " << inputPath << " (" << err << ")\n";
+				return 1;
+			}
+			for (int r = 0; r < n; ++r) split(band.data() + static_cast<size_t>(r) * cols * 3, r0 + r);
 		}
+	} else {
+		// Vectorised deinterleave of all selected channels in one pass, split across threads by row bands
+		parallelRows(rows, static_cast<size_t>(cols) * 3, [&](int r0, int r1) {
+			for (int r = r0; r < r1; ++r) split(color.ptr<unsigned char>(r), r);
+		});
 	}
 
-	// Write output image
-	if (!cv::imwrite(outputPath, singleChannel)) {
-		std::cerr << "Failed to write output image: " << outputPath << "\n";
-		return 1;
+	if (gimg) {
+		for (int k = 0; k < 3; ++k) {
+			if (!selected[k]) continue;
+			std::vector<uint8_t> encoded(imageEncodedBound(cols, rows));
+			size_t written = 0; ImageInfo info;
+			CodecStatus st = encodeImagePlane(planes.ptr<unsigned char>(planeRow[k]), cols, rows,
+											  planes.step, predictor, encoded.data(), encoded.size(), written, &info);
+			if (st != CodecStatus::Ok) {
+				std::cerr << "Encode failed: " << codecStatusString(st) << "\n";
+				return 1;
+			}
+			std::string path = nselected == 1 && channelArg != "all" ? outputPath
+																		: plane_path(outputPath, kChannelSuffix[k], ".gimg");
+			std::ofstream ofs(path, std::ios::binary);
+			if (!ofs || !ofs.write(reinterpret_cast<const char*>(encoded.data()), written)) {
+				std::cerr << "Failed to write output: " << path << "\n";
+				return 1;
+			}
+			std::cout << "Encoded channel " << k << " (" << kChannelNames[k] << ") to '" << path
+					  << "' m=" << info.m << " bits=" << info.nbits << "\n";
+		}
+		return 0;
 	}
 
-	std::cout << "Extracted channel " << channelIndex << " (" << (channelIndex==0?"Blue":channelIndex==1?"Green":"Red")
-			  << ") from '" << inputPath << "' to '" << outputPath << "'\n";
+	if (planar || nselected == 1) {
+		// Write output image
+		if (!cv::imwrite(outputPath, planes)) {
+			std::cerr << "Failed to write output image: " << outputPath << "\n";
+			return 1;
+		}
+		if (nselected == 1) {
+			int k = selected[0] ? 0 : selected[1] ? 1 : 2;
+			std::cout << "Extracted channel " << k << " (" << kChannelNames[k]
+					  << ") from '" << inputPath << "' to '" << outputPath << "'\n";
+		} else {
+			std::cout << "Wrote " << nselected << " planes (planar) from '" << inputPath << "' to '" << outputPath << "'\n";
+		}
+		return 0;
+	}
+
+	for (int k = 0; k < 3; ++k) {
+		if (!selected[k]) continue;
+		std::string path = plane_path(outputPath, kChannelSuffix[k]);
+		if (!cv::imwrite(path, planes.rowRange(planeRow[k], planeRow[k] + rows))) {
+			std::cerr << "Failed to write output image: " << path << "\n";
+			return 1;
+		}
+		std::cout << "Extracted channel " << k << " (" << kChannelNames[k] << ") from '" << inputPath << "' to '" << path << "'\n";
+	}
 	return 0;
 }
-
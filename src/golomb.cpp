@@ -1,9 +1,16 @@
 #include "golomb.hpp"
+#include <algorithm>
 #include <stdexcept>
+#include <cstring>
 #include <vector>
 #include <limits>
 #include <iostream>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GOLOMB_X86 1
+#endif
+
 // ---------------- BitWriter implementation ----------------
 void BitWriter::writeBit(bool b) {
     bits.push_back(b ? '1' : '0');
@@ -34,6 +41,93 @@ uint64_t BitReader::readBits(int count) {
     return v;
 }
 
+const char *codecStatusString(CodecStatus s) {
+    switch (s) {
+    case CodecStatus::Ok: return "ok";
+    case CodecStatus::BufferTooSmall: return "destination buffer too small";
+    case CodecStatus::Corrupt: return "corrupt or truncated input";
+    case CodecStatus::Unsupported: return "unsupported feature";
+    }
+    return "unknown status";
+}
+
+// ---------------- BitSink implementation ----------------
+BitSink::BitSink(uint8_t *dst_, size_t capacityBytes)
+    : dst(dst_), cap(capacityBytes), nbytes(0), acc(0), nacc(0), bits(0), overflow(false) {}
+
+// byte-at-a-time drain used near the end of the destination buffer
+void BitSink::flush() {
+    while (nacc >= 8) {
+        nacc -= 8;
+        uint8_t byte = static_cast<uint8_t>(acc >> nacc);
+        if (nbytes < cap) dst[nbytes] = byte; else overflow = true;
+        ++nbytes;
+    }
+}
+
+void BitSink::writeZeros(uint64_t count) {
+    while (count >= 32) { writeBits(0, 32); count -= 32; }
+    writeBits(0, static_cast<int>(count));
+}
+
+size_t BitSink::finish() {
+    flush();
+    if (nacc > 0) {
+        // zero-pad the final byte; padding is not counted as payload
+        uint8_t byte = static_cast<uint8_t>(acc << (8 - nacc));
+        if (nbytes < cap) dst[nbytes] = byte; else overflow = true;
+        ++nbytes;
+        acc = 0;
+        nacc = 0;
+    }
+    return nbytes;
+}
+
+// ---------------- BitSource implementation ----------------
+BitSource::BitSource(const uint8_t *src_, uint64_t nbits_) : src(src_), nbits(nbits_), pos(0), error(false) {}
+
+uint64_t BitSource::peek64() const {
+    uint64_t byte = pos >> 3;
+    uint64_t nbytes = (nbits + 7) >> 3;
+    uint64_t w = 0;
+    if (byte + 8 <= nbytes) {
+        for (int i = 0; i < 8; ++i) w = (w << 8) | src[byte + i];
+    } else {
+        for (int i = 0; i < 8; ++i) w = (w << 8) | (byte + i < nbytes ? src[byte + i] : 0);
+    }
+    return w << (pos & 7);
+}
+
+uint64_t BitSource::readBits(int count) {
+    if (count <= 0) return 0;
+    if (pos + static_cast<uint64_t>(count) > nbits) {
+        error = true;
+        pos = nbits;
+        return 0;
+    }
+    uint64_t v = peek64() >> (64 - count);
+    pos += static_cast<uint64_t>(count);
+    return v;
+}
+
+uint64_t BitSource::readUnary() {
+    uint64_t zeros = 0;
+    while (true) {
+        if (pos >= nbits) { error = true; return zeros; }
+        uint64_t w = peek64();
+        // only 57 bits of the window are guaranteed; mask the rest off as zeros
+        w &= ~0ULL << 7;
+        if (w != 0) {
+            int lz = __builtin_clzll(w);
+            if (pos + static_cast<uint64_t>(lz) >= nbits) { error = true; pos = nbits; return zeros; }
+            pos += static_cast<uint64_t>(lz) + 1;
+            return zeros + static_cast<uint64_t>(lz);
+        }
+        zeros += 57;
+        pos += 57;
+    }
+}
+
 // ---------------- Golomb implementation ----------------
 Golomb::Golomb(uint64_t m_, NegativeMode negMode_) : m(m_), negMode(negMode_) {
     if (m == 0) throw std::invalid_argument("m must be >= 1");
@@ -44,6 +138,9 @@ Golomb::Golomb(uint64_t m_, NegativeMode negMode_) : m(m_), negMode(negMode_) {
     } else {
         cutoff = (1ULL << b) - m;
     }
+    // Granlund-Montgomery: q = (t + ((n - t) >> 1)) >> (b - 1), t = mulhi(n, divMagic)
+    divMagic = 0;
+    if (cutoff != 0 && b < 32) divMagic = static_cast<uint32_t>(((1ULL << 32) * ((1ULL << b) - m)) / m + 1);
 }
 
 std::string Golomb::encode(int64_t value) const {
@@ -96,6 +193,50 @@ std::pair<uint64_t, size_t> Golomb::decodeUnsignedFromString(const std::string &
     return {v, r.pos};
 }
 
+void Golomb::encode(int64_t value, BitSink &w) const {
+    if (negMode == NegativeMode::SIGN_MAGNITUDE) {
+        w.writeBit(value < 0);
+        encodeUnsigned(value < 0 ? (uint64_t)(-value) : (uint64_t)value, w);
+    } else {
+        encodeUnsigned(toZigZag(value), w);
+    }
+}
+
+int64_t Golomb::decode(BitSource &r) const {
+    if (negMode == NegativeMode::SIGN_MAGNITUDE) {
+        bool sign = r.readBit();
+        uint64_t mag = decodeUnsigned(r);
+        return sign ? -(int64_t)mag : (int64_t)mag;
+    }
+    return fromZigZag(decodeUnsigned(r));
+}
+
+void Golomb::encodeUnsigned(uint64_t n, BitSink &w) const {
+    uint64_t q = n / m;
+    uint64_t r = n % m;
+    w.writeZeros(q);
+    w.writeBit(true);
+    if (m == 1) return;
+    int nb = static_cast<int>(r < cutoff ? b - 1 : b);
+    uint64_t v = r < cutoff ? r : r + cutoff;
+    if (nb > 32) { w.writeBits(v >> 32, nb - 32); nb = 32; } // BitSink takes at most 32 bits per call
+    w.writeBits(v, nb);
+}
+
+uint64_t Golomb::decodeUnsigned(BitSource &r) const {
+    uint64_t q = r.readUnary();
+    if (m == 1) return q;
+    uint64_t x = r.readBits(static_cast<int>(b - 1));
+    if (x >= cutoff) x = ((x << 1) | r.readBits(1)) - cutoff;
+    return q * m + x;
+}
+
+uint64_t Golomb::unsignedLength(uint64_t n) const {
+    uint64_t len = n / m + 1;
+    if (m == 1) return len;
+    return len + ((n % m) < cutoff ? b - 1 : b);
+}
+
 uint64_t Golomb::toZigZag(int64_t x) {
     if (x >= 0) return (uint64_t)x << 1;
     return (uint64_t)((-x << 1) - 1);
@@ -151,4 +292,185 @@ uint64_t Golomb::decodeUnsigned(BitReader &r) const {
         r_value = combined - cutoff;
     }
     return q * m + r_value;
-}  
\ No newline at end of file
+}
+
+// ---------------- bulk array encoding ----------------
+namespace {
+const size_t kLanes = 8;
+
+// Codeword parts for up to kLanes values: q zeros, then `code` in `clen` bits
+// (the terminating '1' followed by the truncated-binary remainder).
+struct CodeSplit {
+    uint32_t q[kLanes];
+    uint32_t code[kLanes];
+    uint32_t clen[kLanes];
+};
+
+struct SplitParams {
+    uint32_t m, b, cutoff, magic;
+    bool pow2, signMag;
+};
+
+void splitScalar(const int32_t *v, size_t cnt, const SplitParams &p, CodeSplit &s) {
+    for (size_t i = 0; i < cnt; ++i) {
+        uint32_t z = p.signMag ? (v[i] < 0 ? 0u - (uint32_t)v[i] : (uint32_t)v[i])
+                               : ((uint32_t)v[i] << 1) ^ (uint32_t)(v[i] >> 31);
+        uint32_t q, r;
+        if (p.pow2) {
+            q = z >> p.b; r = z & (p.m - 1);
+        } else {
+            uint32_t t = (uint32_t)(((uint64_t)z * p.magic) >> 32);
+            q = (t + ((z - t) >> 1)) >> (p.b - 1);
+            r = z - q * p.m;
+        }
+        uint32_t nb = r < p.cutoff ? p.b - 1 : p.b;
+        uint32_t rem = r < p.cutoff ? r : r + p.cutoff;
+        s.q[i] = q;
+        s.code[i] = (1u << nb) | rem;
+        s.clen[i] = nb + 1;
+    }
+}
+
+#ifdef GOLOMB_X86
+__attribute__((target("avx2")))
+void splitAVX2(const int32_t *v, const SplitParams &p, CodeSplit &s) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v));
+    __m256i z = p.signMag ? _mm256_abs_epi32(x)
+                          : _mm256_xor_si256(_mm256_slli_epi32(x, 1), _mm256_srai_epi32(x, 31));
+    const __m256i vm = _mm256_set1_epi32((int)p.m);
+    const __m256i vb = _mm256_set1_epi32((int)p.b);
+    const __m256i vcut = _mm256_set1_epi32((int)p.cutoff);
+    __m256i q, r;
+    if (p.pow2) {
+        q = _mm256_srlv_epi32(z, vb);
+        r = _mm256_and_si256(z, _mm256_set1_epi32((int)(p.m - 1)));
+    } else {
+        const __m256i magic = _mm256_set1_epi32((int)p.magic);
+        __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(z, magic), 32);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(z, 32), magic);
+        __m256i t = _mm256_blend_epi32(even, odd, 0xAA);
+        q = _mm256_add_epi32(t, _mm256_srli_epi32(_mm256_sub_epi32(z, t), 1));
+        q = _mm256_srlv_epi32(q, _mm256_set1_epi32((int)(p.b - 1)));
+        r = _mm256_sub_epi32(z, _mm256_mullo_epi32(q, vm));
+    }
+    // r < cutoff (both < 2^31): one bit shorter remainder, value unchanged
+    __m256i lt = _mm256_cmpgt_epi32(vcut, r);
+    __m256i nb = _mm256_add_epi32(vb, lt);
+    __m256i rem = _mm256_add_epi32(r, _mm256_andnot_si256(lt, vcut));
+    __m256i code = _mm256_or_si256(_mm256_sllv_epi32(_mm256_set1_epi32(1), nb), rem);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s.q), q);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s.code), code);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s.clen), _mm256_add_epi32(nb, _mm256_set1_epi32(1)));
+}
+
+bool haveAVX2() { static const bool v = __builtin_cpu_supports("avx2"); return v; }
+#endif
+
+inline void split(const int32_t *v, size_t cnt, const SplitParams &p, CodeSplit &s) {
+#ifdef GOLOMB_X86
+    if (cnt == kLanes && haveAVX2()) { splitAVX2(v, p, s); return; }
+#endif
+    splitScalar(v, cnt, p, s);
+}
+}
+
+void Golomb::encodeArray(const int32_t *values, size_t n, BitSink &w) const {
+    // the split works on 32-bit lanes; very large m goes through the generic path
+    if (m >= (1ULL << 31)) {
+        for (size_t i = 0; i < n; ++i) encode(values[i], w);
+        return;
+    }
+    const SplitParams p{(uint32_t)m, (uint32_t)b, (uint32_t)cutoff, divMagic, cutoff == 0,
+                        negMode == NegativeMode::SIGN_MAGNITUDE};
+    CodeSplit s;
+    // Branch-free packing on a register copy of the sink state: every codeword
+    // is OR-ed into a 64-bit accumulator and the whole accumulator is stored
+    // big-endian unconditionally; only the completed bytes are kept (nbytes
+    // advances by nacc / 8). This needs 8 bytes of slack at the destination, so
+    // the last few codewords before the end (and every codeword of a sink with
+    // less than 8 bytes, such as a size probe) go through the generic path.
+    w.flush();
+    uint64_t acc = w.acc, bits = w.bits;
+    unsigned nacc = (unsigned)w.nacc;
+    uint8_t *dst = w.dst;
+    size_t nbytes = w.nbytes;
+    // the fast store is taken while nbytes < fastEnd, i.e. nbytes + 8 <= cap
+    const size_t fastEnd = w.cap >= 8 ? w.cap - 7 : 0;
+    for (size_t base = 0; base < n; base += kLanes) {
+        size_t cnt = std::min(kLanes, n - base);
+        split(values + base, cnt, p, s);
+        for (size_t i = 0; i < cnt; ++i) {
+            // 64-bit: q reaches 2^32 - 1 for m = 1
+            const uint64_t total = (uint64_t)s.q[i] + s.clen[i] + (p.signMag ? 1 : 0);
+            if (total > 32 || nbytes >= fastEnd) {
+                // long unary run or close to the end of the buffer: generic path
+                w.acc = acc; w.nacc = (int)nacc; w.nbytes = nbytes; w.bits = bits;
+                if (p.signMag) w.writeBit(values[base + i] < 0);
+                w.writeZeros(s.q[i]);
+                w.writeBits(s.code[i], (int)s.clen[i]);
+                w.flush();
+                acc = w.acc; nacc = (unsigned)w.nacc; nbytes = w.nbytes; bits = w.bits;
+                continue;
+            }
+            uint64_t code = s.code[i];
+            if (p.signMag && values[base + i] < 0) code |= 1ULL << (total - 1);
+            acc = (acc << total) | code;   // nacc <= 7 here, so at most 39 bits are live
+            nacc += (unsigned)total;
+            bits += total;
+            uint64_t be = acc << (64 - nacc);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            be = __builtin_bswap64(be);
+#endif
+            std::memcpy(dst + nbytes, &be, 8);
+            nbytes += nacc >> 3;
+            nacc &= 7;
+        }
+    }
+    w.acc = acc; w.nacc = (int)nacc; w.nbytes = nbytes; w.bits = bits;
+}
+
+uint64_t Golomb::arrayLength(const int32_t *values, size_t n) const {
+    if (m >= (1ULL << 31)) {
+        uint64_t len = 0;
+        for (size_t i = 0; i < n; ++i) {
+            int64_t v = values[i];
+            len += negMode == NegativeMode::SIGN_MAGNITUDE ? 1 + unsignedLength((uint64_t)(v < 0 ? -v : v))
+                                                           : unsignedLength(toZigZag(v));
+        }
+        return len;
+    }
+    const SplitParams p{(uint32_t)m, (uint32_t)b, (uint32_t)cutoff, divMagic, cutoff == 0,
+                        negMode == NegativeMode::SIGN_MAGNITUDE};
+    CodeSplit s;
+    uint64_t len = p.signMag ? n : 0;
+    for (size_t base = 0; base < n; base += kLanes) {
+        size_t cnt = std::min(kLanes, n - base);
+        split(values + base, cnt, p, s);
+        for (size_t i = 0; i < cnt; ++i) len += (uint64_t)s.q[i] + s.clen[i];
+    }
+    return len;
+}
+
+// ---------------- integer array API ----------------
+CodecStatus encodeInts(const int32_t *values, size_t n, uint64_t m, NegativeMode mode,
+                       uint8_t *dst, size_t capacityBytes, uint64_t &bitsOut) {
+    if (m == 0) return CodecStatus::Unsupported;
+    Golomb g(m, mode);
+    BitSink w(dst, capacityBytes);
+    g.encodeArray(values, n, w);
+    w.finish();
+    bitsOut = w.bitCount();
+    return w.overflowed() ? CodecStatus::BufferTooSmall : CodecStatus::Ok;
+}
+
+CodecStatus decodeInts(const uint8_t *src, uint64_t nbits, uint64_t m, NegativeMode mode,
+                       int32_t *out, size_t n) {
+    if (m == 0) return CodecStatus::Unsupported;
+    Golomb g(m, mode);
+    BitSource r(src, nbits);
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<int32_t>(g.decode(r));
+        if (!r.ok()) return CodecStatus::Corrupt;
+    }
+    return CodecStatus::Ok;
+}
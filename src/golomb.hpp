@@ -1,6 +1,7 @@
 #ifndef GOLOMB_HPP
 #define GOLOMB_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <utility>
@@ -30,6 +31,86 @@ public:
     uint64_t readBits(int count);
 };
 
+// Status codes for the buffer-based (allocation-free) encode/decode APIs.
+enum class CodecStatus {
+    Ok,
+    BufferTooSmall, // destination capacity exceeded; the required size is still reported
+    Corrupt,        // malformed or truncated input
+    Unsupported     // valid input using a feature this build does not handle
+};
+
+const char *codecStatusString(CodecStatus s);
+
+// BitSink packs bits MSB-first into caller-provided memory (same layout as
+// packing a BitWriter string). It never allocates; once the capacity is
+// exceeded further bytes are dropped but bitCount() keeps counting, so the
+// caller can learn the required size from a failed attempt.
+class Golomb;
+
+class BitSink {
+public:
+    BitSink(uint8_t *dst, size_t capacityBytes);
+    // append the low `count` bits of value (0 <= count <= 32)
+    void writeBits(uint64_t value, int count) {
+        acc = (acc << count) | (value & ((1ULL << count) - 1));
+        nacc += count;
+        bits += static_cast<uint64_t>(count);
+        if (nacc >= 32) {
+            if (nbytes + 4 <= cap) {
+                uint32_t word = static_cast<uint32_t>(acc >> (nacc - 32));
+                uint8_t *p = dst + nbytes;
+                p[0] = uint8_t(word >> 24); p[1] = uint8_t(word >> 16); p[2] = uint8_t(word >> 8); p[3] = uint8_t(word);
+                nbytes += 4;
+                nacc -= 32;
+            } else {
+                flush();
+            }
+        }
+    }
+    void writeBit(bool b) { writeBits(b ? 1u : 0u, 1); }
+    void writeZeros(uint64_t count);
+    // pad the last partial byte with zeros and flush; returns bytes used
+    size_t finish();
+    uint64_t bitCount() const { return bits; }
+    bool overflowed() const { return overflow; }
+
+private:
+    friend class Golomb; // encodeArray runs its packing loop on a register copy of the state
+
+    uint8_t *dst;
+    size_t cap;
+    size_t nbytes;  // bytes emitted so far (including dropped ones)
+    uint64_t acc;   // pending bits, right-aligned (bits above nacc are stale)
+    int nacc;       // number of pending bits (< 32 between calls)
+    uint64_t bits;
+    bool overflow;
+
+    void flush();
+};
+
+// BitSource reads MSB-first packed bits from caller memory. Reading past the
+// end yields zero bits and latches an error flag (no exceptions thrown).
+class BitSource {
+public:
+    BitSource(const uint8_t *src, uint64_t nbits);
+    bool readBit() { return readBits(1) != 0; }
+    // read `count` bits (count <= 57)
+    uint64_t readBits(int count);
+    // count zero bits up to and including the terminating '1'; returns the zero count
+    uint64_t readUnary();
+    uint64_t position() const { return pos; }
+    uint64_t size() const { return nbits; }
+    bool ok() const { return !error; }
+
+private:
+    const uint8_t *src;
+    uint64_t nbits;
+    uint64_t pos;
+    bool error;
+
+    uint64_t peek64() const; // 64 bits from pos, MSB-aligned; at least 57 are valid
+};
+
 // Golomb coder class
 class Golomb {
 public:
@@ -43,6 +124,25 @@ public:
     // Returns pair(value, bits_consumed).
     std::pair<int64_t, size_t> decode(const std::string &bits) const;
 
+    // Packed-stream variants (no allocation). Errors are reported through
+    // BitSink::overflowed() / BitSource::ok().
+    void encode(int64_t value, BitSink &w) const;
+    int64_t decode(BitSource &r) const;
+    void encodeUnsigned(uint64_t n, BitSink &w) const;
+    uint64_t decodeUnsigned(BitSource &r) const;
+
+    // Length in bits of the codeword for unsigned value n
+    uint64_t unsignedLength(uint64_t n) const;
+
+    // Bulk path: zig-zag (or sign split), quotient/remainder and codeword
+    // lengths are computed for several values at once (AVX2 when the CPU has
+    // it), then emitted with one packed write per codeword. Produces the same
+    // bits as calling encode() on every value.
+    void encodeArray(const int32_t *values, size_t n, BitSink &w) const;
+
+    // Total code length in bits of n values, computed the same way without emitting
+    uint64_t arrayLength(const int32_t *values, size_t n) const;
+
     // Convenience helpers for unsigned values
     std::string encodeUnsignedToString(uint64_t value) const;
     std::pair<uint64_t, size_t> decodeUnsignedFromString(const std::string &bits) const;
@@ -52,6 +152,7 @@ private:
     uint64_t b;       // ceil(log2(m))
     uint64_t cutoff;  // (1<<b) - m
     NegativeMode negMode;
+    uint32_t divMagic; // multiply-high reciprocal of m (3 <= m < 2^31, not a power of two)
 
     static uint64_t toZigZag(int64_t x);
     static int64_t fromZigZag(uint64_t z);
@@ -60,4 +161,13 @@ private:
     uint64_t decodeUnsigned(BitReader &r) const;
 };
 
-#endif
\ No newline at end of file
+// Encode n integers into caller memory (interleaved mode uses zig-zag).
+// bitsOut receives the exact stream length in bits, even on BufferTooSmall.
+CodecStatus encodeInts(const int32_t *values, size_t n, uint64_t m, NegativeMode mode,
+                       uint8_t *dst, size_t capacityBytes, uint64_t &bitsOut);
+
+// Decode exactly n integers from an nbits-long packed stream.
+CodecStatus decodeInts(const uint8_t *src, uint64_t nbits, uint64_t m, NegativeMode mode,
+                       int32_t *out, size_t n);
+
+#endif
@@ -1,280 +1,346 @@
 #include <bits/stdc++.h>
 using namespace std;
 
-#include "golomb.hpp"
-
-// keeping memory offsets continuous
-#pragma pack(push,1)
-struct WAVHeader {
-    char riff[4];
-    uint32_t overall_size;
-    char wave[4];
-    char fmt_chunk_marker[4];
-    uint32_t length_of_fmt;
-    uint16_t format_type;
-    uint16_t channels;
-    uint32_t sample_rate;
-    uint32_t byterate;
-    uint16_t block_align;
-    uint16_t bits_per_sample;
-    char data_chunk_header[4];
-    uint32_t data_size;
-};
-#pragma pack(pop)
-
-#pragma pack(push,1)
-struct GBLHeader {
-    char magic[4]; // "GBL1"
-    uint16_t channels;
-    uint32_t sample_rate;
-    uint32_t num_frames;
-    uint16_t bits_per_sample;
-    uint8_t neg_mode;
-};
-#pragma pack(pop)
-
-bool readWav(const string &filename, WAVHeader &hdr, vector<int16_t> &samples) {
-    ifstream f(filename, ios::binary);
-    if (!f) return false;
-    f.read(reinterpret_cast<char*>(&hdr), sizeof(WAVHeader));
-    if (!f) return false;
-    if (strncmp(hdr.riff, "RIFF", 4) != 0 || strncmp(hdr.wave, "WAVE", 4) != 0) {
-        cerr << "readWav: not a RIFF/WAVE file\n";
-        return false;
-    }
-    if (hdr.format_type != 1 || hdr.bits_per_sample != 16) {
-        cerr << "readWav: only PCM16 supported\n";
-        return false;
-    }
-    size_t totalSamples = hdr.data_size / (hdr.bits_per_sample / 8);
-    samples.resize(totalSamples);
-    f.read(reinterpret_cast<char*>(samples.data()), hdr.data_size);
+#include "audio_coder.hpp"
+#include "entropy_coder.hpp"
+#include "pipeline.hpp"
+#include "wav_io.hpp"
+
+// --stats prints a per-stage report to stderr, --stats-json writes it as JSON ("-" = stdout)
+static bool reportStats(const CodecStats &stats, bool table, const string &jsonPath) {
+    if (table) stats.printTable(cerr);
+    if (jsonPath.empty()) return true;
+    if (jsonPath == "-") { stats.writeJson(cout); return true; }
+    ofstream f(jsonPath);
+    if (!f) { cerr << "Cannot write stats: " << jsonPath << "\n"; return false; }
+    stats.writeJson(f);
     return true;
 }
 
-bool writeWav(const string &filename, const WAVHeader &tmpl, const vector<int16_t> &samples) {
-    ofstream f(filename, ios::binary);
+static bool readFile(const string &filename, vector<uint8_t> &bytes) {
+    ifstream f(filename, ios::binary | ios::ate);
     if (!f) return false;
-    WAVHeader hdr = tmpl;
-    hdr.data_size = static_cast<uint32_t>(samples.size() * sizeof(int16_t));
-    hdr.overall_size = 36 + hdr.data_size;
-    f.write(reinterpret_cast<const char*>(&hdr), sizeof(WAVHeader));
-    f.write(reinterpret_cast<const char*>(samples.data()), hdr.data_size);
-    return true;
+    bytes.resize((size_t)f.tellg());
+    f.seekg(0);
+    return bool(f.read(reinterpret_cast<char*>(bytes.data()), bytes.size()));
 }
 
-void packBitsToBytes(const string &bits, vector<uint8_t> &outBytes) {
-    size_t nbits = bits.size();
-    size_t nbytes = (nbits + 7) / 8;
-    outBytes.assign(nbytes, 0);
-    for (size_t i = 0; i < nbits; ++i) {
-        if (bits[i] == '1') outBytes[i/8] |= (1u << (7 - (i%8)));
-    }
+static string profileName(uint32_t id) {
+    char buf[9];
+    snprintf(buf, sizeof buf, "%08x", id);
+    return buf;
 }
 
-string unpackBytesToBits(const vector<uint8_t> &bytes, size_t nbits) {
-    string bits;
-    bits.reserve(nbits);
-    for (size_t i = 0; i < nbits; ++i) {
-        uint8_t b = bytes[i/8];
-        bool bit = ((b >> (7 - (i%8))) & 1u) != 0;
-        bits.push_back(bit ? '1' : '0');
+// --profile: the trained profile to code from / decode with
+static bool loadProfile(const string &path, CodecProfile &profile) {
+    vector<uint8_t> bytes;
+    if (!readFile(path, bytes)) { cerr << "Failed to read profile: " << path << "\n"; return false; }
+    CodecStatus st = readProfile(bytes.data(), bytes.size(), profile);
+    if (st == CodecStatus::Ok && profile.kind != PROFILE_AUDIO) st = CodecStatus::Unsupported;
+    if (st != CodecStatus::Ok) {
+        cerr << "Invalid audio profile: " << path << " (" << codecStatusString(st) << ")\n";
+        return false;
     }
-    return bits;
+    return true;
 }
 
-// compute m from EMA of absolute residuals.
-static uint64_t choose_m_from_ema(double ema) {
-    double r = floor(ema + 0.5);
-    uint64_t m = (uint64_t)max<double>(1.0, r);
-    return m;
+// "" if the file can be decoded with profile (which may be null)
+static string missingProfile(const AudioInfo &info, const CodecProfile *profile) {
+    if (!info.profile || (profile && profile->id == info.profile)) return "";
+    return "coded with profile " + profileName(info.profile) + "; pass it with --profile";
 }
 
-string encodeSamples(const vector<int16_t> &samples, int channels) {
-    string bits;
-    bits.reserve(samples.size()*4);
-
-    double emaL = 1.0, emaR = 1.0;
-    const double alpha = 0.01;
-    int64_t prevL = 0;
-    bool first = true;
-    size_t frames = samples.size() / channels;
-
-    for (size_t i = 0; i < frames; ++i) {
-        // left channel
-        int16_t L = samples[i*channels + 0];
-        int16_t R = (channels==2) ? samples[i*channels + 1] : 0;
-
-        int64_t predL = first ? 0 : prevL;
-        int64_t resL = int64_t(L) - predL;
-
-        uint64_t mL = choose_m_from_ema(emaL);
-        Golomb gL(mL, NegativeMode::INTERLEAVED);
-        string encL = gL.encode(resL);
-        bits += encL;
-        emaL = (1.0 - alpha) * emaL + alpha * std::abs((double)resL);
-
-        if (channels == 2) {
-            // right channel
-            int64_t predR = L;
-            int64_t resR = int64_t(R) - predR;
-            uint64_t mR = choose_m_from_ema(emaR);
-            Golomb gR(mR, NegativeMode::INTERLEAVED);
-            string encR = gR.encode(resR);
-            bits += encR;
-            emaR = (1.0 - alpha) * emaR + alpha * std::abs((double)resR);
-        }
-
-        prevL = L;
-        first = false;
+// train: learn the starting state of the codec from the recordings and
+// write it as a profile file
+static int trainProfile(const string &outPath, const vector<string> &inputs) {
+    unique_ptr<ProfileTrainer> trainer(new ProfileTrainer);
+    for (const string &path : inputs) {
+        WAVHeader wh;
+        vector<int16_t> samples;
+        if (!readWav(path, wh, samples)) { cerr << "Failed to read WAV: " << path << "\n"; return 2; }
+        AudioInfo info;
+        info.channels = wh.channels;
+        info.sample_rate = wh.sample_rate;
+        info.frames = samples.size() / max<uint16_t>(wh.channels, 1);
+        CodecStatus st = trainAudioProfile(samples.data(), info, *trainer);
+        if (st != CodecStatus::Ok) { cerr << "Cannot train on " << path << ": " << codecStatusString(st) << "\n"; return 2; }
+    }
+    CodecProfile profile;
+    trainer->finish(profile);
+    vector<uint8_t> bytes(kMaxProfileBytes);
+    size_t written = 0;
+    writeProfile(profile, bytes.data(), bytes.size(), written);
+    ofstream f(outPath, ios::binary);
+    if (!f || !f.write(reinterpret_cast<const char*>(bytes.data()), written)) {
+        cerr << "Cannot open output file for writing: " << outPath << "\n";
+        return 4;
     }
-    return bits;
+    cerr << "Trained profile " << profileName(profile.id) << " from " << trainer->files() << " files (" << written
+         << " bytes): initial EMA " << fixed << setprecision(1) << profile.ema[0] << " / " << profile.ema[1] << "\n";
+    return 0;
 }
 
-vector<int16_t> decodeSamples(const string &bits, int channels, size_t frames) {
-    vector<int16_t> out;
-    out.reserve(frames * channels);
-
-    double emaL = 1.0, emaR = 1.0;
-    const double alpha = 0.01;
-    int64_t prevL = 0;
-    bool first = true;
-    size_t bitpos = 0;
-    size_t totalBits = bits.size();
-
-    for (size_t i = 0; i < frames; ++i) {
-        // left channel
-        uint64_t mL = choose_m_from_ema(emaL);
-        Golomb gL(mL, NegativeMode::INTERLEAVED);
-
-        if (bitpos >= totalBits) throw runtime_error("decode: bitstream exhausted while decoding left");
-        string_view tail(bits.c_str() + bitpos, totalBits - bitpos);
-        string tailstr(tail);
-        auto decL = gL.decode(tailstr);
-        int64_t resL = decL.first;
-        size_t consumedL = decL.second;
-        if (consumedL == 0) throw runtime_error("decode: Golomb reported 0 bits consumed for left");
-        bitpos += consumedL;
-
-        int64_t predL = first ? 0 : prevL;
-        int64_t L = predL + resL;
-        L = std::clamp(L, int64_t(-32768), int64_t(32767));
-        out.push_back(int16_t(L));
-        emaL = (1.0 - alpha) * emaL + alpha * std::abs((double)resL);
-
-        // right channel (if stereo)
-        if (channels == 2) {
-            uint64_t mR = choose_m_from_ema(emaR);
-            Golomb gR(mR, NegativeMode::INTERLEAVED);
-
-            if (bitpos >= totalBits) throw runtime_error("decode: bitstream exhausted while decoding right");
-            string tailstr2(bits.c_str() + bitpos, totalBits - bitpos);
-            auto decR = gR.decode(tailstr2);
-            int64_t resR = decR.first;
-            size_t consumedR = decR.second;
-            if (consumedR == 0) throw runtime_error("decode: Golomb reported 0 bits consumed for right");
-            bitpos += consumedR;
-
-            int64_t R = L + resR;
-            R = std::clamp(R, int64_t(-32768), int64_t(32767));
-            out.push_back(int16_t(R));
-            emaR = (1.0 - alpha) * emaR + alpha * std::abs((double)resR);
+// verify: check every file against its checksums without decoding; one line
+// per file on stdout, exit status 5 if any file is damaged or unreadable
+static int verifyFiles(const vector<string> &paths) {
+    int bad = 0;
+    for (const string &path : paths) {
+        vector<uint8_t> file;
+        if (!readFile(path, file)) { cout << "UNREADABLE " << path << "\n"; ++bad; continue; }
+        ChecksumReport rep;
+        auto t0 = chrono::steady_clock::now();
+        CodecStatus st = verifyAudio(file.data(), file.size(), &rep);
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        if (st == CodecStatus::Ok && !rep.present) {
+            cout << "NOCRC   " << path << ": no checksums (older file), header and length OK\n";
+        } else if (st == CodecStatus::Ok) {
+            cout << "OK      " << path << ": " << rep.segments << " segments, " << rep.bytes << " bytes, "
+                 << fixed << setprecision(0) << rep.bytes / max(sec, 1e-9) / 1e6 << " MB/s\n";
+        } else {
+            ++bad;
+            cout << "CORRUPT " << path << ": ";
+            if (!rep.present) cout << codecStatusString(st) << " (header or length)";
+            else if (!rep.headerOk) cout << "header checksum mismatch or damaged chunk framing";
+            if (rep.badSegments) cout << (rep.headerOk ? "" : ", ") << rep.badSegments << " of " << rep.segments
+                                      << " segments damaged, first at byte offset " << rep.firstBadOffset;
+            cout << "\n";
         }
-
-        prevL = out.back() - (channels == 2 ? out[out.size() - 1] - out[out.size() - 2] : 0);
-        first = false;
     }
-
-    return out;
+    return bad ? 5 : 0;
 }
 
-
-void writeCompressedFile(const string &filename, const WAVHeader &wavhdr, const string &bitstring, uint16_t channels) {
-    ofstream f(filename, ios::binary);
-    if (!f) throw runtime_error("Cannot open output file for writing");
-    GBLHeader gh;
-    memcpy(gh.magic, "GBL1", 4);
-    gh.channels = channels;
-    gh.sample_rate = wavhdr.sample_rate;
-    gh.num_frames = wavhdr.data_size / wavhdr.block_align;
-    gh.bits_per_sample = wavhdr.bits_per_sample;
-    gh.neg_mode = static_cast<uint8_t>(NegativeMode::INTERLEAVED);
-
-    f.write(reinterpret_cast<const char*>(&gh), sizeof(GBLHeader));
-    uint32_t nbits = static_cast<uint32_t>(bitstring.size());
-    f.write(reinterpret_cast<const char*>(&nbits), sizeof(uint32_t));
-    vector<uint8_t> bytes;
-    packBitsToBytes(bitstring, bytes);
-    f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+// stream: decode with AudioDecoder one period at a time and write raw
+// interleaved PCM16 to stdout, e.g. for `| aplay -f S16_LE -r 44100 -c 2`
+static int streamFile(const string &path, size_t period, const CodecProfile *profile) {
+    vector<uint8_t> file;
+    if (!readFile(path, file)) { cerr << "Failed to read compressed file: " << path << "\n"; return 3; }
+    AudioInfo header;
+    if (readAudioInfo(file.data(), file.size(), header) == CodecStatus::Ok && !missingProfile(header, profile).empty()) {
+        cerr << path << ": " << missingProfile(header, profile) << "\n";
+        return 3;
+    }
+    AudioDecoder dec;
+    CodecStatus st = dec.open(file.data(), file.size(), profile);
+    if (st != CodecStatus::Ok) {
+        cerr << "Invalid GBL file: " << path << " (" << codecStatusString(st) << ")\n";
+        return 3;
+    }
+    const AudioInfo &info = dec.info();
+    cerr << "Streaming: rate=" << info.sample_rate << " channels=" << info.channels << " frames=" << info.frames
+         << " (raw 16-bit PCM, " << period << " frames per read)\n";
+    vector<int16_t> buf(period * info.channels);
+    size_t got;
+    while ((st = dec.read(buf.data(), period, got)) == CodecStatus::Ok && got) {
+        if (!cout.write(reinterpret_cast<const char*>(buf.data()), got * info.channels * sizeof(int16_t))) {
+            cerr << "Failed to write to stdout\n";
+            return 4;
+        }
+    }
+    if (st != CodecStatus::Ok) {
+        cerr << "Decode failed after " << dec.position() << " frames: " << codecStatusString(st) << "\n";
+        return 3;
+    }
+    return cout.flush() ? 0 : 4;
 }
 
-bool readCompressedFile(const string &filename, GBLHeader &gh, string &bitstring) {
-    ifstream f(filename, ios::binary);
-    if (!f) return false;
-    f.read(reinterpret_cast<char*>(&gh), sizeof(GBLHeader));
-    if (!f) return false;
-    uint32_t nbits = 0;
-    f.read(reinterpret_cast<char*>(&nbits), sizeof(uint32_t));
-    uint32_t nbytes = (nbits + 7) / 8;
-    vector<uint8_t> bytes(nbytes);
-    f.read(reinterpret_cast<char*>(bytes.data()), nbytes);
-    bitstring = unpackBytesToBits(bytes, nbits);
-    return true;
-}
+// One file of a batch as it moves through the pipeline (pipeline.hpp); the
+// buffers are reused by later files.
+struct AudioJob {
+    WAVHeader wh;
+    vector<int16_t> samples;
+    vector<uint8_t> bytes;   // the GBL file: encode output, decode input
+    size_t written = 0;
+    AudioInfo info;
+    CodecStats stats;
+    int rc = 0;              // exit status of the first failure
+    string error;
+};
 
 int main(int argc, char **argv) {
-    if (argc < 4) {
-        cerr << "Usage:\n  Encode: " << argv[0] << " encode in.wav out.gbl\n  Decode: " << argv[0] << " decode in.gbl out.wav\n";
+    vector<string> args;
+    bool statsTable = false;
+    string statsJson;
+    int backend = BACKEND_GOLOMB;
+    bool runMode = false;
+    bool blocks = false;
+    int preset = -1; // -0 .. -8
+    int jobs = 0;    // coder threads, 0 = one per core
+    int period = 1024; // stream: frames per read
+    string profilePath;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--stats") statsTable = true;
+        else if (a == "--run") runMode = true;
+        else if (a == "--blocks") blocks = true;
+        else if (a.size() == 2 && a[0] == '-' && a[1] >= '0' && a[1] <= '8') preset = a[1] - '0';
+        else if (a == "--stats-json" && i + 1 < argc) statsJson = argv[++i];
+        else if (a == "--jobs" && i + 1 < argc) jobs = atoi(argv[++i]);
+        else if (a == "--period" && i + 1 < argc) period = atoi(argv[++i]);
+        else if (a == "--profile" && i + 1 < argc) profilePath = argv[++i];
+        else if (a == "--backend" && i + 1 < argc) {
+            backend = parseBackend(argv[++i]);
+            if (backend < 0) { cerr << "Unknown backend: " << argv[i] << " (golomb, range or rans)\n"; return 1; }
+        }
+        else args.push_back(a);
+    }
+    if (args.size() >= 2 && args[0] == "verify") return verifyFiles(vector<string>(args.begin() + 1, args.end()));
+    if (args.size() >= 3 && args[0] == "train") return trainProfile(args[1], vector<string>(args.begin() + 2, args.end()));
+    CodecProfile profileStore;
+    const CodecProfile *profile = nullptr;
+    if (!profilePath.empty()) {
+        if (!loadProfile(profilePath, profileStore)) return 1;
+        profile = &profileStore;
+    }
+    if (args.size() == 2 && args[0] == "stream") return streamFile(args[1], (size_t)max(period, 1), profile);
+    if (args.size() < 3 || args.size() % 2 == 0) {
+        cerr << "Usage:\n  Encode: " << argv[0] << " encode in.wav out.gbl [in.wav out.gbl ...] [--backend golomb|range|rans]"
+             << " [--run | --blocks | -0..-8] [--profile p.gprof] [--jobs N] [--stats] [--stats-json file|-]\n"
+             << "  Decode: " << argv[0] << " decode in.gbl out.wav [in.gbl out.wav ...] [--profile p.gprof] [--jobs N]"
+             << " [--stats] [--stats-json file|-]\n"
+             << "  Verify: " << argv[0] << " verify in.gbl [more.gbl ...]\n"
+             << "  Stream: " << argv[0] << " stream in.gbl [--period frames] [--profile p.gprof] > out.pcm\n"
+             << "  Train:  " << argv[0] << " train out.gprof in.wav [more.wav ...]\n";
         return 1;
     }
+    const bool collect = statsTable || !statsJson.empty();
+    CodecStats stats;
+    const size_t files = (args.size() - 1) / 2;
+    auto inPath = [&](size_t j) -> const string & { return args[1 + 2 * j]; };
+    auto outPath = [&](size_t j) -> const string & { return args[2 + 2 * j]; };
+    if (jobs <= 0) jobs = (int)max(1u, thread::hardware_concurrency());
+    const int workers = (int)min<size_t>((size_t)jobs, files);
+    int rc = 0;
+    // the writer stage: reports the job in order and keeps the first failure
+    auto finish = [&](AudioJob &job, size_t j, const string &line) {
+        if (job.rc) {
+            cerr << job.error << "\n";
+            if (!rc) rc = job.rc;
+            return;
+        }
+        cerr << (files > 1 ? outPath(j) + ": " : string()) << line << "\n";
+        if (collect) stats.merge(job.stats);
+    };
 
-    string mode = argv[1];
+    string mode = args[0];
     if (mode == "encode") {
-        string inwav = argv[2], outg = argv[3];
-        WAVHeader wh;
-        vector<int16_t> samples;
-        if (!readWav(inwav, wh, samples)) {
-            cerr << "Failed to read WAV: " << inwav << "\n";
-            return 2;
+        AudioInfo coding;
+        coding.backend = backend;
+        coding.runMode = runMode;
+        coding.blocks = blocks;
+        if (preset >= 0 && (blocks || runMode || backend != BACKEND_GOLOMB)) {
+            cerr << "-" << preset << " selects the coding mode itself; drop --backend, --run and --blocks\n";
+            return 1;
         }
-        int channels = wh.channels;
-        string bits = encodeSamples(samples, channels);
-        writeCompressedFile(outg, wh, bits, channels);
-        cerr << "Encoded: bits=" << bits.size() << " frames=" << (wh.data_size / wh.block_align) << "\n";
-        return 0;
-    } else if (mode == "decode") {
-        string ing = argv[2], outwav = argv[3];
-        GBLHeader gh;
-        string bits;
-        if (!readCompressedFile(ing, gh, bits)) {
-            cerr << "Failed to read compressed file: " << ing << "\n";
-            return 3;
+        if (preset >= 0) audioPreset(preset, coding);
+        if (blocks && (backend != BACKEND_GOLOMB || runMode)) {
+            cerr << "--blocks needs the golomb backend and cannot be combined with --run\n";
+            return 1;
         }
-        int channels = gh.channels;
-        size_t frames = gh.num_frames;
-        vector<int16_t> samples = decodeSamples(bits, channels, frames);
-
-        WAVHeader wh = {};
-        memcpy(wh.riff, "RIFF", 4);
-        memcpy(wh.wave, "WAVE", 4);
-        memcpy(wh.fmt_chunk_marker, "fmt ", 4);
-        wh.length_of_fmt = 16;
-        wh.format_type = 1;
-        wh.channels = channels;
-        wh.sample_rate = gh.sample_rate;
-        wh.bits_per_sample = gh.bits_per_sample;
-        wh.block_align = (wh.channels * wh.bits_per_sample) / 8;
-        wh.byterate = wh.sample_rate * wh.block_align;
-        memcpy(wh.data_chunk_header, "data", 4);
-        wh.data_size = static_cast<uint32_t>(samples.size() * sizeof(int16_t));
-        wh.overall_size = 36 + wh.data_size;
-
-        if (!writeWav(outwav, wh, samples)) {
-            cerr << "Failed to write WAV: " << outwav << "\n";
-            return 4;
-        }
-        cerr << "Decoded: frames=" << frames << " samples=" << samples.size() << "\n";
-        return 0;
+        runPipeline<AudioJob>(files, workers, [&](AudioJob &job, size_t j) {
+            job.rc = 0;
+            job.stats = CodecStats();
+            StageTimer timer(collect ? &job.stats : nullptr, "read");
+            if (!readWav(inPath(j), job.wh, job.samples)) {
+                job.rc = 2;
+                job.error = "Failed to read WAV: " + inPath(j);
+                return;
+            }
+            timer.setWork(job.samples.size(), sizeof(WAVHeader) + job.samples.size() * sizeof(int16_t));
+        }, [&](AudioJob &job) {
+            if (job.rc) return;
+            CodecStats *js = collect ? &job.stats : nullptr;
+            AudioInfo info = coding;
+            info.channels = job.wh.channels;
+            info.sample_rate = job.wh.sample_rate;
+            info.bits_per_sample = job.wh.bits_per_sample;
+            info.frames = job.samples.size() / max<uint16_t>(job.wh.channels, 1);
+            // threads the batch leaves idle code the blocks of a file in parallel
+            info.threads = max(1, jobs / workers);
+            job.info = info;
+            job.bytes.resize(audioEncodedSizeHint(info));
+            CodecStatus st = encodeAudio(job.samples.data(), info, job.bytes.data(), job.bytes.size(), job.written, js,
+                                         profile);
+            if (st == CodecStatus::BufferTooSmall) {
+                // the retry is what gets reported; drop the partial first pass
+                if (js) { CodecStats keep; keep.stages.push_back(js->stages.front()); *js = keep; }
+                job.bytes.resize(job.written);
+                st = encodeAudio(job.samples.data(), info, job.bytes.data(), job.bytes.size(), job.written, js,
+                                 profile);
+            }
+            if (st != CodecStatus::Ok) {
+                job.rc = 2;
+                job.error = "Encode failed: " + string(codecStatusString(st));
+            }
+        }, [&](AudioJob &job, size_t j) {
+            if (!job.rc) {
+                StageTimer timer(collect ? &job.stats : nullptr, "write", 0, job.written);
+                ofstream f(outPath(j), ios::binary);
+                if (!f || !f.write(reinterpret_cast<const char*>(job.bytes.data()), job.written)) {
+                    job.rc = 2;
+                    job.error = "Cannot open output file for writing: " + outPath(j);
+                }
+            }
+            AudioInfo writtenInfo;
+            if (!job.rc) readAudioInfo(job.bytes.data(), job.written, writtenInfo);
+            ostringstream line;
+            line << "Encoded: bits=" << writtenInfo.nbits << " frames=" << job.info.frames;
+            if (backend != BACKEND_GOLOMB) line << " backend=" << backendName(backend);
+            if (runMode) line << " run";
+            if (preset >= 0) line << " preset=" << preset;
+            else if (blocks) line << " blocks";
+            if (writtenInfo.profile) line << " profile=" << profileName(writtenInfo.profile);
+            finish(job, j, line.str());
+        });
+        if (rc) return rc;
+        return collect && !reportStats(stats, statsTable, statsJson) ? 2 : 0;
+    } else if (mode == "decode") {
+        runPipeline<AudioJob>(files, workers, [&](AudioJob &job, size_t j) {
+            job.rc = 0;
+            job.stats = CodecStats();
+            StageTimer timer(collect ? &job.stats : nullptr, "read");
+            if (!readFile(inPath(j), job.bytes)) {
+                job.rc = 3;
+                job.error = "Failed to read compressed file: " + inPath(j);
+                return;
+            }
+            CodecStatus st = readAudioInfo(job.bytes.data(), job.bytes.size(), job.info);
+            if (st != CodecStatus::Ok) {
+                job.rc = 3;
+                job.error = "Invalid GBL file: " + inPath(j) + " (" + codecStatusString(st) + ")";
+                return;
+            }
+            if (!missingProfile(job.info, profile).empty()) {
+                job.rc = 3;
+                job.error = inPath(j) + ": " + missingProfile(job.info, profile);
+                return;
+            }
+            timer.setWork(0, job.bytes.size());
+        }, [&](AudioJob &job) {
+            if (job.rc) return;
+            job.samples.resize(job.info.frames * job.info.channels);
+            CodecStatus st = decodeAudio(job.bytes.data(), job.bytes.size(), job.samples.data(), job.samples.size(),
+                                         collect ? &job.stats : nullptr, profile);
+            if (st != CodecStatus::Ok) {
+                job.rc = 3;
+                job.error = "Decode failed: " + string(codecStatusString(st));
+                return;
+            }
+            job.wh = makeWavHeader(job.info.channels, job.info.sample_rate, job.info.bits_per_sample,
+                                   job.samples.size());
+        }, [&](AudioJob &job, size_t j) {
+            if (!job.rc) {
+                StageTimer timer(collect ? &job.stats : nullptr, "write", job.samples.size(),
+                                 sizeof(WAVHeader) + job.samples.size() * sizeof(int16_t));
+                if (!writeWav(outPath(j), job.wh, job.samples)) {
+                    job.rc = 4;
+                    job.error = "Failed to write WAV: " + outPath(j);
+                }
+            }
+            finish(job, j, "Decoded: frames=" + to_string(job.info.frames) + " samples=" +
+                           to_string(job.samples.size()));
+        });
+        if (rc) return rc;
+        return collect && !reportStats(stats, statsTable, statsJson) ? 4 : 0;
     } else {
         cerr << "Unknown mode: " << mode << "\n";
         return 1;
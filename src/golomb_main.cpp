@@ -1,23 +1,48 @@
 #include "golomb.hpp"
+#include "bitpack.hpp"
 #include <iostream>
+#include <fstream>
+#include <iterator>
 #include <string>
 #include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <sstream>
 
+// Packed bitstream file: "GBIT" | u64 nbits (host byte order) | packed bits, MSB first
+static const char kPackedMagic[4] = {'G', 'B', 'I', 'T'};
+static const size_t kPackedHeader = 4 + 8;
+
 static void print_usage(const char *prog) {
     std::cout << "Usage:\n"
               << "  " << prog << " -m <m> -mode <sign|interleave> encode <int1> [int2 ...]\n"
-              << "  " << prog << " -m <m> -mode <sign|interleave> decode <bitstring>\n\n"
+              << "  " << prog << " -m <m> -mode <sign|interleave> decode <bitstring>\n"
+              << "  " << prog << " -m <m> -mode <sign|interleave> [-i <file>] [-o <file>] [-text] encode|decode\n"
+              << "  " << prog << " [-m <m>|auto] [-mode <sign|interleave>] [-type int16|int32|int64] encode-file <in> <out>\n"
+              << "  " << prog << " decode-file <in> <out>\n\n"
               << "Examples:\n"
               << "  " << prog << " -m 3 -mode interleave encode 0 -1 5 10\n"
-              << "  " << prog << " -m 4 -mode sign decode 00110110\n\n"
+              << "  " << prog << " -m 4 -mode sign decode 00110110\n"
+              << "  " << prog << " -m 3 -i values.txt -o values.gbit encode\n"
+              << "  " << prog << " -m 3 -i values.gbit -o values.txt decode\n"
+              << "  " << prog << " -type int16 encode-file samples.raw samples.gint\n"
+              << "  " << prog << " decode-file samples.gint - > samples.raw\n\n"
               << "Notes:\n"
               << "  - m must be >= 1\n"
               << "  - mode 'sign' uses SIGN_MAGNITUDE; 'interleave' uses INTERLEAVED \n"
               << "  - encode prints each encoded bitstring and then decodes the concatenated stream\n"
-              << "  - decode will repeatedly decode values from the provided bitstring until exhausted\n";
+              << "  - decode will repeatedly decode values from the provided bitstring until exhausted\n"
+              << "  - -i reads the integers (encode) or the bitstream (decode) from a file instead of\n"
+              << "    the command line; a bitstream file is either packed (as written by -o) or '0'/'1' text\n"
+              << "  - -o writes the packed bitstream (encode) or the decoded integers, one per line (decode);\n"
+              << "    with -text, encode writes the bitstream as '0'/'1' text instead\n"
+              << "  - with -i or -o only a summary is printed\n"
+              << "  - encode-file compresses a binary array of native-endian integers (-type, default\n"
+              << "    int32) into a GINT stream; decode-file restores the array. '-' is stdin/stdout.\n"
+              << "    Without -m (or with -m auto) m is estimated per block of " << (1 << 16) << " values\n";
 }
 
 static bool parse_mode(const std::string &s, NegativeMode &mode_out) {
@@ -31,6 +56,245 @@ static bool parse_mode(const std::string &s, NegativeMode &mode_out) {
     return false;
 }
 
+static bool read_file(const std::string &path, std::string &out) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    out.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Bitstream from a file: packed (GBIT header) or '0'/'1' text (anything else is ignored)
+static bool load_bitstream(const std::string &data, std::vector<uint8_t> &packed, uint64_t &nbits) {
+    if (data.size() >= kPackedHeader && std::memcmp(data.data(), kPackedMagic, 4) == 0) {
+        std::memcpy(&nbits, data.data() + 4, 8);
+        if (packedBytes(nbits) > data.size() - kPackedHeader) return false;
+        packed.assign(data.begin() + kPackedHeader, data.begin() + kPackedHeader + packedBytes(nbits));
+        return true;
+    }
+    std::string bits(data.size(), '\0');
+    nbits = filterBits(data.data(), data.size(), &bits[0]);
+    packed.assign(packedBytes(nbits), 0);
+    return packBits(bits.data(), nbits, packed.data());
+}
+
+// Encode values into a packed stream, growing the buffer once if needed
+static uint64_t encode_packed(const Golomb &coder, const std::vector<int64_t> &values, std::vector<uint8_t> &packed) {
+    packed.assign(values.size() / 2 + 64, 0);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        BitSink sink(packed.data(), packed.size());
+        for (int64_t v : values) coder.encode(v, sink);
+        size_t used = sink.finish();
+        if (!sink.overflowed()) {
+            packed.resize(used);
+            return sink.bitCount();
+        }
+        packed.assign(used, 0);
+    }
+    return 0; // not reached: the second pass has the exact size
+}
+
+// ---------------- integer array streams (encode-file / decode-file) ----------------
+// GINT stream (host byte order):
+//   "GINT" | u8 version (1) | u8 element bytes (2, 4, 8) | u8 NegativeMode | u8 0
+//   blocks: u32 count | u64 m | u64 nbits | packed Golomb codes of count values
+//   end:    u32 0
+// Blocks let both directions stream through fixed-size buffers (pipes work)
+// and let -m auto follow the data. int16/int32 go through the bulk encoder.
+
+static const char kStreamMagic[4] = {'G', 'I', 'N', 'T'};
+static const size_t kBlockValues = 1 << 16;
+static const uint64_t kMaxBlockBits = 1ULL << 36; // 8 GiB of codes per block is certainly a bad m
+// BitSource reads at most 57 bits per call, which bounds the remainder width
+static const uint64_t kMaxStreamM = 1ULL << 56;
+
+// unsigned value the Golomb code sees (zig-zag, or the magnitude for sign mode)
+static inline uint64_t mapped(int64_t v, NegativeMode mode) {
+    if (mode == NegativeMode::SIGN_MAGNITUDE) return v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+// Optimal Golomb parameter for a geometric source with the block's mean:
+// m = ceil(log(1 + p) / -log(p)), p = mean / (mean + 1)
+template <typename T>
+static uint64_t estimate_m(const T *v, size_t n, NegativeMode mode) {
+    long double sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += (long double)mapped(v[i], mode);
+    double mean = n ? (double)(sum / n) : 0.0;
+    if (mean < 0.5) return 1;
+    // -log(p) = log1p(1 / mean) keeps its precision for very large means
+    double est = std::ceil(std::log1p(mean / (mean + 1.0)) / std::log1p(1.0 / mean));
+    return est < 1 ? 1 : est > (double)kMaxStreamM ? kMaxStreamM : (uint64_t)est;
+}
+
+// Code one block into payload; returns the bit count (0 with n > 0 means m is unusable)
+template <typename T>
+static uint64_t encode_block(const T *v, size_t n, const Golomb &g, uint64_t m, NegativeMode mode,
+                             std::vector<int32_t> &wide, std::vector<uint8_t> &payload) {
+    uint64_t nbits = 0;
+    if (sizeof(T) <= 4) {
+        wide.assign(v, v + n);
+        nbits = g.arrayLength(wide.data(), n);
+    } else {
+        for (size_t i = 0; i < n && nbits <= kMaxBlockBits; ++i) {
+            uint64_t u = mapped(v[i], mode);
+            nbits += u / m > kMaxBlockBits ? kMaxBlockBits + 1 : g.unsignedLength(u);
+            if (mode == NegativeMode::SIGN_MAGNITUDE) ++nbits;
+        }
+    }
+    if (nbits > kMaxBlockBits) return 0;
+    payload.assign(packedBytes(nbits), 0);
+    BitSink sink(payload.data(), payload.size());
+    if (sizeof(T) <= 4) {
+        g.encodeArray(wide.data(), n, sink);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            if (mode == NegativeMode::SIGN_MAGNITUDE) sink.writeBit(v[i] < 0);
+            g.encodeUnsigned(mapped(v[i], mode), sink);
+        }
+    }
+    sink.finish();
+    return nbits;
+}
+
+template <typename T>
+static bool decode_block(const uint8_t *payload, uint64_t nbits, size_t n, const Golomb &g, NegativeMode mode,
+                         uint64_t m, std::vector<int32_t> &wide, T *out) {
+    if (sizeof(T) <= 4) {
+        wide.resize(n);
+        if (decodeInts(payload, nbits, m, mode, wide.data(), n) != CodecStatus::Ok) return false;
+        for (size_t i = 0; i < n; ++i) {
+            if (wide[i] != (int32_t)(T)wide[i]) return false;
+            out[i] = (T)wide[i];
+        }
+        return true;
+    }
+    BitSource r(payload, nbits);
+    for (size_t i = 0; i < n; ++i) {
+        bool neg = mode == NegativeMode::SIGN_MAGNITUDE && r.readBit();
+        uint64_t u = g.decodeUnsigned(r);
+        if (mode == NegativeMode::SIGN_MAGNITUDE) out[i] = (T)(neg ? 0 - u : u);
+        else out[i] = (T)((u >> 1) ^ (0 - (u & 1)));
+    }
+    return r.ok();
+}
+
+static FILE *open_stream(const std::string &path, bool write) {
+    if (path == "-") return write ? stdout : stdin;
+    return std::fopen(path.c_str(), write ? "wb" : "rb");
+}
+
+template <typename T>
+static int encode_stream(FILE *in, FILE *out, uint64_t fixed_m, NegativeMode mode, uint64_t &count,
+                         uint64_t &written) {
+    std::vector<T> block(kBlockValues);
+    std::vector<int32_t> wide;
+    std::vector<uint8_t> payload;
+    uint8_t header[8] = {'G', 'I', 'N', 'T', 1, (uint8_t)sizeof(T), (uint8_t)mode, 0};
+    if (std::fwrite(header, 1, sizeof header, out) != sizeof header) return 2;
+    written = sizeof header;
+    for (;;) {
+        size_t got = std::fread(block.data(), 1, kBlockValues * sizeof(T), in);
+        if (got % sizeof(T)) {
+            std::cerr << "Error: input size is not a multiple of " << sizeof(T) << " bytes\n";
+            return 3;
+        }
+        size_t n = got / sizeof(T);
+        if (n == 0) break;
+        uint64_t m = fixed_m ? fixed_m : estimate_m(block.data(), n, mode);
+        Golomb g(m, mode);
+        uint64_t nbits = encode_block(block.data(), n, g, m, mode, wide, payload);
+        if (nbits == 0) {
+            std::cerr << "Error: m=" << m << " is far too small for the data (try -m auto)\n";
+            return 3;
+        }
+        uint32_t n32 = (uint32_t)n;
+        bool ok = std::fwrite(&n32, 4, 1, out) == 1 && std::fwrite(&m, 8, 1, out) == 1 &&
+                  std::fwrite(&nbits, 8, 1, out) == 1 &&
+                  std::fwrite(payload.data(), 1, payload.size(), out) == payload.size();
+        if (!ok) return 2;
+        count += n;
+        written += 4 + 8 + 8 + payload.size();
+        if (n < kBlockValues) break;
+    }
+    if (std::ferror(in)) return 2;
+    uint32_t end = 0;
+    if (std::fwrite(&end, 4, 1, out) != 1) return 2;
+    written += 4;
+    return 0;
+}
+
+template <typename T>
+static int decode_stream(FILE *in, FILE *out, NegativeMode mode, uint64_t &count) {
+    std::vector<T> block;
+    std::vector<int32_t> wide;
+    std::vector<uint8_t> payload;
+    for (;;) {
+        uint32_t n;
+        uint64_t m, nbits;
+        if (std::fread(&n, 4, 1, in) != 1) return 4;
+        if (n == 0) return 0;
+        if (std::fread(&m, 8, 1, in) != 1 || std::fread(&nbits, 8, 1, in) != 1) return 4;
+        if (n > kBlockValues || m == 0 || m > kMaxStreamM || nbits > kMaxBlockBits) return 4;
+        payload.resize(packedBytes(nbits));
+        if (std::fread(payload.data(), 1, payload.size(), in) != payload.size()) return 4;
+        block.resize(n);
+        if (!decode_block(payload.data(), nbits, n, Golomb(m, mode), mode, m, wide, block.data())) return 4;
+        if (std::fwrite(block.data(), sizeof(T), n, out) != n) return 2;
+        count += n;
+    }
+}
+
+static int run_file_op(const std::string &op, const std::string &in_path, const std::string &out_path,
+                       int elem_bytes, uint64_t fixed_m, NegativeMode mode) {
+    FILE *in = open_stream(in_path, false);
+    if (!in) { std::cerr << "Error: cannot read " << in_path << "\n"; return 2; }
+    FILE *out = open_stream(out_path, true);
+    if (!out) { std::cerr << "Error: cannot write " << out_path << "\n"; return 2; }
+    // large stdio buffers: the block loop then does few system calls
+    std::vector<char> inbuf(1 << 20), outbuf(1 << 20);
+    std::setvbuf(in, inbuf.data(), _IOFBF, inbuf.size());
+    std::setvbuf(out, outbuf.data(), _IOFBF, outbuf.size());
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t count = 0, written = 0;
+    int rc;
+    if (op == "encode-file") {
+        rc = elem_bytes == 2 ? encode_stream<int16_t>(in, out, fixed_m, mode, count, written)
+           : elem_bytes == 4 ? encode_stream<int32_t>(in, out, fixed_m, mode, count, written)
+                             : encode_stream<int64_t>(in, out, fixed_m, mode, count, written);
+    } else {
+        uint8_t header[8];
+        rc = 4;
+        if (std::fread(header, 1, sizeof header, in) == sizeof header && std::memcmp(header, kStreamMagic, 4) == 0 &&
+            header[4] == 1 && header[6] <= 1) {
+            elem_bytes = header[5];
+            mode = (NegativeMode)header[6];
+            rc = elem_bytes == 2 ? decode_stream<int16_t>(in, out, mode, count)
+               : elem_bytes == 4 ? decode_stream<int32_t>(in, out, mode, count)
+               : elem_bytes == 8 ? decode_stream<int64_t>(in, out, mode, count) : 4;
+        }
+    }
+    if (std::fflush(out) != 0 && rc == 0) rc = 2;
+    if (out != stdout) std::fclose(out);
+    if (in != stdin) std::fclose(in);
+    if (rc == 2) std::cerr << "Error: I/O error\n";
+    if (rc == 4) std::cerr << "Error: " << in_path << " is not a valid GINT stream\n";
+    if (rc != 0) return rc;
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    uint64_t raw = count * (uint64_t)elem_bytes;
+    if (op == "encode-file") {
+        std::fprintf(stderr, "Encoded %llu int%d values: %llu -> %llu bytes (ratio %.3f), %.1f MB/s\n",
+                     (unsigned long long)count, elem_bytes * 8, (unsigned long long)raw,
+                     (unsigned long long)written, written ? (double)raw / written : 0.0,
+                     secs > 0 ? raw / secs / 1e6 : 0.0);
+    } else {
+        std::fprintf(stderr, "Decoded %llu int%d values (%llu bytes), %.1f MB/s\n", (unsigned long long)count,
+                     elem_bytes * 8, (unsigned long long)raw, secs > 0 ? raw / secs / 1e6 : 0.0);
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
         print_usage(argv[0]);
@@ -41,7 +305,10 @@ int main(int argc, char **argv) {
     NegativeMode mode = NegativeMode::INTERLEAVED;
     bool have_m = false;
     bool have_mode = false;
-
+    std::string in_path, out_path;
+    bool text_out = false;
+    bool auto_m = false;
+    int elem_bytes = 4;
 
     int argi = 1;
     while (argi < argc) {
@@ -50,6 +317,11 @@ int main(int argc, char **argv) {
                 std::cerr << "Error: -m requires a value\n";
                 return 2;
             }
+            if (std::strcmp(argv[argi + 1], "auto") == 0) {
+                auto_m = have_m = true;
+                argi += 2;
+                continue;
+            }
             long long tmp = std::atoll(argv[argi + 1]);
             if (tmp < 1) {
                 std::cerr << "Error: m must be >= 1\n";
@@ -70,17 +342,29 @@ int main(int argc, char **argv) {
             }
             have_mode = true;
             argi += 2;
+        } else if (std::strcmp(argv[argi], "-i") == 0 || std::strcmp(argv[argi], "-o") == 0) {
+            if (argi + 1 >= argc) {
+                std::cerr << "Error: " << argv[argi] << " requires a file name\n";
+                return 2;
+            }
+            (argv[argi][1] == 'i' ? in_path : out_path) = argv[argi + 1];
+            argi += 2;
+        } else if (std::strcmp(argv[argi], "-type") == 0) {
+            std::string t = argi + 1 < argc ? argv[argi + 1] : "";
+            elem_bytes = t == "int16" ? 2 : t == "int32" ? 4 : t == "int64" ? 8 : 0;
+            if (elem_bytes == 0) {
+                std::cerr << "Error: -type must be int16, int32 or int64\n";
+                return 2;
+            }
+            argi += 2;
+        } else if (std::strcmp(argv[argi], "-text") == 0) {
+            text_out = true;
+            argi += 1;
         } else {
             break;
         }
     }
 
-    if (!have_m) {
-        std::cerr << "Error: please specify -m <m> (m >= 1)\n";
-        print_usage(argv[0]);
-        return 2;
-    }
-
     if (argi >= argc) {
         std::cerr << "Error: missing operation (encode/decode)\n";
         print_usage(argv[0]);
@@ -88,20 +372,51 @@ int main(int argc, char **argv) {
     }
 
     std::string op = argv[argi++];
-    Golomb coder(m, mode);
-
-    if (op == "encode") {
-        if (argi >= argc) {
-            std::cerr << "Error: encode requires at least one integer argument\n";
+    if (op == "encode-file" || op == "decode-file") {
+        if (!auto_m && m > kMaxStreamM) {
+            std::cerr << "Error: encode-file supports m <= 2^56\n";
+            return 2;
+        }
+        if (argi + 2 != argc) {
+            std::cerr << "Error: " << op << " requires <in> and <out> ('-' for stdin/stdout)\n";
             print_usage(argv[0]);
             return 2;
         }
+        return run_file_op(op, argv[argi], argv[argi + 1], elem_bytes, auto_m ? 0 : m, mode);
+    }
+
+    if (!have_m || auto_m) {
+        std::cerr << "Error: please specify -m <m> (m >= 1)\n";
+        print_usage(argv[0]);
+        return 2;
+    }
+    Golomb coder(m, mode);
+    const bool file_mode = !in_path.empty() || !out_path.empty();
+
+    if (op == "encode") {
         std::vector<int64_t> values;
-        for (; argi < argc; ++argi) {
+        std::vector<std::string> tokens;
+        if (!in_path.empty()) {
+            std::string data;
+            if (!read_file(in_path, data)) {
+                std::cerr << "Error: cannot read " << in_path << "\n";
+                return 2;
+            }
+            std::istringstream iss(data);
+            for (std::string tok; iss >> tok;) tokens.push_back(tok);
+        } else {
+            if (argi >= argc) {
+                std::cerr << "Error: encode requires at least one integer argument\n";
+                print_usage(argv[0]);
+                return 2;
+            }
+            for (; argi < argc; ++argi) tokens.push_back(argv[argi]);
+        }
+        for (const std::string &tok : tokens) {
             char *endptr = nullptr;
-            long long v = std::strtoll(argv[argi], &endptr, 0);
-            if (endptr == argv[argi] || *endptr != '\0') {
-                std::cerr << "Warning: skipping invalid integer '" << argv[argi] << "'\n";
+            long long v = std::strtoll(tok.c_str(), &endptr, 0);
+            if (endptr == tok.c_str() || *endptr != '\0') {
+                std::cerr << "Warning: skipping invalid integer '" << tok << "'\n";
                 continue;
             }
             values.push_back((int64_t)v);
@@ -111,97 +426,137 @@ int main(int argc, char **argv) {
             return 2;
         }
 
-        std::cout << "Parameters: m=" << m
-                  << " mode=" << (mode == NegativeMode::SIGN_MAGNITUDE ? "SIGN_MAGNITUDE" : "INTERLEAVED")
-                  << "\n\n";
+        std::vector<uint8_t> packed;
+        uint64_t nbits = encode_packed(coder, values, packed);
 
-        std::string concat;
-        for (size_t i = 0; i < values.size(); ++i) {
-            std::string bits = coder.encode(values[i]);
-            concat += bits;
-            std::cout << "Value[" << i << "] = " << values[i] << " -> bits: " << bits
-                      << " (len=" << bits.size() << ")\n";
+        if (!file_mode) {
+            std::cout << "Parameters: m=" << m
+                      << " mode=" << (mode == NegativeMode::SIGN_MAGNITUDE ? "SIGN_MAGNITUDE" : "INTERLEAVED")
+                      << "\n\n";
+            for (size_t i = 0; i < values.size(); ++i) {
+                std::string bits = coder.encode(values[i]);
+                std::cout << "Value[" << i << "] = " << values[i] << " -> bits: " << bits
+                          << " (len=" << bits.size() << ")\n";
+            }
+            std::string concat(nbits, '0');
+            unpackBits(packed.data(), nbits, &concat[0]);
+            std::cout << "\nConcatenated bitstream (" << concat.size() << " bits):\n"
+                      << concat << "\n\n";
+            std::cout << "Decoding concatenated stream to verify round-trip:\n";
         }
 
-        std::cout << "\nConcatenated bitstream (" << concat.size() << " bits):\n"
-                  << concat << "\n\n";
-
-        std::cout << "Decoding concatenated stream to verify round-trip:\n";
-        size_t pos = 0;
+        // decode the packed stream back and compare
+        BitSource r(packed.data(), nbits);
         size_t index = 0;
-        while (pos < concat.size()) {
-            std::string tail = concat.substr(pos);
-            auto res = coder.decode(tail);
-            int64_t decoded = res.first;
-            size_t consumed = res.second;
-            if (consumed == 0) {
-                std::cerr << "Decoding error: consumed 0 bits at pos " << pos << "\n";
-                break;
-            }
-            std::cout << "Decoded[" << index << "] = " << decoded << " (consumed=" << consumed << " bits)\n";
-            pos += consumed;
+        bool same = true;
+        while (r.position() < nbits) {
+            uint64_t pos = r.position();
+            int64_t decoded = coder.decode(r);
+            if (!r.ok()) break;
+            if (!file_mode) {
+                std::cout << "Decoded[" << index << "] = " << decoded << " (consumed=" << r.position() - pos
+                          << " bits)\n";
+            }
+            same = same && index < values.size() && values[index] == decoded;
             ++index;
         }
-        if (pos != concat.size()) {
-            std::cerr << "Warning: not all bits consumed (pos=" << pos << " total=" << concat.size() << ")\n";
-        } else {
-            std::cout << "Round-trip OK: encoded " << values.size() << " values into " << concat.size() << " bits.\n";
+        if (!r.ok() || r.position() != nbits || !same || index != values.size()) {
+            std::cerr << "Warning: round-trip mismatch (pos=" << r.position() << " total=" << nbits << ")\n";
+        } else if (!file_mode) {
+            std::cout << "Round-trip OK: encoded " << values.size() << " values into " << nbits << " bits.\n";
         }
+        if (!file_mode) return 0;
 
-        return 0;
-    } else if (op == "decode") {
-        if (argi >= argc) {
-            std::cerr << "Error: decode requires a bitstring argument\n";
-            print_usage(argv[0]);
-            return 2;
+        std::string out;
+        if (text_out || out_path.empty()) {
+            out.assign(nbits, '0');
+            unpackBits(packed.data(), nbits, &out[0]);
+            out.push_back('\n');
+        } else {
+            out.assign(kPackedMagic, 4);
+            out.append(reinterpret_cast<const char*>(&nbits), 8);
+            out.append(packed.begin(), packed.end());
         }
-        std::ostringstream oss;
-        for (; argi < argc; ++argi) {
-            if (argi > 0) oss << ' ';
-            oss << argv[argi];
+        if (out_path.empty()) {
+            std::cout << out;
+        } else {
+            std::ofstream f(out_path, std::ios::binary);
+            if (!f || !f.write(out.data(), out.size())) {
+                std::cerr << "Error: cannot write " << out_path << "\n";
+                return 2;
+            }
         }
-        std::string raw = oss.str();
-
-        std::string bits;
-        bits.reserve(raw.size());
-        for (char c : raw) {
-            if (c == '0' || c == '1') bits.push_back(c);
+        std::cerr << "Encoded " << values.size() << " values into " << nbits << " bits"
+                  << (out_path.empty() ? "" : " -> " + out_path) << "\n";
+        return 0;
+    } else if (op == "decode") {
+        std::vector<uint8_t> packed;
+        uint64_t nbits = 0;
+        if (!in_path.empty()) {
+            std::string data;
+            if (!read_file(in_path, data)) {
+                std::cerr << "Error: cannot read " << in_path << "\n";
+                return 2;
+            }
+            if (!load_bitstream(data, packed, nbits)) {
+                std::cerr << "Error: truncated packed bitstream in " << in_path << "\n";
+                return 2;
+            }
+        } else {
+            if (argi >= argc) {
+                std::cerr << "Error: decode requires a bitstring argument\n";
+                print_usage(argv[0]);
+                return 2;
+            }
+            std::ostringstream oss;
+            for (; argi < argc; ++argi) {
+                if (argi > 0) oss << ' ';
+                oss << argv[argi];
+            }
+            load_bitstream(oss.str(), packed, nbits);
         }
 
-        if (bits.empty()) {
+        if (nbits == 0) {
             std::cerr << "Error: provided bitstring contains no '0'/'1' characters\n";
             return 2;
         }
 
-        std::cout << "Parameters: m=" << m
-                  << " mode=" << (mode == NegativeMode::SIGN_MAGNITUDE ? "SIGN_MAGNITUDE" : "INTERLEAVED")
-                  << "\n\n";
-
-        std::cout << "Decoding bitstream (" << bits.size() << " bits):\n";
-        std::cout << bits << "\n\n";
+        if (!file_mode) {
+            std::string bits(nbits, '0');
+            unpackBits(packed.data(), nbits, &bits[0]);
+            std::cout << "Parameters: m=" << m
+                      << " mode=" << (mode == NegativeMode::SIGN_MAGNITUDE ? "SIGN_MAGNITUDE" : "INTERLEAVED")
+                      << "\n\n";
+            std::cout << "Decoding bitstream (" << bits.size() << " bits):\n";
+            std::cout << bits << "\n\n";
+        }
 
-        size_t pos = 0;
+        std::ofstream fout;
+        if (!out_path.empty()) {
+            fout.open(out_path);
+            if (!fout) {
+                std::cerr << "Error: cannot write " << out_path << "\n";
+                return 2;
+            }
+        }
+        std::ostream &values_out = out_path.empty() ? std::cout : fout;
+        BitSource r(packed.data(), nbits);
         size_t index = 0;
-        while (pos < bits.size()) {
-            std::string tail = bits.substr(pos);
-            try {
-                auto res = coder.decode(tail);
-                int64_t decoded = res.first;
-                size_t consumed = res.second;
-                if (consumed == 0) {
-                    std::cerr << "Decoding error: consumed 0 bits at pos " << pos << "\n";
-                    return 3;
-                }
-                std::cout << "Decoded[" << index << "] = " << decoded << " (consumed=" << consumed << " bits)\n";
-                pos += consumed;
-                ++index;
-            } catch (const std::exception &ex) {
-                std::cerr << "Decoding failed at pos " << pos << ": " << ex.what() << "\n";
+        while (r.position() < nbits) {
+            uint64_t pos = r.position();
+            int64_t decoded = coder.decode(r);
+            if (!r.ok()) {
+                std::cerr << "Decoding failed at pos " << pos << ": truncated codeword\n";
                 return 4;
             }
+            if (file_mode) values_out << decoded << '\n';
+            else std::cout << "Decoded[" << index << "] = " << decoded << " (consumed=" << r.position() - pos
+                           << " bits)\n";
+            ++index;
         }
 
-        std::cout << "\nDecoded " << index << " value(s).\n";
+        if (file_mode) std::cerr << "Decoded " << index << " value(s) from " << nbits << " bits.\n";
+        else std::cout << "\nDecoded " << index << " value(s).\n";
         return 0;
     } else {
         std::cerr << "Error: unknown operation '" << op << "'. Use 'encode' or 'decode'.\n";
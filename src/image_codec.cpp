@@ -2,173 +2,454 @@
 // Lossless grayscale image codec using Golomb coding of prediction residuals.
 // Usage:
 //  Encode: ./build/image_codec encode <input_gray_image> <output.gimg> [predictor]
-//  Decode: ./build/image_codec decode <input.gimg> <output_image>
-// predictor: 0=left, 1=median (JPEG-LS style). Default: 1
+//  Decode: ./build/image_codec decode <input.gimg> <output_image> [--thumb N]
+//    --thumb N writes the thumbnail subsampled by 2^N of a progressive file,
+//    reading only the part of the file it needs
+//  Verify: ./build/image_codec verify <input.gimg> [more.gimg ...]  (checksums only, no decoding)
+//  Transform: ./build/image_codec transform <op> <in.gimg> <out.gimg> [<in.gimg> <out.gimg> ...]
+//    op: neg | mirror_h | mirror_v | rotate <k> (as image_transform); the output
+//    is coded with the predictor, backend, run mode and m of the input (no m search)
+//  Train: ./build/image_codec train <out.gprof> <in_gray> [more ...]
+//    learns a profile of the adaptive backends from the images; encode with
+//    --profile <file> to start from it (decode and transform then need it too)
+// predictor: 0=left, 1=median (JPEG-LS style), 2=progressive (hierarchical
+// interpolation, decodable at 1/2 .. 1/16 size from a prefix). Default: 1
+// The encoder input may also be a gzip-compressed PGM (.pgm.gz).
+// Options (anywhere): --backend golomb|range|rans selects the entropy coder
+// (default golomb), --run codes flat areas as runs (JPEG-LS run mode), --stats prints per-stage timings and histograms to stderr,
+// --stats-json <file|-> writes the same report as JSON. -0 .. -8 pick an encoder
+// preset (fastest to smallest: predictor, m search, backend and run mode).
+// --profile <file> codes from / decodes with a trained profile (range and rans).
 
 #include <opencv2/opencv.hpp>
-#include "golomb.hpp"
+#include "entropy_coder.hpp"
+#include "image_coder.hpp"
+#include "netpbm.hpp"
+#include "pixel_ops.hpp"
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
 #include <cstdint>
-#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
 
 using namespace std;
 
-static inline uint32_t read_u32(ifstream &f) { uint32_t v; f.read(reinterpret_cast<char*>(&v),4); return v; }
-static inline uint64_t read_u64(ifstream &f) { uint64_t v; f.read(reinterpret_cast<char*>(&v),8); return v; }
-static inline void write_u32(ofstream &f, uint32_t v) { f.write(reinterpret_cast<const char*>(&v),4); }
-static inline void write_u64(ofstream &f, uint64_t v) { f.write(reinterpret_cast<const char*>(&v),8); }
+static bool reportStats(const CodecStats &stats, bool table, const string &jsonPath) {
+    if (table) stats.printTable(cerr);
+    if (jsonPath.empty()) return true;
+    if (jsonPath == "-") { stats.writeJson(cout); return true; }
+    ofstream f(jsonPath);
+    if (!f) { cerr << "Cannot write stats: " << jsonPath << "\n"; return false; }
+    stats.writeJson(f);
+    return true;
+}
+
+static bool readFile(const string &path, vector<uint8_t> &bytes) {
+    ifstream f(path, ios::binary | ios::ate);
+    if (!f) return false;
+    bytes.resize((size_t)f.tellg());
+    f.seekg(0);
+    return bool(f.read(reinterpret_cast<char*>(bytes.data()), bytes.size()));
+}
+
+// the first n bytes of the file (fewer if it is shorter)
+static bool readPrefix(const string &path, uint64_t n, vector<uint8_t> &bytes) {
+    ifstream f(path, ios::binary);
+    if (!f) return false;
+    bytes.resize((size_t)n);
+    f.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    bytes.resize((size_t)f.gcount());
+    return true;
+}
+
+// one line per file on stdout; exit status 2 if any file is damaged or unreadable
+static int verifyFiles(const vector<string> &paths) {
+    int bad = 0;
+    for (const string &path : paths) {
+        vector<uint8_t> file;
+        if (!readFile(path, file)) { cout << "UNREADABLE " << path << "\n"; ++bad; continue; }
+        ChecksumReport rep;
+        auto t0 = chrono::steady_clock::now();
+        CodecStatus st = verifyImagePlane(file.data(), file.size(), &rep);
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        if (st == CodecStatus::Ok && !rep.present) {
+            cout << "NOCRC   " << path << ": no checksums (older file), header and length OK\n";
+        } else if (st == CodecStatus::Ok) {
+            cout << "OK      " << path << ": " << rep.segments << " segments, " << rep.bytes << " bytes, "
+                 << fixed << setprecision(0) << rep.bytes / max(sec, 1e-9) / 1e6 << " MB/s\n";
+        } else {
+            ++bad;
+            cout << "CORRUPT " << path << ": ";
+            if (!rep.present) cout << codecStatusString(st) << " (header or length)";
+            else if (!rep.headerOk) cout << "header checksum mismatch or damaged chunk framing";
+            if (rep.badSegments) cout << (rep.headerOk ? "" : ", ") << rep.badSegments << " of " << rep.segments
+                                      << " segments damaged, first at byte offset " << rep.firstBadOffset;
+            cout << "\n";
+        }
+    }
+    return bad ? 2 : 0;
+}
+
+static string profileName(uint32_t id) {
+    char buf[9];
+    snprintf(buf, sizeof buf, "%08x", id);
+    return buf;
+}
+
+// --profile: the trained profile to code from / decode with
+static bool loadProfile(const string &path, CodecProfile &profile) {
+    vector<uint8_t> bytes;
+    if (!readFile(path, bytes)) { cerr << "Failed to read profile: " << path << "\n"; return false; }
+    CodecStatus st = readProfile(bytes.data(), bytes.size(), profile);
+    if (st == CodecStatus::Ok && profile.kind != PROFILE_IMAGE) st = CodecStatus::Unsupported;
+    if (st != CodecStatus::Ok) {
+        cerr << "Invalid image profile: " << path << " (" << codecStatusString(st) << ")\n";
+        return false;
+    }
+    return true;
+}
+
+// false (with a message) if the file needs a profile other than `profile`
+static bool haveProfile(const string &path, const ImageInfo &info, const CodecProfile *profile) {
+    if (!info.profile || (profile && profile->id == info.profile)) return true;
+    cerr << path << ": coded with profile " << profileName(info.profile) << "; pass it with --profile\n";
+    return false;
+}
 
-static string pack_bits_to_bytes(const string &bits) {
-    size_t n = bits.size();
-    size_t nbytes = (n + 7) / 8;
-    string out; out.resize(nbytes);
-    for (size_t i = 0; i < nbytes; ++i) out[i] = 0;
-    for (size_t i = 0; i < n; ++i) {
-        if (bits[i] == '1') out[i/8] |= (1 << (7 - (i%8)));
+// Geometric op of `transform` on a w x h plane; dst receives the ow x oh result
+static void transformPlane(const uint8_t *src, uint32_t w, uint32_t h, const string &op, int k, uint8_t *dst,
+                           uint32_t &ow, uint32_t &oh) {
+    ow = w; oh = h;
+    if (op == "neg") {
+        parallelRows((int)h, w, [&](int r0, int r1) {
+            negateRow(src + (size_t)r0 * w, dst + (size_t)r0 * w, (size_t)(r1 - r0) * w);
+        });
+    } else if (op == "mirror_h") {
+        parallelRows((int)h, w, [&](int r0, int r1) {
+            for (int r = r0; r < r1; ++r) mirrorRow(src + (size_t)r * w, dst + (size_t)r * w, w, 1);
+        });
+    } else if (op == "mirror_v") {
+        for (uint32_t r = 0; r < h; ++r)
+            std::copy(src + (size_t)r * w, src + (size_t)(r + 1) * w, dst + (size_t)(h - 1 - r) * w);
+    } else { // rotate
+        if (k & 1) { ow = h; oh = w; }
+        rotateImage(src, w, (int)w, (int)h, 1, k, dst, ow);
     }
-    return out;
 }
 
-static string unpack_bytes_to_bits(const string &bytes, uint64_t bits_len) {
-    string out; out.reserve(bits_len);
-    for (uint64_t i = 0; i < bits_len; ++i) {
-        size_t b = i/8; int off = 7 - (i%8);
-        bool bit = (bytes[b] >> off) & 1;
-        out.push_back(bit ? '1' : '0');
+// Decode, transform and re-encode each in/out pair with the coding parameters
+// of its input. Buffers are reused from one pair to the next.
+static int transformFiles(const string &op, int k, const vector<string> &paths, CodecStats *stats,
+                          const CodecProfile *profile) {
+    vector<uint8_t> file, plane, out, encoded;
+    for (size_t i = 0; i + 1 < paths.size(); i += 2) {
+        const string &inpath = paths[i], &outpath = paths[i + 1];
+        {
+            StageTimer timer(stats, "read");
+            if (!readFile(inpath, file)) { cerr << "Failed to open " << inpath << "\n"; return 1; }
+            timer.setWork(0, file.size());
+        }
+        ImageInfo info;
+        CodecStatus st = readImageInfo(file.data(), file.size(), info);
+        if (st == CodecStatus::Ok && !haveProfile(inpath, info, profile)) return 1;
+        if (st == CodecStatus::Ok) {
+            plane.resize((size_t)info.width * info.height);
+            st = decodeImagePlane(file.data(), file.size(), plane.data(), info.width, stats, profile);
+        }
+        if (st != CodecStatus::Ok) { cerr << inpath << ": decoding error: " << codecStatusString(st) << "\n"; return 1; }
+
+        uint32_t ow, oh;
+        out.resize(plane.size());
+        {
+            StageTimer timer(stats, "transform", plane.size(), plane.size());
+            transformPlane(plane.data(), info.width, info.height, op, k, out.data(), ow, oh);
+        }
+        encoded.resize(imageEncodedBound(ow, oh, info.backend, info.m));
+        size_t written = 0;
+        ImageInfo outInfo;
+        st = reencodeImagePlane(out.data(), ow, oh, ow, info, encoded.data(), encoded.size(), written, &outInfo, stats,
+                                profile);
+        if (st != CodecStatus::Ok) { cerr << inpath << ": encode failed: " << codecStatusString(st) << "\n"; return 1; }
+        {
+            StageTimer timer(stats, "write", 0, written);
+            ofstream ofs(outpath, ios::binary);
+            if (!ofs || !ofs.write(reinterpret_cast<const char*>(encoded.data()), written)) {
+                cerr << "Failed to write " << outpath << "\n"; return 1;
+            }
+        }
+        cerr << "Wrote " << outpath << " (" << ow << "x" << oh << ", bits " << info.nbits << " -> " << outInfo.nbits
+             << ")\n";
+    }
+    return 0;
+}
+
+// an encoder input: gray or color image (cv::imread), or PGM/PPM, possibly gzip-compressed
+static cv::Mat readInputImage(const string &inpath, string &err) {
+    cv::Mat img;
+    if (isGzipFile(inpath)) {
+        // inflated on a worker thread, rows stored into the plane as they arrive
+        NetpbmReader in;
+        if (in.open(inpath, err)) {
+            img.create(in.height, in.width, in.channels == 3 ? CV_8UC3 : CV_8UC1);
+            if (!in.readRows(img.ptr<uint8_t>(0), img.step, img.rows, err, true)) img = cv::Mat();
+        }
+    } else {
+        img = cv::imread(inpath, cv::IMREAD_UNCHANGED);
+    }
+    return img;
+}
+
+// encode of a gzip-compressed PGM: rows go to an ImagePlaneEncoder in bands
+// of 64 as they are inflated, so its histograms (or the adaptive coder) run
+// while the worker thread inflates the next band. False (with a message
+// printed) if the input cannot be read.
+static bool encodeGzipInput(const string &inpath, int predictor, int backend, bool runMode, int mSearch,
+                            const CodecProfile *profile, CodecStats *stats, vector<uint8_t> &encoded,
+                            size_t &written, ImageInfo &info, CodecStatus &st) {
+    NetpbmReader in;
+    string err;
+    bool ok;
+    {
+        StageTimer timer(stats, "read");
+        ok = in.open(inpath, err);
+    }
+    if (!ok) { cerr << "Failed to read input: "<<inpath<<" ("<<err<<")\n"; return false; }
+    if (in.channels != 1) { cerr << "Input must be grayscale (single channel)\n"; return false; }
+    const int bandRows = 64;
+    cv::Mat img(in.height, in.width, CV_8UC1);
+    encoded.resize(imageEncodedBound(img.cols, img.rows, backend));
+    ImagePlaneEncoder enc;
+    st = enc.start(img.ptr<uint8_t>(0), img.cols, img.rows, img.step, predictor, encoded.data(), encoded.size(),
+                   stats, backend, runMode, mSearch, profile);
+    if (st != CodecStatus::Ok) return true;
+    for (int r0 = 0; r0 < img.rows; r0 += bandRows) {
+        const int n = min(bandRows, img.rows - r0);
+        {
+            StageTimer timer(stats, "read", (uint64_t)n * img.cols, (uint64_t)n * img.cols);
+            ok = in.readRows(img.ptr<uint8_t>(r0), img.step, n, err);
+        }
+        if (!ok) { cerr << "Failed to read input: "<<inpath<<" ("<<err<<")\n"; return false; }
+        enc.rowsReady((uint32_t)n);
     }
-    return out;
+    st = enc.finish(written, &info);
+    return true;
+}
+
+// train: learn a profile from the grayscale images and write it to outpath
+static int trainProfile(const string &outpath, const vector<string> &inputs) {
+    unique_ptr<ProfileTrainer> trainer(new ProfileTrainer);
+    for (const string &inpath : inputs) {
+        string err;
+        cv::Mat img = readInputImage(inpath, err);
+        if (img.empty()) { cerr << "Failed to read input: "<<inpath<<(err.empty() ? "" : " (" + err + ")")<<"\n"; return 1; }
+        if (img.channels() != 1) { cerr << inpath << ": input must be grayscale (single channel)\n"; return 1; }
+        CodecStatus st = trainImageProfile(img.ptr<uint8_t>(0), img.cols, img.rows, img.step, *trainer);
+        if (st != CodecStatus::Ok) { cerr << "Cannot train on " << inpath << ": " << codecStatusString(st) << "\n"; return 1; }
+    }
+    CodecProfile profile;
+    trainer->finish(profile);
+    vector<uint8_t> bytes(kMaxProfileBytes);
+    size_t written = 0;
+    writeProfile(profile, bytes.data(), bytes.size(), written);
+    ofstream ofs(outpath, ios::binary);
+    if (!ofs || !ofs.write(reinterpret_cast<const char*>(bytes.data()), written)) {
+        cerr << "Failed to write " << outpath << "\n"; return 1;
+    }
+    cerr << "Trained profile " << profileName(profile.id) << " from " << trainer->files() << " images (" << written
+         << " bytes) written to " << outpath << "\n";
+    return 0;
+}
+
+// decode --thumb: the header first, then just the prefix the thumbnail needs
+static int decodeThumbnail(const string &inpath, const string &outpath, int scale, const CodecProfile *profile,
+                           CodecStats *stats, bool statsTable, const string &statsJson) {
+    vector<uint8_t> file;
+    ImageThumbnail thumb;
+    CodecStatus st;
+    {
+        StageTimer timer(stats, "read");
+        if (!readPrefix(inpath, kImageHeaderBytes, file)) { cerr<<"Failed to open "<<inpath<<"\n"; return 1; }
+        st = imageThumbnailInfo(file.data(), file.size(), scale, thumb);
+        // older files are only located from the whole file
+        if (st != CodecStatus::Ok && file.size() == kImageHeaderBytes && readFile(inpath, file))
+            st = imageThumbnailInfo(file.data(), file.size(), scale, thumb);
+        if (st == CodecStatus::Ok && thumb.bytes > file.size() && !readPrefix(inpath, thumb.bytes, file)) {
+            cerr<<"Failed to open "<<inpath<<"\n"; return 1;
+        }
+        timer.setWork(0, file.size());
+    }
+    ImageInfo info;
+    info.profile = thumb.profile;
+    if (st == CodecStatus::Ok && !haveProfile(inpath, info, profile)) return 1;
+    cv::Mat out;
+    if (st == CodecStatus::Ok) {
+        out.create(thumb.height, thumb.width, CV_8UC1);
+        st = decodeImageThumbnail(file.data(), file.size(), scale, out.ptr<uint8_t>(0), out.step, stats, profile);
+    }
+    if (st != CodecStatus::Ok) { cerr<<"Decoding error: "<<codecStatusString(st)<<"\n"; return 1; }
+    {
+        StageTimer timer(stats, "write", (uint64_t)out.rows * out.cols, (uint64_t)out.rows * out.cols);
+        if (!cv::imwrite(outpath, out)) { cerr<<"Failed to write output image\n"; return 1; }
+    }
+    if (thumb.scale == 0 && scale > 0) cerr<<"Not a progressive file, decoded at full size\n";
+    else if (thumb.scale < scale) cerr<<"File has "<<thumb.scale<<" levels only\n";
+    cerr<<"Thumbnail 1/"<<(1 << thumb.scale)<<" ("<<thumb.width<<"x"<<thumb.height<<") from "<<file.size()
+        <<" bytes written to "<<outpath<<"\n";
+    return stats && !reportStats(*stats, statsTable, statsJson) ? 1 : 0;
 }
 
 int main(int argc, char **argv) {
-    if (argc < 2) { cerr << "Usage: encode/decode ...\n"; return 1; }
-    string mode = argv[1];
+    vector<string> args;
+    bool statsTable = false;
+    string statsJson;
+    int backend = BACKEND_GOLOMB;
+    bool runMode = false;
+    int preset = -1;
+    int thumbScale = -1;
+    string profilePath;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--stats") statsTable = true;
+        else if (a == "--run") runMode = true;
+        else if (a.size() == 2 && a[0] == '-' && a[1] >= '0' && a[1] <= '8') preset = a[1] - '0';
+        else if (a == "--stats-json" && i + 1 < argc) statsJson = argv[++i];
+        else if (a == "--thumb" && i + 1 < argc) thumbScale = atoi(argv[++i]);
+        else if (a == "--profile" && i + 1 < argc) profilePath = argv[++i];
+        else if (a == "--backend" && i + 1 < argc) {
+            backend = parseBackend(argv[++i]);
+            if (backend < 0) { cerr << "Unknown backend: " << argv[i] << " (golomb, range or rans)\n"; return 1; }
+        }
+        else args.push_back(a);
+    }
+    CodecStats statsStore;
+    CodecStats *stats = (statsTable || !statsJson.empty()) ? &statsStore : nullptr;
+
+    if (args.empty()) { cerr << "Usage: encode/decode/verify/transform/train ... [--stats] [--stats-json file|-]\n"; return 1; }
+    string mode = args[0];
+    if (mode == "verify") {
+        if (args.size() < 2) { cerr << "Usage: verify <in.gimg> [more.gimg ...]\n"; return 1; }
+        return verifyFiles(vector<string>(args.begin() + 1, args.end()));
+    }
+    if (mode == "train") {
+        if (args.size() < 3) { cerr << "Usage: train <out.gprof> <in_gray> [more ...]\n"; return 1; }
+        return trainProfile(args[1], vector<string>(args.begin() + 2, args.end()));
+    }
+    CodecProfile profileStore;
+    const CodecProfile *profile = nullptr;
+    if (!profilePath.empty()) {
+        if (!loadProfile(profilePath, profileStore)) return 1;
+        profile = &profileStore;
+    }
+    if (mode == "transform") {
+        const char *usage = "Usage: transform neg|mirror_h|mirror_v|rotate <k> <in.gimg> <out.gimg> [<in.gimg> <out.gimg> ...]\n";
+        if (args.size() < 2) { cerr << usage; return 1; }
+        string op = args[1];
+        size_t first = 2;
+        int k = 0;
+        if (op == "rotate") {
+            if (args.size() < 3) { cerr << usage; return 1; }
+            k = atoi(args[2].c_str()) % 4;
+            if (k < 0) k += 4;
+            first = 3;
+        } else if (op != "neg" && op != "mirror_h" && op != "mirror_v") {
+            cerr << "Unknown operation: " << op << "\n"; return 1;
+        }
+        if (args.size() < first + 2 || (args.size() - first) % 2) { cerr << usage; return 1; }
+        if (preset >= 0 || runMode || backend != BACKEND_GOLOMB) {
+            cerr << "transform keeps the coding parameters of each input\n"; return 1;
+        }
+        int rc = transformFiles(op, k, vector<string>(args.begin() + first, args.end()), stats, profile);
+        return rc == 0 && stats && !reportStats(*stats, statsTable, statsJson) ? 1 : rc;
+    }
     if (mode == "encode") {
-        if (argc < 4) { cerr << "Usage: encode <in_gray> <out.gimg> [predictor]\n"; return 1; }
-        string inpath = argv[2];
-        string outpath = argv[3];
+        if (args.size() < 3) { cerr << "Usage: encode <in_gray> <out.gimg> [predictor 0|1|2] [--backend golomb|range|rans] [--run] [-0..-8] [--profile p.gprof]\n"; return 1; }
+        string inpath = args[1];
+        string outpath = args[2];
         int predictor = 1;
-        if (argc >= 5) predictor = atoi(argv[4]);
-
-        cv::Mat img = cv::imread(inpath, cv::IMREAD_UNCHANGED);
-        if (img.empty()) { cerr << "Failed to read input: "<<inpath<<"\n"; return 1; }
-        if (img.channels() != 1) {
-            cerr << "Input must be grayscale (single channel)\n"; return 1;
-        }
-        int h = img.rows; int w = img.cols;
-
-        // compute residuals using predictor
-        vector<int> residuals; residuals.reserve(h*w);
-        for (int r=0;r<h;++r) {
-            for (int c=0;c<w;++c) {
-                int cur = img.ptr<uint8_t>(r)[c];
-                int pred = 0;
-                if (predictor == 0) {
-                    pred = (c==0?0:img.ptr<uint8_t>(r)[c-1]);
-                } else {
-                    int left = (c==0?0:img.ptr<uint8_t>(r)[c-1]);
-                    int top = (r==0?0:img.ptr<uint8_t>(r-1)[c]);
-                    int topleft = (r==0||c==0?0:img.ptr<uint8_t>(r-1)[c-1]);
-                    int p = left + top - topleft;
-                    int a = left, b = top, cval = p;
-                    int mx = max(a,max(b,cval)); int mn = min(a,min(b,cval));
-                    if (a!=mx && a!=mn) pred=a; else if (b!=mx && b!=mn) pred=b; else pred=cval;
-                }
-                int res = cur - pred;
-                residuals.push_back(res);
+        if (args.size() >= 4) predictor = atoi(args[3].c_str());
+        int mSearch = M_SEARCH_DEFAULT;
+        if (preset >= 0) {
+            if (args.size() >= 4 || runMode || backend != BACKEND_GOLOMB) {
+                cerr << "-" << preset << " selects predictor, backend and run mode itself\n"; return 1;
             }
+            ImagePreset p = imagePreset(preset);
+            predictor = p.predictor; backend = p.backend; runMode = p.runMode; mSearch = p.mSearch;
+        }
+        if (predictor == PRED_INTERPOLATE && runMode) { cerr << "--run does not apply to progressive files\n"; return 1; }
+        if (profile && backend == BACKEND_GOLOMB) {
+            cerr << "--profile applies to the range and rans backends only\n"; return 1;
         }
 
-        // pick best m by trying candidates
-        size_t best_len = SIZE_MAX; uint32_t best_m = 1;
-        string best_bits;
-        for (uint32_t m=1;m<=64;m*=2) {
-            Golomb g(m, NegativeMode::INTERLEAVED);
-            string bits;
-            bits.reserve(residuals.size()*4);
-            for (int v: residuals) {
-                bits += g.encode(v);
+        vector<uint8_t> encoded;
+        size_t written = 0; ImageInfo info;
+        CodecStatus st;
+        if (isGzipFile(inpath)) {
+            if (!encodeGzipInput(inpath, predictor, backend, runMode, mSearch, profile, stats, encoded, written, info,
+                                 st))
+                return 1;
+        } else {
+            cv::Mat img;
+            string err;
+            {
+                StageTimer timer(stats, "read");
+                img = readInputImage(inpath, err);
+                timer.setWork((uint64_t)img.rows * img.cols, (uint64_t)img.rows * img.cols * img.channels());
             }
-            if (bits.size() < best_len) { best_len = bits.size(); best_m = m; best_bits = std::move(bits); }
-        }
-        for (uint32_t m=3;m<=32;m+=2) {
-            Golomb g(m, NegativeMode::INTERLEAVED);
-            string bits;
-            bits.reserve(residuals.size()*4);
-            for (int v: residuals) bits += g.encode(v);
-            if (bits.size() < best_len) { best_len = bits.size(); best_m = m; best_bits = std::move(bits); }
+            if (img.empty()) { cerr << "Failed to read input: "<<inpath<<(err.empty() ? "" : " (" + err + ")")<<"\n"; return 1; }
+            if (img.channels() != 1) {
+                cerr << "Input must be grayscale (single channel)\n"; return 1;
+            }
+            encoded.resize(imageEncodedBound(img.cols, img.rows, backend));
+            st = encodeImagePlane(img.ptr<uint8_t>(0), img.cols, img.rows, img.step, predictor, encoded.data(),
+                                  encoded.size(), written, &info, stats, backend, runMode, mSearch, profile);
         }
-
-        cerr << "Chosen m="<<best_m<<" bits="<<best_bits.size()<<"\n";
-
-        // pack bits to bytes
-        string packed = pack_bits_to_bytes(best_bits);
+        if (st != CodecStatus::Ok) { cerr << "Encode failed: " << codecStatusString(st) << "\n"; return 1; }
+        if (backend == BACKEND_GOLOMB) cerr << "Chosen m="<<info.m<<" bits="<<info.nbits<<"\n";
+        else cerr << "Backend "<<backendName(backend)<<" bits="<<info.nbits
+                  <<(info.profile ? " profile=" + profileName(info.profile) : "")<<"\n";
 
         // write header and data
-        ofstream ofs(outpath, ios::binary);
-        if (!ofs) { cerr << "Failed to open output file"<<outpath<<"\n"; return 1; }
-        ofs.write("GIMG",4);
-        write_u32(ofs, (uint32_t)w);
-        write_u32(ofs, (uint32_t)h);
-        uint8_t pred8 = (uint8_t)predictor; ofs.write(reinterpret_cast<char*>(&pred8),1);
-        write_u32(ofs, best_m);
-        write_u64(ofs, (uint64_t)best_bits.size());
-        ofs.write(packed.data(), packed.size());
-        ofs.close();
+        {
+            StageTimer timer(stats, "write", 0, written);
+            ofstream ofs(outpath, ios::binary);
+            if (!ofs) { cerr << "Failed to open output file"<<outpath<<"\n"; return 1; }
+            ofs.write(reinterpret_cast<const char*>(encoded.data()), written);
+        }
         cerr<<"Wrote encoded file: "<<outpath<<"\n";
-        return 0;
+        return stats && !reportStats(*stats, statsTable, statsJson) ? 1 : 0;
 
     } else if (mode == "decode") {
-        if (argc < 4) { cerr << "Usage: decode <in.gimg> <out_image>\n"; return 1; }
-        string inpath = argv[2]; string outpath = argv[3];
-        ifstream ifs(inpath, ios::binary);
-        if (!ifs) { cerr<<"Failed to open "<<inpath<<"\n"; return 1; }
-        char magic[4]; ifs.read(magic,4); if (ifs.gcount()!=4 || string(magic,4)!="GIMG") { cerr<<"Not a GIMG file\n"; return 1; }
-        uint32_t w = read_u32(ifs); uint32_t h = read_u32(ifs);
-        uint8_t pred8=0; ifs.read(reinterpret_cast<char*>(&pred8),1);
-        uint32_t m = read_u32(ifs);
-        uint64_t bits_len = read_u64(ifs);
-        string bytes; bytes.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
-        string bits = unpack_bytes_to_bits(bytes, bits_len);
-
-        Golomb g(m, NegativeMode::INTERLEAVED);
-        vector<int> residuals; residuals.reserve((size_t)w*h);
-        size_t pos=0;
-        while (pos < bits.size() && residuals.size() < (size_t)w*h) {
-            string tail = bits.substr(pos);
-            auto res = g.decode(tail);
-            residuals.push_back((int)res.first);
-            size_t consumed = res.second;
-            if (consumed==0) { cerr<<"Decoding error\n"; return 1; }
-            pos += consumed;
-        }
-        if (residuals.size() != (size_t)w*h) { cerr<<"Decoded count mismatch\n"; return 1; }
-
-        cv::Mat out(h,w,CV_8UC1);
-        size_t idx=0;
-        for (uint32_t r=0;r<h;++r) {
-            for (uint32_t c=0;c<w;++c) {
-                int pred=0;
-                if (pred8==0) {
-                    pred = (c==0?0:out.ptr<uint8_t>(r)[c-1]);
-                } else {
-                    int left = (c==0?0:out.ptr<uint8_t>(r)[c-1]);
-                    int top = (r==0?0:out.ptr<uint8_t>(r-1)[c]);
-                    int topleft = (r==0||c==0?0:out.ptr<uint8_t>(r-1)[c-1]);
-                    int p = left + top - topleft;
-                    int a=left,b=top,cval=p; int mx=max(a,max(b,cval)), mn=min(a,min(b,cval));
-                    if (a!=mx && a!=mn) pred=a; else if (b!=mx && b!=mn) pred=b; else pred=cval;
-                }
-                int val = pred + residuals[idx++];
-                if (val < 0) val = 0; else if (val > 255) val = 255;
-                out.ptr<uint8_t>(r)[c] = (uint8_t)val;
-            }
+        if (args.size() < 3) { cerr << "Usage: decode <in.gimg> <out_image> [--thumb N] [--profile p.gprof]\n"; return 1; }
+        string inpath = args[1]; string outpath = args[2];
+        vector<uint8_t> file;
+        if (thumbScale >= 0) return decodeThumbnail(inpath, outpath, thumbScale, profile, stats, statsTable, statsJson);
+        {
+            StageTimer timer(stats, "read");
+            if (!readFile(inpath, file)) { cerr<<"Failed to open "<<inpath<<"\n"; return 1; }
+            timer.setWork(0, file.size());
+        }
+
+        ImageInfo info;
+        CodecStatus st = readImageInfo(file.data(), file.size(), info);
+        if (st == CodecStatus::Corrupt && (file.size() < 4 || string(file.begin(), file.begin() + 4) != "GIMG")) {
+            cerr<<"Not a GIMG file\n"; return 1;
+        }
+        if (st == CodecStatus::Ok && !haveProfile(inpath, info, profile)) return 1;
+        cv::Mat out;
+        if (st == CodecStatus::Ok) {
+            out.create(info.height, info.width, CV_8UC1);
+            st = decodeImagePlane(file.data(), file.size(), out.ptr<uint8_t>(0), out.step, stats, profile);
+        }
+        if (st != CodecStatus::Ok) { cerr<<"Decoding error: "<<codecStatusString(st)<<"\n"; return 1; }
+        {
+            StageTimer timer(stats, "write", (uint64_t)out.rows * out.cols, (uint64_t)out.rows * out.cols);
+            if (!cv::imwrite(outpath, out)) { cerr<<"Failed to write output image\n"; return 1; }
         }
-        if (!cv::imwrite(outpath, out)) { cerr<<"Failed to write output image\n"; return 1; }
         cerr<<"Decoded image written to "<<outpath<<"\n";
-        return 0;
+        return stats && !reportStats(*stats, statsTable, statsJson) ? 1 : 0;
     }
     cerr<<"Unknown mode\n"; return 1;
 }
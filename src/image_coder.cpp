@@ -0,0 +1,1211 @@
+#include "image_coder.hpp"
+#include "entropy_coder.hpp"
+#include "run_mode.hpp"
+#include "container.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+static const char kMagic[] = "GIM2";
+static const size_t kLegacyHeaderSize = 4 + 4 + 4 + 1 + 4 + 8; // "GIMG" files
+static const int kModeRun = 0x08; // mode bit: run mode enabled
+static const int kModeCrc = 0x80; // mode bit of "GIMG" files: CRC32C trailer (checksum.hpp)
+static const int kModeProfile = 0x100; // mode bit: coded from a trained profile, INFO carries its ID
+
+// Candidate m values: powers of two up to 64 (M_SEARCH_POW2 stops there),
+// then odd values up to 31; M_SEARCH_FULL tries every m up to 64
+static const uint32_t kCandidates[] = {1, 2, 4, 8, 16, 32, 64,
+                                       3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31};
+static const size_t kPow2Candidates = 7;
+static const uint32_t kMaxCandidate = 64;
+// M_SEARCH_SAMPLED histograms one row in kSampleRows
+static const uint32_t kSampleRows = 8;
+
+// Residuals of 8-bit samples lie in [-255, 255], i.e. zig-zag values 0..510
+static const int kMaxZigZag = 510;
+
+static inline uint32_t zigzag(int v) { return v >= 0 ? (uint32_t)v << 1 : ((uint32_t)(-v) << 1) - 1; }
+
+// PRED_MEDIAN as decoded from "GIMG" files, see predict() (never stored)
+static const int kPredMedianV1 = 7;
+
+// left / top / top-left neighbours, 0 outside the image
+static inline int predict(int predictor, int left, int top, int topleft) {
+    if (predictor == PRED_LEFT) return left;
+    if (predictor == PRED_MEDIAN) {
+        int mx = std::max(left, top), mn = std::min(left, top);
+        if (topleft >= mx) return mn;
+        if (topleft <= mn) return mx;
+        return left + top - topleft;
+    }
+    // "GIMG" files: the median of left, top and left + top - topleft, except
+    // that left == top yielded the gradient, which can leave [0, 255]
+    int p = left + top - topleft;
+    int mx = std::max(left, std::max(top, p)), mn = std::min(left, std::min(top, p));
+    if (left != mx && left != mn) return left;
+    if (top != mx && top != mn) return top;
+    return p;
+}
+
+// Adaptive backends: contexts are the bit length of the local gradient
+// |left - topleft| + |top - topleft| + |topright - top| (0..765, so 0..10)
+static const int kImageContexts = 11;
+// version 1 median residuals reach +-510: zig-zag values up to 1020 have at most 10 bits
+static const int kImageClasses = 11;
+// run interruption pixels get their own two contexts (top == run value or not)
+static const int kRunContext = kImageContexts;
+
+static inline int gradientContext(int left, int top, int topleft, int topright) {
+    return CodecStats::bucket((uint64_t)(std::abs(left - topleft) + std::abs(top - topleft) + std::abs(topright - top)));
+}
+
+// typical residual bit length for a gradient context
+static inline int imagePivot(int ctx) { return std::min(std::max(ctx - 1, 0), kImageClasses - 1); }
+
+static inline int unzigzag(uint32_t z) { return (z & 1) ? -(int)((z + 1) >> 1) : (int)(z >> 1); }
+
+// Raster scan shared by every backend, of rows [r0, r1) of the plane at px
+// (row r0 - 1 provides the neighbours above); rs carries the run state from
+// one band of rows to the next. put(residual, ctx, pivot) codes one pixel;
+// contexts are only computed when kContexts is set.
+//
+// Run mode (JPEG-LS style): where left, top, topleft and topright are all
+// equal, the pixels repeating `left` are coded as one run (run_mode.hpp) up
+// to the end of the row. The pixel that interrupts a run is predicted from
+// top; when top equals the run value a zero residual is impossible, so
+// positive residuals are shifted down by one.
+template <bool kContexts, class RunOut, typename Put>
+static void scanRows(const uint8_t *px, uint32_t w, uint32_t r0, uint32_t r1, size_t stride, int predictor,
+                     bool runMode, RunState &rs, RunOut &runOut, CodecStats *stats, Put put) {
+    for (uint32_t r = r0; r < r1; ++r) {
+        const uint8_t *row = px + (size_t)r*stride;
+        const uint8_t *up = r ? row - stride : nullptr;
+        for (uint32_t c = 0; c < w; ++c) {
+            int left = c ? row[c-1] : 0;
+            int top = up ? up[c] : 0;
+            int topleft = (up && c) ? up[c-1] : 0;
+            int topright = up ? up[c + 1 < w ? c + 1 : c] : 0;
+            if (runMode && left == top && top == topleft && top == topright) {
+                uint32_t end = c;
+                while (end < w && row[end] == left) ++end;
+                encodeRun(runOut, rs, end - c, end == w);
+                if (stats) { ++stats->runs; stats->runItems += end - c; }
+                if (end == w) break;
+                c = end;
+                int runval = left;
+                left = c ? row[c-1] : 0;
+                top = up ? up[c] : 0;
+                int res = row[c] - top;
+                if (top == runval && res > 0) --res;
+                int ctx = 0, pivot = 0;
+                if (kContexts) {
+                    topleft = (up && c) ? up[c-1] : 0;
+                    topright = up ? up[c + 1 < w ? c + 1 : c] : 0;
+                    pivot = imagePivot(gradientContext(left, top, topleft, topright));
+                    ctx = kRunContext + (top != runval);
+                }
+                put(res, ctx, pivot);
+                continue;
+            }
+            int ctx = kContexts ? gradientContext(left, top, topleft, topright) : 0;
+            put(row[c] - predict(predictor, left, top, topleft), ctx, kContexts ? imagePivot(ctx) : 0);
+        }
+    }
+}
+
+template <bool kContexts, class RunOut, typename Put>
+static void scanPlane(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor, bool runMode,
+                      RunOut &runOut, CodecStats *stats, Put put) {
+    RunState rs;
+    scanRows<kContexts>(px, w, 0, h, stride, predictor, runMode, rs, runOut, stats, put);
+}
+
+// Inverse of scanPlane: get(ctx, pivot) returns the next residual. Stops
+// early (returning false) once ok() reports a damaged stream.
+template <bool kContexts, class RunIn, typename Get, typename Ok>
+static bool reconstructPlane(uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor, bool runMode,
+                             RunIn &runIn, CodecStats *stats, Get get, Ok ok) {
+    RunState rs;
+    for (uint32_t r = 0; r < h; ++r) {
+        uint8_t *row = px + (size_t)r*stride;
+        const uint8_t *up = r ? row - stride : nullptr;
+        for (uint32_t c = 0; c < w; ++c) {
+            int left = c ? row[c-1] : 0;
+            int top = up ? up[c] : 0;
+            int topleft = (up && c) ? up[c-1] : 0;
+            int topright = up ? up[c + 1 < w ? c + 1 : c] : 0;
+            if (runMode && left == top && top == topleft && top == topright) {
+                bool interrupted;
+                size_t len = decodeRun(runIn, rs, w - c, interrupted);
+                std::memset(row + c, left, len);
+                if (stats) { ++stats->runs; stats->runItems += len; }
+                if (!interrupted) break;
+                c += (uint32_t)len;
+                int runval = left;
+                left = c ? row[c-1] : 0;
+                top = up ? up[c] : 0;
+                int ctx = 0, pivot = 0;
+                if (kContexts) {
+                    topleft = (up && c) ? up[c-1] : 0;
+                    topright = up ? up[c + 1 < w ? c + 1 : c] : 0;
+                    pivot = imagePivot(gradientContext(left, top, topleft, topright));
+                    ctx = kRunContext + (top != runval);
+                }
+                int64_t res = get(ctx, pivot);
+                if (top == runval && res >= 0) ++res;
+                row[c] = (uint8_t)std::clamp<int64_t>(top + res, 0, 255);
+                continue;
+            }
+            int ctx = kContexts ? gradientContext(left, top, topleft, topright) : 0;
+            int64_t res = get(ctx, kContexts ? imagePivot(ctx) : 0);
+            row[c] = (uint8_t)std::clamp<int64_t>(predict(predictor, left, top, topleft) + res, 0, 255);
+        }
+        if (rs.bad || !ok()) return false;
+    }
+    return true;
+}
+
+// Progressive mode (PRED_INTERPOLATE), resolution levels coded coarse to
+// fine. Level 0 holds the pixels on the grid of step S = 2^levels, i.e. the
+// image subsampled by S, with the median predictor. Level k refines the
+// grid from step s = 2t to t = S >> k in two passes: the centres of the
+// s-grid cells, interpolated from their four diagonal neighbours, then the
+// rest of the t-grid from its four horizontal and vertical neighbours
+// (which the first pass completed). The opposite pair that differs less is
+// averaged, so edges are interpolated along rather than across.
+//
+// Pixel (y, x) of the step-2^j grid is pixel (y >> j, x >> j) of the image
+// subsampled by 2^j, and scanning that image with levels - j levels visits
+// exactly those pixels with the same neighbours (y + t < h holds just when
+// (y + t) >> j < ceil(h / 2^j)). A thumbnail is therefore decoded at its own
+// size, from the first levels - j + 1 levels.
+//
+// Every level is a separate byte-aligned stream: Golomb levels k > 0 start
+// with m - 1 of their two passes (kLevelMBits each; level 0 codes with the
+// m of INFO), the adaptive backends restart the coder but keep the model.
+static const int kMaxLevels = 8;     // decoder limit: levels + 6 INFO fields
+static const int kEncodeLevels = 4;  // thumbnails down to 1/16 of the size
+static const int kEncodePasses = 1 + 2 * kEncodeLevels;
+static const int kLevelMBits = 6;    // m up to kMaxCandidate
+
+// payload offset (bytes) where level k ends
+struct LevelTable {
+    uint64_t end[kMaxLevels + 1];
+};
+
+// Interpolate from two opposite pairs of neighbours, -1 outside the image;
+// grad receives the local activity for the context.
+static inline int interpolate(int a1, int a2, int b1, int b2, int &grad) {
+    if (a1 >= 0 && a2 >= 0 && b1 >= 0 && b2 >= 0) {
+        const int da = std::abs(a1 - a2), db = std::abs(b1 - b2);
+        grad = da + db;
+        return da <= db ? (a1 + a2 + 1) >> 1 : (b1 + b2 + 1) >> 1;
+    }
+    // at the border: the mean of what there is
+    int sum = 0, n = 0, lo = 255, hi = 0;
+    for (int v : {a1, a2, b1, b2}) {
+        if (v < 0) continue;
+        sum += v;
+        ++n;
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+    }
+    grad = hi - lo;
+    return (sum + n / 2) / n;
+}
+
+// Adaptive model contexts: level 0 as scanPlane, then the gradient bucket of
+// each interpolation pass (after the two run contexts)
+static inline int levelContext(int pass, int ctx) {
+    return pass == 0 ? ctx : kRunContext + 2 + ((pass & 1) ? 0 : kImageContexts) + ctx;
+}
+static const int kModelContexts = kRunContext + 2 + 2 * kImageContexts; // of both scans
+
+// adaptive backend model: cold, or the probabilities of a trained profile
+static ResidualModel initialModel(const CodecProfile *profile) {
+    return profile ? profile->model : ResidualModel(kImageClasses);
+}
+static bool isImageProfile(const CodecProfile &profile) {
+    return profile.kind == PROFILE_IMAGE && profile.model.classes == kImageClasses &&
+           profile.contexts == kModelContexts;
+}
+
+// Visit the pixels of level k of a w x h plane coded with `levels` levels;
+// code(pass, pixel, prediction, ctx) codes one, pass being 0 for level 0 and
+// 2k - 1, 2k for the two passes of level k. Px is uint8_t when decoding.
+template <bool kContexts, class Px, typename Code>
+static void scanLevel(Px *px, uint32_t w, uint32_t h, size_t stride, int levels, int k, Code code) {
+    auto at = [&](uint64_t y, uint64_t x) -> Px & { return px[y * stride + x]; };
+    if (k == 0) {
+        const uint64_t S = (uint64_t)1 << levels;
+        for (uint64_t y = 0; y < h; y += S) {
+            for (uint64_t x = 0; x < w; x += S) {
+                int left = x ? at(y, x - S) : 0;
+                int top = y ? at(y - S, x) : 0;
+                int topleft = (x && y) ? at(y - S, x - S) : 0;
+                int ctx = kContexts ? gradientContext(left, top, topleft, y ? at(y - S, x + S < w ? x + S : x) : 0) : 0;
+                code(0, at(y, x), predict(PRED_MEDIAN, left, top, topleft), ctx);
+            }
+        }
+        return;
+    }
+    const uint64_t t = (uint64_t)1 << (levels - k), s = 2 * t;
+    int grad;
+    for (uint64_t y = t; y < h; y += s) {
+        const bool down = y + t < h;
+        for (uint64_t x = t; x < w; x += s) {
+            const bool right = x + t < w;
+            int pred = interpolate(at(y - t, x - t), down && right ? at(y + t, x + t) : -1,
+                                   right ? at(y - t, x + t) : -1, down ? at(y + t, x - t) : -1, grad);
+            code(2 * k - 1, at(y, x), pred, kContexts ? CodecStats::bucket((uint64_t)grad) : 0);
+        }
+    }
+    for (uint64_t y = 0; y < h; y += t) {
+        const bool up = y >= t, down = y + t < h;
+        for (uint64_t x = y % s ? 0 : t; x < w; x += s) {
+            int pred = interpolate(x >= t ? at(y, x - t) : -1, x + t < w ? at(y, x + t) : -1,
+                                   up ? at(y - t, x) : -1, down ? at(y + t, x) : -1, grad);
+            code(2 * k, at(y, x), pred, kContexts ? CodecStats::bucket((uint64_t)grad) : 0);
+        }
+    }
+}
+
+// Adaptive coding of a plane band by band (see ImagePlaneEncoder)
+template <class Enc>
+struct AdaptiveScan {
+    Enc e;
+    ResidualModel model;
+    RunModel runModel;
+    CodedRunOut<Enc> runOut{e, runModel};
+    RunState rs;
+
+    AdaptiveScan(uint8_t *payload, size_t cap, const CodecProfile *profile)
+        : e(payload, cap), model(initialModel(profile)) {}
+    void rows(const uint8_t *px, uint32_t w, uint32_t r0, uint32_t r1, size_t stride, int predictor, bool runMode,
+              CodecStats *stats) {
+        scanRows<true>(px, w, r0, r1, stride, predictor, runMode, rs, runOut, stats, [&](int res, int ctx, int pivot) {
+            encodeResidual(e, model, ctx, pivot, zigzag(res));
+            if (stats) stats->addResidual(res);
+        });
+    }
+    size_t finish(bool &overflow) {
+        size_t n = e.finish();
+        overflow = e.overflowed();
+        return n;
+    }
+};
+
+template <class Enc>
+static size_t encodeAdaptive(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor, bool runMode,
+                             const CodecProfile *profile, uint8_t *payload, size_t cap, bool &overflow,
+                             CodecStats *stats) {
+    AdaptiveScan<Enc> scan(payload, cap, profile);
+    scan.rows(px, w, 0, h, stride, predictor, runMode, stats);
+    return scan.finish(overflow);
+}
+
+template <class Dec>
+static bool decodeAdaptive(const uint8_t *payload, size_t len, const ImageInfo &info, const CodecProfile *profile,
+                           uint8_t *px, size_t stride, CodecStats *stats) {
+    Dec d(payload, len);
+    ResidualModel model = initialModel(profile);
+    RunModel runModel;
+    CodedRunIn<Dec> runIn{d, runModel};
+    return reconstructPlane<true>(px, info.width, info.height, stride, info.predictor, info.runMode, runIn, stats,
+                                  [&](int ctx, int pivot) {
+        int res = unzigzag(decodeResidual(d, model, ctx, pivot));
+        if (stats) stats->addResidual(res);
+        return (int64_t)res;
+    }, [&] { return d.ok(); });
+}
+
+// Golomb packing: residuals are batched through the bulk (SIMD) encoder, run
+// bits go straight to the sink once the pending batch is written
+struct GolombPacker {
+    Golomb g;
+    BitSink &sink;
+    int32_t chunk[1024];
+    size_t n = 0;
+
+    GolombPacker(uint32_t m, BitSink &sink) : g(m, NegativeMode::INTERLEAVED), sink(sink) {}
+    void put(int res) {
+        chunk[n++] = res;
+        if (n == 1024) flush();
+    }
+    void flush() {
+        if (n) g.encodeArray(chunk, n, sink);
+        n = 0;
+    }
+    void runBit(int bit, int) { flush(); sink.writeBit(bit != 0); }
+    void runBits(uint32_t value, int nbits) { flush(); sink.writeBits(value, nbits); }
+};
+
+// the payload has been written at dst + kPayloadReserve; progressive files
+// pass their levels and where each but the last ends, files coded from a
+// profile its ID
+static size_t finishFile(uint8_t *dst, uint32_t w, uint32_t h, int mode, uint32_t m, uint64_t nbits,
+                         size_t payloadBytes, int levels = 0, const LevelTable *table = nullptr,
+                         uint32_t profile = 0) {
+    FieldWriter fields;
+    fields.put(w);
+    fields.put(h);
+    fields.put(mode | (profile ? kModeProfile : 0));
+    fields.put(m);
+    fields.put(nbits);
+    if (levels) {
+        fields.put(levels);
+        for (int k = 0; k < levels; ++k) fields.put(table->end[k]);
+    }
+    if (profile) fields.put(profile);
+    return (size_t)finishContainer(dst, kMagic, fields, payloadBytes);
+}
+
+static void recordTotals(CodecStats *stats, uint32_t w, uint32_t h, uint64_t nbits, uint64_t fileBytes) {
+    stats->unit = "pixel";
+    stats->items += (uint64_t)w * h;
+    stats->rawBytes += (uint64_t)w * h;
+    stats->codedBits += nbits;
+    stats->codedBytes += fileBytes;
+}
+
+size_t imageEncodedBound(uint32_t w, uint32_t h, int backend, uint32_t m) {
+    uint64_t npx = (uint64_t)w * h;
+    // m = 64 is always a candidate and codes any residual in at most 14 bits
+    // (a fixed m in at most the length of the largest zig-zag value); a run
+    // interruption adds at most 2 run bits, amortised over the pixels whose
+    // run bits raised the run index. Progressive levels add their m fields
+    // and padding, or the coder's flush, within kLevelSlack bytes each.
+    const uint64_t kLevelSlack = 16;
+    uint64_t payload;
+    if (backend == BACKEND_GOLOMB) {
+        uint64_t resBits = m ? std::max<uint64_t>(14, Golomb(m).unsignedLength(kMaxZigZag)) : 14;
+        payload = (npx * (resBits + 2) + 7) / 8;
+    } else {
+        // at most 11 adaptive decisions (< 7.1 bits each at the probability
+        // floor) and 8 raw bits per pixel, plus one run decision and run bits,
+        // plus the per-chunk rANS state words
+        uint64_t chunks = npx * 13 / RansEncoder::kChunk + 1;
+        payload = (npx * 96 + 7) / 8 + chunks * 8 + 8;
+    }
+    payload += (kEncodeLevels + 1) * kLevelSlack;
+    return kPayloadReserve + payload + containerTail(payload);
+}
+
+// Histogram of zig-zag residuals and the run bits of rows [r0, r1) of the
+// plane, continuing the run state rs. sampled: only every kSampleRows-th
+// row (each predicted from the row above it) and no runs, which is enough
+// to pick m.
+static void histogramRows(const uint8_t *px, uint32_t w, uint32_t h, uint32_t r0, uint32_t r1, size_t stride,
+                          int predictor, bool runMode, bool sampled, RunState &rs, uint64_t *hist,
+                          RunBitCounter &runBits) {
+    if (!sampled) {
+        scanRows<false>(px, w, r0, r1, stride, predictor, runMode, rs, runBits, nullptr,
+                        [&](int res, int, int) { ++hist[zigzag(res)]; });
+        return;
+    }
+    RunBitCounter none;
+    for (uint32_t r = r0 < 2 ? 1 : r0 + (kSampleRows - (r0 - 1) % kSampleRows) % kSampleRows; r < r1;
+         r += kSampleRows) {
+        RunState fresh;
+        scanRows<false>(px, w, r, r + 1, stride, predictor, false, fresh, none, nullptr,
+                        [&](int res, int, int) { ++hist[zigzag(res)]; });
+    }
+    if (h == 1 && r0 == 0 && r1 == 1)
+        scanPlane<false>(px, w, 1, stride, predictor, false, none, nullptr,
+                         [&](int res, int, int) { ++hist[zigzag(res)]; });
+}
+
+static void residualHistogram(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor,
+                              bool runMode, bool sampled, uint64_t *hist, RunBitCounter &runBits) {
+    RunState rs;
+    histogramRows(px, w, h, 0, h, stride, predictor, runMode, sampled, rs, hist, runBits);
+}
+
+// Best m for a residual histogram among the candidates of mSearch; returns
+// the exact code length of the residuals. The length of every candidate
+// follows from the histogram, without encoding the plane once per candidate.
+static uint64_t searchM(const uint64_t *hist, int mSearch, uint32_t &bestM) {
+    uint64_t bestLen = std::numeric_limits<uint64_t>::max();
+    bestM = 1;
+    const size_t n = mSearch == M_SEARCH_FULL ? kMaxCandidate
+                   : mSearch == M_SEARCH_DEFAULT ? sizeof(kCandidates) / sizeof(kCandidates[0]) : kPow2Candidates;
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t m = mSearch == M_SEARCH_FULL ? (uint32_t)i + 1 : kCandidates[i];
+        Golomb g(m, NegativeMode::INTERLEAVED);
+        uint64_t len = 0;
+        for (int z = 0; z <= kMaxZigZag; ++z) {
+            if (hist[z]) len += hist[z] * g.unsignedLength((uint64_t)z);
+        }
+        if (len < bestLen) { bestLen = len; bestM = m; }
+    }
+    return bestLen;
+}
+
+// PRED_AUTO: the predictor with the shorter Golomb code (also used as the
+// estimate for the adaptive backends), from the histograms of PRED_LEFT
+// (hist, runBits) and PRED_MEDIAN (other, otherRuns); hist and runBits
+// receive those of the predictor returned.
+static int pickPredictor(int mSearch, uint64_t *hist, RunBitCounter &runBits, const uint64_t *other,
+                         const RunBitCounter &otherRuns) {
+    uint32_t m;
+    if (searchM(other, mSearch, m) + otherRuns.bits >= searchM(hist, mSearch, m) + runBits.bits) return PRED_LEFT;
+    std::copy(other, other + kMaxZigZag + 1, hist);
+    runBits = otherRuns;
+    return PRED_MEDIAN;
+}
+
+static int choosePredictor(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, bool runMode, bool sampled,
+                           int mSearch, uint64_t *hist, RunBitCounter &runBits) {
+    uint64_t other[kMaxZigZag + 1] = {};
+    RunBitCounter otherRuns;
+    residualHistogram(px, w, h, stride, PRED_LEFT, runMode, sampled, hist, runBits);
+    residualHistogram(px, w, h, stride, PRED_MEDIAN, runMode, sampled, other, otherRuns);
+    return pickPredictor(mSearch, hist, runBits, other, otherRuns);
+}
+
+template <class Enc>
+static size_t encodeLevelsAdaptive(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int levels,
+                                   const CodecProfile *profile, uint8_t *payload, size_t cap, bool &overflow,
+                                   LevelTable &table, CodecStats *stats) {
+    ResidualModel model = initialModel(profile);
+    size_t off = 0;
+    overflow = false;
+    for (int k = 0; k <= levels; ++k) {
+        Enc e(payload && off < cap ? payload + off : nullptr, off < cap ? cap - off : 0);
+        scanLevel<true>(px, w, h, stride, levels, k, [&](int pass, const uint8_t &v, int pred, int ctx) {
+            const int res = v - pred;
+            encodeResidual(e, model, levelContext(pass, ctx), imagePivot(ctx), zigzag(res));
+            if (stats) stats->addResidual(res);
+        });
+        off += e.finish();
+        overflow = overflow || e.overflowed();
+        table.end[k] = off;
+    }
+    return off;
+}
+
+// PRED_INTERPOLATE. Golomb: one histogram per pass gives every pass its m
+// and the exact size, then one packing pass (M_SEARCH_SAMPLED searches the
+// powers of two, as sampling rows does not fit the level grids).
+static CodecStatus encodeProgressive(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, uint8_t *dst,
+                                     size_t capacity, size_t &written, ImageInfo *info, CodecStats *stats,
+                                     int backend, int mSearch, const CodecProfile *profile) {
+    const int levels = kEncodeLevels;
+    const int mode = PRED_INTERPOLATE | backend << 4;
+    const uint64_t npx = (uint64_t)w * h;
+    uint8_t *payload = capacity >= kPayloadReserve ? dst + kPayloadReserve : nullptr;
+    const size_t cap = payload ? capacity - kPayloadReserve : 0;
+    LevelTable table;
+    uint32_t m[kEncodePasses] = {};
+    uint64_t hist[kEncodePasses][kMaxZigZag + 1] = {};
+    size_t payloadBytes;
+    uint64_t nbits = 0;
+    bool overflow;
+    auto setInfo = [&] {
+        if (!info) return;
+        info->width = w; info->height = h; info->predictor = PRED_INTERPOLATE; info->runMode = false;
+        info->backend = backend; info->checksum = true; info->m = m[0]; info->nbits = nbits; info->levels = levels;
+        info->profile = profile ? profile->id : 0;
+    };
+
+    if (backend != BACKEND_GOLOMB) {
+        {
+            StageTimer timer(stats, "code", npx, npx);
+            payloadBytes = backend == BACKEND_RANGE
+                ? encodeLevelsAdaptive<RangeEncoder>(px, w, h, stride, levels, profile, payload, cap, overflow, table,
+                                                     stats)
+                : encodeLevelsAdaptive<RansEncoder>(px, w, h, stride, levels, profile, payload, cap, overflow, table,
+                                                    stats);
+        }
+        nbits = (uint64_t)payloadBytes * 8;
+    } else {
+        {
+            StageTimer timer(stats, "predict", npx, npx);
+            for (int k = 0; k <= levels; ++k)
+                scanLevel<false>(px, w, h, stride, levels, k, [&](int pass, const uint8_t &v, int pred, int) {
+                    ++hist[pass][zigzag(v - pred)];
+                });
+        }
+        {
+            StageTimer timer(stats, "m search");
+            payloadBytes = 0;
+            uint64_t levelBits = 0;
+            for (int pass = 0; pass < kEncodePasses; ++pass) {
+                levelBits += searchM(hist[pass], mSearch == M_SEARCH_SAMPLED ? M_SEARCH_POW2 : mSearch, m[pass]);
+                if (pass & 1) continue; // level k ends with pass 2k
+                if (pass) levelBits += 2 * kLevelMBits;
+                nbits = (uint64_t)payloadBytes * 8 + levelBits; // the last level's end counts
+                payloadBytes += (size_t)((levelBits + 7) / 8);
+                table.end[pass / 2] = payloadBytes;
+                levelBits = 0;
+            }
+        }
+        written = kPayloadReserve + payloadBytes + containerTail(payloadBytes);
+        if (capacity < written) { setInfo(); return CodecStatus::BufferTooSmall; }
+        {
+            StageTimer timer(stats, "pack", npx, payloadBytes);
+            BitSink sink(payload, payloadBytes);
+            GolombPacker packer(m[0], sink);
+            for (int k = 0; k <= levels; ++k) {
+                if (k) {
+                    sink.writeZeros((8 - sink.bitCount() % 8) % 8);
+                    sink.writeBits(m[2 * k - 1] - 1, kLevelMBits);
+                    sink.writeBits(m[2 * k] - 1, kLevelMBits);
+                }
+                int cur = -1;
+                scanLevel<false>(px, w, h, stride, levels, k, [&](int pass, const uint8_t &v, int pred, int) {
+                    if (pass != cur) {
+                        packer.flush();
+                        packer.g = Golomb(m[pass], NegativeMode::INTERLEAVED);
+                        cur = pass;
+                    }
+                    packer.put(v - pred);
+                });
+                packer.flush();
+            }
+            nbits = sink.bitCount();
+            payloadBytes = sink.finish();
+            overflow = sink.overflowed();
+        }
+    }
+    written = kPayloadReserve + payloadBytes + containerTail(payloadBytes);
+    setInfo();
+    if (overflow || !payload || capacity < written) return CodecStatus::BufferTooSmall;
+    {
+        StageTimer timer(stats, "container", 0, payloadBytes);
+        written = finishFile(dst, w, h, mode, m[0], nbits, payloadBytes, levels, &table, profile ? profile->id : 0);
+    }
+    if (stats && backend == BACKEND_GOLOMB) {
+        for (int pass = 0; pass < kEncodePasses; ++pass) {
+            uint64_t coded = 0;
+            for (int z = 0; z <= kMaxZigZag; ++z) {
+                stats->residualHist[CodecStats::bucket((z + 1) / 2)] += hist[pass][z];
+                coded += hist[pass][z];
+            }
+            stats->addM(m[pass], coded);
+        }
+    }
+    if (stats) recordTotals(stats, w, h, nbits, written);
+    return CodecStatus::Ok;
+}
+
+// Decode levels 0..last of a progressive payload into the w x h plane, the
+// image subsampled by 2^(info.levels - last).
+static bool decodeLevels(const uint8_t *payload, const ImageInfo &info, const LevelTable &table, int last,
+                         const CodecProfile *profile, uint8_t *px, uint32_t w, uint32_t h, size_t stride,
+                         CodecStats *stats) {
+    if (info.backend != BACKEND_GOLOMB) {
+        ResidualModel model = initialModel(profile);
+        for (int k = 0; k <= last; ++k) {
+            const uint64_t start = k ? table.end[k - 1] : 0;
+            auto level = [&](auto &d) {
+                scanLevel<true>(px, w, h, stride, last, k, [&](int pass, uint8_t &v, int pred, int ctx) {
+                    const int res = unzigzag(decodeResidual(d, model, levelContext(pass, ctx), imagePivot(ctx)));
+                    v = (uint8_t)std::clamp(pred + res, 0, 255);
+                    if (stats) stats->addResidual(res);
+                });
+                return d.ok();
+            };
+            bool ok;
+            if (info.backend == BACKEND_RANGE) {
+                RangeDecoder d(payload + start, (size_t)(table.end[k] - start));
+                ok = level(d);
+            } else {
+                RansDecoder d(payload + start, (size_t)(table.end[k] - start));
+                ok = level(d);
+            }
+            if (!ok) return false;
+        }
+        return true;
+    }
+    for (int k = 0; k <= last; ++k) {
+        const uint64_t start = k ? table.end[k - 1] : 0;
+        BitSource bits(payload + start, k == info.levels ? info.nbits - start * 8 : (table.end[k] - start) * 8);
+        uint32_t m[2] = {info.m, info.m}; // by pass & 1: pass 2k, pass 2k - 1
+        if (k) {
+            m[1] = (uint32_t)bits.readBits(kLevelMBits) + 1;
+            m[0] = (uint32_t)bits.readBits(kLevelMBits) + 1;
+        }
+        const Golomb g[2] = {Golomb(m[0], NegativeMode::INTERLEAVED), Golomb(m[1], NegativeMode::INTERLEAVED)};
+        uint64_t coded[2] = {};
+        scanLevel<false>(px, w, h, stride, last, k, [&](int pass, uint8_t &v, int pred, int) {
+            const int64_t res = g[pass & 1].decode(bits);
+            v = (uint8_t)std::clamp<int64_t>(pred + res, 0, 255);
+            if (stats) { stats->addResidual(res); ++coded[pass & 1]; }
+        });
+        if (!bits.ok()) return false;
+        if (stats) {
+            stats->addM(m[0], coded[0]);
+            if (k) stats->addM(m[1], coded[1]);
+        }
+    }
+    return true;
+}
+
+ImagePreset imagePreset(int level) {
+    // predictor, backend, runMode, mSearch
+    static const ImagePreset kPresets[9] = {
+        {PRED_LEFT, BACKEND_GOLOMB, false, M_SEARCH_SAMPLED}, {PRED_MEDIAN, BACKEND_GOLOMB, false, M_SEARCH_SAMPLED},
+        {PRED_MEDIAN, BACKEND_GOLOMB, true, M_SEARCH_SAMPLED}, {PRED_MEDIAN, BACKEND_GOLOMB, true, M_SEARCH_POW2},
+        {PRED_MEDIAN, BACKEND_GOLOMB, true, M_SEARCH_DEFAULT}, {PRED_AUTO, BACKEND_GOLOMB, true, M_SEARCH_FULL},
+        {PRED_MEDIAN, BACKEND_RANGE, false, M_SEARCH_DEFAULT}, {PRED_MEDIAN, BACKEND_RANGE, true, M_SEARCH_DEFAULT},
+        {PRED_AUTO, BACKEND_RANGE, true, M_SEARCH_DEFAULT}};
+    return kPresets[std::min(std::max(level, 0), 8)];
+}
+
+// Golomb coding of the plane with the m picked by mSearch, or with fixedM
+// (0 = search). hist and runBits already hold the histogram of predictor
+// when haveHist.
+//
+// Exact search: histogram of zig-zag residuals, from which the code length
+// of every candidate m follows (run bits do not depend on m and are
+// simply added), then one packing pass at the exact size. Sampled: m from
+// a partial histogram; sampled or fixed m: the size is only known once
+// packed.
+static CodecStatus encodeGolomb(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor,
+                                bool runMode, int mSearch, uint32_t fixedM, bool haveHist, uint64_t *hist,
+                                RunBitCounter &runBits, uint8_t *dst, size_t capacity, size_t &written,
+                                ImageInfo *info, CodecStats *stats) {
+    const uint64_t npx = (uint64_t)w * h;
+    const bool sampled = mSearch == M_SEARCH_SAMPLED;
+    const int mode = predictor | (runMode ? kModeRun : 0) | BACKEND_GOLOMB << 4;
+    const bool packOnly = sampled || fixedM;
+    uint64_t nbits = 0;
+    uint32_t bestM = fixedM;
+    if (!fixedM) {
+        if (!haveHist) {
+            StageTimer timer(stats, "predict", npx, npx);
+            residualHistogram(px, w, h, stride, predictor, runMode, sampled, hist, runBits);
+        }
+        StageTimer timer(stats, "m search");
+        nbits = searchM(hist, mSearch, bestM) + runBits.bits;
+    }
+
+    size_t payloadBytes = packOnly ? (capacity > kPayloadReserve ? capacity - kPayloadReserve : 0)
+                                   : (size_t)((nbits + 7) / 8);
+    if (!packOnly) {
+        written = kPayloadReserve + payloadBytes + containerTail(payloadBytes);
+        if (capacity < written) {
+            if (info) {
+                info->width = w; info->height = h; info->predictor = predictor; info->runMode = runMode;
+                info->backend = BACKEND_GOLOMB; info->checksum = true; info->m = bestM; info->nbits = nbits;
+                info->profile = 0;
+            }
+            return CodecStatus::BufferTooSmall;
+        }
+    }
+    // residual statistics come from the packing pass unless the full histogram was taken
+    const bool packHist = packOnly && stats;
+    if (packHist) std::fill(hist, hist + kMaxZigZag + 1, 0);
+    bool overflow;
+    {
+        StageTimer timer(stats, "pack", npx, payloadBytes);
+        BitSink sink(capacity > kPayloadReserve ? dst + kPayloadReserve : nullptr, payloadBytes);
+        GolombPacker packer(bestM, sink);
+        scanPlane<false>(px, w, h, stride, predictor, runMode, packer, stats, [&](int res, int, int) {
+            packer.put(res);
+            if (packHist) ++hist[zigzag(res)];
+        });
+        packer.flush();
+        payloadBytes = sink.finish();
+        nbits = sink.bitCount();
+        overflow = sink.overflowed();
+    }
+    written = kPayloadReserve + payloadBytes + containerTail(payloadBytes);
+    if (info) {
+        info->width = w; info->height = h; info->predictor = predictor; info->runMode = runMode;
+        info->backend = BACKEND_GOLOMB; info->checksum = true; info->m = bestM; info->nbits = nbits;
+        info->profile = 0;
+    }
+    if (overflow || capacity < written) return CodecStatus::BufferTooSmall;
+    {
+        StageTimer timer(stats, "container", 0, payloadBytes);
+        written = finishFile(dst, w, h, mode, bestM, nbits, payloadBytes);
+    }
+    if (stats) {
+        uint64_t coded = 0;
+        for (int z = 0; z <= kMaxZigZag; ++z) {
+            stats->residualHist[CodecStats::bucket((z + 1) / 2)] += hist[z];
+            coded += hist[z];
+        }
+        stats->addM(bestM, coded);
+        recordTotals(stats, w, h, nbits, written);
+    }
+    return CodecStatus::Ok;
+}
+
+// Golomb coding as encodeGolomb, with the retry of a sampled m search:
+// a sampled m may suit the other rows far worse (m = 1 spends up to 511
+// bits on a residual), so if it does not fit, the plane is coded again with
+// m searched on the whole plane, whose exact minimiser stays within
+// imageEncodedBound. The statistics of the discarded pass only count as
+// time spent.
+static CodecStatus encodeGolombPlane(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor,
+                                     bool runMode, int mSearch, uint32_t fixedM, bool haveHist, uint64_t *hist,
+                                     RunBitCounter &runBits, uint8_t *dst, size_t capacity, size_t &written,
+                                     ImageInfo *info, CodecStats *stats) {
+    if (mSearch != M_SEARCH_SAMPLED || fixedM)
+        return encodeGolomb(px, w, h, stride, predictor, runMode, mSearch, fixedM, haveHist, hist, runBits, dst,
+                            capacity, written, info, stats);
+    CodecStats trial;
+    ImageInfo trialInfo;
+    CodecStatus st = encodeGolomb(px, w, h, stride, predictor, runMode, M_SEARCH_SAMPLED, 0, haveHist, hist,
+                                  runBits, dst, capacity, written, &trialInfo, stats ? &trial : nullptr);
+    if (st == CodecStatus::Ok) {
+        if (info) *info = trialInfo;
+        if (stats) stats->merge(trial);
+        return st;
+    }
+    if (stats) {
+        double wall = 0, cpu = 0;
+        for (const StageStats &s : trial.stages) { wall += s.wallSeconds; cpu += s.cpuSeconds; }
+        stats->addStage("sampled pack (discarded)", wall, cpu, (uint64_t)w * h, 0);
+    }
+    std::fill(hist, hist + kMaxZigZag + 1, 0);
+    runBits = RunBitCounter();
+    return encodeGolomb(px, w, h, stride, predictor, runMode, M_SEARCH_POW2, 0, false, hist, runBits, dst,
+                        capacity, written, info, stats);
+}
+
+// Adaptive backends: lay out the file around the payload of `bytes` coded
+// at dst + kPayloadReserve
+static CodecStatus finishAdaptive(uint32_t w, uint32_t h, int predictor, bool runMode, int backend,
+                                  const CodecProfile *profile, size_t bytes, bool overflow, uint8_t *dst,
+                                  size_t capacity, size_t &written, ImageInfo *info, CodecStats *stats) {
+    written = kPayloadReserve + bytes + containerTail(bytes);
+    uint64_t nbits = (uint64_t)bytes * 8;
+    if (info) {
+        info->width = w; info->height = h; info->predictor = predictor; info->runMode = runMode;
+        info->backend = backend; info->checksum = true; info->m = 0; info->nbits = nbits;
+        info->profile = profile ? profile->id : 0;
+    }
+    if (overflow || capacity < kPayloadReserve || capacity < written) return CodecStatus::BufferTooSmall;
+    {
+        StageTimer timer(stats, "container", 0, bytes);
+        const int mode = predictor | (runMode ? kModeRun : 0) | backend << 4;
+        written = finishFile(dst, w, h, mode, 0, nbits, bytes, 0, nullptr, profile ? profile->id : 0);
+    }
+    if (stats) recordTotals(stats, w, h, nbits, written);
+    return CodecStatus::Ok;
+}
+
+// Parameters of encodeImagePlane; profile is dropped for Golomb coding.
+static CodecStatus checkPlaneParams(int predictor, int backend, bool runMode, int mSearch,
+                                    const CodecProfile *&profile) {
+    if (predictor != PRED_LEFT && predictor != PRED_MEDIAN && predictor != PRED_AUTO && predictor != PRED_INTERPOLATE)
+        return CodecStatus::Unsupported;
+    if (backend < BACKEND_GOLOMB || backend > BACKEND_RANS) return CodecStatus::Unsupported;
+    if (mSearch < M_SEARCH_SAMPLED || mSearch > M_SEARCH_FULL) return CodecStatus::Unsupported;
+    if (backend == BACKEND_GOLOMB) profile = nullptr; // m is chosen for the whole plane
+    if (profile && !isImageProfile(*profile)) return CodecStatus::Unsupported;
+    if (predictor == PRED_INTERPOLATE && runMode) return CodecStatus::Unsupported;
+    return CodecStatus::Ok;
+}
+
+// fixedM: Golomb parameter to code with instead of searching (0 = search)
+static CodecStatus encodePlane(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor,
+                               uint8_t *dst, size_t capacity, size_t &written, ImageInfo *info, CodecStats *stats,
+                               int backend, bool runMode, int mSearch, uint32_t fixedM, const CodecProfile *profile) {
+    written = 0;
+    CodecStatus st = checkPlaneParams(predictor, backend, runMode, mSearch, profile);
+    if (st != CodecStatus::Ok) return st;
+    if (predictor == PRED_INTERPOLATE)
+        return encodeProgressive(px, w, h, stride, dst, capacity, written, info, stats, backend, mSearch, profile);
+    const uint64_t npx = (uint64_t)w * h;
+    const bool sampled = mSearch == M_SEARCH_SAMPLED;
+    uint64_t hist[kMaxZigZag + 1] = {};
+    RunBitCounter runBits;
+    const bool haveHist = predictor == PRED_AUTO; // hist then belongs to the chosen predictor
+    if (predictor == PRED_AUTO) {
+        StageTimer timer(stats, "predictor search", 2 * npx, 2 * npx);
+        predictor = choosePredictor(px, w, h, stride, runMode, sampled || backend != BACKEND_GOLOMB, mSearch,
+                                    hist, runBits);
+    }
+    if (backend == BACKEND_GOLOMB)
+        return encodeGolombPlane(px, w, h, stride, predictor, runMode, mSearch, fixedM, haveHist, hist, runBits, dst,
+                                 capacity, written, info, stats);
+
+    uint8_t *payload = capacity >= kPayloadReserve ? dst + kPayloadReserve : nullptr;
+    size_t cap = payload ? capacity - kPayloadReserve : 0;
+    size_t bytes;
+    bool overflow;
+    {
+        StageTimer timer(stats, "code", npx, npx);
+        bytes = backend == BACKEND_RANGE
+            ? encodeAdaptive<RangeEncoder>(px, w, h, stride, predictor, runMode, profile, payload, cap, overflow,
+                                           stats)
+            : encodeAdaptive<RansEncoder>(px, w, h, stride, predictor, runMode, profile, payload, cap, overflow,
+                                          stats);
+    }
+    return finishAdaptive(w, h, predictor, runMode, backend, profile, bytes, overflow, dst, capacity, written, info,
+                          stats);
+}
+
+CodecStatus encodeImagePlane(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor,
+                             uint8_t *dst, size_t capacity, size_t &written, ImageInfo *info, CodecStats *stats,
+                             int backend, bool runMode, int mSearch, const CodecProfile *profile) {
+    return encodePlane(px, w, h, stride, predictor, dst, capacity, written, info, stats, backend, runMode, mSearch, 0,
+                       profile);
+}
+
+// ImagePlaneEncoder: each band extends the histograms (both predictors'
+// for PRED_AUTO) or the adaptive coder, whose run states carry over from
+// one band to the next exactly as within scanPlane.
+struct ImagePlaneEncoder::State {
+    const uint8_t *px = nullptr;
+    uint32_t w = 0, h = 0;
+    size_t stride = 0;
+    int predictor = PRED_MEDIAN;
+    uint8_t *dst = nullptr;
+    size_t capacity = 0;
+    CodecStats *stats = nullptr;
+    int backend = BACKEND_GOLOMB;
+    bool runMode = false;
+    int mSearch = M_SEARCH_DEFAULT;
+    const CodecProfile *profile = nullptr;
+    bool ok = false;             // started with valid arguments
+    uint32_t rows = 0;           // rows ready so far
+
+    // Golomb and PRED_AUTO: histograms of PRED_LEFT and PRED_MEDIAN, or of the predictor
+    bool histograms = false;
+    bool sampled = false;
+    uint64_t hist[2][kMaxZigZag + 1];
+    RunBitCounter runBits[2];
+    RunState rs[2];
+    // adaptive backends with a fixed predictor
+    std::unique_ptr<AdaptiveScan<RangeEncoder>> range;
+    std::unique_ptr<AdaptiveScan<RansEncoder>> rans;
+};
+
+ImagePlaneEncoder::ImagePlaneEncoder() = default;
+ImagePlaneEncoder::~ImagePlaneEncoder() = default;
+
+CodecStatus ImagePlaneEncoder::start(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor,
+                                     uint8_t *dst, size_t capacity, CodecStats *stats, int backend, bool runMode,
+                                     int mSearch, const CodecProfile *profile) {
+    st.reset(new State);
+    State &s = *st;
+    CodecStatus status = checkPlaneParams(predictor, backend, runMode, mSearch, profile);
+    if (status != CodecStatus::Ok) return status;
+    s.px = px; s.w = w; s.h = h; s.stride = stride; s.predictor = predictor;
+    s.dst = dst; s.capacity = capacity; s.stats = stats;
+    s.backend = backend; s.runMode = runMode; s.mSearch = mSearch; s.profile = profile;
+    s.ok = true;
+    if (predictor == PRED_INTERPOLATE) return CodecStatus::Ok; // levels need the whole plane
+    if (backend == BACKEND_GOLOMB || predictor == PRED_AUTO) {
+        s.histograms = true;
+        s.sampled = mSearch == M_SEARCH_SAMPLED || backend != BACKEND_GOLOMB;
+        std::fill(&s.hist[0][0], &s.hist[0][0] + 2 * (kMaxZigZag + 1), 0);
+        return CodecStatus::Ok;
+    }
+    uint8_t *payload = capacity >= kPayloadReserve ? dst + kPayloadReserve : nullptr;
+    size_t cap = payload ? capacity - kPayloadReserve : 0;
+    if (backend == BACKEND_RANGE) s.range.reset(new AdaptiveScan<RangeEncoder>(payload, cap, profile));
+    else s.rans.reset(new AdaptiveScan<RansEncoder>(payload, cap, profile));
+    return CodecStatus::Ok;
+}
+
+void ImagePlaneEncoder::rowsReady(uint32_t rows) {
+    if (!st || !st->ok) return;
+    State &s = *st;
+    const uint32_t r0 = s.rows, r1 = (uint32_t)std::min<uint64_t>((uint64_t)r0 + rows, s.h);
+    s.rows = r1;
+    if (r0 == r1) return;
+    const uint64_t band = (uint64_t)(r1 - r0) * s.w;
+    if (s.histograms && s.predictor == PRED_AUTO) {
+        StageTimer timer(s.stats, "predictor search", 2 * band, 2 * band);
+        for (int p : {PRED_LEFT, PRED_MEDIAN})
+            histogramRows(s.px, s.w, s.h, r0, r1, s.stride, p, s.runMode, s.sampled, s.rs[p], s.hist[p], s.runBits[p]);
+    } else if (s.histograms) {
+        StageTimer timer(s.stats, "predict", band, band);
+        histogramRows(s.px, s.w, s.h, r0, r1, s.stride, s.predictor, s.runMode, s.sampled, s.rs[0], s.hist[0],
+                      s.runBits[0]);
+    } else if (s.range || s.rans) {
+        StageTimer timer(s.stats, "code", band, band);
+        if (s.range) s.range->rows(s.px, s.w, r0, r1, s.stride, s.predictor, s.runMode, s.stats);
+        else s.rans->rows(s.px, s.w, r0, r1, s.stride, s.predictor, s.runMode, s.stats);
+    }
+}
+
+CodecStatus ImagePlaneEncoder::finish(size_t &written, ImageInfo *info) {
+    written = 0;
+    if (!st || !st->ok || st->rows < st->h) return CodecStatus::Unsupported;
+    State &s = *st;
+    s.ok = false;
+    if (!s.histograms && !s.range && !s.rans)
+        return encodePlane(s.px, s.w, s.h, s.stride, s.predictor, s.dst, s.capacity, written, info, s.stats,
+                           s.backend, s.runMode, s.mSearch, 0, s.profile);
+    if (s.range || s.rans) {
+        bool overflow;
+        size_t bytes = s.range ? s.range->finish(overflow) : s.rans->finish(overflow);
+        return finishAdaptive(s.w, s.h, s.predictor, s.runMode, s.backend, s.profile, bytes, overflow, s.dst,
+                              s.capacity, written, info, s.stats);
+    }
+    int predictor = s.predictor;
+    if (predictor == PRED_AUTO) {
+        StageTimer timer(s.stats, "predictor search");
+        predictor = pickPredictor(s.mSearch, s.hist[PRED_LEFT], s.runBits[PRED_LEFT], s.hist[PRED_MEDIAN],
+                                  s.runBits[PRED_MEDIAN]);
+    }
+    if (s.backend == BACKEND_GOLOMB)
+        return encodeGolombPlane(s.px, s.w, s.h, s.stride, predictor, s.runMode, s.mSearch, 0, true, s.hist[0],
+                                 s.runBits[0], s.dst, s.capacity, written, info, s.stats);
+    return encodePlane(s.px, s.w, s.h, s.stride, predictor, s.dst, s.capacity, written, info, s.stats, s.backend,
+                       s.runMode, s.mSearch, 0, s.profile);
+}
+
+// The profile to decode (or recode) a file with: the caller's if the file
+// names it, none if the file was coded cold; Unsupported if the caller lacks it.
+static CodecStatus fileProfile(const ImageInfo &info, const CodecProfile *&profile) {
+    if (!info.profile) profile = nullptr;
+    else if (!profile || profile->id != info.profile || !isImageProfile(*profile)) return CodecStatus::Unsupported;
+    return CodecStatus::Ok;
+}
+
+CodecStatus reencodeImagePlane(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, const ImageInfo &like,
+                               uint8_t *dst, size_t capacity, size_t &written, ImageInfo *info, CodecStats *stats,
+                               const CodecProfile *profile) {
+    if (like.backend == BACKEND_GOLOMB && like.m == 0) return CodecStatus::Unsupported;
+    if (fileProfile(like, profile) != CodecStatus::Ok) return CodecStatus::Unsupported;
+    return encodePlane(px, w, h, stride, like.predictor, dst, capacity, written, info, stats, like.backend,
+                       like.runMode, M_SEARCH_DEFAULT, like.backend == BACKEND_GOLOMB ? like.m : 0, profile);
+}
+
+// Training counts the decisions of every context of the adaptive backends:
+// a raster scan with the median predictor, one in run mode for the two run
+// interruption contexts only, and the interpolation passes of a progressive
+// file (level 0 is a raster scan again).
+CodecStatus trainImageProfile(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, ProfileTrainer &trainer) {
+    if (!trainer.start(PROFILE_IMAGE, kImageClasses, kModelContexts)) return CodecStatus::Unsupported;
+    RunBitCounter runOut;
+    for (int runs = 0; runs < 2; ++runs) {
+        scanPlane<true>(px, w, h, stride, PRED_MEDIAN, runs != 0, runOut, nullptr, [&](int res, int ctx, int pivot) {
+            if ((runs != 0) == (ctx >= kRunContext)) trainer.addResidual(ctx, pivot, zigzag(res));
+        });
+    }
+    for (int k = 1; k <= kEncodeLevels; ++k) {
+        scanLevel<true>(px, w, h, stride, kEncodeLevels, k, [&](int pass, const uint8_t &v, int pred, int ctx) {
+            trainer.addResidual(levelContext(pass, ctx), imagePivot(ctx), zigzag(v - pred));
+        });
+    }
+    return CodecStatus::Ok;
+}
+
+// "GIMG" files: fixed header in host byte order, then the payload and, if
+// flagged, a checksum trailer (the header as its head).
+static CodecStatus parseLegacy(const uint8_t *src, size_t len, ImageInfo &info) {
+    if (len < kLegacyHeaderSize) return CodecStatus::Corrupt;
+    const uint8_t *p = src + 4;
+    std::memcpy(&info.width, p, 4); p += 4;
+    std::memcpy(&info.height, p, 4); p += 4;
+    info.predictor = *p & 0x07;
+    info.runMode = (*p & kModeRun) != 0;
+    info.checksum = (*p & kModeCrc) != 0;
+    info.backend = (*p++ >> 4) & 0x07;
+    info.levels = 0;
+    info.profile = 0;
+    std::memcpy(&info.m, p, 4); p += 4;
+    std::memcpy(&info.nbits, p, 8);
+    const uint64_t payloadLen = info.nbits / 8 + (info.nbits % 8 != 0);
+    if (payloadLen > len - kLegacyHeaderSize) return CodecStatus::Corrupt;
+    // checksummed files end right after the trailer
+    if (info.checksum && len - kLegacyHeaderSize - payloadLen != checksumTrailerSize(payloadLen)) return CodecStatus::Corrupt;
+    return CodecStatus::Ok;
+}
+
+// INFO fields of a version 2 file; view.data only needs its size
+static CodecStatus parseInfo(const ContainerView &view, ImageInfo &info, LevelTable &table) {
+    FieldReader f(view.info.body, view.info.size);
+    uint64_t w = f.get(), h = f.get(), mode = f.get(), m = f.get();
+    info.nbits = f.get();
+    if (f.error || w > UINT32_MAX || h > UINT32_MAX || m > UINT32_MAX || mode > 0x1FF) return CodecStatus::Corrupt;
+    if (info.nbits / 8 + (info.nbits % 8 != 0) != view.data.size) return CodecStatus::Corrupt;
+    info.width = (uint32_t)w;
+    info.height = (uint32_t)h;
+    info.predictor = (int)(mode & 0x07);
+    info.runMode = (mode & kModeRun) != 0;
+    info.backend = (int)((mode >> 4) & 0x07);
+    info.m = (uint32_t)m;
+    info.checksum = true;
+    info.levels = 0;
+    if (info.predictor == PRED_INTERPOLATE) {
+        const uint64_t levels = f.get();
+        if (f.error || levels == 0) return CodecStatus::Corrupt;
+        if (levels > kMaxLevels) return CodecStatus::Unsupported;
+        info.levels = (int)levels;
+        uint64_t prev = 0;
+        for (int k = 0; k < info.levels; ++k) {
+            table.end[k] = f.get();
+            if (f.error || table.end[k] < prev || table.end[k] * 8 > info.nbits) return CodecStatus::Corrupt;
+            prev = table.end[k];
+        }
+        table.end[info.levels] = view.data.size;
+    }
+    const uint64_t profile = (mode & kModeProfile) ? f.get() : 0;
+    if (f.error || profile > UINT32_MAX || ((mode & kModeProfile) && !profile)) return CodecStatus::Corrupt;
+    info.profile = (uint32_t)profile;
+    return CodecStatus::Ok;
+}
+
+// Coding parameters the decoder handles
+static CodecStatus checkCoding(const ImageInfo &info, bool legacy) {
+    if (info.backend == BACKEND_GOLOMB && info.m == 0) return CodecStatus::Corrupt;
+    if (info.predictor != PRED_LEFT && info.predictor != PRED_MEDIAN &&
+        (legacy || info.predictor != PRED_INTERPOLATE))
+        return CodecStatus::Unsupported;
+    if (info.backend > BACKEND_RANS) return CodecStatus::Unsupported;
+    if (info.runMode && info.predictor == PRED_INTERPOLATE) return CodecStatus::Unsupported;
+    if (info.profile && info.backend == BACKEND_GOLOMB) return CodecStatus::Unsupported;
+    return CodecStatus::Ok;
+}
+
+// Header fields of either version and where the payload is, checked against
+// len; checksums of the header (not of the payload) are checked. table
+// receives the levels of progressive files.
+static CodecStatus parseFile(const uint8_t *src, size_t len, ImageInfo &info, const uint8_t *&payload,
+                             bool &legacy, LevelTable &table) {
+    legacy = hasMagic(src, len, "GIMG");
+    if (legacy) {
+        CodecStatus st = parseLegacy(src, len, info);
+        if (st != CodecStatus::Ok) return st;
+        payload = src + kLegacyHeaderSize;
+        if (info.checksum && !checkHeaderChecksum(src, kLegacyHeaderSize, (size_t)((info.nbits + 7) / 8)))
+            return CodecStatus::Corrupt;
+    } else {
+        ContainerView view;
+        CodecStatus st = readContainer(src, len, kMagic, view);
+        if (st == CodecStatus::Ok) st = parseInfo(view, info, table);
+        if (st != CodecStatus::Ok) return st;
+        payload = view.data.body;
+    }
+    return checkCoding(info, legacy);
+}
+
+CodecStatus readImageInfo(const uint8_t *src, size_t len, ImageInfo &info) {
+    const uint8_t *payload;
+    bool legacy;
+    LevelTable table;
+    return parseFile(src, len, info, payload, legacy, table);
+}
+
+CodecStatus verifyImagePlane(const uint8_t *src, size_t len, ChecksumReport *report) {
+    if (report) *report = ChecksumReport();
+    if (!hasMagic(src, len, "GIMG")) return verifyContainer(src, len, kMagic, report);
+    ImageInfo info;
+    CodecStatus st = parseLegacy(src, len, info);
+    if (st != CodecStatus::Ok || !info.checksum) return st;
+    return verifyChecksums(src, kLegacyHeaderSize, (size_t)((info.nbits + 7) / 8), report);
+}
+
+CodecStatus decodeImagePlane(const uint8_t *src, size_t len, uint8_t *px, size_t stride, CodecStats *stats,
+                             const CodecProfile *profile) {
+    ImageInfo info;
+    const uint8_t *payload;
+    bool legacy;
+    LevelTable table;
+    CodecStatus st = parseFile(src, len, info, payload, legacy, table);
+    if (st == CodecStatus::Ok) st = fileProfile(info, profile);
+    if (st != CodecStatus::Ok) return st;
+    if (legacy && info.predictor == PRED_MEDIAN) info.predictor = kPredMedianV1;
+
+    const uint64_t npx = (uint64_t)info.width * info.height;
+    const uint64_t fileBytes = info.checksum ? len : kLegacyHeaderSize + (info.nbits + 7) / 8;
+    if (info.checksum) {
+        StageTimer timer(stats, "checksum", 0, fileBytes);
+        if (verifyImagePlane(src, len) != CodecStatus::Ok) return CodecStatus::Corrupt;
+    }
+    StageTimer timer(stats, "decode", npx, npx);
+    if (info.levels) {
+        if (!decodeLevels(payload, info, table, info.levels, profile, px, info.width, info.height, stride, stats))
+            return CodecStatus::Corrupt;
+        if (stats) recordTotals(stats, info.width, info.height, info.nbits, fileBytes);
+        return CodecStatus::Ok;
+    }
+    if (info.backend != BACKEND_GOLOMB) {
+        size_t bytes = (size_t)(info.nbits / 8);
+        bool ok = info.backend == BACKEND_RANGE
+            ? decodeAdaptive<RangeDecoder>(payload, bytes, info, profile, px, stride, stats)
+            : decodeAdaptive<RansDecoder>(payload, bytes, info, profile, px, stride, stats);
+        if (!ok) return CodecStatus::Corrupt;
+        if (stats) recordTotals(stats, info.width, info.height, info.nbits, fileBytes);
+        return CodecStatus::Ok;
+    }
+    Golomb g(info.m, NegativeMode::INTERLEAVED);
+    BitSource bits(payload, info.nbits);
+    BitRunIn runIn{bits};
+    uint64_t coded = 0;
+    bool ok = reconstructPlane<false>(px, info.width, info.height, stride, info.predictor, info.runMode, runIn, stats,
+                                      [&](int, int) {
+        int64_t res = g.decode(bits);
+        if (stats) { stats->addResidual(res); ++coded; }
+        return res;
+    }, [&] { return bits.ok(); });
+    if (!ok) return CodecStatus::Corrupt;
+    if (stats) {
+        stats->addM(info.m, coded);
+        recordTotals(stats, info.width, info.height, info.nbits, fileBytes);
+    }
+    return CodecStatus::Ok;
+}
+
+// Header of a whole file or of a prefix of a version 2 file, and the
+// thumbnail at scale. whole: src is the complete file (parseFile).
+static CodecStatus parseThumbnail(const uint8_t *src, size_t len, int scale, ImageInfo &info,
+                                  const uint8_t *&payload, LevelTable &table, ImageThumbnail &thumb, bool &whole) {
+    bool legacy;
+    CodecStatus st = parseFile(src, len, info, payload, legacy, table);
+    whole = st == CodecStatus::Ok;
+    uint64_t fileBytes = len;
+    if (!whole) {
+        if (legacy) return st;
+        ContainerView view;
+        uint64_t available;
+        st = readContainerPrefix(src, len, kMagic, view, available);
+        if (st == CodecStatus::Ok) st = parseInfo(view, info, table);
+        if (st == CodecStatus::Ok) st = checkCoding(info, false);
+        if (st != CodecStatus::Ok) return st;
+        payload = view.data.body;
+        // DATA and its checksums, then END
+        fileBytes = (uint64_t)(payload - src) + view.data.size + containerTail(view.data.size);
+    }
+    thumb.scale = std::min(std::max(scale, 0), info.levels);
+    thumb.width = (uint32_t)(((uint64_t)info.width + ((uint64_t)1 << thumb.scale) - 1) >> thumb.scale);
+    thumb.height = (uint32_t)(((uint64_t)info.height + ((uint64_t)1 << thumb.scale) - 1) >> thumb.scale);
+    thumb.bytes = thumb.scale ? (uint64_t)(payload - src) + table.end[info.levels - thumb.scale] : fileBytes;
+    thumb.profile = info.profile;
+    return CodecStatus::Ok;
+}
+
+CodecStatus imageThumbnailInfo(const uint8_t *src, size_t len, int scale, ImageThumbnail &thumb) {
+    ImageInfo info;
+    const uint8_t *payload;
+    LevelTable table;
+    bool whole;
+    return parseThumbnail(src, len, scale, info, payload, table, thumb, whole);
+}
+
+CodecStatus decodeImageThumbnail(const uint8_t *src, size_t len, int scale, uint8_t *px, size_t stride,
+                                 CodecStats *stats, const CodecProfile *profile) {
+    ImageInfo info;
+    const uint8_t *payload;
+    LevelTable table;
+    ImageThumbnail thumb;
+    bool whole;
+    CodecStatus st = parseThumbnail(src, len, scale, info, payload, table, thumb, whole);
+    if (st != CodecStatus::Ok) return st;
+    if (thumb.scale == 0) return whole ? decodeImagePlane(src, len, px, stride, stats, profile) : CodecStatus::Corrupt;
+    if (fileProfile(info, profile) != CodecStatus::Ok) return CodecStatus::Unsupported;
+    if (len < thumb.bytes) return CodecStatus::Corrupt;
+    if (whole) {
+        StageTimer timer(stats, "checksum", 0, len);
+        if (verifyImagePlane(src, len) != CodecStatus::Ok) return CodecStatus::Corrupt;
+    }
+    const uint64_t npx = (uint64_t)thumb.width * thumb.height;
+    StageTimer timer(stats, "decode", npx, npx);
+    if (!decodeLevels(payload, info, table, info.levels - thumb.scale, profile, px, thumb.width, thumb.height, stride,
+                      stats))
+        return CodecStatus::Corrupt;
+    if (stats) recordTotals(stats, thumb.width, thumb.height, (thumb.bytes - (uint64_t)(payload - src)) * 8,
+                            thumb.bytes);
+    return CodecStatus::Ok;
+}
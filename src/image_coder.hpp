@@ -0,0 +1,189 @@
+#ifndef IMAGE_CODER_HPP
+#define IMAGE_CODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "checksum.hpp"
+#include "codec_profile.hpp"
+#include "codec_stats.hpp"
+#include "golomb.hpp"
+
+// Lossless grayscale plane codec (GIMG container) shared by image_codec and
+// extract_color_channel. Works on raw 8-bit planes so it has no OpenCV
+// dependency. Entry points use caller memory only and keep no global state,
+// so they may be called concurrently from several threads. Only the rANS
+// encoder allocates (its 96 KB chunk buffer, once per call).
+//
+// Files are written in the chunked container (container.hpp) with magic
+// "GIM2"; INFO holds the varints width, height, mode, m and nbits. mode holds
+// the predictor in bits 0-2, the run mode flag in bit 3 and the
+// EntropyBackend in bits 4-6. Golomb payloads are packed bits, MSB first;
+// adaptive backends (entropy_coder.hpp) store m = 0 and a byte stream.
+// Progressive files (PRED_INTERPOLATE) add the varint levels and the payload
+// offset at which each level but the last ends. Bit 8 of mode marks a file
+// coded from a trained profile (codec_profile.hpp, adaptive backends only),
+// whose ID then follows as the last field.
+//
+// Version 1 files are still read (host byte order, no chunks):
+//   "GIMG" | u32 width | u32 height | u8 mode | u32 m | u64 nbits | payload [| checksums]
+// with bit 7 of mode flagging the checksum trailer (checksum.hpp).
+
+enum ImagePredictor : int {
+    PRED_AUTO = -1,   // encoder only: the predictor with the shorter Golomb code
+    PRED_LEFT = 0,
+    PRED_MEDIAN = 1,  // JPEG-LS median edge detector
+    PRED_INTERPOLATE = 2 // progressive: resolution levels coded coarse to fine (see decodeImageThumbnail)
+};
+
+// m candidates the Golomb encoder tries (exactly, from a residual histogram)
+enum MSearch : int {
+    M_SEARCH_SAMPLED = 0, // powers of two, histogram of every 8th row: one full pass instead of two
+                          // (M_SEARCH_POW2 if that m does not fit the buffer)
+    M_SEARCH_POW2 = 1,    // powers of two up to 64
+    M_SEARCH_DEFAULT = 2, // powers of two and odd m up to 31 (22 candidates)
+    M_SEARCH_FULL = 3     // every m up to 64
+};
+
+// Encoder presets 0 (fastest) to 8 (smallest), as `image_codec -N`
+struct ImagePreset {
+    int predictor;
+    int backend;    // EntropyBackend
+    bool runMode;
+    int mSearch;    // MSearch (Golomb only)
+};
+
+// Settings of preset level (clamped to 0..8): 0-5 use Golomb, from the left
+// predictor with m from a sample of rows up to run mode, every m up to 64
+// and both predictors tried; 6-8 use the adaptive range coder, which
+// compresses better but decodes slower.
+ImagePreset imagePreset(int level);
+
+struct ImageInfo {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int predictor = PRED_MEDIAN;
+    int backend = 0;      // EntropyBackend
+    bool runMode = false; // flat areas coded as runs (JPEG-LS run mode)
+    bool checksum = false; // the file carries checksums (older files may not)
+    uint32_t m = 0;       // Golomb parameter (of level 0 in progressive files)
+    uint64_t nbits = 0;   // payload length in bits
+    int levels = 0;       // PRED_INTERPOLATE: thumbnails down to 1/2^levels of the size
+    uint32_t profile = 0; // ID of the profile needed to decode (0 = none)
+};
+
+// Upper bound on the encoded size of a w x h plane (header included); m is
+// the Golomb parameter given to reencodeImagePlane (0 for encodeImagePlane).
+size_t imageEncodedBound(uint32_t w, uint32_t h, int backend = 0, uint32_t m = 0);
+
+// Encode a w x h plane (rows `stride` bytes apart) into a complete GIMG file
+// image. For Golomb the best m is picked from the mSearch candidate set by
+// exact code length; backend selects an adaptive binary coder instead.
+// runMode codes runs of identical pixels in flat areas as run lengths
+// (run_mode.hpp).
+// `written` receives the encoded size; on BufferTooSmall it is the size needed
+// to encode (a few bytes above the final size). info (optional) receives the
+// header fields that were written; stats (optional) receives stage timings,
+// totals and residual/m histograms. profile (optional, an image profile)
+// gives the adaptive backends their starting probabilities; Golomb coding
+// does not use it.
+CodecStatus encodeImagePlane(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor,
+                             uint8_t *dst, size_t capacity, size_t &written, ImageInfo *info = nullptr,
+                             CodecStats *stats = nullptr, int backend = 0,
+                             bool runMode = false, int mSearch = M_SEARCH_DEFAULT,
+                             const CodecProfile *profile = nullptr);
+
+// Incremental encoding of a plane that arrives band by band, e.g. rows
+// inflated from a compressed file. start() takes the arguments of
+// encodeImagePlane, with px pointing at storage for the whole plane, which
+// the caller fills top to bottom and announces with rowsReady(). The
+// residual histograms of the m and predictor searches, and for the
+// adaptive backends with a fixed predictor the coding itself, run on each
+// band as it arrives; finish() then does what needs the whole plane (the
+// Golomb packing pass, coding after PRED_AUTO on the adaptive backends,
+// progressive files) and writes the same file as encodeImagePlane would.
+// Unlike the functions above, start() allocates the state (about 10 KB,
+// plus the coder of an adaptive backend).
+class ImagePlaneEncoder {
+public:
+    ImagePlaneEncoder();
+    ~ImagePlaneEncoder();
+
+    // Unsupported for arguments encodeImagePlane rejects.
+    CodecStatus start(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, int predictor,
+                      uint8_t *dst, size_t capacity, CodecStats *stats = nullptr, int backend = 0,
+                      bool runMode = false, int mSearch = M_SEARCH_DEFAULT, const CodecProfile *profile = nullptr);
+
+    // The next `rows` rows of the plane are filled in.
+    void rowsReady(uint32_t rows);
+
+    // Once every row is ready: the result of encodeImagePlane (Unsupported
+    // if rows are missing or start() failed).
+    CodecStatus finish(size_t &written, ImageInfo *info = nullptr);
+
+private:
+    struct State;
+    std::unique_ptr<State> st;
+};
+
+// Add a plane to an image profile being trained.
+CodecStatus trainImageProfile(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, ProfileTrainer &trainer);
+
+// Encode a plane with the predictor, backend, run mode and m of `like` (as
+// read by readImageInfo from another file) instead of searching for them:
+// one packing pass, for planes whose statistics match that file, such as a
+// rotated or mirrored copy of its image. Progressive files only keep their
+// predictor and backend; m is searched for every level. A file coded from a
+// profile is recoded from it, so profile must be that profile (Unsupported
+// otherwise). Arguments otherwise as for
+// encodeImagePlane; BufferTooSmall is reported when the plane does not fit,
+// with `written` then not exact (size dst with imageEncodedBound(w, h,
+// like.backend, like.m)).
+CodecStatus reencodeImagePlane(const uint8_t *px, uint32_t w, uint32_t h, size_t stride, const ImageInfo &like,
+                               uint8_t *dst, size_t capacity, size_t &written, ImageInfo *info = nullptr,
+                               CodecStats *stats = nullptr, const CodecProfile *profile = nullptr);
+
+// Parse the GIMG header. For checksummed files the length and the header
+// checksum are checked too, so a damaged header is reported as Corrupt.
+CodecStatus readImageInfo(const uint8_t *src, size_t len, ImageInfo &info);
+
+// Check a GIMG file image against its checksums without decoding it (runs at
+// memory bandwidth). Files without checksums only get the structural checks
+// and leave report->present false.
+CodecStatus verifyImagePlane(const uint8_t *src, size_t len, ChecksumReport *report = nullptr);
+
+// Decode a GIMG file image into px (rows `stride` bytes apart, at least width bytes).
+// Checksums, when present, are verified before decoding. A file coded from
+// a profile needs that profile (Unsupported otherwise); other files ignore it.
+CodecStatus decodeImagePlane(const uint8_t *src, size_t len, uint8_t *px, size_t stride,
+                             CodecStats *stats = nullptr, const CodecProfile *profile = nullptr);
+
+// Progressive files (PRED_INTERPOLATE) store the image subsampled by
+// 2^levels first, then each level doubles the resolution, so a thumbnail
+// at scale j (every 2^j-th pixel of every 2^j-th row) needs only a prefix of
+// the file: on photos about 30% of the payload for j = 1, 8% for j = 2 and
+// 2% for j = 3. The price is a few percent of size against PRED_MEDIAN.
+struct ImageThumbnail {
+    int scale = 0;        // the scale asked for, at most the file's levels (0 for other files)
+    uint32_t width = 0;   // ceil(width / 2^scale)
+    uint32_t height = 0;
+    uint64_t bytes = 0;   // length of the file prefix the thumbnail is decoded from
+    uint32_t profile = 0; // ID of the profile needed to decode (0 = none)
+};
+
+// A prefix of this length always holds the header a thumbnail is located from.
+static const size_t kImageHeaderBytes = 256;
+
+// Size and required prefix of the thumbnail at `scale`. src may be a prefix
+// of the file, of at least kImageHeaderBytes (or the whole file).
+CodecStatus imageThumbnailInfo(const uint8_t *src, size_t len, int scale, ImageThumbnail &thumb);
+
+// Decode the thumbnail at `scale` into px (rows `stride` bytes apart) from
+// at least thumb.bytes of the file; other files need the whole file and
+// decode at full size. Given the whole file, checksums are verified first;
+// a prefix is decoded without the payload checksums, which follow it.
+// profile as for decodeImagePlane.
+CodecStatus decodeImageThumbnail(const uint8_t *src, size_t len, int scale, uint8_t *px, size_t stride,
+                                 CodecStats *stats = nullptr, const CodecProfile *profile = nullptr);
+
+#endif
@@ -1,4 +1,6 @@
 #include <opencv2/opencv.hpp>
+#include "netpbm.hpp"
+#include "pixel_ops.hpp"
 #include <iostream>
 #include <string>
 #include <algorithm>
@@ -9,6 +11,7 @@ int main(int argc, char* argv[]) {
     if (argc < 4) {
         std::cerr << "Usage: " << argv[0] << " <input> <output> <operation> [param]\n";
         std::cerr << "operations: neg | mirror_h | mirror_v | rotate <k> | bright <delta>\n";
+        std::cerr << "input may also be a gzip-compressed PGM/PPM (.pgm.gz, .ppm.gz)\n";
         return 1;
     }
 
@@ -16,7 +19,22 @@ int main(int argc, char* argv[]) {
     std::string output = argv[2];
     std::string op = argv[3];
 
-    cv::Mat img = cv::imread(input, cv::IMREAD_UNCHANGED);
+    // gzip netpbm input (which OpenCV cannot read) is inflated on a worker thread while rows are stored
+    cv::Mat img;
+    if (isGzipFile(input)) {
+        NetpbmReader in;
+        std::string err;
+        if (in.open(input, err)) {
+            img.create(in.height, in.width, in.channels == 3 ? CV_8UC3 : CV_8UC1);
+            if (!in.readRows(img.ptr<uchar>(0), img.step, img.rows, err, true)) img = cv::Mat();
+        }
+        if (img.empty()) {
+            std::cerr << "Failed to read input: " << input << " (" << err << ")\n";
+            return 1;
+        }
+    } else {
+        img = cv::imread(input, cv::IMREAD_UNCHANGED);
+    }
     if (img.empty()) {
         std::cerr << "Failed to read input: " << input << "\n";
         return 1;
@@ -27,27 +45,16 @@ int main(int argc, char* argv[]) {
 
     if (op == "neg") {
         dst.create(img.rows, img.cols, img.type());
-        for (int r = 0; r < img.rows; ++r) {
-            const uchar* srcp = img.ptr<uchar>(r);
-            uchar* dstp = dst.ptr<uchar>(r);
-            int channels = img.channels();
-            int rowBytes = img.cols * channels;
-            for (int i = 0; i < rowBytes; ++i) {
-                dstp[i] = 255 - srcp[i];
-            }
-        }
+        size_t rowBytes = static_cast<size_t>(img.cols) * img.channels();
+        parallelRows(img.rows, rowBytes, [&](int r0, int r1) {
+            for (int r = r0; r < r1; ++r) negateRow(img.ptr<uchar>(r), dst.ptr<uchar>(r), rowBytes);
+        });
     } else if (op == "mirror_h") {
         dst.create(img.rows, img.cols, img.type());
         int channels = img.channels();
-        for (int r = 0; r < img.rows; ++r) {
-            const uchar* srcp = img.ptr<uchar>(r);
-            uchar* dstp = dst.ptr<uchar>(r);
-            for (int c = 0; c < img.cols; ++c) {
-                for (int ch = 0; ch < channels; ++ch) {
-                    dstp[c*channels + ch] = srcp[(img.cols - 1 - c)*channels + ch];
-                }
-            }
-        }
+        parallelRows(img.rows, static_cast<size_t>(img.cols) * channels, [&](int r0, int r1) {
+            for (int r = r0; r < r1; ++r) mirrorRow(img.ptr<uchar>(r), dst.ptr<uchar>(r), img.cols, channels);
+        });
     } else if (op == "mirror_v") {
         dst.create(img.rows, img.cols, img.type());
         int channels = img.channels();
@@ -65,63 +72,21 @@ int main(int argc, char* argv[]) {
         k %= 4; if (k < 0) k += 4;
         if (k == 0) {
             dst = img.clone();
-        } else if (k == 2) {
-            // 180 deg
-            dst.create(img.rows, img.cols, img.type());
-            int channels = img.channels();
-            for (int r = 0; r < img.rows; ++r) {
-                const uchar* srcp = img.ptr<uchar>(r);
-                uchar* dstp = dst.ptr<uchar>(img.rows - 1 - r);
-                int rowBytes = img.cols * channels;
-                // reverse row
-                for (int c = 0; c < img.cols; ++c) {
-                    for (int ch = 0; ch < channels; ++ch) {
-                        dstp[(img.cols - 1 - c)*channels + ch] = srcp[c*channels + ch];
-                    }
-                }
-            }
-        } else if (k == 1) {
-            // 90 deg clockwise: size becomes cols x rows
-            dst.create(img.cols, img.rows, img.type());
-            int channels = img.channels();
-            for (int r = 0; r < img.rows; ++r) {
-                const uchar* srcp = img.ptr<uchar>(r);
-                for (int c = 0; c < img.cols; ++c) {
-                    for (int ch = 0; ch < channels; ++ch) {
-                        // pixel (r,c) -> (c, newcol) where newcol = (rows-1 - r)
-                        dst.ptr<uchar>(c)[(img.rows - 1 - r)*channels + ch] = srcp[c*channels + ch];
-                    }
-                }
-            }
-        } else if (k == 3) {
-            // 270 deg clockwise (or 90 deg ccw)
-            dst.create(img.cols, img.rows, img.type());
-            int channels = img.channels();
-            for (int r = 0; r < img.rows; ++r) {
-                const uchar* srcp = img.ptr<uchar>(r);
-                for (int c = 0; c < img.cols; ++c) {
-                    for (int ch = 0; ch < channels; ++ch) {
-                        // pixel (r,c) -> (newr, c) where newr = img.cols - 1 - c
-                        dst.ptr<uchar>(img.cols - 1 - c)[r*channels + ch] = srcp[c*channels + ch];
-                    }
-                }
-            }
+        } else {
+            // odd k: size becomes cols x rows
+            if (k == 2) dst.create(img.rows, img.cols, img.type());
+            else dst.create(img.cols, img.rows, img.type());
+            rotateImage(img.ptr<uchar>(0), img.step, img.cols, img.rows, img.channels(), k,
+                        dst.ptr<uchar>(0), dst.step);
         }
     } else if (op == "bright") {
         if (argc < 5) { std::cerr << "bright needs parameter delta (integer)\n"; return 1; }
         int delta = std::stoi(argv[4]);
         dst.create(img.rows, img.cols, img.type());
-        int channels = img.channels();
-        for (int r = 0; r < img.rows; ++r) {
-            const uchar* srcp = img.ptr<uchar>(r);
-            uchar* dstp = dst.ptr<uchar>(r);
-            int rowBytes = img.cols * channels;
-            for (int i = 0; i < rowBytes; ++i) {
-                int v = srcp[i] + delta;
-                clamp_ip(v);
-                dstp[i] = static_cast<uchar>(v);
-            }
-        }
+        size_t rowBytes = static_cast<size_t>(img.cols) * img.channels();
+        parallelRows(img.rows, rowBytes, [&](int r0, int r1) {
+            for (int r = r0; r < r1; ++r) brightenRow(img.ptr<uchar>(r), dst.ptr<uchar>(r), rowBytes, delta);
+        });
     } else {
         std::cerr << "Unknown operation: " << op << "\n";
         return 1;
@@ -0,0 +1,49 @@
+#ifndef LIBGOLOMB_HPP
+#define LIBGOLOMB_HPP
+
+// Public entry point of libgolomb (build/libgolomb.a, build/libgolomb.so).
+//
+// Buffer-based API for in-process compression: every encode/decode call takes
+// (pointer, length) views of caller-owned memory and keeps no global state,
+// so calls are safe to make concurrently from multiple threads. Decoders
+// perform no heap allocation; audio block mode and rANS encoders allocate
+// their scratch space once per call instead of using 100+ KB of stack. Results are reported with CodecStatus; a BufferTooSmall
+// encode still reports the exact size needed so the caller can retry.
+//
+//   Integer arrays : encodeInts / decodeInts          (golomb.hpp)
+//   Bit strings    : packBits / unpackBits between '0'/'1' text and bytes (bitpack.hpp)
+//   PCM16 audio    : encodeAudio / decodeAudio (GBL); AudioDecoder decodes
+//                    incrementally for playback (audio_coder.hpp)
+//   8-bit planes   : encodeImagePlane / decodeImagePlane (GIMG); reencodeImagePlane
+//                    codes with the parameters of an existing file (image_coder.hpp)
+//   Thumbnails     : progressive GIMG files (PRED_INTERPOLATE) decode at 1/2 .. 1/16
+//                    size from a prefix via decodeImageThumbnail (image_coder.hpp)
+//   Instrumentation: optional CodecStats* on the codec calls (codec_stats.hpp)
+//   Entropy backends: Golomb (default), adaptive range coder or rANS, chosen
+//                     per file via AudioInfo::backend / the backend argument (entropy_coder.hpp)
+//   Run mode       : JPEG-LS style runs for silence and flat areas, via
+//                    AudioInfo::runMode / the runMode argument (run_mode.hpp)
+//   Rice blocks    : block-optimal partitioned Rice coding of audio, via
+//                    AudioInfo::blocks (rice_partition.hpp)
+//   Presets        : audioPreset / imagePreset map levels 0 (fastest) .. 8
+//                    (smallest) to coding modes and search effort
+//   File format    : GBL/GIMG version 2, little-endian chunks with varint header
+//                    fields; version 1 files are still read (container.hpp)
+//   Integrity      : CRC32C per 64 KiB of every chunk plus a checksum of its tag
+//                    and length; verifyAudio / verifyImagePlane check a file
+//                    without decoding it (checksum.hpp)
+//   Profiles       : trained starting state for short files; trainAudioProfile /
+//                    trainImageProfile, passed to the codec calls as CodecProfile* (codec_profile.hpp)
+
+#include "golomb.hpp"
+#include "bitpack.hpp"
+#include "checksum.hpp"
+#include "container.hpp"
+#include "codec_stats.hpp"
+#include "codec_profile.hpp"
+#include "entropy_coder.hpp"
+#include "rice_partition.hpp"
+#include "audio_coder.hpp"
+#include "image_coder.hpp"
+
+#endif
@@ -0,0 +1,228 @@
+#include "netpbm.hpp"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <zlib.h>
+
+// Inflated data travels from the worker in chunks of kChunkSize; at most
+// kChunks of them exist, which bounds how far the worker runs ahead.
+static const size_t kChunkSize = 256 * 1024;
+static const size_t kChunks = 4;
+
+// ---------------- byte stream ----------------
+// Plain files are read in chunks on the caller's thread; gzip files are
+// inflated by `worker` into recycled chunks.
+struct NetpbmReader::Stream {
+    std::ifstream file;
+    bool gz = false;
+    std::vector<uint8_t> cur;
+    size_t pos = 0;
+
+    std::thread worker;
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> full, spare;
+    bool done = false, stop = false;
+    std::string error;
+
+    ~Stream() {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stop = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    void start() {
+        for (size_t i = 0; i < kChunks; ++i) spare.emplace_back();
+        worker = std::thread([this] { inflateLoop(); });
+    }
+
+    void inflateLoop() {
+        z_stream zs = {};
+        std::string err;
+        if (inflateInit2(&zs, 15 + 16) != Z_OK) err = "cannot initialise zlib";
+        std::vector<uint8_t> in(kChunkSize);
+        bool finished = !err.empty();
+        bool memberEnd = false; // at the end of a gzip member; more may follow
+        while (!finished) {
+            std::vector<uint8_t> buf;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                cv.wait(lock, [&] { return stop || !spare.empty(); });
+                if (stop) break;
+                buf = std::move(spare.front());
+                spare.pop_front();
+            }
+            buf.resize(kChunkSize);
+            zs.next_out = buf.data();
+            zs.avail_out = (uInt)buf.size();
+            while (zs.avail_out && !finished) {
+                if (zs.avail_in == 0) {
+                    file.read(reinterpret_cast<char*>(in.data()), in.size());
+                    size_t n = (size_t)file.gcount();
+                    if (n == 0) {
+                        if (!memberEnd) err = "truncated gzip data";
+                        finished = true;
+                        break;
+                    }
+                    zs.next_in = in.data();
+                    zs.avail_in = (uInt)n;
+                }
+                if (memberEnd) { inflateReset(&zs); memberEnd = false; }
+                int ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END) memberEnd = true;
+                else if (ret != Z_OK && ret != Z_BUF_ERROR) { err = "corrupt gzip data"; finished = true; }
+            }
+            buf.resize(buf.size() - zs.avail_out);
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                full.push_back(std::move(buf));
+            }
+            cv.notify_all();
+        }
+        inflateEnd(&zs);
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            done = true;
+            error = err;
+        }
+        cv.notify_all();
+    }
+
+    // make cur hold unread bytes; false at the end of the data
+    bool fill() {
+        if (!gz) {
+            cur.resize(kChunkSize);
+            file.read(reinterpret_cast<char*>(cur.data()), cur.size());
+            cur.resize((size_t)file.gcount());
+            pos = 0;
+            return !cur.empty();
+        }
+        std::unique_lock<std::mutex> lock(mu);
+        if (cur.capacity()) { spare.push_back(std::move(cur)); cur = std::vector<uint8_t>(); }
+        cv.notify_all();
+        cv.wait(lock, [&] { return !full.empty() || done; });
+        if (full.empty()) return false;
+        cur = std::move(full.front());
+        full.pop_front();
+        pos = 0;
+        return true;
+    }
+
+    int get() { return pos < cur.size() || fill() ? cur[pos++] : EOF; }
+    int peek() { return pos < cur.size() || fill() ? cur[pos] : EOF; }
+
+    size_t read(uint8_t *dst, size_t n) {
+        size_t got = 0;
+        while (got < n && (pos < cur.size() || fill())) {
+            size_t k = std::min(n - got, cur.size() - pos);
+            std::copy(cur.data() + pos, cur.data() + pos + k, dst + got);
+            pos += k;
+            got += k;
+        }
+        return got;
+    }
+
+    // next header token, skipping whitespace and '#' comments
+    bool token(std::string &tok) {
+        tok.clear();
+        int c;
+        while ((c = get()) != EOF) {
+            if (c == '#') {
+                while ((c = get()) != EOF && c != '\n') {}
+            } else if (!std::isspace(c)) {
+                break;
+            }
+        }
+        if (c == EOF) return false;
+        tok.push_back((char)c);
+        while ((c = peek()) != EOF && !std::isspace(c) && c != '#') tok.push_back((char)get());
+        return true;
+    }
+
+    // gzip: inflate what follows the raster so the CRC of the data gets checked
+    bool finish() {
+        if (!gz) return true;
+        while (fill()) pos = cur.size();
+        std::lock_guard<std::mutex> lock(mu);
+        return error.empty();
+    }
+
+    // err for a short read: the inflate error if there was one
+    std::string failure(const char *what) {
+        std::lock_guard<std::mutex> lock(mu);
+        return error.empty() ? what : error;
+    }
+};
+
+bool isGzipFile(const std::string &path) {
+    std::ifstream f(path, std::ios::binary);
+    unsigned char magic[2];
+    return f.read(reinterpret_cast<char*>(magic), 2) && magic[0] == 0x1F && magic[1] == 0x8B;
+}
+
+// ---------------- reader ----------------
+
+NetpbmReader::NetpbmReader() = default;
+NetpbmReader::~NetpbmReader() = default;
+
+bool NetpbmReader::open(const std::string &path, std::string &err) {
+    in.reset(new Stream);
+    rowsLeft = 0;
+    in->gz = isGzipFile(path);
+    in->file.open(path, std::ios::binary);
+    if (!in->file) { err = "cannot open " + path; return false; }
+    if (in->gz) in->start();
+    std::string magic, sw, sh, smax;
+    if (!in->token(magic) || (magic != "P5" && magic != "P6")) {
+        err = in->failure("not a binary PGM/PPM file");
+        return false;
+    }
+    if (!in->token(sw) || !in->token(sh) || !in->token(smax)) {
+        err = in->failure("truncated header");
+        return false;
+    }
+    in->get(); // single whitespace before the raster
+    try {
+        width = std::stoi(sw);
+        height = std::stoi(sh);
+        if (std::stoi(smax) > 255) { err = "16-bit netpbm is not supported"; return false; }
+    } catch (const std::exception &) {
+        err = "malformed header"; return false;
+    }
+    if (width <= 0 || height <= 0) { err = "invalid dimensions"; return false; }
+    channels = magic == "P6" ? 3 : 1;
+    rowsLeft = height;
+    return true;
+}
+
+bool NetpbmReader::readRows(uint8_t *dst, size_t stride, int rows, std::string &err, bool bgr) {
+    if (!in || rows > rowsLeft) { err = "read past the last row"; return false; }
+    const size_t rowBytes = (size_t)width * channels;
+    for (int r = 0; r < rows; ++r) {
+        uint8_t *row = dst + (size_t)r * stride;
+        if (in->read(row, rowBytes) != rowBytes) { err = in->failure("truncated raster"); return false; }
+        if (bgr && channels == 3)
+            for (size_t i = 0; i < rowBytes; i += 3) std::swap(row[i], row[i + 2]);
+    }
+    rowsLeft -= rows;
+    if (rowsLeft == 0 && !in->finish()) { err = in->failure(""); return false; }
+    return true;
+}
+
+bool readNetpbm(const std::string &path, NetpbmImage &img, std::string &err) {
+    NetpbmReader r;
+    if (!r.open(path, err)) return false;
+    img.width = r.width;
+    img.height = r.height;
+    img.channels = r.channels;
+    img.pixels.resize((size_t)img.width * img.height * img.channels);
+    return r.readRows(img.pixels.data(), (size_t)img.width * img.channels, img.height, err);
+}
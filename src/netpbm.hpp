@@ -0,0 +1,54 @@
+#ifndef NETPBM_HPP
+#define NETPBM_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Minimal reader for binary netpbm images (P5 gray / P6 RGB, maxval <= 255)
+// for tools that must not depend on OpenCV. Pixels are stored as in the file
+// (RGB order for P6), rows packed without padding. Gzip-compressed files
+// (e.g. images-ppm/kodak/*.ppm.gz) are read too, recognised by their magic
+// rather than their name.
+struct NetpbmImage {
+    int width = 0;
+    int height = 0;
+    int channels = 0;   // 1 (P5) or 3 (P6)
+    std::vector<uint8_t> pixels;
+};
+
+// Returns false (with a message in err) if the file cannot be read or parsed.
+bool readNetpbm(const std::string &path, NetpbmImage &img, std::string &err);
+
+// True if the file starts with the gzip magic.
+bool isGzipFile(const std::string &path);
+
+// Streaming reader: open() parses the header, readRows() then delivers the
+// raster in any number of bands. Gzip input is inflated on a separate thread
+// a few chunks ahead of the caller, so decompression overlaps with whatever
+// the caller does between bands, and neither the compressed nor the
+// inflated file is ever held in memory as a whole.
+class NetpbmReader {
+public:
+    int width = 0;
+    int height = 0;
+    int channels = 0;   // 1 (P5) or 3 (P6)
+
+    NetpbmReader();
+    ~NetpbmReader();
+
+    bool open(const std::string &path, std::string &err);
+
+    // Read the next `rows` rows into dst, rows `stride` bytes apart. bgr
+    // stores P6 pixels in B, G, R order (as OpenCV does). Reading the last
+    // row of a gzip file also checks the rest of the stream (its CRC).
+    bool readRows(uint8_t *dst, size_t stride, int rows, std::string &err, bool bgr = false);
+
+private:
+    struct Stream;
+    std::unique_ptr<Stream> in;
+    int rowsLeft = 0;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Three-stage file pipeline for the batch CLIs: a reader thread, coder
+// worker threads and the calling thread as the writer, which finishes jobs
+// in submission order. Reading, coding and writing of different files
+// overlap.
+//
+// Jobs circulate in reusable slots (double buffering: two per worker). Every
+// link is a bounded single-producer single-consumer queue, and job j always
+// goes to worker j % workers, which keeps each queue SPSC and lets the
+// writer restore the order by visiting the workers round-robin:
+//   reader -> coder[w] -> writer -> spare[w] -> reader
+// A slot is only touched by the stage that currently holds it, so stage
+// callbacks need no locking of their own.
+
+// Bounded lock-free ring of pointers for exactly one producer and one
+// consumer thread. push/pop spin (yielding, then sleeping briefly) while
+// the ring is full/empty.
+template <class T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : ring(capacity + 1) {}
+
+    void push(T *v) {
+        const size_t t = tail.load(std::memory_order_relaxed), next = (t + 1) % ring.size();
+        for (int spins = 0; next == head.load(std::memory_order_acquire); ++spins) backoff(spins);
+        ring[t] = v;
+        tail.store(next, std::memory_order_release);
+    }
+
+    T *pop() {
+        const size_t h = head.load(std::memory_order_relaxed);
+        for (int spins = 0; h == tail.load(std::memory_order_acquire); ++spins) backoff(spins);
+        T *v = ring[h];
+        head.store((h + 1) % ring.size(), std::memory_order_release);
+        return v;
+    }
+
+private:
+    std::vector<T*> ring;   // one entry stays free to tell full from empty
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    static void backoff(int spins) {
+        if (spins < 64) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+};
+
+// Run jobs 0..jobs-1 through read(slot, j), code(slot) and write(slot, j) on
+// `workers` coder threads (at least 1). Slot is default constructed once per
+// buffer and reused; failures are for the callbacks to record in the slot.
+template <class Slot>
+void runPipeline(size_t jobs, int workers, const std::function<void(Slot&, size_t)> &read,
+                 const std::function<void(Slot&)> &code, const std::function<void(Slot&, size_t)> &write) {
+    const size_t nw = (size_t)std::max(workers, 1);
+    const size_t depth = 2;
+    std::vector<std::unique_ptr<Slot>> slots(nw * depth);
+    std::vector<std::unique_ptr<SpscQueue<Slot>>> toCoder(nw), toWriter(nw), spare(nw);
+    for (size_t w = 0; w < nw; ++w) {
+        toCoder[w].reset(new SpscQueue<Slot>(depth));
+        toWriter[w].reset(new SpscQueue<Slot>(depth));
+        spare[w].reset(new SpscQueue<Slot>(depth));
+        for (size_t d = 0; d < depth; ++d) {
+            slots[w * depth + d].reset(new Slot());
+            spare[w]->push(slots[w * depth + d].get());
+        }
+    }
+
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] {
+        for (size_t j = 0; j < jobs; ++j) {
+            Slot *s = spare[j % nw]->pop();
+            read(*s, j);
+            toCoder[j % nw]->push(s);
+        }
+    });
+    for (size_t w = 0; w < nw; ++w) {
+        threads.emplace_back([&, w] {
+            for (size_t j = w; j < jobs; j += nw) {
+                Slot *s = toCoder[w]->pop();
+                code(*s);
+                toWriter[w]->push(s);
+            }
+        });
+    }
+    for (size_t j = 0; j < jobs; ++j) {
+        Slot *s = toWriter[j % nw]->pop();
+        write(*s, j);
+        spare[j % nw]->push(s);
+    }
+    for (std::thread &t : threads) t.join();
+}
+
+#endif
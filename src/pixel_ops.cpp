@@ -0,0 +1,213 @@
+#include "pixel_ops.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_OPS_X86 1
+#endif
+
+// ---------------- scalar (table) paths ----------------
+static void negateScalar(const uint8_t *src, uint8_t *dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) dst[i] = static_cast<uint8_t>(~src[i]);
+}
+
+static void brightenScalar(const uint8_t *src, uint8_t *dst, size_t n, int delta) {
+    uint8_t lut[256];
+    for (int v = 0; v < 256; ++v) lut[v] = static_cast<uint8_t>(std::clamp(v + delta, 0, 255));
+    for (size_t i = 0; i < n; ++i) dst[i] = lut[src[i]];
+}
+
+static void deinterleave3Scalar(const uint8_t *src, size_t pixels, uint8_t *p0, uint8_t *p1, uint8_t *p2) {
+    for (size_t i = 0; i < pixels; ++i) {
+        if (p0) p0[i] = src[3*i + 0];
+        if (p1) p1[i] = src[3*i + 1];
+        if (p2) p2[i] = src[3*i + 2];
+    }
+}
+
+#ifdef PIXEL_OPS_X86
+// ---------------- SSE2 (always available on x86-64) ----------------
+static void negateSSE2(const uint8_t *src, uint8_t *dst, size_t n) {
+    const __m128i ones = _mm_set1_epi8(static_cast<char>(0xFF));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(v, ones));
+    }
+    negateScalar(src + i, dst + i, n - i);
+}
+
+static void brightenSSE2(const uint8_t *src, uint8_t *dst, size_t n, int delta) {
+    // saturating add (delta > 0) or subtract (delta < 0) of |delta| clamped to 255
+    const __m128i d = _mm_set1_epi8(static_cast<char>(std::min(std::abs(delta), 255)));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        v = delta >= 0 ? _mm_adds_epu8(v, d) : _mm_subs_epu8(v, d);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+    brightenScalar(src + i, dst + i, n - i, delta);
+}
+
+// ---------------- AVX2 (runtime dispatched) ----------------
+__attribute__((target("avx2")))
+static void negateAVX2(const uint8_t *src, uint8_t *dst, size_t n) {
+    const __m256i ones = _mm256_set1_epi8(static_cast<char>(0xFF));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(v, ones));
+    }
+    negateSSE2(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void brightenAVX2(const uint8_t *src, uint8_t *dst, size_t n, int delta) {
+    const __m256i d = _mm256_set1_epi8(static_cast<char>(std::min(std::abs(delta), 255)));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        v = delta >= 0 ? _mm256_adds_epu8(v, d) : _mm256_subs_epu8(v, d);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    }
+    brightenSSE2(src + i, dst + i, n - i, delta);
+}
+
+// ---------------- SSSE3 3-way deinterleave (runtime dispatched) ----------------
+// 16 pixels (48 bytes, three loads) per step. For channel k the byte of pixel i
+// sits at 3*i + k, i.e. in load (3*i + k) / 16 at offset (3*i + k) % 16; each
+// plane is the OR of three pshufb gathers, one per load.
+namespace {
+struct ShuffleMasks {
+    alignas(16) int8_t m[3][3][16]; // [channel][load][lane]
+    ShuffleMasks() {
+        for (int k = 0; k < 3; ++k)
+            for (int j = 0; j < 3; ++j)
+                for (int i = 0; i < 16; ++i) {
+                    int pos = 3*i + k;
+                    m[k][j][i] = (pos / 16 == j) ? static_cast<int8_t>(pos % 16) : int8_t(-128);
+                }
+    }
+};
+const ShuffleMasks kShuffleMasks;
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i gatherChannel(__m128i a, __m128i b, __m128i c, int k) {
+    const __m128i *m = reinterpret_cast<const __m128i*>(kShuffleMasks.m[k]);
+    __m128i r = _mm_shuffle_epi8(a, _mm_load_si128(m + 0));
+    r = _mm_or_si128(r, _mm_shuffle_epi8(b, _mm_load_si128(m + 1)));
+    return _mm_or_si128(r, _mm_shuffle_epi8(c, _mm_load_si128(m + 2)));
+}
+
+__attribute__((target("ssse3")))
+static void deinterleave3SSSE3(const uint8_t *src, size_t pixels, uint8_t *p0, uint8_t *p1, uint8_t *p2) {
+    uint8_t *planes[3] = {p0, p1, p2};
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        const __m128i *s = reinterpret_cast<const __m128i*>(src + 3*i);
+        __m128i a = _mm_loadu_si128(s + 0);
+        __m128i b = _mm_loadu_si128(s + 1);
+        __m128i c = _mm_loadu_si128(s + 2);
+        for (int k = 0; k < 3; ++k) {
+            if (planes[k]) _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[k] + i), gatherChannel(a, b, c, k));
+        }
+    }
+    deinterleave3Scalar(src + 3*i, pixels - i,
+                        p0 ? p0 + i : nullptr, p1 ? p1 + i : nullptr, p2 ? p2 + i : nullptr);
+}
+
+static bool haveAVX2() { static const bool v = __builtin_cpu_supports("avx2"); return v; }
+static bool haveSSSE3() { static const bool v = __builtin_cpu_supports("ssse3"); return v; }
+#endif
+
+// ---------------- public entry points ----------------
+void negateRow(const uint8_t *src, uint8_t *dst, size_t n) {
+#ifdef PIXEL_OPS_X86
+    if (haveAVX2()) negateAVX2(src, dst, n); else negateSSE2(src, dst, n);
+#else
+    negateScalar(src, dst, n);
+#endif
+}
+
+void brightenRow(const uint8_t *src, uint8_t *dst, size_t n, int delta) {
+#ifdef PIXEL_OPS_X86
+    if (haveAVX2()) brightenAVX2(src, dst, n, delta); else brightenSSE2(src, dst, n, delta);
+#else
+    brightenScalar(src, dst, n, delta);
+#endif
+}
+
+void deinterleave3(const uint8_t *src, size_t pixels, uint8_t *p0, uint8_t *p1, uint8_t *p2) {
+#ifdef PIXEL_OPS_X86
+    if (haveSSSE3()) { deinterleave3SSSE3(src, pixels, p0, p1, p2); return; }
+#endif
+    deinterleave3Scalar(src, pixels, p0, p1, p2);
+}
+
+void mirrorRow(const uint8_t *src, uint8_t *dst, size_t pixels, int channels) {
+    if (channels == 1) {
+        for (size_t c = 0; c < pixels; ++c) dst[c] = src[pixels - 1 - c];
+        return;
+    }
+    for (size_t c = 0; c < pixels; ++c) {
+        const uint8_t *s = src + (pixels - 1 - c) * channels;
+        for (int ch = 0; ch < channels; ++ch) dst[c*channels + ch] = s[ch];
+    }
+}
+
+void rotateImage(const uint8_t *src, size_t srcStride, int w, int h, int channels, int k,
+                 uint8_t *dst, size_t dstStride) {
+    k %= 4; if (k < 0) k += 4;
+    const size_t rowBytes = static_cast<size_t>(w) * channels;
+    if (k == 0) {
+        for (int r = 0; r < h; ++r) std::copy(src + r*srcStride, src + r*srcStride + rowBytes, dst + r*dstStride);
+        return;
+    }
+    if (k == 2) {
+        // 180 deg: reversed rows in reversed order
+        for (int r = 0; r < h; ++r) mirrorRow(src + r*srcStride, dst + (size_t)(h - 1 - r)*dstStride, w, channels);
+        return;
+    }
+    // 90 deg: (r,c) -> (c, h-1-r); 270 deg: (r,c) -> (w-1-c, r)
+    const int tile = 32;
+    for (int r0 = 0; r0 < h; r0 += tile) {
+        int r1 = std::min(h, r0 + tile);
+        for (int c0 = 0; c0 < w; c0 += tile) {
+            int c1 = std::min(w, c0 + tile);
+            for (int r = r0; r < r1; ++r) {
+                const uint8_t *s = src + r*srcStride;
+                for (int c = c0; c < c1; ++c) {
+                    uint8_t *d = k == 1 ? dst + (size_t)c*dstStride + (size_t)(h - 1 - r)*channels
+                                        : dst + (size_t)(w - 1 - c)*dstStride + (size_t)r*channels;
+                    for (int ch = 0; ch < channels; ++ch) d[ch] = s[c*channels + ch];
+                }
+            }
+        }
+    }
+}
+
+void parallelRows(int rows, size_t rowBytes, const std::function<void(int, int)> &fn) {
+    // below ~1 MiB the cost of spawning threads outweighs the work
+    const size_t minBandBytes = size_t(1) << 20;
+    size_t total = static_cast<size_t>(std::max(rows, 0)) * rowBytes;
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    int nthreads = static_cast<int>(std::min<size_t>(hw, std::max<size_t>(1, total / minBandBytes)));
+    nthreads = std::min(nthreads, std::max(rows, 1));
+    if (nthreads <= 1) {
+        if (rows > 0) fn(0, rows);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(nthreads - 1);
+    int band = (rows + nthreads - 1) / nthreads;
+    for (int t = 1; t < nthreads; ++t) {
+        int r0 = t * band, r1 = std::min(rows, r0 + band);
+        if (r0 < r1) workers.emplace_back(fn, r0, r1);
+    }
+    fn(0, std::min(rows, band));
+    for (auto &th : workers) th.join();
+}
@@ -0,0 +1,36 @@
+#ifndef PIXEL_OPS_HPP
+#define PIXEL_OPS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Point operations on rows of 8-bit samples (any channel count, interleaved).
+// These do not depend on OpenCV so they can be shared by the image tools and
+// exercised on raw buffers. On x86 the widest available SIMD path is picked at
+// runtime; elsewhere a lookup table is used.
+
+// dst[i] = 255 - src[i]  (src and dst may alias)
+void negateRow(const uint8_t *src, uint8_t *dst, size_t n);
+
+// dst[i] = clamp(src[i] + delta, 0, 255)  (src and dst may alias)
+void brightenRow(const uint8_t *src, uint8_t *dst, size_t n, int delta);
+
+// Split `pixels` interleaved 3-byte pixels into up to three planes in one pass.
+// Any of p0/p1/p2 may be null, in which case that channel is skipped.
+void deinterleave3(const uint8_t *src, size_t pixels, uint8_t *p0, uint8_t *p1, uint8_t *p2);
+
+// Reverse the order of `pixels` pixels of `channels` bytes each (src != dst).
+void mirrorRow(const uint8_t *src, uint8_t *dst, size_t pixels, int channels);
+
+// Rotate a w x h image clockwise by k*90 degrees (k is normalised to 0..3).
+// dst is h x w for odd k and w x h otherwise; src and dst must not overlap.
+// Quarter turns walk the image in cache-sized tiles.
+void rotateImage(const uint8_t *src, size_t srcStride, int w, int h, int channels, int k,
+                 uint8_t *dst, size_t dstStride);
+
+// Run fn(r0, r1) over [0, rows) split into contiguous row bands, one band per
+// worker thread. Small images (rows * rowBytes below a threshold) run inline.
+void parallelRows(int rows, size_t rowBytes, const std::function<void(int, int)> &fn);
+
+#endif
@@ -0,0 +1,153 @@
+#include "rice_partition.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define RICE_X86 1
+#endif
+
+static inline uint32_t zigzag32(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+// ---------------- cost sums ----------------
+// sums[k] += sum over the values of zigzag(v) >> k, for k = 0..kTop
+
+static void shiftSumsScalar(const int32_t *v, size_t n, int kTop, uint64_t *sums) {
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t z = zigzag32(v[i]);
+        for (int k = 0; k <= kTop; ++k, z >>= 1) sums[k] += z;
+    }
+}
+
+#ifdef RICE_X86
+// eight values per step, widened to 64-bit lanes so no sum can overflow
+__attribute__((target("avx2")))
+static void shiftSumsAVX2(const int32_t *v, size_t n, int kTop, uint64_t *sums) {
+    __m256i acc[kMaxRiceParam + 1];
+    for (int k = 0; k <= kTop; ++k) acc[k] = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+        __m256i z = _mm256_xor_si256(_mm256_slli_epi32(x, 1), _mm256_srai_epi32(x, 31));
+        __m256i lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(z));
+        __m256i hi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(z, 1));
+        for (int k = 0; k <= kTop; ++k) {
+            acc[k] = _mm256_add_epi64(acc[k], _mm256_add_epi64(lo, hi));
+            lo = _mm256_srli_epi64(lo, 1);
+            hi = _mm256_srli_epi64(hi, 1);
+        }
+    }
+    for (int k = 0; k <= kTop; ++k) {
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc[k]);
+        sums[k] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    shiftSumsScalar(v + i, n - i, kTop, sums);
+}
+
+static bool haveAVX2() { static const bool v = __builtin_cpu_supports("avx2"); return v; }
+#endif
+
+static void shiftSums(const int32_t *v, size_t n, int kTop, uint64_t *sums) {
+#ifdef RICE_X86
+    if (n >= 8 && haveAVX2()) { shiftSumsAVX2(v, n, kTop, sums); return; }
+#endif
+    shiftSumsScalar(v, n, kTop, sums);
+}
+
+// Cheapest k for `count` values with shift sums s; returns the codeword bits.
+// cost(k) = count * (k + 1) + s[k] is convex in k (each step saves
+// sum(ceil((z >> k) / 2)), which only shrinks), so the scan stops at the
+// first increase.
+static uint64_t bestParam(const uint64_t *s, uint64_t count, int kTop, uint8_t &k) {
+    if (s[0] == 0) { k = kRiceZero; return 0; }
+    uint64_t best = count + s[0];
+    k = 0;
+    for (int i = 1; i <= kTop; ++i) {
+        uint64_t c = count * (uint64_t)(i + 1) + s[i];
+        if (c >= best) break;
+        best = c;
+        k = (uint8_t)i;
+    }
+    return best;
+}
+
+// ---------------- encoder ----------------
+
+void chooseRicePartition(const int32_t *residuals, size_t n, RicePartition &part, RiceScratch &scratch,
+                         int maxOrder) {
+    maxOrder = std::min(std::max(maxOrder, 0), kMaxPartitionOrder);
+    // past the bit length of the largest value every quotient is zero and k only costs more
+    uint32_t all = 0;
+    for (size_t i = 0; i < n; ++i) all |= zigzag32(residuals[i]);
+    int kTop = 0;
+    while (kTop < kMaxRiceParam && (all >> kTop) != 0) ++kTop;
+    const size_t kn = (size_t)kTop + 1;
+
+    // sums for the finest partitions, then merged pairwise order by order
+    const size_t leaves = (size_t)1 << maxOrder;
+    uint64_t *sums = scratch.sums, *counts = scratch.counts;
+    for (size_t j = 0; j < leaves; ++j) {
+        size_t a = partitionStart(n, maxOrder, j), b = partitionStart(n, maxOrder, j + 1);
+        uint64_t *s = sums + j * kn;
+        std::fill(s, s + kn, 0);
+        shiftSums(residuals + a, b - a, kTop, s);
+        counts[j] = b - a;
+    }
+
+    uint8_t *k = scratch.k;
+    part.bits = UINT64_MAX;
+    for (int order = maxOrder;; --order) {
+        const size_t parts = (size_t)1 << order;
+        uint64_t bits = kPartitionOrderBits + parts * kRiceParamBits;
+        for (size_t j = 0; j < parts; ++j) bits += bestParam(sums + j * kn, counts[j], kTop, k[j]);
+        if (bits <= part.bits) { // ties go to the coarser order
+            part.order = order;
+            part.bits = bits;
+            std::memcpy(part.k, k, parts);
+        }
+        if (order == 0) break;
+        for (size_t j = 0; j < parts / 2; ++j) {
+            for (size_t i = 0; i < kn; ++i) sums[j * kn + i] = sums[2 * j * kn + i] + sums[(2 * j + 1) * kn + i];
+            counts[j] = counts[2 * j] + counts[2 * j + 1];
+        }
+    }
+}
+
+void writeRicePartitioned(const int32_t *residuals, size_t n, const RicePartition &part, BitSink &w) {
+    w.writeBits((uint64_t)part.order, kPartitionOrderBits);
+    const size_t parts = (size_t)1 << part.order;
+    for (size_t j = 0; j < parts; ++j) {
+        w.writeBits(part.k[j], kRiceParamBits);
+        if (part.k[j] == kRiceZero) continue;
+        size_t a = partitionStart(n, part.order, j), b = partitionStart(n, part.order, j + 1);
+        Golomb(1ULL << part.k[j], NegativeMode::INTERLEAVED).encodeArray(residuals + a, b - a, w);
+    }
+}
+
+// ---------------- decoder ----------------
+
+bool readRicePartitioned(BitSource &r, int32_t *residuals, size_t n, RicePartition &part) {
+    const uint64_t start = r.position();
+    part.order = (int)r.readBits(kPartitionOrderBits);
+    if (part.order > kMaxPartitionOrder) return false;
+    const size_t parts = (size_t)1 << part.order;
+    for (size_t j = 0; j < parts; ++j) {
+        const int k = (int)r.readBits(kRiceParamBits);
+        part.k[j] = (uint8_t)k;
+        size_t a = partitionStart(n, part.order, j), b = partitionStart(n, part.order, j + 1);
+        if (k == kRiceZero) {
+            std::fill(residuals + a, residuals + b, 0);
+            continue;
+        }
+        for (size_t i = a; i < b; ++i) {
+            uint64_t q = r.readUnary();
+            if (q >> (32 - k)) return false; // zig-zag value would not fit 32 bits
+            uint32_t z = (uint32_t)(q << k) | (uint32_t)r.readBits(k);
+            residuals[i] = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+        }
+        if (!r.ok()) return false;
+    }
+    part.bits = r.position() - start;
+    return r.ok();
+}
@@ -0,0 +1,55 @@
+#ifndef RICE_PARTITION_HPP
+#define RICE_PARTITION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "golomb.hpp"
+
+// Block-optimal partitioned Rice coding (as in FLAC). A block of n signed
+// residuals is split into 2^order partitions, partition j covering
+// [j * n >> order, (j + 1) * n >> order), and each partition is Golomb coded
+// (interleaved, so zig-zag) with its own m = 2^k:
+//   order (4 bits) | per partition: k (5 bits) | codewords
+// k = kRiceZero marks a partition whose residuals are all zero (no codewords).
+//
+// The encoder picks order and every k exactly: the cost of k over a set of
+// values is count * (k + 1) + sum(z >> k), and those sums are additive, so
+// they are computed once per finest partition (AVX2 when the CPU has it) and
+// merged pairwise for each coarser order. Work per value is bounded by the
+// number of candidate k; the decoder only reads the parameters it is given.
+
+static const int kMaxPartitionOrder = 8;
+static const int kPartitionOrderBits = 4;
+static const int kRiceParamBits = 5;
+static const int kMaxRiceParam = 30;
+static const int kRiceZero = 31;
+
+struct RicePartition {
+    int order = 0;
+    uint8_t k[1 << kMaxPartitionOrder];
+    uint64_t bits = 0;   // exact coded size of the block
+};
+
+inline size_t partitionStart(size_t n, int order, size_t j) { return (size_t)(((uint64_t)j * n) >> order); }
+
+// Cost sums of chooseRicePartition (about 66 KB); callers keep one per
+// encoder rather than on the stack.
+struct RiceScratch {
+    uint64_t sums[(1 << kMaxPartitionOrder) * (kMaxRiceParam + 1)];
+    uint64_t counts[1 << kMaxPartitionOrder];
+    uint8_t k[1 << kMaxPartitionOrder];
+};
+
+// Choose the partition order (up to maxOrder) and parameters minimising the
+// coded size.
+void chooseRicePartition(const int32_t *residuals, size_t n, RicePartition &part, RiceScratch &scratch,
+                         int maxOrder = kMaxPartitionOrder);
+
+// Write n residuals as chosen by chooseRicePartition.
+void writeRicePartitioned(const int32_t *residuals, size_t n, const RicePartition &part, BitSink &w);
+
+// Read n residuals; part receives the parameters read. False on a damaged
+// stream (bad order, codeword out of range or end of input).
+bool readRicePartitioned(BitSource &r, int32_t *residuals, size_t n, RicePartition &part);
+
+#endif
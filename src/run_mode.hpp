@@ -0,0 +1,121 @@
+#ifndef RUN_MODE_HPP
+#define RUN_MODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "golomb.hpp"
+
+// JPEG-LS style run-length coding (ITU-T T.87, A.7) shared by the image and
+// audio codecs. A run is coded as a sequence of '1' bits, each standing for a
+// full segment of 2^J[index] repeats (index then grows, so long runs cost
+// few bits), closed either by the end of the line or by a '0' followed by
+// the J[index]-bit remainder, after which index shrinks again.
+//
+// Coders plug in through small adapters:
+//   encoder: runBit(int bit, int index), runBits(uint32_t value, int n)
+//   decoder: int runBit(int index), uint32_t runBits(int n)
+// so the Golomb path writes plain bits and the adaptive backends can give
+// every index its own probability.
+
+static const uint8_t kRunJ[32] = {0, 0, 0, 0, 1, 1, 1, 1, 2, 2,  2,  2,  3,  3,  3,  3,
+                                  4, 4, 5, 5, 6, 6, 7, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+struct RunState {
+    int index = 0;
+    bool bad = false;   // decoder saw a run longer than the line
+};
+
+// Code a run of `len` repeats. atEnd: the run stopped at the end of the line
+// (nothing follows); otherwise an interruption sample follows.
+template <class Out>
+inline void encodeRun(Out &out, RunState &st, size_t len, bool atEnd) {
+    while (len >= ((size_t)1 << kRunJ[st.index])) {
+        out.runBit(1, st.index);
+        len -= (size_t)1 << kRunJ[st.index];
+        if (st.index < 31) ++st.index;
+    }
+    if (atEnd) {
+        if (len > 0) out.runBit(1, st.index);
+        return;
+    }
+    out.runBit(0, st.index);
+    if (kRunJ[st.index]) out.runBits((uint32_t)len, kRunJ[st.index]);
+    if (st.index > 0) --st.index;
+}
+
+// Decode a run of at most maxLen repeats; interrupted is set when an
+// interruption sample follows (the run then ended before maxLen).
+template <class In>
+inline size_t decodeRun(In &in, RunState &st, size_t maxLen, bool &interrupted) {
+    size_t run = 0;
+    for (;;) {
+        if (!in.runBit(st.index)) {
+            run += kRunJ[st.index] ? in.runBits(kRunJ[st.index]) : 0;
+            if (st.index > 0) --st.index;
+            if (run >= maxLen) { st.bad = true; interrupted = false; return maxLen; }
+            interrupted = true;
+            return run;
+        }
+        size_t seg = (size_t)1 << kRunJ[st.index];
+        if (seg > maxLen - run) break; // partial segment closed by the end of the line
+        run += seg;
+        if (st.index < 31) ++st.index;
+        if (run == maxLen) break;
+    }
+    interrupted = false;
+    return maxLen;
+}
+
+// ---------------- adapters ----------------
+
+// Golomb streams: plain bits
+struct BitRunOut {
+    BitSink &w;
+    void runBit(int bit, int) { w.writeBit(bit != 0); }
+    void runBits(uint32_t value, int n) { w.writeBits(value, n); }
+};
+
+struct BitRunIn {
+    BitSource &r;
+    int runBit(int) { return r.readBit(); }
+    uint32_t runBits(int n) { return (uint32_t)r.readBits(n); }
+};
+
+// size in bits of what BitRunOut would write
+struct RunBitCounter {
+    uint64_t bits = 0;
+    void runBit(int, int) { ++bits; }
+    void runBits(uint32_t, int n) { bits += (uint64_t)n; }
+};
+
+// Adaptive backends (entropy_coder.hpp): one probability per run index, the
+// remainder as equiprobable bits (the coders take at most 12 per call)
+struct RunModel {
+    uint16_t prob[32];
+    RunModel() { for (uint16_t &p : prob) p = 1u << 11; }
+};
+
+template <class Enc>
+struct CodedRunOut {
+    Enc &e;
+    RunModel &m;
+    void runBit(int bit, int index) { e.encodeBit(m.prob[index], bit); }
+    void runBits(uint32_t value, int n) {
+        if (n > 12) { e.encodeBits(value >> 12, n - 12); n = 12; }
+        e.encodeBits(value & ((1u << n) - 1), n);
+    }
+};
+
+template <class Dec>
+struct CodedRunIn {
+    Dec &d;
+    RunModel &m;
+    int runBit(int index) { return d.decodeBit(m.prob[index]); }
+    uint32_t runBits(int n) {
+        uint32_t hi = 0;
+        if (n > 12) { hi = d.decodeBits(n - 12) << 12; n = 12; }
+        return hi | d.decodeBits(n);
+    }
+};
+
+#endif
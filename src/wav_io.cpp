@@ -0,0 +1,52 @@
+#include "wav_io.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+bool readWav(const std::string &filename, WAVHeader &hdr, std::vector<int16_t> &samples) {
+    std::ifstream f(filename, std::ios::binary);
+    if (!f) return false;
+    f.read(reinterpret_cast<char*>(&hdr), sizeof(WAVHeader));
+    if (!f) return false;
+    if (std::strncmp(hdr.riff, "RIFF", 4) != 0 || std::strncmp(hdr.wave, "WAVE", 4) != 0) {
+        std::cerr << "readWav: not a RIFF/WAVE file\n";
+        return false;
+    }
+    if (hdr.format_type != 1 || hdr.bits_per_sample != 16) {
+        std::cerr << "readWav: only PCM16 supported\n";
+        return false;
+    }
+    size_t totalSamples = hdr.data_size / (hdr.bits_per_sample / 8);
+    samples.resize(totalSamples);
+    f.read(reinterpret_cast<char*>(samples.data()), hdr.data_size);
+    return true;
+}
+
+bool writeWav(const std::string &filename, const WAVHeader &tmpl, const std::vector<int16_t> &samples) {
+    std::ofstream f(filename, std::ios::binary);
+    if (!f) return false;
+    WAVHeader hdr = tmpl;
+    hdr.data_size = static_cast<uint32_t>(samples.size() * sizeof(int16_t));
+    hdr.overall_size = 36 + hdr.data_size;
+    f.write(reinterpret_cast<const char*>(&hdr), sizeof(WAVHeader));
+    f.write(reinterpret_cast<const char*>(samples.data()), hdr.data_size);
+    return true;
+}
+
+WAVHeader makeWavHeader(uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t samples) {
+    WAVHeader wh = {};
+    std::memcpy(wh.riff, "RIFF", 4);
+    std::memcpy(wh.wave, "WAVE", 4);
+    std::memcpy(wh.fmt_chunk_marker, "fmt ", 4);
+    wh.length_of_fmt = 16;
+    wh.format_type = 1;
+    wh.channels = channels;
+    wh.sample_rate = sample_rate;
+    wh.bits_per_sample = bits_per_sample;
+    wh.block_align = (wh.channels * wh.bits_per_sample) / 8;
+    wh.byterate = wh.sample_rate * wh.block_align;
+    std::memcpy(wh.data_chunk_header, "data", 4);
+    wh.data_size = static_cast<uint32_t>(samples * sizeof(int16_t));
+    wh.overall_size = 36 + wh.data_size;
+    return wh;
+}
@@ -0,0 +1,36 @@
+#ifndef WAV_IO_HPP
+#define WAV_IO_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// keeping memory offsets continuous
+#pragma pack(push,1)
+struct WAVHeader {
+    char riff[4];
+    uint32_t overall_size;
+    char wave[4];
+    char fmt_chunk_marker[4];
+    uint32_t length_of_fmt;
+    uint16_t format_type;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byterate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    char data_chunk_header[4];
+    uint32_t data_size;
+};
+#pragma pack(pop)
+
+// Read a canonical 44-byte-header PCM16 WAV file.
+bool readWav(const std::string &filename, WAVHeader &hdr, std::vector<int16_t> &samples);
+
+// Write samples using tmpl for the format fields (sizes are recomputed).
+bool writeWav(const std::string &filename, const WAVHeader &tmpl, const std::vector<int16_t> &samples);
+
+// Canonical PCM16 header for the given format and sample count.
+WAVHeader makeWavHeader(uint16_t channels, uint32_t sample_rate, uint16_t bits_per_sample, size_t samples);
+
+#endif
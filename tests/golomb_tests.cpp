@@ -0,0 +1,2222 @@
+// golomb_tests.cpp
+// Round-trip tests for libgolomb: every coder must decode its own output
+// exactly, report the size it needs when the buffer is too small and reject
+// truncated input. Each test prints a line per failed check; the exit status
+// is non-zero if any check failed.
+// Usage:
+//   ./build/golomb_tests [--filter substr]
+
+#include "libgolomb.hpp"
+#include "netpbm.hpp"
+#include "pipeline.hpp"
+#include "pixel_ops.hpp"
+#include "wav_io.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace std;
+
+static int checks = 0, failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        ++checks; \
+        if (!(cond)) { ++failures; fprintf(stderr, "  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } \
+    } while (0)
+
+// total count of a CodecStats histogram
+static uint64_t histTotal(const uint64_t *hist) {
+    uint64_t n = 0;
+    for (int i = 0; i < CodecStats::kBuckets; ++i) n += hist[i];
+    return n;
+}
+
+// ---------------- integer arrays ----------------
+
+static vector<int32_t> randomInts(size_t n, int spread, uint32_t seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> d(-spread, spread);
+    vector<int32_t> v(n);
+    for (int32_t &x : v) x = d(rng);
+    return v;
+}
+
+// encodeInts / decodeInts in both modes and for m around powers of two; the
+// packed stream holds the same bits as the string coder.
+static void testIntsRoundTrip() {
+    for (NegativeMode mode : {NegativeMode::INTERLEAVED, NegativeMode::SIGN_MAGNITUDE}) {
+        for (uint64_t m : {1, 2, 3, 4, 5, 7, 8, 9, 16, 100, 1000}) {
+            for (int spread : {0, 3, 50, 5000}) {
+                const size_t n = 300;
+                const vector<int32_t> v = randomInts(n, spread, (uint32_t)(m * 7919 + spread));
+                const Golomb g(m, mode);
+                string text;
+                for (int32_t x : v) text += g.encode(x);
+
+                vector<uint8_t> buf(text.size() / 8 + 1);
+                uint64_t bits = 0;
+                CHECK(encodeInts(v.data(), n, m, mode, buf.data(), buf.size(), bits) == CodecStatus::Ok);
+                CHECK(bits == text.size());
+                bool same = true;
+                for (size_t i = 0; i < text.size(); ++i)
+                    same = same && ((buf[i / 8] >> (7 - i % 8)) & 1) == (text[i] == '1' ? 1 : 0);
+                CHECK(same);
+
+                vector<int32_t> out(n);
+                CHECK(decodeInts(buf.data(), bits, m, mode, out.data(), n) == CodecStatus::Ok);
+                CHECK(out == v);
+                if (bits > 0) CHECK(decodeInts(buf.data(), bits - 1, m, mode, out.data(), n) == CodecStatus::Corrupt);
+            }
+        }
+    }
+}
+
+// Values at the ends of the int32 range (with an m large enough to keep
+// the unary part short), and the parameter checks.
+static void testIntsExtremes() {
+    const vector<int32_t> v = {0, 1, -1, INT32_MAX, INT32_MIN, INT32_MIN + 1, INT32_MAX - 1, 12345, -12345};
+    for (NegativeMode mode : {NegativeMode::INTERLEAVED, NegativeMode::SIGN_MAGNITUDE}) {
+        for (uint64_t m : {1ULL << 26, (1ULL << 26) + 1, 1ULL << 31, 3000000000ULL}) {
+            vector<uint8_t> buf(1024);
+            uint64_t bits = 0;
+            CHECK(encodeInts(v.data(), v.size(), m, mode, buf.data(), buf.size(), bits) == CodecStatus::Ok);
+            vector<int32_t> out(v.size());
+            CHECK(decodeInts(buf.data(), bits, m, mode, out.data(), out.size()) == CodecStatus::Ok);
+            CHECK(out == v);
+        }
+    }
+    uint64_t bits = 0;
+    int32_t out = 0;
+    CHECK(encodeInts(v.data(), v.size(), 0, NegativeMode::INTERLEAVED, nullptr, 0, bits) == CodecStatus::Unsupported);
+    CHECK(decodeInts(nullptr, 0, 0, NegativeMode::INTERLEAVED, &out, 1) == CodecStatus::Unsupported);
+}
+
+// A buffer one byte short reports BufferTooSmall with the exact length.
+static void testIntsBufferTooSmall() {
+    const vector<int32_t> v = randomInts(1000, 40, 3);
+    uint64_t bits = 0;
+    vector<uint8_t> buf(4096);
+    CHECK(encodeInts(v.data(), v.size(), 5, NegativeMode::INTERLEAVED, buf.data(), buf.size(), bits) == CodecStatus::Ok);
+    const size_t bytes = (size_t)((bits + 7) / 8);
+    uint64_t shortBits = 0;
+    CHECK(encodeInts(v.data(), v.size(), 5, NegativeMode::INTERLEAVED, buf.data(), bytes - 1, shortBits) ==
+          CodecStatus::BufferTooSmall);
+    CHECK(shortBits == bits);
+}
+
+// Golomb::encodeArray against per-value encode() on the same sink, for m
+// with and without the reciprocal division, from a sink that already holds
+// a few bits, and over lengths that end in a partial group of lanes.
+static void testIntsBulkMatchesScalar() {
+    const uint64_t ms[] = {1, 2, 3, 5, 6, 7, 64, 255, 256, 257, 1000, 65535, 65537, (1u << 30) + 1, 0x7FFFFFFF};
+    for (NegativeMode mode : {NegativeMode::INTERLEAVED, NegativeMode::SIGN_MAGNITUDE}) {
+        for (uint64_t m : ms) {
+            const Golomb g(m, mode);
+            for (size_t n : {1, 7, 8, 9, 31, 1000}) {
+                for (unsigned lead = 0; lead < 12; lead += 5) {
+                    // spread about 4m keeps most quotients short and some above 32
+                    const int spread = (int)min<uint64_t>(4 * m + 40, INT32_MAX / 2);
+                    vector<int32_t> v = randomInts(n, spread, (uint32_t)(m + n * 3 + lead));
+                    if (m >= 65535) { v[0] = INT32_MAX; v[n - 1] = INT32_MIN; }
+                    vector<uint8_t> bulk(1 << 16), ref(1 << 16);
+                    BitSink a(bulk.data(), bulk.size()), b(ref.data(), ref.size());
+                    a.writeBits(0x5A5, (int)lead);
+                    b.writeBits(0x5A5, (int)lead);
+                    g.encodeArray(v.data(), n, a);
+                    for (int32_t x : v) g.encode(x, b);
+                    CHECK(a.bitCount() == b.bitCount());
+                    CHECK(a.bitCount() == lead + g.arrayLength(v.data(), n));
+                    const size_t bytes = a.finish();
+                    CHECK(bytes == b.finish());
+                    CHECK(memcmp(bulk.data(), ref.data(), bytes) == 0);
+                }
+            }
+        }
+    }
+}
+
+static const uint8_t kGuard = 0xA5;
+
+// Scratch file for the file I/O tests, removed by the test that made it.
+static string tmpPath(const char *name) {
+    const char *dir = getenv("TMPDIR");
+    return string(dir && *dir ? dir : "/tmp") + "/golomb_tests_" + to_string(getpid()) + "_" + name;
+}
+
+static string readFileBytes(const string &path) {
+    ifstream f(path, ios::binary);
+    return string(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+}
+
+static void writeFileBytes(const string &path, const void *data, size_t n) {
+    ofstream f(path, ios::binary);
+    f.write(static_cast<const char*>(data), (streamsize)n);
+}
+
+// encodeInts with every capacity from 0 to 8 bytes, and the null size probe:
+// the exact length is reported, the bytes that fit match the full stream and
+// nothing past the capacity is written.
+static void testIntsSmallCapacity() {
+    for (NegativeMode mode : {NegativeMode::INTERLEAVED, NegativeMode::SIGN_MAGNITUDE}) {
+        for (size_t n : {1, 3, 8, 40}) {
+            for (uint64_t m : {1, 3, 4, 16}) {
+                const vector<int32_t> v = randomInts(n, 20, (uint32_t)(n * 131 + m));
+                uint64_t bits = 0;
+                vector<uint8_t> full(4096);
+                CHECK(encodeInts(v.data(), n, m, mode, full.data(), full.size(), bits) == CodecStatus::Ok);
+                const size_t fullBytes = (size_t)((bits + 7) / 8);
+                CHECK(bits == Golomb(m, mode).arrayLength(v.data(), n));
+
+                uint64_t probeBits = 0;
+                CHECK(encodeInts(v.data(), n, m, mode, nullptr, 0, probeBits) == CodecStatus::BufferTooSmall);
+                CHECK(probeBits == bits);
+
+                for (size_t cap = 0; cap <= 8; ++cap) {
+                    vector<uint8_t> buf(cap + 16, kGuard);
+                    uint64_t capBits = 0;
+                    CodecStatus st = encodeInts(v.data(), n, m, mode, buf.data(), cap, capBits);
+                    CHECK(st == (fullBytes <= cap ? CodecStatus::Ok : CodecStatus::BufferTooSmall));
+                    CHECK(capBits == bits);
+                    const size_t kept = min(cap, fullBytes);
+                    CHECK(memcmp(buf.data(), full.data(), kept) == 0);
+                    bool guardOk = true;
+                    for (size_t i = cap; i < buf.size(); ++i) guardOk = guardOk && buf[i] == kGuard;
+                    CHECK(guardOk);
+                }
+            }
+        }
+    }
+}
+
+// m = 1 codes INT32_MIN (zig-zag 2^32 - 1) with a 2^32-bit unary part; the
+// bulk path must count it rather than wrap the codeword length to 0.
+static void testIntsLongUnary() {
+    const int32_t v[] = {0, INT32_MIN, 1, 2};
+    const Golomb g(1);
+    uint64_t expected = 0;
+    for (int32_t x : v) expected += g.unsignedLength(x >= 0 ? (uint64_t)x << 1 : ((uint64_t)-(int64_t)x << 1) - 1);
+    CHECK(g.arrayLength(v, 4) == expected);
+    vector<uint8_t> buf(64);
+    uint64_t bits = 0;
+    CHECK(encodeInts(v, 4, 1, NegativeMode::INTERLEAVED, buf.data(), buf.size(), bits) == CodecStatus::BufferTooSmall);
+    CHECK(bits == expected);
+}
+
+// m above 2^32 has remainders wider than one BitSink write; the packed
+// encode must match the string coder and decode back.
+static void testIntsWideM() {
+    const int64_t v[] = {0, 1, -1, INT32_MAX, INT32_MIN, 12345678901LL, -98765432109LL, (1LL << 45) + 3};
+    for (uint64_t m : {(1ULL << 32) + 5, 1ULL << 33, 3000000000ULL * 7, (1ULL << 40) - 1}) {
+        for (NegativeMode mode : {NegativeMode::INTERLEAVED, NegativeMode::SIGN_MAGNITUDE}) {
+            const Golomb g(m, mode);
+            vector<uint8_t> buf(8192);
+            BitSink w(buf.data(), buf.size());
+            string text;
+            for (int64_t x : v) {
+                g.encode(x, w);
+                text += g.encode(x);
+            }
+            const uint64_t bits = w.bitCount();
+            w.finish();
+            CHECK(!w.overflowed() && bits == text.size());
+            vector<uint8_t> packed(packedBytes(text.size()));
+            CHECK(packBits(text.data(), text.size(), packed.data()));
+            CHECK(std::equal(packed.begin(), packed.end(), buf.begin()));
+            BitSource r(buf.data(), bits);
+            for (int64_t x : v) CHECK(g.decode(r) == x);
+            CHECK(r.ok() && r.position() == bits);
+        }
+    }
+}
+
+// ---------------- partitioned Rice coding ----------------
+
+// Residuals whose scale changes along the block, with zero stretches
+static vector<int32_t> riceResiduals(size_t n, uint32_t seed, int maxBits) {
+    mt19937 rng(seed);
+    vector<int32_t> v(n);
+    for (size_t i = 0; i < n; ++i) {
+        const int bits = (int)((i * 7 / max<size_t>(n, 1) + seed) % (size_t)(maxBits + 1));
+        const int32_t mag = bits ? (int32_t)(rng() & ((1u << bits) - 1)) : 0;
+        v[i] = rng() & 1 ? -mag : mag;
+    }
+    return v;
+}
+
+// Smallest coded size over every order and parameter, by brute force
+static uint64_t bestRiceBits(const vector<int32_t> &v) {
+    uint64_t best = UINT64_MAX;
+    for (int order = 0; order <= kMaxPartitionOrder; ++order) {
+        uint64_t bits = kPartitionOrderBits;
+        for (size_t j = 0; j < ((size_t)1 << order); ++j) {
+            const size_t a = partitionStart(v.size(), order, j), b = partitionStart(v.size(), order, j + 1);
+            bool zero = true;
+            for (size_t i = a; i < b; ++i) zero = zero && v[i] == 0;
+            uint64_t part = UINT64_MAX;
+            for (int k = 0; !zero && k <= kMaxRiceParam; ++k) {
+                const Golomb g(1ULL << k);
+                uint64_t c = 0;
+                for (size_t i = a; i < b; ++i) c += g.unsignedLength(((uint32_t)v[i] << 1) ^ (uint32_t)(v[i] >> 31));
+                part = min(part, c);
+            }
+            bits += kRiceParamBits + (zero ? 0 : part);
+        }
+        best = min(best, bits);
+    }
+    return best;
+}
+
+// chooseRicePartition finds the smallest encoding, its size is what
+// writeRicePartitioned emits, and readRicePartitioned restores the values and
+// parameters; damaged orders and truncated streams are rejected.
+static void testRicePartition() {
+    unique_ptr<RiceScratch> scratch(new RiceScratch);
+    for (size_t n : {1, 2, 7, 255, 256, 1000, 4096}) {
+        for (int maxBits : {0, 3, 12, 20}) {
+            const vector<int32_t> v = riceResiduals(n, (uint32_t)(n + maxBits), maxBits);
+            RicePartition part;
+            chooseRicePartition(v.data(), n, part, *scratch);
+            CHECK(part.bits == bestRiceBits(v));
+            vector<uint8_t> buf(n * 8 + 1024);
+            BitSink w(buf.data(), buf.size());
+            writeRicePartitioned(v.data(), n, part, w);
+            const uint64_t bits = w.bitCount();
+            w.finish();
+            CHECK(bits == part.bits);
+
+            BitSource r(buf.data(), bits);
+            vector<int32_t> out(n);
+            RicePartition got;
+            CHECK(readRicePartitioned(r, out.data(), n, got));
+            CHECK(out == v && got.order == part.order && got.bits == bits);
+            CHECK(memcmp(got.k, part.k, (size_t)1 << part.order) == 0);
+
+            if (bits > 1) {
+                BitSource cut(buf.data(), bits - 1);
+                CHECK(!readRicePartitioned(cut, out.data(), n, got));
+            }
+        }
+    }
+    uint8_t bad[8] = {0x90}; // order 9
+    BitSource r(bad, 64);
+    vector<int32_t> out(16);
+    RicePartition part;
+    CHECK(!readRicePartitioned(r, out.data(), out.size(), part));
+}
+
+// ---------------- bit strings ----------------
+
+// packBits / unpackBits against a bit-at-a-time reference, for every length
+// up to a few SIMD steps and from unaligned text; unused low bits of the last
+// byte are zero and the bytes after it are untouched.
+static void testBitsPackRoundTrip() {
+    mt19937 rng(34);
+    vector<size_t> lengths;
+    for (size_t n = 0; n <= 200; ++n) lengths.push_back(n);
+    for (size_t n : {255, 256, 257, 1000, 4099}) lengths.push_back(n);
+    for (size_t n : lengths) {
+        for (size_t offset = 0; offset < 4; ++offset) {
+            string text(offset + n, '0');
+            for (size_t i = offset; i < text.size(); ++i) text[i] = char('0' + (rng() & 1));
+            vector<uint8_t> ref(packedBytes(n), 0);
+            for (size_t i = 0; i < n; ++i) ref[i / 8] |= uint8_t((text[offset + i] - '0') << (7 - i % 8));
+
+            vector<uint8_t> packed(packedBytes(n) + 1, kGuard);
+            CHECK(packBits(text.data() + offset, n, packed.data()));
+            CHECK(std::equal(ref.begin(), ref.end(), packed.begin()));
+            CHECK(packed.back() == kGuard);
+
+            string back(offset + n + 1, '#');
+            unpackBits(packed.data(), n, &back[offset]);
+            CHECK(back.compare(offset, n, text, offset, n) == 0);
+            CHECK(back.back() == '#');
+        }
+    }
+}
+
+// Anything but '0' and '1' is rejected wherever it sits; filterBits drops it.
+static void testBitsPackRejects() {
+    const size_t n = 100;
+    for (size_t pos : {0, 7, 8, 31, 32, 63, 64, 95, 99}) {
+        for (char bad : {'2', '/', ' ', '\0', 'x'}) {
+            string text(n, '1');
+            text[pos] = bad;
+            vector<uint8_t> packed(packedBytes(n));
+            CHECK(!packBits(text.data(), n, packed.data()));
+        }
+    }
+    string text = "10 1\n1\t0-01,1";
+    CHECK(filterBits(text.data(), text.size(), &text[0]) == 8);
+    CHECK(text.compare(0, 8, "10110011") == 0);
+}
+
+// ---------------- audio ----------------
+
+// Random walk with occasional jumps, clamped to the 16-bit range; the right
+// channel follows the left one with its own noise.
+static vector<int16_t> audioSignal(size_t frames, int channels, uint32_t seed, int step = 300) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> d(-step, step);
+    vector<int16_t> s(frames * channels);
+    int l = 0;
+    for (size_t i = 0; i < frames; ++i) {
+        l = (rng() % 97 == 0) ? (int)(rng() & 0xFFFF) - 32768 : min(32767, max(-32768, l + d(rng)));
+        s[i * channels] = (int16_t)l;
+        if (channels == 2) s[i * channels + 1] = (int16_t)min(32767, max(-32768, l + d(rng) / 4));
+    }
+    return s;
+}
+
+// Encodes into audioEncodedSizeHint bytes, growing the buffer to the size
+// reported if that is not enough.
+static CodecStatus encodeAudioGrow(const vector<int16_t> &s, const AudioInfo &info, vector<uint8_t> &out,
+                                   CodecStats *stats = nullptr) {
+    out.assign(audioEncodedSizeHint(info), 0);
+    size_t written = 0;
+    CodecStatus st = encodeAudio(s.data(), info, out.data(), out.size(), written, stats);
+    if (st == CodecStatus::BufferTooSmall) {
+        out.assign(written, 0);
+        if (stats) *stats = CodecStats();
+        st = encodeAudio(s.data(), info, out.data(), out.size(), written, stats);
+    }
+    out.resize(written);
+    return st;
+}
+
+static void checkAudioRoundTrip(const vector<int16_t> &s, const AudioInfo &info) {
+    vector<uint8_t> file;
+    CHECK(encodeAudioGrow(s, info, file) == CodecStatus::Ok);
+    AudioInfo got;
+    CHECK(readAudioInfo(file.data(), file.size(), got) == CodecStatus::Ok);
+    CHECK(got.channels == info.channels && got.frames == info.frames && got.sample_rate == info.sample_rate);
+    vector<int16_t> out(s.size());
+    CHECK(decodeAudio(file.data(), file.size(), out.data(), out.size()) == CodecStatus::Ok);
+    CHECK(out == s);
+}
+
+// Mono and stereo, from a single frame up, including full-scale swings.
+static void testAudioRoundTrip() {
+    for (uint16_t channels : {1, 2}) {
+        for (size_t frames : {1, 2, 77, 5000}) {
+            AudioInfo info;
+            info.channels = channels;
+            info.sample_rate = 44100;
+            info.frames = frames;
+            checkAudioRoundTrip(audioSignal(frames, channels, (uint32_t)(frames + channels)), info);
+
+            vector<int16_t> swing(frames * channels);
+            for (size_t i = 0; i < swing.size(); ++i) swing[i] = (i / channels) % 2 ? 32767 : -32768;
+            checkAudioRoundTrip(swing, info);
+        }
+    }
+}
+
+// Too small a buffer reports the size needed; damaged or truncated files
+// and short destinations are rejected.
+static void testAudioErrors() {
+    AudioInfo info;
+    info.channels = 2;
+    info.sample_rate = 8000;
+    info.frames = 3000;
+    const vector<int16_t> s = audioSignal(info.frames, 2, 11);
+    vector<uint8_t> file;
+    CHECK(encodeAudioGrow(s, info, file) == CodecStatus::Ok);
+
+    vector<uint8_t> small(file.size() - 1);
+    size_t written = 0;
+    CHECK(encodeAudio(s.data(), info, small.data(), small.size(), written) == CodecStatus::BufferTooSmall);
+    // the payload is coded at kPayloadReserve before the file is laid out
+    CHECK(written >= file.size() && written <= file.size() + kPayloadReserve);
+    const size_t need = written;
+    CHECK(encodeAudio(s.data(), info, nullptr, 0, written) == CodecStatus::BufferTooSmall);
+    CHECK(written == need);
+    vector<uint8_t> exact(need);
+    CHECK(encodeAudio(s.data(), info, exact.data(), exact.size(), written) == CodecStatus::Ok);
+    CHECK(written == file.size() && equal(file.begin(), file.end(), exact.begin()));
+
+    vector<int16_t> out(s.size());
+    CHECK(decodeAudio(file.data(), file.size(), out.data(), out.size() - 1) == CodecStatus::BufferTooSmall);
+    CHECK(decodeAudio(file.data(), file.size() - 1, out.data(), out.size()) == CodecStatus::Corrupt);
+    CHECK(decodeAudio(file.data(), 5, out.data(), out.size()) == CodecStatus::Corrupt);
+    vector<uint8_t> bad = file;
+    bad[0] ^= 0x20;
+    CHECK(decodeAudio(bad.data(), bad.size(), out.data(), out.size()) == CodecStatus::Corrupt);
+
+    AudioInfo odd = info;
+    odd.channels = 3;
+    CHECK(encodeAudio(s.data(), odd, file.data(), file.size(), written) == CodecStatus::Unsupported);
+}
+
+// The adaptive backends on the same signals, long enough for several rANS
+// chunks, plus digital silence (the most skewed model state).
+static void testAudioBackends() {
+    for (int backend : {BACKEND_RANGE, BACKEND_RANS}) {
+        for (uint16_t channels : {1, 2}) {
+            for (size_t frames : {1, 2, 77, 30000}) {
+                AudioInfo info;
+                info.channels = channels;
+                info.sample_rate = 48000;
+                info.frames = frames;
+                info.backend = backend;
+                checkAudioRoundTrip(audioSignal(frames, channels, (uint32_t)(frames * 3 + backend)), info);
+                checkAudioRoundTrip(vector<int16_t>(frames * channels, 0), info);
+                vector<int16_t> swing(frames * channels);
+                for (size_t i = 0; i < swing.size(); ++i) swing[i] = (i / channels) % 2 ? 32767 : -32768;
+                checkAudioRoundTrip(swing, info);
+
+                vector<uint8_t> file;
+                CHECK(encodeAudioGrow(audioSignal(frames, channels, 1), info, file) == CodecStatus::Ok);
+                AudioInfo got;
+                CHECK(readAudioInfo(file.data(), file.size(), got) == CodecStatus::Ok);
+                CHECK(got.backend == backend);
+            }
+        }
+        AudioInfo info;
+        info.channels = 2;
+        info.frames = 5000;
+        info.backend = backend;
+        const vector<int16_t> s = audioSignal(info.frames, 2, 8);
+        vector<uint8_t> file;
+        CHECK(encodeAudioGrow(s, info, file) == CodecStatus::Ok);
+        vector<uint8_t> small(file.size() - 1);
+        size_t written = 0;
+        CHECK(encodeAudio(s.data(), info, small.data(), small.size(), written) == CodecStatus::BufferTooSmall);
+        CHECK(written >= file.size() && written <= file.size() + kPayloadReserve);
+        vector<int16_t> out(s.size());
+        CHECK(decodeAudio(file.data(), file.size() - 1, out.data(), out.size()) == CodecStatus::Corrupt);
+    }
+    AudioInfo info;
+    info.channels = 1;
+    info.frames = 10;
+    info.backend = 3;
+    vector<int16_t> s(10);
+    vector<uint8_t> file(1024);
+    size_t written = 0;
+    CHECK(encodeAudio(s.data(), info, file.data(), file.size(), written) == CodecStatus::Unsupported);
+}
+
+// audioSignal with stretches of digital silence of 1 frame up to several
+// thousand, including at both ends.
+static vector<int16_t> gappedSignal(size_t frames, int channels, uint32_t seed) {
+    vector<int16_t> s = audioSignal(frames, channels, seed);
+    mt19937 rng(seed);
+    for (size_t i = 0; i < frames;) {
+        size_t len = (size_t)1 << (rng() % 13);
+        if (i == 0 || rng() % 2) std::fill(s.begin() + i * channels, s.begin() + min(frames, i + len) * channels, 0);
+        i += len + rng() % 200;
+    }
+    std::fill(s.end() - min<size_t>(frames, 37) * channels, s.end(), 0);
+    return s;
+}
+
+// Run mode with every backend: silence, gapped signals and signals without
+// silence round-trip, the header records the flag and silence is coded as runs.
+static void testAudioRunMode() {
+    for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) {
+        for (uint16_t channels : {1, 2}) {
+            for (size_t frames : {1, 3, 100, 40000}) {
+                AudioInfo info;
+                info.channels = channels;
+                info.frames = frames;
+                info.backend = backend;
+                info.runMode = true;
+                checkAudioRoundTrip(vector<int16_t>(frames * channels, 0), info);
+                checkAudioRoundTrip(gappedSignal(frames, channels, (uint32_t)frames + backend), info);
+                checkAudioRoundTrip(audioSignal(frames, channels, 5), info);
+
+                vector<uint8_t> file;
+                CHECK(encodeAudioGrow(gappedSignal(frames, channels, 2), info, file) == CodecStatus::Ok);
+                AudioInfo got;
+                CHECK(readAudioInfo(file.data(), file.size(), got) == CodecStatus::Ok);
+                CHECK(got.runMode && got.backend == backend);
+            }
+            AudioInfo info;
+            info.channels = channels;
+            info.frames = 20000;
+            info.backend = backend;
+            const vector<int16_t> silence(info.frames * channels, 0);
+            vector<uint8_t> plain, runs;
+            CHECK(encodeAudioGrow(silence, info, plain) == CodecStatus::Ok);
+            info.runMode = true;
+            vector<uint8_t> dst(audioEncodedSizeHint(info));
+            size_t written = 0;
+            CodecStats stats;
+            CHECK(encodeAudio(silence.data(), info, dst.data(), dst.size(), written, &stats) == CodecStatus::Ok);
+            CHECK(written < plain.size());
+            CHECK(stats.runs > 0 && stats.runItems > info.frames * channels / 2);
+        }
+    }
+}
+
+// file with its INFO fields passed through edit and the container laid out
+// again around the same payload
+static vector<uint8_t> rewriteInfo(const vector<uint8_t> &file, const char *magic,
+                                   const function<void(vector<uint64_t>&)> &edit) {
+    ContainerView view;
+    CHECK(readContainer(file.data(), file.size(), magic, view) == CodecStatus::Ok);
+    vector<uint64_t> fields;
+    for (FieldReader r(view.info.body, view.info.size); r.p < r.end;) fields.push_back(r.get());
+    edit(fields);
+    FieldWriter info;
+    for (uint64_t v : fields) info.put(v);
+    const size_t n = (size_t)view.data.size;
+    vector<uint8_t> out(kPayloadReserve + n + containerTail(n));
+    std::copy(view.data.body, view.data.body + n, out.begin() + kPayloadReserve);
+    out.resize((size_t)finishContainer(out.data(), magic, info, n));
+    return out;
+}
+
+// Block mode: mono and stereo across block boundaries, on the usual
+// signals, silence (all-zero partitions) and full-scale swings; it only
+// combines with the Golomb backend and without run mode.
+static void testAudioBlocks() {
+    for (uint16_t channels : {1, 2}) {
+        for (size_t frames : {1, 2, 4095, 4096, 4097, 3 * 4096 + 5}) {
+            AudioInfo info;
+            info.channels = channels;
+            info.frames = frames;
+            info.blocks = true;
+            checkAudioRoundTrip(audioSignal(frames, channels, (uint32_t)frames), info);
+            checkAudioRoundTrip(gappedSignal(frames, channels, 3), info);
+            vector<int16_t> swing(frames * channels);
+            for (size_t i = 0; i < swing.size(); ++i) swing[i] = (i / channels + i) % 2 ? 32767 : -32768;
+            checkAudioRoundTrip(swing, info);
+
+            vector<uint8_t> file;
+            CHECK(encodeAudioGrow(audioSignal(frames, channels, 4), info, file) == CodecStatus::Ok);
+            AudioInfo got;
+            CHECK(readAudioInfo(file.data(), file.size(), got) == CodecStatus::Ok);
+            CHECK(got.blocks && got.backend == BACKEND_GOLOMB);
+            vector<int16_t> out(frames * channels);
+            CHECK(decodeAudio(file.data(), file.size() - 1, out.data(), out.size()) == CodecStatus::Corrupt);
+        }
+    }
+    AudioInfo info;
+    info.channels = 1;
+    info.frames = 100;
+    info.blocks = true;
+    const vector<int16_t> s(100);
+    vector<uint8_t> file(4096);
+    size_t written = 0;
+    info.runMode = true;
+    CHECK(encodeAudio(s.data(), info, file.data(), file.size(), written) == CodecStatus::Unsupported);
+    info.runMode = false;
+    info.backend = BACKEND_RANS;
+    CHECK(encodeAudio(s.data(), info, file.data(), file.size(), written) == CodecStatus::Unsupported);
+}
+
+// Stereo pairs that favour different channel decorrelations: the right
+// channel following the left one, independent, inverted, or silent.
+static vector<vector<int16_t>> stereoSignals(size_t frames, uint32_t seed) {
+    vector<int16_t> follow = audioSignal(frames, 2, seed);
+    vector<int16_t> indep = audioSignal(frames, 2, seed + 1), other = audioSignal(frames, 1, seed + 2, 2000);
+    vector<int16_t> invert = follow, silent = follow;
+    for (size_t i = 0; i < frames; ++i) {
+        indep[2 * i + 1] = other[i];
+        invert[2 * i + 1] = (int16_t)max(-32767, -(int)follow[2 * i]);
+        silent[2 * i + 1] = 0;
+    }
+    return {follow, indep, invert, silent};
+}
+
+// Block mode search: every predictor order limit, with and without the stereo
+// search, short and full blocks and every partition order limit. Settings
+// outside the documented ranges are rejected.
+static void testAudioBlockSearch() {
+    const size_t frames = 2 * 1000 + 37;
+    for (uint16_t channels : {1, 2}) {
+        const vector<vector<int16_t>> signals =
+            channels == 2 ? stereoSignals(frames, 11) : vector<vector<int16_t>>{audioSignal(frames, 1, 11)};
+        for (int maxOrder = 0; maxOrder <= 4; ++maxOrder) {
+            for (bool stereoSearch : {false, true}) {
+                for (uint32_t blockFrames : {16u, 1000u, 4096u}) {
+                    for (int maxPartitionOrder : {0, 3, 8}) {
+                        AudioInfo info;
+                        info.channels = channels;
+                        info.frames = frames;
+                        info.blocks = true;
+                        info.maxOrder = maxOrder;
+                        info.stereoSearch = stereoSearch;
+                        info.blockFrames = blockFrames;
+                        info.maxPartitionOrder = maxPartitionOrder;
+                        for (const vector<int16_t> &s : signals) checkAudioRoundTrip(s, info);
+                    }
+                }
+            }
+        }
+    }
+    AudioInfo info;
+    info.channels = 2;
+    info.frames = 100;
+    info.blocks = true;
+    const vector<int16_t> s(200);
+    vector<uint8_t> file(4096);
+    size_t written = 0;
+    for (uint32_t blockFrames : {0u, 15u, 4097u}) {
+        info.blockFrames = blockFrames;
+        CHECK(encodeAudio(s.data(), info, file.data(), file.size(), written) == CodecStatus::Unsupported);
+    }
+    info.blockFrames = 4096;
+    for (int maxOrder : {-1, 5}) {
+        info.maxOrder = maxOrder;
+        CHECK(encodeAudio(s.data(), info, file.data(), file.size(), written) == CodecStatus::Unsupported);
+    }
+
+    // decoders reject block lengths below 16 and block files without heads
+    info.maxOrder = 2;
+    vector<uint8_t> good;
+    CHECK(encodeAudioGrow(s, info, good) == CodecStatus::Ok);
+    vector<int16_t> out(s.size());
+    for (uint64_t blockFrames : {0u, 1u, 15u}) {
+        const vector<uint8_t> bad = rewriteInfo(good, "GBL2", [&](vector<uint64_t> &f) { f[6] = blockFrames; });
+        CHECK(readAudioInfo(bad.data(), bad.size(), info) == CodecStatus::Corrupt);
+        CHECK(decodeAudio(bad.data(), bad.size(), out.data(), out.size()) == CodecStatus::Corrupt);
+    }
+    const vector<uint8_t> headless = rewriteInfo(good, "GBL2", [](vector<uint64_t> &f) {
+        f[4] &= ~(uint64_t)0x200;
+        f.resize(6);
+    });
+    CHECK(readAudioInfo(headless.data(), headless.size(), info) == CodecStatus::Corrupt);
+    AudioDecoder dec;
+    CHECK(dec.open(headless.data(), headless.size()) == CodecStatus::Corrupt);
+    const vector<uint8_t> same = rewriteInfo(good, "GBL2", [](vector<uint64_t> &) {});
+    CHECK(same == good);
+
+    // blocks coded on several threads give the same file and statistics
+    for (uint16_t channels : {1, 2}) {
+        for (uint32_t blockFrames : {16u, 1000u, 4096u}) {
+            const size_t n = 4 * 32768 + 5; // four threads' worth
+            const vector<int16_t> sig = audioSignal(n, channels, blockFrames);
+            AudioInfo base;
+            base.channels = channels;
+            base.frames = n;
+            CHECK(audioPreset(6, base));
+            base.blockFrames = blockFrames;
+            vector<uint8_t> want;
+            CodecStats wantStats;
+            CHECK(encodeAudioGrow(sig, base, want, &wantStats) == CodecStatus::Ok);
+            for (int threads : {2, 3, 7, 64}) {
+                AudioInfo par = base;
+                par.threads = threads;
+                vector<uint8_t> got;
+                CodecStats gotStats;
+                CHECK(encodeAudioGrow(sig, par, got, &gotStats) == CodecStatus::Ok);
+                CHECK(got == want);
+                CHECK(gotStats.unit == wantStats.unit && gotStats.items == wantStats.items);
+                CHECK(std::equal(begin(gotStats.residualHist), end(gotStats.residualHist),
+                                 begin(wantStats.residualHist)));
+                CHECK(std::equal(begin(gotStats.mHist), end(gotStats.mHist), begin(wantStats.mHist)));
+            }
+        }
+    }
+}
+
+// Every preset round trips; higher levels never do worse than level 0 on a
+// stereo signal, and levels outside 0..8 leave info alone.
+static void testAudioPresets() {
+    for (uint16_t channels : {1, 2}) {
+        for (size_t frames : {1, 600, 9000}) {
+            size_t size0 = 0;
+            for (int level = 0; level <= 8; ++level) {
+                AudioInfo info;
+                info.channels = channels;
+                info.sample_rate = 48000;
+                info.frames = frames;
+                CHECK(audioPreset(level, info));
+                CHECK(info.blocks && info.backend == BACKEND_GOLOMB && !info.runMode);
+                const vector<int16_t> s = audioSignal(frames, channels, (uint32_t)(frames + level));
+                checkAudioRoundTrip(s, info);
+                if (channels == 2) {
+                    vector<uint8_t> file;
+                    CHECK(encodeAudioGrow(stereoSignals(frames, 5)[0], info, file) == CodecStatus::Ok);
+                    if (level == 0) size0 = file.size();
+                    CHECK(file.size() <= size0);
+                }
+            }
+        }
+    }
+    AudioInfo info;
+    CHECK(!audioPreset(-1, info) && !audioPreset(9, info));
+    CHECK(!info.blocks && info.blockFrames == 4096);
+}
+
+// Decodes file with one AudioDecoder in reads of the given sizes (cycled);
+// false if a read fails or returns fewer frames than asked before the end.
+static bool streamAudio(AudioDecoder &dec, const vector<uint8_t> &file, const vector<size_t> &sizes,
+                        vector<int16_t> &out) {
+    if (dec.open(file.data(), file.size()) != CodecStatus::Ok) return false;
+    const AudioInfo &info = dec.info();
+    out.assign(info.frames * info.channels, 0);
+    for (size_t i = 0, done = 0;; ++i) {
+        const size_t want = sizes[i % sizes.size()];
+        vector<int16_t> chunk(want * info.channels + 1, 0x5A5A);
+        size_t got = 0;
+        if (dec.read(chunk.data(), want, got) != CodecStatus::Ok) return false;
+        if (got > want || done + got > info.frames || chunk[got * info.channels] != 0x5A5A) return false;
+        copy(chunk.begin(), chunk.begin() + got * info.channels, out.begin() + done * info.channels);
+        done += got;
+        if (dec.position() != done) return false;
+        if (got < want) return done == info.frames;
+    }
+}
+
+// AudioDecoder in every coding mode, with reads of single frames, of sizes
+// straddling blocks and silence runs, and larger than the file; it matches
+// decodeAudio, can be reopened, and a damaged stream fails for good.
+static void testAudioDecoder() {
+    const vector<vector<size_t>> readSizes = {{1}, {7, 256, 1}, {4095, 2}, {5000}, {100000}};
+    AudioDecoder dec;
+    for (uint16_t channels : {1, 2}) {
+        const size_t frames = 9001;
+        const vector<int16_t> signals[] = {audioSignal(frames, channels, 21), gappedSignal(frames, channels, 22)};
+        for (int mode = 0; mode < 9; ++mode) {
+            AudioInfo info;
+            info.channels = channels;
+            info.sample_rate = 44100;
+            info.frames = frames;
+            if (mode < 3) info.backend = mode;
+            else if (mode < 6) { info.backend = mode - 3; info.runMode = true; }
+            else if (mode == 6) info.blocks = true;
+            else audioPreset(mode == 7 ? 3 : 8, info);
+            for (const vector<int16_t> &s : signals) {
+                vector<uint8_t> file;
+                CHECK(encodeAudioGrow(s, info, file) == CodecStatus::Ok);
+                for (const vector<size_t> &sizes : readSizes) {
+                    vector<int16_t> out;
+                    CHECK(streamAudio(dec, file, sizes, out));
+                    CHECK(out == s);
+                }
+                size_t got = 1;
+                int16_t none[2];
+                CHECK(dec.read(none, 1, got) == CodecStatus::Ok && got == 0);
+
+                vector<uint8_t> bad = file;
+                bad[bad.size() / 2] ^= 0x10;
+                vector<int16_t> out;
+                CHECK(!streamAudio(dec, bad, {512}, out));
+                CHECK(dec.read(out.data(), 1, got) == CodecStatus::Corrupt);
+            }
+        }
+    }
+    AudioDecoder fresh;
+    int16_t out[2];
+    size_t got = 1;
+    CHECK(fresh.read(out, 1, got) == CodecStatus::Corrupt && got == 0);
+    const uint8_t junk[64] = {};
+    CHECK(fresh.open(junk, sizeof junk) != CodecStatus::Ok);
+    CHECK(fresh.read(out, 1, got) == CodecStatus::Corrupt);
+}
+
+// ---------------- images ----------------
+
+// Smooth gradient with a little noise: the residuals of both predictors
+// stay small.
+static vector<uint8_t> smoothPlane(uint32_t w, uint32_t h, size_t stride, uint32_t seed) {
+    mt19937 rng(seed);
+    vector<uint8_t> px(stride * h, 0);
+    for (uint32_t r = 0; r < h; ++r)
+        for (uint32_t c = 0; c < w; ++c) px[r * stride + c] = (uint8_t)(((r * 3 + c * 2) & 0x7F) + (rng() % 9));
+    return px;
+}
+
+static vector<uint8_t> noisePlane(uint32_t w, uint32_t h, uint32_t seed) {
+    mt19937 rng(seed);
+    vector<uint8_t> px((size_t)w * h);
+    for (uint8_t &p : px) p = (uint8_t)(rng() & 0xFF);
+    return px;
+}
+
+static bool samePlane(const vector<uint8_t> &a, const vector<uint8_t> &b, uint32_t w, uint32_t h, size_t stride) {
+    for (uint32_t r = 0; r < h; ++r)
+        if (memcmp(&a[r * stride], &b[r * stride], w) != 0) return false;
+    return true;
+}
+
+// Both predictors, with rows wider than the plane; the header records what
+// was coded.
+static void testImageRoundTrip() {
+    const uint32_t sizes[][2] = {{1, 1}, {1, 9}, {9, 1}, {3, 5}, {64, 33}, {200, 150}};
+    for (int predictor : {PRED_LEFT, PRED_MEDIAN}) {
+        for (const auto &sz : sizes) {
+            const uint32_t w = sz[0], h = sz[1];
+            const size_t stride = w + 3;
+            const vector<uint8_t> px = smoothPlane(w, h, stride, w * 31 + h);
+            vector<uint8_t> file(imageEncodedBound(w, h));
+            size_t written = 0;
+            ImageInfo coded;
+            CHECK(encodeImagePlane(px.data(), w, h, stride, predictor, file.data(), file.size(), written, &coded) ==
+                  CodecStatus::Ok);
+            ImageInfo info;
+            CHECK(readImageInfo(file.data(), written, info) == CodecStatus::Ok);
+            CHECK(info.width == w && info.height == h && info.predictor == predictor);
+            CHECK(info.m == coded.m && info.nbits == coded.nbits);
+            vector<uint8_t> out(stride * h, 0);
+            CHECK(decodeImagePlane(file.data(), written, out.data(), stride) == CodecStatus::Ok);
+            CHECK(samePlane(out, px, w, h, stride));
+        }
+    }
+}
+
+// Too small a buffer reports the size needed; damaged or truncated files
+// are rejected.
+static void testImageErrors() {
+    const uint32_t w = 40, h = 30;
+    const vector<uint8_t> px = smoothPlane(w, h, w, 5);
+    vector<uint8_t> file(imageEncodedBound(w, h));
+    size_t written = 0;
+    CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, file.data(), file.size(), written) == CodecStatus::Ok);
+    file.resize(written);
+
+    vector<uint8_t> small(written - 1);
+    size_t need = 0;
+    CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, small.data(), small.size(), need) ==
+          CodecStatus::BufferTooSmall);
+    CHECK(need >= written && need <= written + kPayloadReserve);
+    vector<uint8_t> exact(need);
+    size_t again = 0;
+    CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, exact.data(), exact.size(), again) == CodecStatus::Ok);
+    CHECK(again == written && equal(file.begin(), file.end(), exact.begin()));
+    CHECK(encodeImagePlane(px.data(), w, h, w, 7, file.data(), file.size(), need) == CodecStatus::Unsupported);
+
+    vector<uint8_t> out(px.size());
+    CHECK(decodeImagePlane(file.data(), file.size() - 1, out.data(), w) == CodecStatus::Corrupt);
+    CHECK(decodeImagePlane(file.data(), 10, out.data(), w) == CodecStatus::Corrupt);
+    vector<uint8_t> bad = file;
+    bad[1] ^= 0x20;
+    CHECK(decodeImagePlane(bad.data(), bad.size(), out.data(), w) == CodecStatus::Corrupt);
+}
+
+// Planes of 0 and 255 only: with left == top the median predictor returns
+// left + top - topleft, so residuals reach +-510. Such planes must fit
+// imageEncodedBound and decode exactly.
+static void testImageExtremeResiduals() {
+    const uint8_t corner[][4] = {{255, 0, 0, 255}, {0, 255, 255, 0}};
+    for (const uint8_t *px : corner) {
+        for (int predictor : {PRED_LEFT, PRED_MEDIAN}) {
+            vector<uint8_t> file(imageEncodedBound(2, 2));
+            size_t written = 0;
+            CHECK(encodeImagePlane(px, 2, 2, 2, predictor, file.data(), file.size(), written) == CodecStatus::Ok);
+            uint8_t out[4] = {};
+            CHECK(decodeImagePlane(file.data(), written, out, 2) == CodecStatus::Ok);
+            CHECK(memcmp(out, px, 4) == 0);
+        }
+    }
+    for (uint32_t seed = 1; seed <= 8; ++seed) {
+        const uint32_t w = 7 * seed, h = 5 + seed;
+        mt19937 rng(seed);
+        vector<uint8_t> px((size_t)w * h);
+        for (uint8_t &p : px) p = rng() & 1 ? 255 : 0;
+        for (int predictor : {PRED_LEFT, PRED_MEDIAN}) {
+            vector<uint8_t> file(imageEncodedBound(w, h));
+            size_t written = 0;
+            CHECK(encodeImagePlane(px.data(), w, h, w, predictor, file.data(), file.size(), written) ==
+                  CodecStatus::Ok);
+            vector<uint8_t> out(px.size());
+            CHECK(decodeImagePlane(file.data(), written, out.data(), w) == CodecStatus::Ok);
+            CHECK(out == px);
+        }
+    }
+}
+
+// Both predictors with the adaptive backends, on smooth, noisy and 0/255
+// planes (the largest residuals), within imageEncodedBound.
+static void testImageBackends() {
+    const uint32_t sizes[][2] = {{1, 1}, {2, 2}, {9, 1}, {1, 9}, {37, 23}, {300, 220}};
+    for (int backend : {BACKEND_RANGE, BACKEND_RANS}) {
+        for (int predictor : {PRED_LEFT, PRED_MEDIAN}) {
+            for (const auto &sz : sizes) {
+                const uint32_t w = sz[0], h = sz[1];
+                vector<uint8_t> binary = noisePlane(w, h, w + h);
+                for (uint8_t &p : binary) p = p & 1 ? 255 : 0;
+                for (const vector<uint8_t> &px : {smoothPlane(w, h, w, w), noisePlane(w, h, h), binary}) {
+                    vector<uint8_t> file(imageEncodedBound(w, h, backend));
+                    size_t written = 0;
+                    CHECK(encodeImagePlane(px.data(), w, h, w, predictor, file.data(), file.size(), written, nullptr,
+                                           nullptr, backend) == CodecStatus::Ok);
+                    ImageInfo info;
+                    CHECK(readImageInfo(file.data(), written, info) == CodecStatus::Ok);
+                    CHECK(info.backend == backend && info.predictor == predictor && info.m == 0);
+                    vector<uint8_t> out(px.size());
+                    CHECK(decodeImagePlane(file.data(), written, out.data(), w) == CodecStatus::Ok);
+                    CHECK(out == px);
+                }
+            }
+        }
+        const uint32_t w = 64, h = 48;
+        const vector<uint8_t> px = smoothPlane(w, h, w, 4);
+        vector<uint8_t> file(imageEncodedBound(w, h, backend));
+        size_t written = 0, need = 0;
+        CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, file.data(), file.size(), written, nullptr, nullptr,
+                               backend) == CodecStatus::Ok);
+        CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, file.data(), written - 1, need, nullptr, nullptr,
+                               backend) == CodecStatus::BufferTooSmall);
+        CHECK(need >= written && need <= written + kPayloadReserve);
+        vector<uint8_t> out(px.size());
+        CHECK(decodeImagePlane(file.data(), written - 1, out.data(), w) == CodecStatus::Corrupt);
+    }
+}
+
+// Flat rectangles of a few values over a smooth background, with single
+// pixels that break the runs.
+static vector<uint8_t> flatPlane(uint32_t w, uint32_t h, uint32_t seed) {
+    mt19937 rng(seed);
+    vector<uint8_t> px = smoothPlane(w, h, w, seed);
+    for (int i = 0; i < 6; ++i) {
+        uint32_t x0 = rng() % w, y0 = rng() % h, x1 = x0 + rng() % w, y1 = y0 + rng() % h;
+        uint8_t v = (uint8_t)(i % 2 ? 255 : rng());
+        for (uint32_t r = y0; r < min(y1, h); ++r)
+            for (uint32_t c = x0; c < min(x1, w); ++c) px[r * w + c] = v;
+    }
+    for (int i = 0; i < 20; ++i) px[rng() % px.size()] = (uint8_t)rng();
+    return px;
+}
+
+// Run mode with both predictors and every backend, on constant, flat and
+// noisy planes, within imageEncodedBound.
+static void testImageRunMode() {
+    const uint32_t sizes[][2] = {{1, 1}, {1, 7}, {7, 1}, {2, 2}, {33, 17}, {200, 150}};
+    for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) {
+        for (int predictor : {PRED_LEFT, PRED_MEDIAN}) {
+            for (const auto &sz : sizes) {
+                const uint32_t w = sz[0], h = sz[1];
+                for (const vector<uint8_t> &px : {vector<uint8_t>((size_t)w * h, 200), flatPlane(w, h, w * h),
+                                                  noisePlane(w, h, w)}) {
+                    vector<uint8_t> file(imageEncodedBound(w, h, backend));
+                    size_t written = 0;
+                    CHECK(encodeImagePlane(px.data(), w, h, w, predictor, file.data(), file.size(), written, nullptr,
+                                           nullptr, backend, true) == CodecStatus::Ok);
+                    ImageInfo info;
+                    CHECK(readImageInfo(file.data(), written, info) == CodecStatus::Ok);
+                    CHECK(info.runMode && info.backend == backend && info.predictor == predictor);
+                    vector<uint8_t> out(px.size());
+                    CHECK(decodeImagePlane(file.data(), written, out.data(), w) == CodecStatus::Ok);
+                    CHECK(out == px);
+                }
+            }
+        }
+        const uint32_t w = 256, h = 64;
+        const vector<uint8_t> px((size_t)w * h, 17);
+        vector<uint8_t> file(imageEncodedBound(w, h, backend));
+        size_t plain = 0, runs = 0;
+        CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, file.data(), file.size(), plain, nullptr, nullptr,
+                               backend) == CodecStatus::Ok);
+        CodecStats stats;
+        CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, file.data(), file.size(), runs, nullptr, &stats,
+                               backend, true) == CodecStatus::Ok);
+        CHECK(runs < plain);
+        CHECK(stats.runs > 0 && stats.runItems > (uint64_t)w * h / 2);
+    }
+}
+
+// Capacities around kPayloadReserve, where the payload is coded before the
+// file is laid out: BufferTooSmall, and nothing is written past the capacity.
+// A sampled m search reports the size of its full-plane retry.
+static void testImageSmallCapacity() {
+    const uint32_t w = 37, h = 11;
+    const vector<uint8_t> px = noisePlane(w, h, 7);
+    for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) {
+        for (int mSearch : {M_SEARCH_SAMPLED, M_SEARCH_POW2, M_SEARCH_DEFAULT, M_SEARCH_FULL}) {
+            if (backend != BACKEND_GOLOMB && mSearch != M_SEARCH_DEFAULT) continue;
+            size_t need = 0;
+            CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, nullptr, 0, need, nullptr, nullptr, backend,
+                                   false, mSearch) == CodecStatus::BufferTooSmall);
+            CHECK(need > kPayloadReserve);
+            for (size_t cap = kPayloadReserve - 1; cap <= kPayloadReserve + 8; ++cap) {
+                vector<uint8_t> buf(cap + 16, kGuard);
+                size_t written = 0;
+                CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, buf.data(), cap, written, nullptr, nullptr,
+                                       backend, false, mSearch) == CodecStatus::BufferTooSmall);
+                CHECK(written == need);
+                bool guardOk = true;
+                for (size_t i = cap; i < buf.size(); ++i) guardOk = guardOk && buf[i] == kGuard;
+                CHECK(guardOk);
+            }
+            vector<uint8_t> buf(need);
+            size_t written = 0;
+            CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, buf.data(), buf.size(), written, nullptr, nullptr,
+                                   backend, false, mSearch) == CodecStatus::Ok);
+            vector<uint8_t> out(px.size());
+            CHECK(decodeImagePlane(buf.data(), written, out.data(), w) == CodecStatus::Ok);
+            CHECK(out == px);
+        }
+    }
+}
+
+// Every preset round trips and reports its settings; levels outside 0..8
+// are clamped.
+static void testImagePresets() {
+    const uint32_t w = 53, h = 29;
+    const vector<uint8_t> planes[] = {smoothPlane(w, h, w, 3), noisePlane(w, h, 4), flatPlane(w, h, 5)};
+    for (int level = 0; level <= 8; ++level) {
+        const ImagePreset p = imagePreset(level);
+        for (const vector<uint8_t> &px : planes) {
+            vector<uint8_t> buf(imageEncodedBound(w, h, p.backend));
+            size_t written = 0;
+            ImageInfo info;
+            CHECK(encodeImagePlane(px.data(), w, h, w, p.predictor, buf.data(), buf.size(), written, &info, nullptr,
+                                   p.backend, p.runMode, p.mSearch) == CodecStatus::Ok);
+            CHECK(info.backend == p.backend && info.runMode == p.runMode);
+            CHECK(p.predictor == PRED_AUTO ? info.predictor != PRED_AUTO : info.predictor == p.predictor);
+            ImageInfo got;
+            CHECK(readImageInfo(buf.data(), written, got) == CodecStatus::Ok);
+            CHECK(got.predictor == info.predictor && got.m == info.m && got.nbits == info.nbits);
+            vector<uint8_t> out(px.size());
+            CHECK(decodeImagePlane(buf.data(), written, out.data(), w) == CodecStatus::Ok);
+            CHECK(out == px);
+        }
+    }
+    const ImagePreset lo = imagePreset(-3), hi = imagePreset(12), p0 = imagePreset(0), p8 = imagePreset(8);
+    CHECK(lo.predictor == p0.predictor && lo.backend == p0.backend && lo.mSearch == p0.mSearch);
+    CHECK(hi.predictor == p8.predictor && hi.backend == p8.backend && hi.runMode == p8.runMode);
+}
+
+// reencodeImagePlane keeps the settings of the file it is given: a rotated
+// copy of a coded plane, every backend and run mode, and fixed m from 1 (any
+// residual up to 511 bits) up, each within imageEncodedBound for that m.
+static void testImageReencode() {
+    const uint32_t w = 41, h = 23;
+    const vector<uint8_t> planes[] = {smoothPlane(w, h, w, 8), noisePlane(w, h, 9), flatPlane(w, h, 10)};
+    for (const vector<uint8_t> &px : planes) {
+        vector<uint8_t> rotated(px.size());
+        rotateImage(px.data(), w, (int)w, (int)h, 1, 1, rotated.data(), h);
+        for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) {
+            for (bool runMode : {false, true}) {
+                vector<uint8_t> file(imageEncodedBound(w, h, backend));
+                size_t written = 0;
+                ImageInfo like;
+                CHECK(encodeImagePlane(px.data(), w, h, w, PRED_AUTO, file.data(), file.size(), written, &like,
+                                       nullptr, backend, runMode) == CodecStatus::Ok);
+                vector<uint8_t> buf(imageEncodedBound(h, w, backend, like.m));
+                ImageInfo info;
+                CHECK(reencodeImagePlane(rotated.data(), h, w, h, like, buf.data(), buf.size(), written, &info) ==
+                      CodecStatus::Ok);
+                CHECK(info.width == h && info.height == w && info.predictor == like.predictor &&
+                      info.backend == backend && info.runMode == runMode && info.m == like.m);
+                vector<uint8_t> out(rotated.size());
+                CHECK(decodeImagePlane(buf.data(), written, out.data(), h) == CodecStatus::Ok);
+                CHECK(out == rotated);
+            }
+        }
+        for (uint32_t m : {1u, 2u, 7u, 64u, 300u}) {
+            ImageInfo like;
+            like.predictor = PRED_LEFT;
+            like.backend = BACKEND_GOLOMB;
+            like.runMode = m == 7;
+            like.m = m;
+            vector<uint8_t> buf(imageEncodedBound(w, h, BACKEND_GOLOMB, m));
+            size_t written = 0;
+            ImageInfo info;
+            CHECK(reencodeImagePlane(px.data(), w, h, w, like, buf.data(), buf.size(), written, &info) ==
+                  CodecStatus::Ok);
+            CHECK(info.m == m);
+            vector<uint8_t> out(px.size());
+            CHECK(decodeImagePlane(buf.data(), written, out.data(), w) == CodecStatus::Ok);
+            CHECK(out == px);
+            size_t need = 0;
+            CHECK(reencodeImagePlane(px.data(), w, h, w, like, buf.data(), written - 1, need) ==
+                  CodecStatus::BufferTooSmall);
+        }
+    }
+    ImageInfo like;
+    like.backend = BACKEND_GOLOMB;
+    const vector<uint8_t> px(16);
+    vector<uint8_t> buf(4096);
+    size_t written = 0;
+    CHECK(reencodeImagePlane(px.data(), 4, 4, 4, like, buf.data(), buf.size(), written) == CodecStatus::Unsupported);
+}
+
+// Progressive files in every backend and odd sizes: the full plane round
+// trips, and the thumbnail at each scale is decoded from exactly the prefix
+// imageThumbnailInfo asks for (located from kImageHeaderBytes), holding
+// every 2^scale-th pixel of every 2^scale-th row. Shorter prefixes fail.
+static void testImageThumbnails() {
+    const uint32_t sizes[][2] = {{1, 1}, {3, 5}, {16, 17}, {64, 64}, {100, 37}, {257, 129}};
+    for (const auto &sz : sizes) {
+        const uint32_t w = sz[0], h = sz[1];
+        const vector<uint8_t> planes[] = {smoothPlane(w, h, w, w + h), noisePlane(w, h, w * h)};
+        for (const vector<uint8_t> &px : planes) {
+            for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) {
+                vector<uint8_t> file(imageEncodedBound(w, h, backend));
+                size_t written = 0;
+                ImageInfo info;
+                CHECK(encodeImagePlane(px.data(), w, h, w, PRED_INTERPOLATE, file.data(), file.size(), written,
+                                       &info, nullptr, backend, false, M_SEARCH_SAMPLED) == CodecStatus::Ok);
+                file.resize(written);
+                CHECK(info.predictor == PRED_INTERPOLATE && info.levels > 0);
+                vector<uint8_t> out(px.size());
+                CHECK(decodeImagePlane(file.data(), file.size(), out.data(), w) == CodecStatus::Ok);
+                CHECK(out == px);
+                uint64_t lastBytes = 0;
+                for (int scale = info.levels + 1; scale >= 0; --scale) {
+                    ImageThumbnail thumb;
+                    CHECK(imageThumbnailInfo(file.data(), min(file.size(), kImageHeaderBytes), scale, thumb) ==
+                          CodecStatus::Ok);
+                    const int j = min(scale, info.levels);
+                    CHECK(thumb.scale == j && thumb.width == (w + (1u << j) - 1) >> j &&
+                          thumb.height == (h + (1u << j) - 1) >> j);
+                    CHECK(thumb.bytes >= lastBytes && thumb.bytes <= file.size());
+                    lastBytes = thumb.bytes;
+                    const size_t stride = thumb.width + 3;
+                    vector<uint8_t> small(stride * thumb.height);
+                    CHECK(decodeImageThumbnail(file.data(), (size_t)thumb.bytes, scale, small.data(), stride) ==
+                          CodecStatus::Ok);
+                    bool same = true;
+                    for (uint32_t y = 0; y < thumb.height; ++y)
+                        for (uint32_t x = 0; x < thumb.width; ++x)
+                            same = same && small[y * stride + x] == px[(size_t)(y << j) * w + (x << j)];
+                    CHECK(same);
+                    CHECK(decodeImageThumbnail(file.data(), (size_t)thumb.bytes - 1, scale, small.data(), stride) !=
+                          CodecStatus::Ok);
+                }
+                vector<uint8_t> bad = file;
+                bad[bad.size() - 20] ^= 0x01;
+                vector<uint8_t> small(px.size());
+                CHECK(decodeImageThumbnail(bad.data(), bad.size(), 1, small.data(), w) == CodecStatus::Corrupt);
+            }
+            vector<uint8_t> file(imageEncodedBound(w, h));
+            size_t written = 0;
+            CHECK(encodeImagePlane(px.data(), w, h, w, PRED_INTERPOLATE, file.data(), file.size(), written, nullptr,
+                                   nullptr, BACKEND_GOLOMB, true) == CodecStatus::Unsupported);
+            // other files have a single full-size "thumbnail" that needs the whole file
+            CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, file.data(), file.size(), written) ==
+                  CodecStatus::Ok);
+            ImageThumbnail thumb;
+            CHECK(imageThumbnailInfo(file.data(), written, 2, thumb) == CodecStatus::Ok);
+            CHECK(thumb.scale == 0 && thumb.width == w && thumb.bytes == written);
+            vector<uint8_t> out(px.size());
+            CHECK(decodeImageThumbnail(file.data(), written, 2, out.data(), w) == CodecStatus::Ok && out == px);
+        }
+    }
+}
+
+// M_SEARCH_SAMPLED picks m from every 8th row. On striped planes those rows
+// are predicted perfectly (m = 1) while the others are not, so the sampled m
+// alone overflows imageEncodedBound; every preset must still fit it, and the
+// statistics only describe the pass that was kept.
+static void testImageSampledStripes() {
+    struct Plane {
+        uint32_t w, h;
+        function<uint8_t(uint32_t, uint32_t)> at;
+    };
+    const Plane planes[] = {
+        {255, 3, [](uint32_t, uint32_t c) { return (uint8_t)(c & 1 ? 255 : 0); }},
+        {1, 7, [](uint32_t r, uint32_t) { return (uint8_t)(r == 1 ? 0 : r & 1 ? 255 : 0); }},
+        {64, 17, [](uint32_t r, uint32_t c) { return (uint8_t)(r % 8 == 1 ? 128 : (r * 37 + c * 91) & 0xFF); }},
+    };
+    for (const Plane &pl : planes) {
+        vector<uint8_t> px((size_t)pl.w * pl.h);
+        for (uint32_t r = 0; r < pl.h; ++r)
+            for (uint32_t c = 0; c < pl.w; ++c) px[(size_t)r * pl.w + c] = pl.at(r, c);
+        for (int level = 0; level <= 8; ++level) {
+            const ImagePreset p = imagePreset(level);
+            vector<uint8_t> buf(imageEncodedBound(pl.w, pl.h, p.backend));
+            size_t written = 0;
+            CHECK(encodeImagePlane(px.data(), pl.w, pl.h, pl.w, p.predictor, buf.data(), buf.size(), written, nullptr,
+                                   nullptr, p.backend, p.runMode, p.mSearch) == CodecStatus::Ok);
+            vector<uint8_t> out(px.size());
+            CHECK(decodeImagePlane(buf.data(), written, out.data(), pl.w) == CodecStatus::Ok);
+            CHECK(out == px);
+        }
+        for (int predictor : {PRED_LEFT, PRED_MEDIAN}) {
+            for (bool runMode : {false, true}) {
+                vector<uint8_t> buf(imageEncodedBound(pl.w, pl.h));
+                size_t written = 0;
+                ImageInfo info;
+                CodecStats st;
+                CHECK(encodeImagePlane(px.data(), pl.w, pl.h, pl.w, predictor, buf.data(), buf.size(), written,
+                                       &info, &st, BACKEND_GOLOMB, runMode, M_SEARCH_SAMPLED) == CodecStatus::Ok);
+                ImageInfo got;
+                CHECK(readImageInfo(buf.data(), written, got) == CodecStatus::Ok);
+                CHECK(got.m == info.m && got.nbits == info.nbits);
+                CHECK(st.items == (uint64_t)pl.w * pl.h && st.codedBits == info.nbits && st.codedBytes == written);
+                if (!runMode) CHECK(histTotal(st.residualHist) == st.items);
+                CHECK(histTotal(st.mHist) == histTotal(st.residualHist));
+            }
+        }
+    }
+}
+
+// ImagePlaneEncoder fed in bands of several heights writes the file of
+// encodeImagePlane for every predictor, backend, run mode and m search,
+// including the sampled retry, without reading rows that are not yet ready
+// (the rest of the plane holds garbage until then).
+static void testImageIncremental() {
+    struct Plane {
+        uint32_t w, h;
+        vector<uint8_t> px;
+    };
+    vector<Plane> planes = {{53, 29, smoothPlane(53, 29, 53, 3)}, {53, 29, noisePlane(53, 29, 4)},
+                            {53, 29, flatPlane(53, 29, 5)}, {1, 1, {77}}, {17, 1, noisePlane(17, 1, 6)},
+                            {1, 9, smoothPlane(1, 9, 1, 7)}};
+    Plane stripes{64, 17, vector<uint8_t>(64 * 17)};
+    for (uint32_t r = 0; r < stripes.h; ++r)
+        for (uint32_t c = 0; c < stripes.w; ++c)
+            stripes.px[(size_t)r * stripes.w + c] = (uint8_t)(r % 8 == 1 ? 128 : (r * 37 + c * 91) & 0xFF);
+    planes.push_back(stripes);
+    for (const Plane &pl : planes) {
+        for (int predictor : {PRED_LEFT, PRED_MEDIAN, PRED_AUTO, PRED_INTERPOLATE}) {
+            for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) {
+                for (bool runMode : {false, true}) {
+                    if (runMode && predictor == PRED_INTERPOLATE) continue;
+                    for (int mSearch : {M_SEARCH_SAMPLED, M_SEARCH_POW2, M_SEARCH_DEFAULT, M_SEARCH_FULL}) {
+                        if (backend != BACKEND_GOLOMB && mSearch != M_SEARCH_DEFAULT) continue;
+                        vector<uint8_t> want(imageEncodedBound(pl.w, pl.h, backend));
+                        size_t wantSize = 0;
+                        ImageInfo wantInfo;
+                        CHECK(encodeImagePlane(pl.px.data(), pl.w, pl.h, pl.w, predictor, want.data(), want.size(),
+                                               wantSize, &wantInfo, nullptr, backend, runMode, mSearch)
+                              == CodecStatus::Ok);
+                        want.resize(wantSize);
+                        for (uint32_t band : {1u, 3u, 8u, pl.h}) {
+                            vector<uint8_t> plane(pl.px.size(), 0xA5);
+                            vector<uint8_t> buf(imageEncodedBound(pl.w, pl.h, backend));
+                            ImagePlaneEncoder enc;
+                            CHECK(enc.start(plane.data(), pl.w, pl.h, pl.w, predictor, buf.data(), buf.size(),
+                                            nullptr, backend, runMode, mSearch) == CodecStatus::Ok);
+                            size_t written = 0;
+                            for (uint32_t r = 0; r < pl.h; r += band) {
+                                CHECK(r == 0 || enc.finish(written) == CodecStatus::Unsupported);
+                                const uint32_t n = min(band, pl.h - r);
+                                std::copy(pl.px.begin() + (size_t)r * pl.w, pl.px.begin() + (size_t)(r + n) * pl.w,
+                                          plane.begin() + (size_t)r * pl.w);
+                                enc.rowsReady(n);
+                            }
+                            ImageInfo info;
+                            CHECK(enc.finish(written, &info) == CodecStatus::Ok);
+                            CHECK(written == wantSize && std::equal(want.begin(), want.end(), buf.begin()));
+                            CHECK(info.predictor == wantInfo.predictor && info.m == wantInfo.m &&
+                                  info.nbits == wantInfo.nbits);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    // too small a buffer reports the size needed, as encodeImagePlane does
+    const Plane &pl = planes[1];
+    for (int backend : {BACKEND_GOLOMB, BACKEND_RANS}) {
+        size_t need = 0, written = 0;
+        CHECK(encodeImagePlane(pl.px.data(), pl.w, pl.h, pl.w, PRED_MEDIAN, nullptr, 0, need, nullptr, nullptr,
+                               backend) == CodecStatus::BufferTooSmall);
+        vector<uint8_t> buf(kPayloadReserve + 4);
+        ImagePlaneEncoder enc;
+        CHECK(enc.start(pl.px.data(), pl.w, pl.h, pl.w, PRED_MEDIAN, buf.data(), buf.size(), nullptr, backend)
+              == CodecStatus::Ok);
+        enc.rowsReady(pl.h);
+        CHECK(enc.finish(written) == CodecStatus::BufferTooSmall && written == need);
+        CHECK(enc.finish(written) == CodecStatus::Unsupported);
+    }
+    vector<uint8_t> buf(64);
+    ImagePlaneEncoder enc;
+    size_t written = 0;
+    CHECK(enc.start(pl.px.data(), pl.w, pl.h, pl.w, 5, buf.data(), buf.size()) == CodecStatus::Unsupported);
+    CHECK(enc.start(pl.px.data(), pl.w, pl.h, pl.w, PRED_INTERPOLATE, buf.data(), buf.size(), nullptr,
+                    BACKEND_GOLOMB, true) == CodecStatus::Unsupported);
+    enc.rowsReady(pl.h);
+    CHECK(enc.finish(written) == CodecStatus::Unsupported);
+}
+
+// ---------------- version 1 files ----------------
+
+// Files written by the version 1 (GBL1 / GIMG) encoders, with and without
+// the checksum trailer: 10 stereo frames, and a 3 x 3 plane whose median
+// residuals reach +-510.
+static const int16_t kLegacySamples[] = {0, 0, 10, 9, -12, -11, 15, 16, -20, -19, 5, 4, 0, 0, 0, 0, 0, 0, 0, 0};
+static const vector<uint8_t> kLegacyAudio[] = {
+    // Golomb, checksum trailer
+    {0x47, 0x42, 0x4c, 0x31, 0x02, 0x00, 0x40, 0x1f, 0x00, 0x00, 0x0a, 0x00,
+     0x00, 0x00, 0x10, 0x00, 0x81, 0xd6, 0x00, 0x00, 0x00, 0xc0, 0x00, 0x02,
+     0x80, 0x00, 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x02, 0x40, 0x00, 0x00, 0x00, 0x0c, 0x80, 0x00, 0x00, 0x24, 0x3d, 0xb4,
+     0x2a, 0xff, 0xb0, 0xd2, 0x03, 0xe1, 0xc4, 0x48},
+    // range coder, run mode, no checksums
+    {0x47, 0x42, 0x4c, 0x31, 0x02, 0x00, 0x40, 0x1f, 0x00, 0x00, 0x0a, 0x00,
+     0x00, 0x00, 0x10, 0x00, 0x19, 0x80, 0x00, 0x00, 0x00, 0x00, 0x57, 0x94,
+     0x5b, 0x04, 0xbd, 0xdc, 0xc8, 0x1c, 0x9a, 0xf7, 0xd3, 0x47, 0xf7, 0x67,
+     0xf0},
+    // rANS, checksum trailer
+    {0x47, 0x42, 0x4c, 0x31, 0x02, 0x00, 0x40, 0x1f, 0x00, 0x00, 0x0a, 0x00,
+     0x00, 0x00, 0x10, 0x00, 0xa1, 0x98, 0x00, 0x00, 0x00, 0xfa, 0xa5, 0xfb,
+     0x02, 0x9f, 0x19, 0x60, 0x01, 0x3b, 0xd3, 0xbe, 0x36, 0x37, 0x7c, 0xda,
+     0x7a, 0x6f, 0x05, 0xe4, 0xf1, 0x2b, 0x22, 0x46, 0xd8, 0xc2, 0xc6, 0xd9},
+};
+static const uint8_t kLegacyPixels[] = {255, 0, 255, 0, 255, 0, 255, 0, 100};
+static const vector<uint8_t> kLegacyImages[] = {
+    // Golomb, median
+    {0x47, 0x49, 0x4d, 0x47, 0x03, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+     0x81, 0x40, 0x00, 0x00, 0x00, 0x9a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x01, 0xf8, 0x07, 0xd0, 0x1f, 0x80, 0x7d, 0x00, 0x01, 0xf0, 0x00,
+     0x07, 0xb0, 0x1f, 0x80, 0x00, 0x7b, 0x00, 0x11, 0x80, 0x04, 0x96, 0x11,
+     0xf4, 0x80, 0x8c, 0xcc, 0xed},
+    // range coder, median
+    {0x47, 0x49, 0x4d, 0x47, 0x03, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+     0x91, 0x00, 0x00, 0x00, 0x00, 0x98, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0xff, 0xbf, 0xb7, 0xeb, 0xbe, 0x37, 0x00, 0x2f, 0xca, 0xa8,
+     0xef, 0x99, 0x32, 0x8c, 0x58, 0x49, 0x40, 0x00, 0x61, 0x5a, 0x7c, 0x35,
+     0x69, 0xe9, 0xc8, 0x7a},
+    // rANS, median, run mode
+    {0x47, 0x49, 0x4d, 0x47, 0x03, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+     0xa9, 0x00, 0x00, 0x00, 0x00, 0xa8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x8c, 0xf7, 0xaa, 0x29, 0x88, 0xfe, 0x8f, 0x5e, 0x8f, 0x20, 0xb8,
+     0xff, 0xfc, 0x62, 0xcc, 0xfc, 0x68, 0xa6, 0xb7, 0xbe, 0x00, 0xaa, 0x22,
+     0x60, 0x69, 0x9b, 0x43, 0x1f, 0x67},
+    // range coder, left
+    {0x47, 0x49, 0x4d, 0x47, 0x03, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+     0x90, 0x00, 0x00, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0xff, 0xbf, 0xb7, 0xeb, 0xbe, 0x36, 0x79, 0x82, 0xbb, 0x45,
+     0x59, 0x81, 0x1f, 0x90, 0x5e, 0x62, 0x00, 0x5a, 0x86, 0xf9, 0x98, 0xc6,
+     0x47, 0x8e, 0x20},
+};
+
+// Version 1 files decode and verify; only those with the trailer report
+// checksums, and damage to their payload is still caught.
+static void testLegacyFiles() {
+    for (const vector<uint8_t> &file : kLegacyAudio) {
+        AudioInfo info;
+        CHECK(readAudioInfo(file.data(), file.size(), info) == CodecStatus::Ok);
+        CHECK(info.channels == 2 && info.sample_rate == 8000 && info.frames == 10);
+        vector<int16_t> out(20);
+        CHECK(decodeAudio(file.data(), file.size(), out.data(), out.size()) == CodecStatus::Ok);
+        CHECK(memcmp(out.data(), kLegacySamples, sizeof kLegacySamples) == 0);
+        vector<int16_t> streamed;
+        AudioDecoder dec;
+        CHECK(streamAudio(dec, file, {3}, streamed) && streamed == out);
+        ChecksumReport rep;
+        CHECK(verifyAudio(file.data(), file.size(), &rep) == CodecStatus::Ok);
+        CHECK(rep.present == info.checksum);
+        if (!info.checksum) continue;
+        vector<uint8_t> bad = file;
+        bad[bad.size() - 10] ^= 0x04;
+        CHECK(verifyAudio(bad.data(), bad.size(), &rep) == CodecStatus::Corrupt);
+        CHECK(decodeAudio(bad.data(), bad.size(), out.data(), out.size()) == CodecStatus::Corrupt);
+    }
+    for (const vector<uint8_t> &file : kLegacyImages) {
+        ImageInfo info;
+        CHECK(readImageInfo(file.data(), file.size(), info) == CodecStatus::Ok);
+        CHECK(info.width == 3 && info.height == 3 && info.checksum);
+        uint8_t out[9] = {};
+        CHECK(decodeImagePlane(file.data(), file.size(), out, 3) == CodecStatus::Ok);
+        CHECK(memcmp(out, kLegacyPixels, 9) == 0);
+        ChecksumReport rep;
+        CHECK(verifyImagePlane(file.data(), file.size(), &rep) == CodecStatus::Ok && rep.present);
+        vector<uint8_t> bad = file;
+        bad[30] ^= 0x04;
+        CHECK(verifyImagePlane(bad.data(), bad.size(), &rep) == CodecStatus::Corrupt);
+        CHECK(decodeImagePlane(bad.data(), bad.size(), out, 3) == CodecStatus::Corrupt);
+    }
+}
+
+// A version 1 ("GIMG") file of the given residuals: host byte order header,
+// Golomb payload, no checksum trailer.
+static vector<uint8_t> legacyImageFile(uint32_t w, uint32_t h, int predictor, uint32_t m,
+                                       const vector<int32_t> &residuals) {
+    uint64_t nbits = 0;
+    encodeInts(residuals.data(), residuals.size(), m, NegativeMode::INTERLEAVED, nullptr, 0, nbits);
+    vector<uint8_t> payload((size_t)((nbits + 7) / 8));
+    encodeInts(residuals.data(), residuals.size(), m, NegativeMode::INTERLEAVED, payload.data(), payload.size(), nbits);
+    vector<uint8_t> file(4 + 4 + 4 + 1 + 4 + 8);
+    uint8_t *p = file.data();
+    memcpy(p, "GIMG", 4); p += 4;
+    memcpy(p, &w, 4); p += 4;
+    memcpy(p, &h, 4); p += 4;
+    *p++ = (uint8_t)predictor;
+    memcpy(p, &m, 4); p += 4;
+    memcpy(p, &nbits, 8);
+    file.insert(file.end(), payload.begin(), payload.end());
+    return file;
+}
+
+// GIMG files were coded with the old median predictor, which returns
+// left + top - topleft when left == top, so residuals reach +-510. They must
+// still decode; new files code the same planes with the JPEG-LS median.
+static void testImageLegacyMedian() {
+    struct Case {
+        uint8_t px[4];
+        vector<int32_t> residuals; // under the old predictor, raster order
+    };
+    const Case cases[] = {
+        {{255, 0, 0, 255}, {255, -255, -255, 510}},  // pixel 3 predicted as 0 + 0 - 255
+        {{0, 255, 255, 0}, {0, 255, 255, -510}},     // pixel 3 predicted as 255 + 255 - 0
+        // the same predictions where the JPEG-LS median (0 and 255) would decode otherwise
+        {{255, 0, 0, 100}, {255, -255, -255, 355}},
+        {{0, 255, 255, 200}, {0, 255, 255, -310}},
+    };
+    for (const Case &c : cases) {
+        for (uint32_t m : {1u, 64u}) {
+            const vector<uint8_t> file = legacyImageFile(2, 2, PRED_MEDIAN, m, c.residuals);
+            ImageInfo info;
+            CHECK(readImageInfo(file.data(), file.size(), info) == CodecStatus::Ok);
+            CHECK(info.predictor == PRED_MEDIAN && info.m == m);
+            uint8_t out[4] = {};
+            CHECK(decodeImagePlane(file.data(), file.size(), out, 2) == CodecStatus::Ok);
+            CHECK(memcmp(out, c.px, 4) == 0);
+        }
+        for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) {
+            vector<uint8_t> buf(imageEncodedBound(2, 2, backend));
+            size_t written = 0;
+            CHECK(encodeImagePlane(c.px, 2, 2, 2, PRED_MEDIAN, buf.data(), buf.size(), written, nullptr, nullptr,
+                                   backend) == CodecStatus::Ok);
+            uint8_t out[4] = {};
+            CHECK(decodeImagePlane(buf.data(), written, out, 2) == CodecStatus::Ok);
+            CHECK(memcmp(out, c.px, 4) == 0);
+        }
+    }
+}
+
+// ---------------- checksums ----------------
+
+// Bit-at-a-time CRC32C
+static uint32_t crcReference(const uint8_t *p, size_t len) {
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) {
+        c ^= p[i];
+        for (int k = 0; k < 8; ++k) c = (c >> 1) ^ ((c & 1) ? 0x82F63B78u : 0);
+    }
+    return ~c;
+}
+
+// crc32c (SSE4.2 where available) and the table path agree with the
+// bit-at-a-time definition at every length and alignment, and continue
+// across split buffers.
+static void testCrc32c() {
+    CHECK(crc32c("123456789", 9) == 0xE3069283u);
+    CHECK(crc32cTable("123456789", 9) == 0xE3069283u);
+    CHECK(crc32c(nullptr, 0) == 0);
+    vector<uint8_t> buf(1 << 20);
+    mt19937 rng(36);
+    for (uint8_t &b : buf) b = (uint8_t)rng();
+    for (size_t offset = 0; offset < 8; ++offset) {
+        for (size_t len = 0; len < 80; ++len) {
+            const uint32_t ref = crcReference(buf.data() + offset, len);
+            CHECK(crc32c(buf.data() + offset, len) == ref);
+            CHECK(crc32cTable(buf.data() + offset, len) == ref);
+        }
+    }
+    const uint32_t whole = crcReference(buf.data(), buf.size());
+    CHECK(crc32c(buf.data(), buf.size()) == whole);
+    CHECK(crc32cTable(buf.data(), buf.size()) == whole);
+    for (size_t split : {1, 7, 4096, 99999}) {
+        CHECK(crc32c(buf.data() + split, buf.size() - split, crc32c(buf.data(), split)) == whole);
+        CHECK(crc32cTable(buf.data() + split, buf.size() - split, crc32cTable(buf.data(), split)) == whole);
+    }
+}
+
+// An INFO body of kMaxInfoFields full-width fields (a two-byte length
+// varint) still fits in front of the payload, which survives the layout.
+static void testContainerFullInfo() {
+    FieldWriter info;
+    for (int i = 0; i < kMaxInfoFields; ++i) info.put(UINT64_MAX - (uint64_t)i);
+    CHECK(info.size == kMaxInfoBytes && varintSize(info.size) == 2);
+    const size_t n = 1000;
+    vector<uint8_t> file(kPayloadReserve + n + containerTail(n));
+    for (size_t i = 0; i < n; ++i) file[kPayloadReserve + i] = (uint8_t)(i * 37);
+    const uint64_t size = finishContainer(file.data(), "TEST", info, n);
+    CHECK(size == 4 + chunkSize(info.size) + chunkSize(n) + chunkSize(0) && size <= file.size());
+    ContainerView view;
+    CHECK(readContainer(file.data(), (size_t)size, "TEST", view) == CodecStatus::Ok);
+    CHECK(view.info.size == info.size && std::memcmp(view.info.body, info.buf, info.size) == 0);
+    CHECK(view.data.size == n);
+    bool same = view.data.size == n;
+    for (size_t i = 0; same && i < n; ++i) same = view.data.body[i] == (uint8_t)(i * 37);
+    CHECK(same);
+    FieldReader r(view.info.body, view.info.size);
+    for (int i = 0; i < kMaxInfoFields; ++i) CHECK(r.get() == UINT64_MAX - (uint64_t)i);
+    CHECK(!r.error);
+}
+
+// Damage to one byte of a checksummed file: a byte of the DATA body is
+// reported at the offset of its segment, a byte of its CRC table or of END
+// fails a head checksum, and the rest of the file is checked as well.
+static void checkDamage(const vector<uint8_t> &file, const char *magic,
+                        const function<CodecStatus(const uint8_t*, size_t, ChecksumReport*)> &verify,
+                        const function<CodecStatus(const uint8_t*, size_t)> &decode) {
+    ChecksumReport rep;
+    CHECK(verify(file.data(), file.size(), &rep) == CodecStatus::Ok);
+    CHECK(rep.present && rep.headerOk && rep.badSegments == 0 && rep.bytes == file.size());
+    CHECK(decode(file.data(), file.size()) == CodecStatus::Ok);
+    ContainerView view;
+    CHECK(readContainer(file.data(), file.size(), magic, view) == CodecStatus::Ok);
+    const uint64_t body = view.data.offset + view.data.headSize;
+    for (uint64_t j = 0; j < crcSegments(view.data.size); ++j) {
+        vector<uint8_t> bad = file;
+        bad[body + j * kCrcSegment + (j * 7919) % min<uint64_t>(kCrcSegment, view.data.size - j * kCrcSegment)] ^= 0x10;
+        CHECK(verify(bad.data(), bad.size(), &rep) == CodecStatus::Corrupt);
+        CHECK(rep.headerOk && rep.badSegments == 1 && rep.firstBadOffset == body + j * kCrcSegment);
+        CHECK(decode(bad.data(), bad.size()) == CodecStatus::Corrupt);
+    }
+    for (uint64_t at : {body + view.data.size, (uint64_t)file.size() - 1}) {
+        vector<uint8_t> bad = file;
+        bad[at] ^= 0x01;
+        CHECK(verify(bad.data(), bad.size(), &rep) == CodecStatus::Corrupt && !rep.headerOk);
+        CHECK(decode(bad.data(), bad.size()) == CodecStatus::Corrupt);
+    }
+    for (uint64_t at = 0; at < view.data.offset; ++at) {
+        vector<uint8_t> bad = file;
+        bad[at] ^= 0x01;
+        CHECK(verify(bad.data(), bad.size(), nullptr) != CodecStatus::Ok);
+        CHECK(decode(bad.data(), bad.size()) != CodecStatus::Ok);
+    }
+    CHECK(verify(file.data(), file.size() - 1, nullptr) == CodecStatus::Corrupt);
+}
+
+// GBL files of one to several segments (past the three-way SSE4.2 path).
+static void testAudioChecksums() {
+    for (size_t frames : {10, 20000, 300000}) {
+        AudioInfo info;
+        info.channels = 2;
+        info.frames = frames;
+        const vector<int16_t> s = audioSignal(frames, 2, (uint32_t)frames, 3000);
+        vector<uint8_t> file;
+        CHECK(encodeAudioGrow(s, info, file) == CodecStatus::Ok);
+        vector<int16_t> out(s.size());
+        checkDamage(file, "GBL2", verifyAudio, [&](const uint8_t *p, size_t n) {
+            return decodeAudio(p, n, out.data(), out.size());
+        });
+    }
+}
+
+static void testImageChecksums() {
+    for (uint32_t side : {8, 300, 700}) {
+        const vector<uint8_t> px = noisePlane(side, side, side);
+        vector<uint8_t> file(imageEncodedBound(side, side));
+        size_t written = 0;
+        CHECK(encodeImagePlane(px.data(), side, side, side, PRED_MEDIAN, file.data(), file.size(), written) ==
+              CodecStatus::Ok);
+        file.resize(written);
+        vector<uint8_t> out(px.size());
+        checkDamage(file, "GIM2", verifyImagePlane, [&](const uint8_t *p, size_t n) {
+            return decodeImagePlane(p, n, out.data(), side);
+        });
+    }
+}
+
+// ---------------- profiles ----------------
+
+static bool sameModel(const CodecProfile &a, const CodecProfile &b) {
+    if (a.model.classes != b.model.classes || a.contexts != b.contexts) return false;
+    for (int c = 0; c < a.contexts; ++c) {
+        if (a.model.side[c] != b.model.side[c]) return false;
+        for (int j = 0; j < a.model.classes; ++j)
+            if (a.model.up[c][j] != b.model.up[c][j] || a.model.down[c][j] != b.model.down[c][j] ||
+                a.model.mant[c][j] != b.model.mant[c][j])
+                return false;
+    }
+    return true;
+}
+
+static CodecProfile trainedAudioProfile(uint32_t seed) {
+    ProfileTrainer trainer;
+    for (uint16_t channels : {1, 2}) {
+        AudioInfo info;
+        info.channels = channels;
+        info.frames = 3000;
+        CHECK(trainAudioProfile(audioSignal(info.frames, channels, seed + channels).data(), info, trainer) ==
+              CodecStatus::Ok);
+    }
+    CodecProfile profile;
+    CHECK(trainer.files() == 2 && trainer.finish(profile) == CodecStatus::Ok);
+    return profile;
+}
+
+static CodecProfile trainedImageProfile(uint32_t seed) {
+    ProfileTrainer trainer;
+    const uint32_t w = 48, h = 40;
+    CHECK(trainImageProfile(smoothPlane(w, h, w, seed).data(), w, h, w, trainer) == CodecStatus::Ok);
+    CHECK(trainImageProfile(flatPlane(w, h, seed + 1).data(), w, h, w, trainer) == CodecStatus::Ok);
+    CodecProfile profile;
+    CHECK(trainer.finish(profile) == CodecStatus::Ok);
+    return profile;
+}
+
+// Trained profiles survive writeProfile / readProfile with their ID; short
+// buffers, damaged files and mixed or empty training are rejected.
+static void testProfileFiles() {
+    const CodecProfile profiles[] = {trainedAudioProfile(1), trainedImageProfile(2)};
+    for (const CodecProfile &p : profiles) {
+        CHECK(p.id != 0 && p.id == (p.kind == PROFILE_AUDIO ? trainedAudioProfile(1) : trainedImageProfile(2)).id);
+        bool trained = false;
+        for (int c = 0; c < p.contexts; ++c) trained = trained || p.model.side[c] != kProbOne / 2;
+        CHECK(trained);
+        vector<uint8_t> file(kMaxProfileBytes);
+        size_t written = 0;
+        CHECK(writeProfile(p, file.data(), file.size(), written) == CodecStatus::Ok);
+        file.resize(written);
+        CodecProfile got;
+        CHECK(readProfile(file.data(), file.size(), got) == CodecStatus::Ok);
+        CHECK(got.kind == p.kind && got.id == p.id && got.ema[0] == p.ema[0] && got.ema[1] == p.ema[1]);
+        CHECK(sameModel(got, p));
+        size_t need = 0;
+        vector<uint8_t> small(written - 1);
+        CHECK(writeProfile(p, small.data(), small.size(), need) == CodecStatus::BufferTooSmall && need >= written);
+        small.resize(need);
+        CHECK(writeProfile(p, small.data(), small.size(), need) == CodecStatus::Ok && need == written);
+        CHECK(readProfile(file.data(), file.size() - 1, got) == CodecStatus::Corrupt);
+        vector<uint8_t> bad = file;
+        bad[bad.size() / 2] ^= 0x08;
+        CHECK(readProfile(bad.data(), bad.size(), got) == CodecStatus::Corrupt);
+    }
+    ProfileTrainer trainer;
+    CodecProfile p;
+    CHECK(trainer.finish(p) == CodecStatus::Unsupported);
+    AudioInfo info;
+    info.channels = 1;
+    info.frames = 100;
+    CHECK(trainAudioProfile(audioSignal(100, 1, 3).data(), info, trainer) == CodecStatus::Ok);
+    const vector<uint8_t> px(64);
+    CHECK(trainImageProfile(px.data(), 8, 8, 8, trainer) == CodecStatus::Unsupported);
+}
+
+// Files coded from a profile record its ID and decode with that profile
+// only; block mode audio and Golomb images do not use it.
+static void testProfileCoding() {
+    const CodecProfile audio = trainedAudioProfile(5), otherAudio = trainedAudioProfile(6);
+    for (uint16_t channels : {1, 2}) {
+        const vector<int16_t> s = audioSignal(2000, channels, 7);
+        for (int mode = 0; mode < 7; ++mode) {
+            AudioInfo info;
+            info.channels = channels;
+            info.frames = 2000;
+            info.backend = mode % 3;
+            info.runMode = mode >= 3 && mode < 6;
+            info.blocks = mode == 6;
+            vector<uint8_t> file(audioEncodedSizeHint(info));
+            size_t written = 0;
+            CHECK(encodeAudio(s.data(), info, file.data(), file.size(), written, nullptr, &audio) ==
+                  CodecStatus::Ok);
+            file.resize(written);
+            AudioInfo got;
+            CHECK(readAudioInfo(file.data(), file.size(), got) == CodecStatus::Ok);
+            CHECK(got.profile == (info.blocks ? 0 : audio.id));
+            vector<int16_t> out(s.size());
+            CHECK(decodeAudio(file.data(), file.size(), out.data(), out.size(), nullptr, &audio) == CodecStatus::Ok);
+            CHECK(out == s);
+            AudioDecoder dec;
+            size_t n = 0;
+            CHECK(dec.open(file.data(), file.size(), &audio) == CodecStatus::Ok);
+            CHECK(dec.read(out.data(), info.frames, n) == CodecStatus::Ok && n == info.frames && out == s);
+            if (info.blocks) continue;
+            CHECK(decodeAudio(file.data(), file.size(), out.data(), out.size()) == CodecStatus::Unsupported);
+            CHECK(decodeAudio(file.data(), file.size(), out.data(), out.size(), nullptr, &otherAudio) ==
+                  CodecStatus::Unsupported);
+            CHECK(dec.open(file.data(), file.size()) == CodecStatus::Unsupported);
+        }
+    }
+
+    const CodecProfile image = trainedImageProfile(8);
+    const uint32_t w = 37, h = 29;
+    const vector<uint8_t> px = smoothPlane(w, h, w, 9);
+    for (int backend : {BACKEND_GOLOMB, BACKEND_RANGE, BACKEND_RANS}) {
+        for (int predictor : {PRED_MEDIAN, PRED_INTERPOLATE}) {
+            for (bool runMode : {false, true}) {
+                if (predictor == PRED_INTERPOLATE && runMode) continue;
+                vector<uint8_t> file(imageEncodedBound(w, h, backend));
+                size_t written = 0;
+                ImageInfo info;
+                CHECK(encodeImagePlane(px.data(), w, h, w, predictor, file.data(), file.size(), written, &info,
+                                       nullptr, backend, runMode, M_SEARCH_DEFAULT, &image) == CodecStatus::Ok);
+                file.resize(written);
+                const uint32_t id = backend == BACKEND_GOLOMB ? 0 : image.id;
+                ImageInfo got;
+                CHECK(readImageInfo(file.data(), file.size(), got) == CodecStatus::Ok);
+                CHECK(info.profile == id && got.profile == id);
+                vector<uint8_t> out(px.size());
+                CHECK(decodeImagePlane(file.data(), file.size(), out.data(), w, nullptr, &image) == CodecStatus::Ok);
+                CHECK(out == px);
+                vector<uint8_t> again(imageEncodedBound(w, h, backend, got.m));
+                CHECK(reencodeImagePlane(px.data(), w, h, w, got, again.data(), again.size(), written, nullptr,
+                                         nullptr, &image) == CodecStatus::Ok);
+                CHECK(vector<uint8_t>(again.begin(), again.begin() + written) == file);
+                if (!id) continue;
+                CHECK(decodeImagePlane(file.data(), file.size(), out.data(), w) == CodecStatus::Unsupported);
+                CHECK(decodeImagePlane(file.data(), file.size(), out.data(), w, nullptr, &audio) ==
+                      CodecStatus::Unsupported);
+                CHECK(reencodeImagePlane(px.data(), w, h, w, got, again.data(), again.size(), written) ==
+                      CodecStatus::Unsupported);
+                if (predictor != PRED_INTERPOLATE) continue;
+                ImageThumbnail thumb;
+                CHECK(imageThumbnailInfo(file.data(), file.size(), 1, thumb) == CodecStatus::Ok);
+                vector<uint8_t> small((size_t)thumb.width * thumb.height);
+                CHECK(decodeImageThumbnail(file.data(), (size_t)thumb.bytes, 1, small.data(), thumb.width, nullptr,
+                                           &image) == CodecStatus::Ok);
+                CHECK(decodeImageThumbnail(file.data(), (size_t)thumb.bytes, 1, small.data(), thumb.width) ==
+                      CodecStatus::Unsupported);
+            }
+        }
+    }
+    vector<uint8_t> file(imageEncodedBound(w, h, BACKEND_RANGE));
+    size_t written = 0;
+    CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, file.data(), file.size(), written, nullptr, nullptr,
+                           BACKEND_RANGE, false, M_SEARCH_DEFAULT, &audio) == CodecStatus::Unsupported);
+}
+
+// ---------------- statistics ----------------
+
+static bool hasStage(const CodecStats &st, const char *name) {
+    for (const StageStats &s : st.stages)
+        if (s.name == name) return true;
+    return false;
+}
+
+// Collecting statistics leaves the output unchanged; the totals describe the
+// file and the encoder and decoder see the same residuals and m.
+static void testAudioStats() {
+    AudioInfo info;
+    info.channels = 2;
+    info.sample_rate = 44100;
+    info.frames = 4000;
+    const vector<int16_t> s = audioSignal(info.frames, 2, 21);
+    vector<uint8_t> plain;
+    CHECK(encodeAudioGrow(s, info, plain) == CodecStatus::Ok);
+    vector<uint8_t> file(audioEncodedSizeHint(info));
+    size_t written = 0;
+    CodecStats enc;
+    CHECK(encodeAudio(s.data(), info, file.data(), file.size(), written, &enc) == CodecStatus::Ok);
+    file.resize(written);
+    CHECK(file == plain);
+    CHECK(enc.items == s.size() && enc.rawBytes == s.size() * 2);
+    CHECK(enc.codedBytes == written && (enc.codedBits + 7) / 8 < written);
+    CHECK(histTotal(enc.residualHist) == s.size() && histTotal(enc.mHist) == s.size());
+    CHECK(hasStage(enc, "encode"));
+
+    CodecStats dec;
+    vector<int16_t> out(s.size());
+    CHECK(decodeAudio(file.data(), file.size(), out.data(), out.size(), &dec) == CodecStatus::Ok);
+    CHECK(out == s);
+    CHECK(dec.items == enc.items && dec.codedBits == enc.codedBits && dec.codedBytes == enc.codedBytes);
+    CHECK(memcmp(dec.residualHist, enc.residualHist, sizeof enc.residualHist) == 0);
+    CHECK(memcmp(dec.mHist, enc.mHist, sizeof enc.mHist) == 0);
+    CHECK(hasStage(dec, "decode"));
+
+    ostringstream json;
+    enc.writeJson(json);
+    CHECK(json.str().find("\"coded_bytes\": " + to_string(written)) != string::npos);
+}
+
+static void testImageStats() {
+    const uint32_t w = 50, h = 40;
+    const vector<uint8_t> px = smoothPlane(w, h, w, 9);
+    vector<uint8_t> plain(imageEncodedBound(w, h)), file(plain.size());
+    size_t plainSize = 0, written = 0;
+    CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, plain.data(), plain.size(), plainSize) == CodecStatus::Ok);
+    CodecStats enc;
+    ImageInfo info;
+    CHECK(encodeImagePlane(px.data(), w, h, w, PRED_MEDIAN, file.data(), file.size(), written, &info, &enc) ==
+          CodecStatus::Ok);
+    CHECK(written == plainSize && memcmp(file.data(), plain.data(), written) == 0);
+    CHECK(enc.unit == "pixel" && enc.items == (uint64_t)w * h && enc.codedBytes == written);
+    CHECK(enc.codedBits == info.nbits);
+    CHECK(histTotal(enc.residualHist) == enc.items && histTotal(enc.mHist) == enc.items);
+
+    CodecStats dec;
+    vector<uint8_t> out(px.size());
+    CHECK(decodeImagePlane(file.data(), written, out.data(), w, &dec) == CodecStatus::Ok);
+    CHECK(out == px);
+    CHECK(dec.items == enc.items && dec.codedBits == enc.codedBits && dec.codedBytes == enc.codedBytes);
+    CHECK(memcmp(dec.residualHist, enc.residualHist, sizeof enc.residualHist) == 0);
+    CHECK(memcmp(dec.mHist, enc.mHist, sizeof enc.mHist) == 0);
+}
+
+// ---------------- file I/O and pixel operations ----------------
+
+// writeWav / readWav keep the format fields and every sample.
+static void testWavRoundTrip() {
+    const string path = tmpPath("round_trip.wav");
+    for (uint16_t channels : {1, 2}) {
+        const vector<int16_t> s = audioSignal(1001, channels, channels);
+        CHECK(writeWav(path, makeWavHeader(channels, 22050, 16, s.size()), s));
+        WAVHeader hdr;
+        vector<int16_t> got;
+        CHECK(readWav(path, hdr, got));
+        CHECK(hdr.channels == channels && hdr.sample_rate == 22050 && hdr.bits_per_sample == 16);
+        CHECK(hdr.data_size == s.size() * sizeof(int16_t));
+        CHECK(got == s);
+    }
+    remove(path.c_str());
+    WAVHeader hdr;
+    vector<int16_t> got;
+    CHECK(!readWav(path, hdr, got));
+}
+
+// P5 and P6 files, with comments in the header, read back as written; bad
+// headers and short rasters are reported.
+static void testNetpbmRead() {
+    const string path = tmpPath("read.pnm");
+    for (int channels : {1, 3}) {
+        const int w = 13, h = 7;
+        const vector<uint8_t> px = smoothPlane(w * channels, h, w * channels, (uint32_t)channels);
+        {
+            ofstream f(path, ios::binary);
+            f << (channels == 3 ? "P6" : "P5") << "\n# comment\n" << w << " " << h << "\n#\n255\n";
+            f.write(reinterpret_cast<const char*>(px.data()), (streamsize)px.size());
+        }
+        NetpbmImage img;
+        string err;
+        CHECK(readNetpbm(path, img, err));
+        CHECK(img.width == w && img.height == h && img.channels == channels);
+        CHECK(img.pixels == px);
+        {
+            ofstream f(path, ios::binary);
+            f << (channels == 3 ? "P6" : "P5") << " " << w << " " << h << " 255\n";
+            f.write(reinterpret_cast<const char*>(px.data()), (streamsize)px.size() - 1);
+        }
+        CHECK(!readNetpbm(path, img, err) && !err.empty());
+    }
+    {
+        ofstream f(path, ios::binary);
+        f << "P2 3 3 255\n";
+    }
+    NetpbmImage img;
+    string err;
+    CHECK(!readNetpbm(path, img, err));
+    {
+        ofstream f(path, ios::binary);
+        f << "P5 3 3 65535\n";
+    }
+    CHECK(!readNetpbm(path, img, err));
+    remove(path.c_str());
+}
+
+// mirrorRow and rotateImage against the pixel mapping they implement, on
+
+// One gzip member holding data.
+static string gzipMember(const string &data) {
+    z_stream z = {};
+    CHECK(deflateInit2(&z, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    string out(deflateBound(&z, (uLong)data.size()), '\0');
+    z.next_in = (Bytef*)data.data();
+    z.avail_in = (uInt)data.size();
+    z.next_out = (Bytef*)&out[0];
+    z.avail_out = (uInt)out.size();
+    CHECK(deflate(&z, Z_FINISH) == Z_STREAM_END);
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return out;
+}
+
+// Gzip-compressed P5/P6 files several inflate chunks long, read whole and
+// in uneven bands (RGB and BGR order), from one member or from a stream
+// split into two members mid-raster; truncated and damaged streams fail.
+static void testNetpbmGzip() {
+    const string path = tmpPath("read.pnm.gz");
+    for (int channels : {1, 3}) {
+        const int w = 701, h = 613;
+        const vector<uint8_t> px = noisePlane((uint32_t)(w * channels), h, (uint32_t)channels + 20);
+        const string raw = string(channels == 3 ? "P6" : "P5") + "\n# gzipped\n" + to_string(w) + " " +
+                           to_string(h) + "\n255\n" + string(px.begin(), px.end());
+        const string one = gzipMember(raw);
+        const size_t split = raw.size() / 3;
+        const string two = gzipMember(raw.substr(0, split)) + gzipMember(raw.substr(split));
+        for (const string *gz : {&one, &two}) {
+            writeFileBytes(path, gz->data(), gz->size());
+            CHECK(isGzipFile(path));
+            NetpbmImage img;
+            string err;
+            CHECK(readNetpbm(path, img, err));
+            CHECK(img.width == w && img.height == h && img.channels == channels && img.pixels == px);
+
+            NetpbmReader in;
+            CHECK(in.open(path, err) && in.width == w && in.height == h && in.channels == channels);
+            const size_t stride = (size_t)w * channels + 7;
+            vector<uint8_t> rows(stride * h);
+            bool ok = true, same = true;
+            for (int r = 0, band = 1; r < h && ok; r += band, band = band * 3 % 17 + 1) {
+                const int n = min(band, h - r);
+                ok = in.readRows(rows.data() + (size_t)r * stride, stride, n, err, true);
+            }
+            CHECK(ok);
+            for (int r = 0; r < h; ++r) {
+                for (int c = 0; c < w * channels; ++c) {
+                    const int src = channels == 3 ? c - c % 3 + 2 - c % 3 : c;
+                    same = same && rows[(size_t)r * stride + c] == px[(size_t)r * w * channels + src];
+                }
+            }
+            CHECK(same);
+        }
+        for (size_t cut : {one.size() / 2, one.size() - 4}) {
+            writeFileBytes(path, one.data(), cut);
+            NetpbmImage img;
+            string err;
+            CHECK(!readNetpbm(path, img, err) && !err.empty());
+        }
+        string bad = one;
+        bad[bad.size() - 6] ^= 0x40;   // CRC32 of the member
+        writeFileBytes(path, bad.data(), bad.size());
+        NetpbmImage img;
+        string err;
+        CHECK(!readNetpbm(path, img, err) && !err.empty());
+        writeFileBytes(path, raw.data(), raw.size());
+        CHECK(!isGzipFile(path) && readNetpbm(path, img, err) && img.pixels == px);
+    }
+    remove(path.c_str());
+}
+
+// sizes that leave partial tiles.
+static void testMirrorRotate() {
+    for (int channels : {1, 3}) {
+        const int w = 45, h = 37;
+        const size_t stride = (size_t)w * channels + 5;
+        const vector<uint8_t> src = noisePlane((uint32_t)stride, h, (uint32_t)channels);
+        vector<uint8_t> row((size_t)w * channels);
+        mirrorRow(src.data(), row.data(), w, channels);
+        bool mirrored = true;
+        for (int c = 0; c < w; ++c)
+            for (int ch = 0; ch < channels; ++ch)
+                mirrored = mirrored && row[c * channels + ch] == src[(size_t)(w - 1 - c) * channels + ch];
+        CHECK(mirrored);
+
+        for (int k = -1; k <= 4; ++k) {
+            const int q = ((k % 4) + 4) % 4;
+            const int dw = q % 2 ? h : w, dh = q % 2 ? w : h;
+            const size_t dstStride = (size_t)dw * channels + 3;
+            vector<uint8_t> dst(dstStride * dh);
+            rotateImage(src.data(), stride, w, h, channels, k, dst.data(), dstStride);
+            bool same = true;
+            for (int r = 0; r < h; ++r) {
+                for (int c = 0; c < w; ++c) {
+                    const int dr = q == 0 ? r : q == 1 ? c : q == 2 ? h - 1 - r : w - 1 - c;
+                    const int dc = q == 0 ? c : q == 1 ? h - 1 - r : q == 2 ? w - 1 - c : r;
+                    for (int ch = 0; ch < channels; ++ch)
+                        same = same && dst[dr * dstStride + (size_t)dc * channels + ch] ==
+                                           src[r * stride + (size_t)c * channels + ch];
+                }
+            }
+            CHECK(same);
+        }
+    }
+}
+
+// ---------------- command-line tools ----------------
+
+static string toolDir = ".";   // directory of the test binary, where make puts the tools
+
+// Runs a tool from toolDir through the shell with stderr discarded; returns
+// its exit status.
+static int runTool(const string &args) {
+    int rc = system(("(" + toolDir + "/" + args + ") 2>/dev/null").c_str());
+    return WIFEXITED(rc) ? WEXITSTATUS(rc) : -1;
+}
+
+// Random walk with jumps to the ends of T's range
+template <typename T>
+static vector<T> intSeries(size_t n, uint32_t seed) {
+    mt19937_64 rng(seed);
+    vector<T> v(n);
+    int64_t x = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (rng() % 5000 == 0) v[i] = rng() & 1 ? numeric_limits<T>::max() : numeric_limits<T>::min();
+        else v[i] = (T)(x += (int64_t)(rng() % 41) - 20);
+    }
+    return v;
+}
+
+// golomb encode-file / decode-file restore int16/int32/int64 arrays of zero,
+// one, exactly one and several blocks, with a fixed or estimated m, in both
+// negative modes and through pipes; damaged streams are rejected.
+template <typename T>
+static void checkIntFiles(const char *type) {
+    const string raw = tmpPath("ints.raw"), gint = tmpPath("ints.gint"), back = tmpPath("ints.back");
+    for (size_t n : {0, 1, 65536, 150001}) {
+        const vector<T> v = intSeries<T>(n, (uint32_t)n + sizeof(T));
+        writeFileBytes(raw, v.data(), v.size() * sizeof(T));
+        // a small fixed m would give the int64 extremes unary parts of 2^58 bits
+        const char *fixed = sizeof(T) == 8 ? "-m 1099511627776 -mode sign" : "-m 37 -mode sign";
+        for (const char *opts : {"", fixed, "-m auto -mode interleave"}) {
+            CHECK(runTool(string("golomb ") + opts + " -type " + type + " encode-file " + raw + " " + gint) == 0);
+            CHECK(runTool("golomb decode-file " + gint + " " + back) == 0);
+            CHECK(readFileBytes(back) == readFileBytes(raw));
+        }
+        CHECK(runTool(string("golomb -type ") + type + " encode-file - - < " + raw + " | " + toolDir +
+                      "/golomb decode-file - - > " + back) == 0);
+        CHECK(readFileBytes(back) == readFileBytes(raw));
+    }
+    const string good = readFileBytes(gint);
+    writeFileBytes(gint, good.data(), good.size() - 3);
+    CHECK(runTool("golomb decode-file " + gint + " " + back) == 4);
+    writeFileBytes(gint, "GINX", 4);
+    CHECK(runTool("golomb decode-file " + gint + " " + back) == 4);
+    if (sizeof(T) == 8) CHECK(runTool(string("golomb -m 37 -type int64 encode-file ") + raw + " " + gint) == 3);
+    remove(raw.c_str());
+    remove(gint.c_str());
+    remove(back.c_str());
+}
+
+static void testCliIntFiles() {
+    checkIntFiles<int16_t>("int16");
+    checkIntFiles<int32_t>("int32");
+    checkIntFiles<int64_t>("int64");
+}
+
+// golomb_audio_codec encode/decode batches: the files of a batch match
+// single-file runs whatever the number of jobs, and a failing file is
+// reported without stopping the others.
+static void testCliAudioBatch() {
+    const size_t n = 5;
+    vector<string> wav(n), gbl(n), back(n);
+    vector<vector<int16_t>> signals(n);
+    string encodeArgs, decodeArgs;
+    for (size_t i = 0; i < n; ++i) {
+        const string id = to_string(i);
+        wav[i] = tmpPath(("batch" + id + ".wav").c_str());
+        gbl[i] = tmpPath(("batch" + id + ".gbl").c_str());
+        back[i] = tmpPath(("batch" + id + ".back.wav").c_str());
+        const uint16_t channels = i % 2 ? 2 : 1;
+        signals[i] = audioSignal(i * 3001 + 1, channels, (uint32_t)i);
+        CHECK(writeWav(wav[i], makeWavHeader(channels, 44100, 16, signals[i].size()), signals[i]));
+        encodeArgs += " " + wav[i] + " " + gbl[i];
+        decodeArgs += " " + gbl[i] + " " + back[i];
+    }
+    for (const char *opts : {"", " --blocks", " -6", " --backend rans --run"}) {
+        for (const char *jobs : {" --jobs 1", " --jobs 3", " --jobs 16"}) {
+            CHECK(runTool(string("golomb_audio_codec encode") + encodeArgs + opts + jobs) == 0);
+            vector<string> batch(n);
+            for (size_t i = 0; i < n; ++i) batch[i] = readFileBytes(gbl[i]);
+            CHECK(runTool(string("golomb_audio_codec decode") + decodeArgs + jobs) == 0);
+            for (size_t i = 0; i < n; ++i) {
+                WAVHeader hdr;
+                vector<int16_t> got;
+                CHECK(readWav(back[i], hdr, got) && got == signals[i]);
+                CHECK(runTool("golomb_audio_codec encode " + wav[i] + " " + gbl[i] + opts) == 0);
+                CHECK(readFileBytes(gbl[i]) == batch[i]);
+            }
+        }
+    }
+    remove(wav[2].c_str());
+    remove(gbl[2].c_str());
+    remove(gbl[3].c_str());
+    CHECK(runTool(string("golomb_audio_codec encode") + encodeArgs + " --jobs 2") == 2);
+    CHECK(readFileBytes(gbl[2]).empty() && !readFileBytes(gbl[3]).empty());
+    remove(gbl[1].c_str());
+    CHECK(runTool(string("golomb_audio_codec decode") + decodeArgs + " --jobs 2") == 3);
+    WAVHeader hdr;
+    vector<int16_t> got;
+    CHECK(readWav(back[4], hdr, got) && got == signals[4]);
+    for (size_t i = 0; i < n; ++i) {
+        remove(wav[i].c_str());
+        remove(gbl[i].c_str());
+        remove(back[i].c_str());
+    }
+}
+
+// ---------------- pipeline ----------------
+
+// runPipeline finishes every job once and in order for any number of jobs
+// and workers, with coding times that let workers overtake each other.
+static void testPipelineOrder() {
+    struct Slot {
+        size_t job = 0;
+        uint64_t value = 0;
+        int uses = 0;
+    };
+    for (int workers : {0, 1, 2, 3, 8}) {
+        for (size_t jobs : {0, 1, 2, 7, 200}) {
+            size_t nextRead = 0, nextWrite = 0;
+            bool inOrder = true, reused = true;
+            runPipeline<Slot>(jobs, workers, [&](Slot &s, size_t j) {
+                inOrder = inOrder && j == nextRead++;
+                s.job = j;
+                s.value = j;
+                ++s.uses;
+            }, [&](Slot &s) {
+                if (s.job % 5 == 0) this_thread::sleep_for(chrono::microseconds(200));
+                s.value = s.value * s.value + 1;
+            }, [&](Slot &s, size_t j) {
+                inOrder = inOrder && j == nextWrite++ && s.job == j && s.value == j * j + 1;
+                reused = reused && s.uses <= (int)(j / (size_t)max(workers, 1) / 2 + 1);
+            });
+            CHECK(nextRead == jobs && nextWrite == jobs);
+            CHECK(inOrder);
+            CHECK(reused);
+        }
+    }
+}
+
+// ---------------- driver ----------------
+
+struct Test {
+    const char *name;
+    function<void()> run;
+};
+
+int main(int argc, char **argv) {
+    string filter;
+    if (const char *slash = strrchr(argv[0], '/')) toolDir.assign(argv[0], (size_t)(slash - argv[0]));
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--filter" && i + 1 < argc) filter = argv[++i];
+        else { fprintf(stderr, "Usage: %s [--filter substr]\n", argv[0]); return 1; }
+    }
+    const Test tests[] = {
+        {"ints.round_trip", testIntsRoundTrip},
+        {"ints.extremes", testIntsExtremes},
+        {"ints.buffer_too_small", testIntsBufferTooSmall},
+        {"ints.bulk_matches_scalar", testIntsBulkMatchesScalar},
+        {"ints.small_capacity", testIntsSmallCapacity},
+        {"ints.long_unary", testIntsLongUnary},
+        {"ints.wide_m", testIntsWideM},
+        {"rice.partition", testRicePartition},
+        {"bits.pack_round_trip", testBitsPackRoundTrip},
+        {"bits.pack_rejects", testBitsPackRejects},
+        {"audio.round_trip", testAudioRoundTrip},
+        {"audio.errors", testAudioErrors},
+        {"audio.backends", testAudioBackends},
+        {"audio.run_mode", testAudioRunMode},
+        {"audio.blocks", testAudioBlocks},
+        {"audio.block_search", testAudioBlockSearch},
+        {"audio.presets", testAudioPresets},
+        {"audio.decoder", testAudioDecoder},
+        {"image.round_trip", testImageRoundTrip},
+        {"image.errors", testImageErrors},
+        {"image.extreme_residuals", testImageExtremeResiduals},
+        {"image.backends", testImageBackends},
+        {"image.run_mode", testImageRunMode},
+        {"image.small_capacity", testImageSmallCapacity},
+        {"image.presets", testImagePresets},
+        {"image.reencode", testImageReencode},
+        {"image.thumbnails", testImageThumbnails},
+        {"image.sampled_stripes", testImageSampledStripes},
+        {"image.incremental", testImageIncremental},
+        {"legacy.files", testLegacyFiles},
+        {"legacy.image_median", testImageLegacyMedian},
+        {"crc.crc32c", testCrc32c},
+        {"crc.container_full_info", testContainerFullInfo},
+        {"crc.audio_verify", testAudioChecksums},
+        {"crc.image_verify", testImageChecksums},
+        {"profile.files", testProfileFiles},
+        {"profile.coding", testProfileCoding},
+        {"stats.audio", testAudioStats},
+        {"stats.image", testImageStats},
+        {"io.wav_round_trip", testWavRoundTrip},
+        {"io.netpbm_read", testNetpbmRead},
+        {"io.netpbm_gzip", testNetpbmGzip},
+        {"pixels.mirror_rotate", testMirrorRotate},
+        {"cli.int_files", testCliIntFiles},
+        {"cli.audio_batch", testCliAudioBatch},
+        {"pipeline.order", testPipelineOrder},
+    };
+    int run = 0, failed = 0;
+    for (const Test &t : tests) {
+        if (!filter.empty() && string(t.name).find(filter) == string::npos) continue;
+        const int before = failures;
+        t.run();
+        ++run;
+        if (failures != before) ++failed;
+        fprintf(stderr, "%-24s %s\n", t.name, failures == before ? "ok" : "FAILED");
+    }
+    fprintf(stderr, "%d of %d tests passed (%d checks)\n", run - failed, run, checks);
+    return failed ? 1 : 0;
+}